@@ -10,6 +10,10 @@
 #ifndef KLEE_BITARRAY_H
 #define KLEE_BITARRAY_H
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
 namespace klee {
 
   // XXX would be nice not to have
@@ -22,6 +26,35 @@ private:
 protected:
   static uint32_t length(unsigned size) { return (size+31)/32; }
 
+  /// Mask of the bits [from, to) of a word, 0 <= from < to <= 32
+  static uint32_t mask(unsigned from, unsigned to) {
+    return (to == 32 ? ~0u : (1u << to) - 1) & ~((1u << from) - 1);
+  }
+
+  /// Return whether all bits in [begin, end) equal \p value, testing a
+  /// word at a time.
+  bool all(unsigned begin, unsigned end, bool value) const {
+    while (begin < end) {
+      unsigned word = begin / 32;
+      unsigned to = std::min(end - word * 32, 32u);
+      uint32_t m = mask(begin % 32, to);
+      if ((bits[word] & m) != (value ? m : 0))
+        return false;
+      begin = word * 32 + to;
+    }
+    return true;
+  }
+
+  void assign(unsigned begin, unsigned end, bool value) {
+    while (begin < end) {
+      unsigned word = begin / 32;
+      unsigned to = std::min(end - word * 32, 32u);
+      uint32_t m = mask(begin % 32, to);
+      bits[word] = value ? bits[word] | m : bits[word] & ~m;
+      begin = word * 32 + to;
+    }
+  }
+
 public:
   BitArray(unsigned size, bool value = false) : bits(new uint32_t[length(size)]) {
     memset(bits, value?0xFF:0, sizeof(*bits)*length(size));
@@ -35,6 +68,29 @@ public:
   void set(unsigned idx) { bits[idx/32] |= 1<<(idx&0x1F); }
   void unset(unsigned idx) { bits[idx/32] &= ~(1<<(idx&0x1F)); }
   void set(unsigned idx, bool value) { if (value) set(idx); else unset(idx); }
+
+  /// Return whether all bits in [begin, end) are set
+  bool allSet(unsigned begin, unsigned end) const {
+    return all(begin, end, true);
+  }
+  /// Return whether no bit in [begin, end) is set
+  bool noneSet(unsigned begin, unsigned end) const {
+    return all(begin, end, false);
+  }
+  void setRange(unsigned begin, unsigned end) { assign(begin, end, true); }
+  void unsetRange(unsigned begin, unsigned end) { assign(begin, end, false); }
+
+  /// Return the index of the first set bit in [begin, end), or end
+  unsigned findNextSet(unsigned begin, unsigned end) const {
+    while (begin < end) {
+      unsigned word = begin / 32;
+      uint32_t w = bits[word] & mask(begin % 32, 32);
+      if (w)
+        return std::min(word * 32 + __builtin_ctz(w), end);
+      begin = (word + 1) * 32;
+    }
+    return end;
+  }
 };
 
 } // End klee namespace
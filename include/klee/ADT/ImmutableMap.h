@@ -34,13 +34,16 @@ namespace klee {
     Tree elts;
 
     ImmutableMap(const Tree &b): elts(b) {}
+    ImmutableMap(Tree &&b): elts(std::move(b)) {}
 
   public:
     ImmutableMap() {}
     ImmutableMap(const ImmutableMap &b) : elts(b.elts) {}
+    ImmutableMap(ImmutableMap &&b) : elts(std::move(b.elts)) {}
     ~ImmutableMap() {}
 
     ImmutableMap &operator=(const ImmutableMap &b) { elts = b.elts; return *this; }
+    ImmutableMap &operator=(ImmutableMap &&b) { elts = std::move(b.elts); return *this; }
     
     bool empty() const { 
       return elts.empty(); 
@@ -34,13 +34,16 @@ namespace klee {
     Tree elts;
 
     ImmutableSet(const Tree &b): elts(b) {}
+    ImmutableSet(Tree &&b): elts(std::move(b)) {}
 
   public:
     ImmutableSet() {}
     ImmutableSet(const ImmutableSet &b) : elts(b.elts) {}
+    ImmutableSet(ImmutableSet &&b) : elts(std::move(b.elts)) {}
     ~ImmutableSet() {}
 
     ImmutableSet &operator=(const ImmutableSet &b) { elts = b.elts; return *this; }
+    ImmutableSet &operator=(ImmutableSet &&b) { elts = std::move(b.elts); return *this; }
     
     bool empty() const { 
       return elts.empty(); 
@@ -10,14 +10,22 @@
 #ifndef KLEE_IMMUTABLETREE_H
 #define KLEE_IMMUTABLETREE_H
 
+#include "klee/ADT/Ref.h"
+
+#include <atomic>
 #include <cassert>
+#include <utility>
 #include <vector>
 
 namespace klee {
   template<class K, class V, class KOV, class CMP>
   class ImmutableTree {
   public:
+#ifdef KLEE_ATOMIC_REFCOUNT
+    static std::atomic<size_t> allocated;
+#else
     static size_t allocated;
+#endif
     class iterator;
 
     typedef K key_type;
@@ -28,9 +36,11 @@ namespace klee {
   public:
     ImmutableTree();
     ImmutableTree(const ImmutableTree &s);
+    ImmutableTree(ImmutableTree &&s);
     ~ImmutableTree();
 
     ImmutableTree &operator=(const ImmutableTree &s);
+    ImmutableTree &operator=(ImmutableTree &&s);
 
     bool empty() const;
 
@@ -74,7 +84,10 @@ namespace klee {
     static Node terminator;
     Node *left, *right;
     value_type value;
-    unsigned height, references;
+    unsigned height;
+    // Trees are shared between threads like the ref<>-managed objects
+    // stored in them.
+    DefaultRefCountPolicy::CountType references;
 
   protected:
     Node(); // solely for creating the terminator node
@@ -240,8 +253,12 @@ namespace klee {
   typename ImmutableTree<K,V,KOV,CMP>::Node 
   ImmutableTree<K,V,KOV,CMP>::Node::terminator;
 
-  template<class K, class V, class KOV, class CMP> 
+  template<class K, class V, class KOV, class CMP>
+#ifdef KLEE_ATOMIC_REFCOUNT
+  std::atomic<size_t> ImmutableTree<K,V,KOV,CMP>::allocated{0};
+#else
   size_t ImmutableTree<K,V,KOV,CMP>::allocated = 0;
+#endif
 
   template<class K, class V, class KOV, class CMP>
   ImmutableTree<K,V,KOV,CMP>::Node::Node() 
@@ -272,13 +289,15 @@ namespace klee {
 
   template<class K, class V, class KOV, class CMP>
   inline void ImmutableTree<K,V,KOV,CMP>::Node::decref() {
-    --references;
-    if (references==0) delete this;
+    // The terminator is static; checking for it when the count drops to
+    // zero also shows the compiler that it is never deleted.
+    if (DefaultRefCountPolicy::decrement(references) && !isTerminator())
+      delete this;
   }
 
   template<class K, class V, class KOV, class CMP>
   inline typename ImmutableTree<K,V,KOV,CMP>::Node *ImmutableTree<K,V,KOV,CMP>::Node::incref() {
-    ++references;
+    DefaultRefCountPolicy::increment(references);
     return this;
   }
 
@@ -435,6 +454,12 @@ namespace klee {
     : node(s.node->incref()) {
   }
 
+  template<class K, class V, class KOV, class CMP>
+  ImmutableTree<K,V,KOV,CMP>::ImmutableTree(ImmutableTree &&s)
+    : node(s.node) {
+    s.node = Node::terminator.incref();
+  }
+
   template<class K, class V, class KOV, class CMP>
   ImmutableTree<K,V,KOV,CMP>::~ImmutableTree() {
     node->decref(); 
@@ -448,6 +473,13 @@ namespace klee {
     return *this;
   }
 
+  template<class K, class V, class KOV, class CMP>
+  ImmutableTree<K,V,KOV,CMP> &ImmutableTree<K,V,KOV,CMP>::operator=(ImmutableTree &&s) {
+    // s releases the old tree, without any count changing here
+    std::swap(node, s.node);
+    return *this;
+  }
+
   template<class K, class V, class KOV, class CMP>
   bool ImmutableTree<K,V,KOV,CMP>::empty() const {
     return node->isTerminator();
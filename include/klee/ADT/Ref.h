@@ -24,13 +24,25 @@
  * }
  * @endcode
  *
+ * ## Thread safety:
+ *
+ * By default, reference counts are plain integers and ref-managed objects
+ * must not be shared between threads. Configuring KLEE with
+ * `-DENABLE_ATOMIC_REFCOUNT=ON` makes every ReferenceCounter atomic.
+ * Individual types can also opt in by using an AtomicReferenceCounter:
+ * @code{.cpp}
+ *   class AtomicReferenceCounter _refCount;
+ * @endcode
+ *
  */
 
 #ifndef KLEE_REF_H
 #define KLEE_REF_H
 
+#include "klee/Config/config.h"
 #include "klee/Support/Casting.h"
 
+#include <atomic>
 #include <cassert>
 
 namespace llvm {
@@ -42,29 +54,67 @@ namespace klee {
 template<class T>
 class ref;
 
-/// Reference counter to be used as part of a ref-managed struct or class
-class ReferenceCounter {
+/// Counting policy for references that never cross threads.
+struct NonAtomicRefCountPolicy {
+  using CountType = unsigned;
+
+  static void increment(CountType &count) { ++count; }
+  /// \return true iff the last reference was dropped
+  static bool decrement(CountType &count) { return --count == 0; }
+  static unsigned load(const CountType &count) { return count; }
+};
+
+/// Counting policy for references shared between threads.
+struct AtomicRefCountPolicy {
+  using CountType = std::atomic<unsigned>;
+
+  // A new reference is always created from an existing one, which keeps the
+  // object alive, so the increment does not need to order anything.
+  static void increment(CountType &count) {
+    count.fetch_add(1, std::memory_order_relaxed);
+  }
+  // Releasing a reference publishes all accesses made through it, and the
+  // thread dropping the last one has to see them all before deleting.
+  static bool decrement(CountType &count) {
+    return count.fetch_sub(1, std::memory_order_acq_rel) == 1;
+  }
+  static unsigned load(const CountType &count) {
+    return count.load(std::memory_order_relaxed);
+  }
+};
+
+#ifdef KLEE_ATOMIC_REFCOUNT
+using DefaultRefCountPolicy = AtomicRefCountPolicy;
+#else
+using DefaultRefCountPolicy = NonAtomicRefCountPolicy;
+#endif
+
+/// Reference counter with a selectable counting policy
+template <class Policy> class BasicReferenceCounter {
   template<class T>
   friend class ref;
 
   /// Count how often the object has been referenced.
-  unsigned refCount = 0;
+  typename Policy::CountType refCount{0};
+
+  void inc() { Policy::increment(refCount); }
+  bool dec() { return Policy::decrement(refCount); }
 
 public:
-  ReferenceCounter() = default;
-  ~ReferenceCounter() = default;
+  BasicReferenceCounter() = default;
+  ~BasicReferenceCounter() = default;
 
   // Explicitly initialise reference counter with 0 again
   // As this object is part of another object, the copy-constructor
   // might be invoked as part of the other one.
-  ReferenceCounter(const ReferenceCounter& ) {}
+  BasicReferenceCounter(const BasicReferenceCounter &) {}
 
   /// Returns the number of parallel references of this objects
   /// \return number of references on this object
-  unsigned getCount() {return refCount;}
+  unsigned getCount() const { return Policy::load(refCount); }
 
   // Copy assignment operator
-  ReferenceCounter &operator=(const ReferenceCounter &a) {
+  BasicReferenceCounter &operator=(const BasicReferenceCounter &a) {
     if (this == &a)
       return *this;
     // The new copy won't be referenced
@@ -74,10 +124,20 @@ public:
 
   // Do not allow move operations for the reference counter
   // as otherwise, references become incorrect.
-  ReferenceCounter(ReferenceCounter &&r) noexcept = delete;
-  ReferenceCounter &operator=(ReferenceCounter &&other) noexcept = delete;
+  BasicReferenceCounter(BasicReferenceCounter &&r) noexcept = delete;
+  BasicReferenceCounter &operator=(BasicReferenceCounter &&other) noexcept =
+      delete;
 };
 
+/// Reference counter to be used as part of a ref-managed struct or class
+class ReferenceCounter final
+    : public BasicReferenceCounter<DefaultRefCountPolicy> {};
+
+/// Reference counter for ref-managed types that are shared between threads
+/// regardless of the build configuration
+class AtomicReferenceCounter final
+    : public BasicReferenceCounter<AtomicRefCountPolicy> {};
+
 template<class T>
 class ref {
   T *ptr;
@@ -90,11 +150,11 @@ public:
 private:
   void inc() const {
     if (ptr)
-      ++ptr->_refCount.refCount;
+      ptr->_refCount.inc();
   }
 
   void dec() const {
-    if (ptr && --ptr->_refCount.refCount == 0)
+    if (ptr && ptr->_refCount.dec())
       delete ptr;
   }
 
@@ -0,0 +1,404 @@
+//===-- SetTrie.h -----------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_SETTRIE_H
+#define KLEE_SETTRIE_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace klee {
+
+/// SetTrie - A map from sets to values that finds stored subsets and
+/// supersets of a set, optionally bounded in memory by evicting the least
+/// recently used entries.
+///
+/// Elements are interned to dense 32-bit ids and every set is stored as the
+/// path of its sorted ids in a trie (the UBTree of MapOfSets), so searches
+/// compare integers instead of elements. A 64-bit signature with one bit per
+/// id modulo 64 is kept for every subtree and rules out subtrees during
+/// superset searches and elements during subset searches.
+template <class K, class V, class Hash = std::hash<K>,
+          class Equal = std::equal_to<K>>
+class SetTrie {
+public:
+  /// Called with the value of an entry that is evicted
+  using EvictionCallback = std::function<void(V &)>;
+
+private:
+  using Id = std::uint32_t;
+  using Signature = std::uint64_t;
+
+  struct Node {
+    Node *parent;
+    Id label;
+    /// Children sorted by label
+    std::vector<std::pair<Id, Node *>> children;
+    /// Union of the signatures of all sets ending at or below this node
+    Signature below = 0;
+    bool isEndOfSet = false;
+    V value{};
+    std::size_t valueBytes = 0;
+    /// Neighbours in the list of entries by last use
+    Node *newer = nullptr;
+    Node *older = nullptr;
+
+    Node(Node *parent, Id label) : parent(parent), label(label) {}
+  };
+
+  static constexpr std::size_t nodeBytes =
+      sizeof(Node) + sizeof(std::pair<Id, Node *>);
+  static constexpr std::size_t elementBytes =
+      2 * sizeof(K) + sizeof(Id) + sizeof(unsigned) + 2 * sizeof(void *);
+
+  std::unordered_map<K, Id, Hash, Equal> ids;
+  /// Element and number of entries containing it, by id
+  std::vector<std::pair<K, unsigned>> elements;
+  std::vector<Id> freeIds;
+
+  Node root{nullptr, 0};
+  Node *newest = nullptr;
+  Node *oldest = nullptr;
+  std::size_t numEntries = 0;
+  std::size_t bytes = 0;
+  /// Memory of values shared by several entries, charged by the owner
+  std::size_t sharedBytes = 0;
+  std::size_t memoryLimit = 0;
+  EvictionCallback onEvict;
+
+  static Signature bit(Id id) { return Signature(1) << (id % 64); }
+
+  Id intern(const K &element) {
+    auto it = ids.find(element);
+    if (it != ids.end())
+      return it->second;
+    Id id;
+    if (freeIds.empty()) {
+      id = elements.size();
+      elements.emplace_back(element, 0);
+    } else {
+      id = freeIds.back();
+      freeIds.pop_back();
+      elements[id] = std::make_pair(element, 0u);
+    }
+    ids.emplace(element, id);
+    bytes += elementBytes;
+    return id;
+  }
+
+  void release(Id id) {
+    assert(elements[id].second && "releasing unused element");
+    if (--elements[id].second)
+      return;
+    ids.erase(elements[id].first);
+    elements[id].first = K();
+    freeIds.push_back(id);
+    bytes -= elementBytes;
+  }
+
+  /// Translate a set into sorted ids. Return false if it contains an
+  /// element that is not in any entry.
+  bool getIds(const std::set<K> &set, std::vector<Id> &out) const {
+    bool all = true;
+    out.reserve(set.size());
+    for (const K &element : set) {
+      auto it = ids.find(element);
+      if (it == ids.end())
+        all = false;
+      else
+        out.push_back(it->second);
+    }
+    std::sort(out.begin(), out.end());
+    return all;
+  }
+
+  static Node *findChild(const Node *n, Id label) {
+    auto it = std::lower_bound(
+        n->children.begin(), n->children.end(), label,
+        [](const std::pair<Id, Node *> &c, Id l) { return c.first < l; });
+    return it != n->children.end() && it->first == label ? it->second
+                                                          : nullptr;
+  }
+
+  void unlink(Node *n) {
+    (n->newer ? n->newer->older : newest) = n->older;
+    (n->older ? n->older->newer : oldest) = n->newer;
+    n->newer = n->older = nullptr;
+  }
+
+  void touch(Node *n) {
+    if (n == newest)
+      return;
+    // Entries in the list other than the newest have a newer neighbour.
+    if (n->newer)
+      unlink(n);
+    n->older = newest;
+    if (newest)
+      newest->newer = n;
+    newest = n;
+    if (!oldest)
+      oldest = n;
+  }
+
+  void evict(Node *n) {
+    assert(n->isEndOfSet);
+    if (onEvict)
+      onEvict(n->value);
+    unlink(n);
+    n->isEndOfSet = false;
+    n->value = V();
+    bytes -= n->valueBytes;
+    n->valueBytes = 0;
+    --numEntries;
+
+    // The path from the entry to the root, and the signatures of the sets
+    // ending at its nodes
+    std::vector<Node *> path;
+    std::vector<Signature> signatures;
+    for (Node *p = n; p != &root; p = p->parent) {
+      release(p->label);
+      path.push_back(p);
+    }
+    path.push_back(&root);
+    signatures.resize(path.size(), 0);
+    for (std::size_t i = path.size() - 1; i > 0; --i)
+      signatures[i - 1] = signatures[i] | bit(path[i - 1]->label);
+
+    // Remove the nodes that no longer lead to an entry.
+    std::size_t remaining = 0;
+    while (n != &root && !n->isEndOfSet && n->children.empty()) {
+      Node *parent = n->parent;
+      auto it = std::find_if(
+          parent->children.begin(), parent->children.end(),
+          [n](const std::pair<Id, Node *> &c) { return c.second == n; });
+      parent->children.erase(it);
+      delete n;
+      bytes -= nodeBytes;
+      n = parent;
+      ++remaining;
+    }
+
+    // Drop the bits of the evicted set from the signatures of the remaining
+    // nodes that no other set below them contributes.
+    for (std::size_t i = remaining; i < path.size(); ++i) {
+      Node *p = path[i];
+      Signature below = p->isEndOfSet ? signatures[i] : 0;
+      for (const auto &c : p->children)
+        below |= c.second->below;
+      if (below == p->below)
+        break;
+      p->below = below;
+    }
+  }
+
+  template <class Predicate>
+  Node *findSubset(Node *n, const Id *begin, const Id *end, Signature set,
+                   const Predicate &p) {
+    if (n->isEndOfSet && p(n->value))
+      return n;
+    if (n->children.size() <= std::size_t(end - begin)) {
+      for (const auto &c : n->children) {
+        if (!(set & bit(c.first)))
+          continue;
+        const Id *it = std::lower_bound(begin, end, c.first);
+        if (it != end && *it == c.first)
+          if (Node *res = findSubset(c.second, it + 1, end, set, p))
+            return res;
+      }
+    } else {
+      for (const Id *it = begin; it != end; ++it)
+        if (Node *child = findChild(n, *it))
+          if (Node *res = findSubset(child, it + 1, end, set, p))
+            return res;
+    }
+    return nullptr;
+  }
+
+  /// \param rest signatures of the suffixes of the searched set
+  template <class Predicate>
+  Node *findSuperset(Node *n, std::size_t pos, const std::vector<Id> &set,
+                     const std::vector<Signature> &rest, const Predicate &p) {
+    if (pos == set.size() && n->isEndOfSet && p(n->value))
+      return n;
+    for (const auto &c : n->children) {
+      if (pos < set.size() && c.first > set[pos])
+        break;
+      if (rest[pos] & ~c.second->below)
+        continue;
+      std::size_t next = pos < set.size() && c.first == set[pos] ? pos + 1 : pos;
+      if (Node *res = findSuperset(c.second, next, set, rest, p))
+        return res;
+    }
+    return nullptr;
+  }
+
+  static void destroy(Node &n) {
+    std::vector<Node *> stack;
+    for (const auto &c : n.children)
+      stack.push_back(c.second);
+    n.children.clear();
+    while (!stack.empty()) {
+      Node *child = stack.back();
+      stack.pop_back();
+      for (const auto &c : child->children)
+        stack.push_back(c.second);
+      delete child;
+    }
+  }
+
+public:
+  SetTrie() = default;
+  ~SetTrie() { destroy(root); }
+
+  SetTrie(const SetTrie &) = delete;
+  SetTrie &operator=(const SetTrie &) = delete;
+
+  /// Bound the estimated memory of the entries, 0 for no bound. Inserting
+  /// evicts least recently used entries while the bound is exceeded.
+  void setMemoryLimit(std::size_t limit) { memoryLimit = limit; }
+  void setEvictionCallback(EvictionCallback callback) {
+    onEvict = std::move(callback);
+  }
+
+  /// Number of entries
+  std::size_t size() const { return numEntries; }
+  /// Estimated memory of the entries in bytes
+  std::size_t memoryUsage() const { return bytes + sharedBytes; }
+
+  /// Charge or discharge memory of values that several entries share,
+  /// such as an object the values point to. The owner charges it once per
+  /// object while any entry refers to it, e.g. from the eviction callback.
+  void chargeSharedMemory(std::size_t size) { sharedBytes += size; }
+  void dischargeSharedMemory(std::size_t size) {
+    assert(size <= sharedBytes && "discharging uncharged memory");
+    sharedBytes -= size;
+  }
+
+  /// Remove all entries without calling the eviction callback. Shared
+  /// memory stays charged until its owner discharges it.
+  void clear() {
+    destroy(root);
+    root.isEndOfSet = false;
+    root.value = V();
+    root.below = 0;
+    ids.clear();
+    elements.clear();
+    freeIds.clear();
+    newest = oldest = nullptr;
+    numEntries = 0;
+    bytes = 0;
+  }
+
+  /// Map a set to a value, replacing and evicting the value it had.
+  /// \param valueBytes memory held by the value, counted against the bound
+  void insert(const std::set<K> &set, const V &value,
+              std::size_t valueBytes = 0) {
+    std::vector<Id> key;
+    key.reserve(set.size());
+    Signature signature = 0;
+    for (const K &element : set) {
+      key.push_back(intern(element));
+      signature |= bit(key.back());
+    }
+    std::sort(key.begin(), key.end());
+
+    Node *n = &root;
+    n->below |= signature;
+    for (Id id : key) {
+      Node *child = findChild(n, id);
+      if (!child) {
+        child = new Node(n, id);
+        auto it = std::lower_bound(
+            n->children.begin(), n->children.end(), id,
+            [](const std::pair<Id, Node *> &c, Id l) { return c.first < l; });
+        n->children.emplace(it, id, child);
+        bytes += nodeBytes;
+      }
+      n = child;
+      n->below |= signature;
+    }
+
+    if (n->isEndOfSet) {
+      if (onEvict)
+        onEvict(n->value);
+      bytes -= n->valueBytes;
+    } else {
+      n->isEndOfSet = true;
+      ++numEntries;
+      for (Id id : key)
+        ++elements[id].second;
+    }
+    n->value = value;
+    n->valueBytes = valueBytes;
+    bytes += valueBytes;
+    touch(n);
+
+    while (memoryLimit && memoryUsage() > memoryLimit && oldest != newest)
+      evict(oldest);
+  }
+
+  /// Return the value of a set, or null if it has none.
+  V *lookup(const std::set<K> &set) {
+    std::vector<Id> key;
+    if (!getIds(set, key))
+      return nullptr;
+    Node *n = &root;
+    for (Id id : key)
+      if (!(n = findChild(n, id)))
+        return nullptr;
+    if (!n->isEndOfSet)
+      return nullptr;
+    touch(n);
+    return &n->value;
+  }
+
+  /// Return the value of a stored subset of `set` satisfying `p`, or null.
+  template <class Predicate>
+  V *findSubset(const std::set<K> &set, const Predicate &p) {
+    std::vector<Id> key;
+    getIds(set, key);
+    Signature signature = 0;
+    for (Id id : key)
+      signature |= bit(id);
+    Node *n = findSubset(&root, key.data(), key.data() + key.size(),
+                         signature, p);
+    if (!n)
+      return nullptr;
+    touch(n);
+    return &n->value;
+  }
+
+  /// Return the value of a stored superset of `set` satisfying `p`, or
+  /// null.
+  template <class Predicate>
+  V *findSuperset(const std::set<K> &set, const Predicate &p) {
+    std::vector<Id> key;
+    if (!getIds(set, key))
+      return nullptr;
+    std::vector<Signature> rest(key.size() + 1, 0);
+    for (std::size_t i = key.size(); i > 0; --i)
+      rest[i - 1] = rest[i] | bit(key[i - 1]);
+    Node *n = findSuperset(&root, 0, key, rest, p);
+    if (!n)
+      return nullptr;
+    touch(n);
+    return &n->value;
+  }
+};
+
+} // namespace klee
+
+#endif /* KLEE_SETTRIE_H */
@@ -47,6 +47,11 @@ public:
   virtual void processTestCase(const ExecutionState &state,
                                const char *err,
                                const char *suffix) = 0;
+
+  /// Receive the branch trail of a state that the interpreter gave up
+  /// after \ref Interpreter::requestStateDonation(). Replaying the trail
+  /// with \ref Interpreter::setReplayBranches() recreates the state.
+  virtual void processDonatedState(const std::vector<unsigned char> &branches) = 0;
 };
 
 class Interpreter {
@@ -60,13 +65,18 @@ public:
     bool Optimize;
     bool CheckDivZero;
     bool CheckOvershift;
+    /// The module was written by an earlier run with --output-module and is
+    /// executed without linking, instrumenting or optimising it again.
+    bool Prepared;
 
     ModuleOptions(const std::string &_LibraryDir,
                   const std::string &_EntryPoint, const std::string &_OptSuffix,
-                  bool _Optimize, bool _CheckDivZero, bool _CheckOvershift)
+                  bool _Optimize, bool _CheckDivZero, bool _CheckOvershift,
+                  bool _Prepared = false)
         : LibraryDir(_LibraryDir), EntryPoint(_EntryPoint),
           OptSuffix(_OptSuffix), Optimize(_Optimize),
-          CheckDivZero(_CheckDivZero), CheckOvershift(_CheckOvershift) {}
+          CheckDivZero(_CheckDivZero), CheckOvershift(_CheckOvershift),
+          Prepared(_Prepared) {}
   };
 
   enum LogType
@@ -120,6 +130,12 @@ public:
   // to record the symbolic path (as a stream of '0' and '1' bytes).
   virtual void setSymbolicPathWriter(TreeStreamWriter *tsw) = 0;
 
+  // supply a tree stream writer which the interpreter will use to
+  // record every branch decision of a state (fork directions and
+  // switch/resolution targets), so that the state can be recreated
+  // with setReplayBranches().
+  virtual void setBranchWriter(TreeStreamWriter *tsw) = 0;
+
   // supply a test case to replay from. this can be used to drive the
   // interpretation down a user specified path. use null to reset.
   virtual void setReplayKTest(const struct KTest *out) = 0;
@@ -129,6 +145,11 @@ public:
   // a user specified path. use null to reset.
   virtual void setReplayPath(const std::vector<bool> *path) = 0;
 
+  // supply a branch trail recorded by the branch writer. the initial
+  // state follows it without forking and explores freely afterwards.
+  // use null to reset.
+  virtual void setReplayBranches(const std::vector<unsigned char> *branches) = 0;
+
   // supply a set of symbolic bindings that will be used as "seeds"
   // for the search. use null to reset.
   virtual void useSeeds(const std::vector<struct KTest *> *seeds) = 0;
@@ -144,6 +165,11 @@ public:
 
   virtual void setInhibitForking(bool value) = 0;
 
+  // ask the interpreter to give up one of its states via
+  // InterpreterHandler::processDonatedState(). safe to call from a
+  // signal handler.
+  virtual void requestStateDonation() = 0;
+
   virtual void prepareForEarlyExit() = 0;
 
   /*** State accessor methods ***/
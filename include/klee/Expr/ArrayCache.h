@@ -15,7 +15,6 @@
 
 #include <string>
 #include <unordered_set>
-#include <vector>
 
 namespace klee {
 
@@ -27,6 +26,16 @@ struct EquivArrayCmpFn {
   }
 };
 
+/// Hashes constant arrays by their shape and contents, but not their name.
+struct ConstantArrayHashFn {
+  unsigned operator()(const Array *array) const;
+};
+
+/// Compares constant arrays by their shape and contents, but not their name.
+struct ConstantArrayCmpFn {
+  bool operator()(const Array *array1, const Array *array2) const;
+};
+
 /// Provides an interface for creating and destroying Array objects.
 class ArrayCache {
 public:
@@ -35,8 +44,10 @@ public:
   /// Create an Array object.
   //
   /// Symbolic Arrays are cached so that only one instance exists. This
-  /// provides a limited form of "alpha-renaming". Constant arrays are not
-  /// cached.
+  /// provides a limited form of "alpha-renaming". Constant arrays are cached
+  /// by their contents, so that equal tables share one Array, and with it
+  /// their encoding in the solver builders; the returned array keeps the
+  /// name of the first array created with these contents.
   ///
   /// This class retains ownership of Array object so that upon destruction
   /// of this object all allocated Array objects are deleted.
@@ -64,8 +75,10 @@ private:
                              klee::EquivArrayCmpFn>
       ArrayHashMap;
   ArrayHashMap cachedSymbolicArrays;
-  typedef std::vector<const Array *> ArrayPtrVec;
-  ArrayPtrVec concreteArrays;
+  typedef std::unordered_set<const Array *, klee::ConstantArrayHashFn,
+                             klee::ConstantArrayCmpFn>
+      ConstantArrayHashMap;
+  ConstantArrayHashMap cachedConstantArrays;
 };
 }
 
@@ -0,0 +1,108 @@
+//===-- CompiledExpr.h ------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_COMPILEDEXPR_H
+#define KLEE_COMPILEDEXPR_H
+
+#include "klee/Expr/Expr.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace klee {
+class Array;
+class Assignment;
+
+/// CompiledExpr - A set of boolean expressions flattened into a register
+/// program, for checking many assignments against the same expressions.
+///
+/// Every distinct subexpression becomes one instruction writing its own
+/// register, so an evaluation is a single pass over an array instead of a
+/// walk over the expression DAG. Assignments are evaluated in batches of
+/// `Lanes`, with one register slot per assignment, so that every
+/// instruction runs as a short loop the compiler can vectorise.
+///
+/// Expressions wider than 64 bits are not compiled; the assignments are then
+/// checked with Assignment::satisfies, as are the assignments that allow free
+/// values or divide by zero. Results are always those of
+/// Assignment::satisfies.
+class CompiledExpr {
+public:
+  /// Number of assignments evaluated together, one bit each in a byte
+  static constexpr unsigned Lanes = 8;
+
+private:
+  struct Instruction {
+    Expr::Kind kind;
+    /// Width of the result
+    Expr::Width width;
+    /// Width of the first operand, or of the second one for Concat
+    Expr::Width operandWidth;
+    /// Operand registers. For Read, `a` is the slot and `b` the index
+    /// register, or none if the index is constant.
+    std::uint32_t a, b, c;
+    /// Value for Constant, offset for Extract, index for Read
+    std::uint64_t value;
+  };
+  class Compiler;
+  /// An array read by the program with its constant initial values
+  struct Slot {
+    const Array *array;
+    std::vector<std::uint8_t> constantValues;
+  };
+
+  std::vector<ref<Expr>> roots;
+  std::vector<Instruction> program;
+  std::vector<Slot> slots;
+  /// Registers holding the values of the roots
+  std::vector<std::uint32_t> results;
+  std::vector<bool> isRoot;
+  bool valid;
+
+  /// Per evaluation: the registers, the lanes of every register that
+  /// divided by zero, and the bound values of every slot by lane
+  std::vector<std::uint64_t> registers;
+  std::vector<std::uint8_t> poisons;
+  std::vector<const std::vector<unsigned char> *> bound;
+
+  void compile();
+
+  /// Evaluate `count` <= Lanes assignments, setting `satisfied` for every
+  /// lane.
+  void evaluate(const Assignment *const *assignments, unsigned count,
+                bool *satisfied);
+
+public:
+  template <class InputIterator>
+  CompiledExpr(InputIterator begin, InputIterator end) : roots(begin, end) {
+    compile();
+  }
+  explicit CompiledExpr(const std::vector<ref<Expr>> &roots)
+      : CompiledExpr(roots.begin(), roots.end()) {}
+  ~CompiledExpr();
+
+  CompiledExpr(const CompiledExpr &) = delete;
+  CompiledExpr &operator=(const CompiledExpr &) = delete;
+
+  /// Whether the expressions were compiled, rather than being evaluated
+  /// with Assignment::satisfies
+  bool isCompiled() const { return valid; }
+  /// Number of instructions of the program
+  std::size_t size() const { return program.size(); }
+
+  /// Return whether `a` satisfies all the expressions.
+  bool satisfies(const Assignment &a);
+
+  /// Return the index of the first assignment satisfying all the
+  /// expressions, or assignments.size() if there is none.
+  std::size_t findSatisfying(const std::vector<const Assignment *> &assignments);
+};
+} // namespace klee
+
+#endif /* KLEE_COMPILEDEXPR_H */
@@ -0,0 +1,110 @@
+//===-- ConstraintPartition.h -----------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_CONSTRAINTPARTITION_H
+#define KLEE_CONSTRAINTPARTITION_H
+
+#include "klee/ADT/ImmutableMap.h"
+#include "klee/ADT/Ref.h"
+#include "klee/Expr/Expr.h"
+
+#include <utility>
+#include <vector>
+
+namespace klee {
+
+class Array;
+
+/// Partition of a set of constraints into independent factors.
+///
+/// Two constraints are dependent if they read the same byte of an array; a
+/// read at a symbolic index stands for all bytes of the array. The partition
+/// is a union-find over the bytes read by the constraints, updated as
+/// constraints are added. It is persistent: copies share their structure and
+/// take constant time, so every state can keep the partition of its path
+/// condition.
+class ConstraintPartition {
+public:
+  /// A byte of an array, or the whole array if the index is `WholeArray`
+  using Element = std::pair<const Array *, unsigned>;
+  static constexpr unsigned WholeArray = ~0u;
+
+  /// An independent factor of the constraints
+  struct Factor {
+    /// The constraints of the factor, in the order they were added
+    std::vector<ref<Expr>> constraints;
+    /// The elements read by the constraints of the factor
+    std::vector<Element> elements;
+  };
+
+  /// Add a constraint
+  /// \param position index of the constraint in its set, used to order
+  ///        the constraints returned by queries
+  void add(const ref<Expr> &constraint, unsigned position);
+
+  /// Collect the constraints in the factors read by an expression
+  /// \param result receives the constraints in the order they were added
+  void getDependentConstraints(const ref<Expr> &e,
+                               std::vector<ref<Expr>> &result) const;
+
+  /// Compute all factors, ordered by their first constraint
+  void getFactors(std::vector<Factor> &factors) const;
+
+  /// Collect the elements read by an expression. Reads of constant arrays
+  /// without updates are ignored, and a whole array subsumes its bytes.
+  static void getElements(const ref<Expr> &e, std::vector<Element> &elements);
+
+private:
+  /// The constraints of a factor, as a binary tree so that merging two
+  /// factors takes constant time. Nodes with a constraint add it to the
+  /// constraints of their children.
+  class ConstraintList {
+  public:
+    /// @brief Required by klee::ref-managed objects
+    class ReferenceCounter _refCount;
+
+    ref<Expr> constraint;
+    unsigned position = 0;
+    ref<ConstraintList> left, right;
+
+    ConstraintList(ref<ConstraintList> left, ref<ConstraintList> right)
+        : left(std::move(left)), right(std::move(right)) {}
+    ConstraintList(const ref<Expr> &constraint, unsigned position,
+                   ref<ConstraintList> rest)
+        : constraint(constraint), position(position), left(std::move(rest)) {}
+    ~ConstraintList();
+
+    /// Collect the constraints of a list with their positions.
+    static void collect(const ConstraintList *list,
+                        std::vector<std::pair<unsigned, ref<Expr>>> &result);
+  };
+
+  struct Node {
+    /// Parent in the union-find; roots are their own parent.
+    Element parent;
+    /// Number of elements in the factor (roots only)
+    unsigned size = 0;
+    /// Constraints of the factor (roots only)
+    ref<ConstraintList> constraints;
+  };
+
+  ImmutableMap<Element, Node> nodes;
+
+  Element find(Element e) const;
+  /// Return the root of an element, adding the element if needed.
+  Element insert(const Element &e);
+  /// Merge two factors and return the new root.
+  Element unite(const Element &a, const Element &b);
+  /// Collect the roots of the factors an element belongs to.
+  void getRoots(const Element &e, std::vector<Element> &roots) const;
+};
+
+} // namespace klee
+
+#endif /* KLEE_CONSTRAINTPARTITION_H */
@@ -10,20 +10,97 @@
 #ifndef KLEE_CONSTRAINTS_H
 #define KLEE_CONSTRAINTS_H
 
+#include "klee/ADT/ImmutableMap.h"
+#include "klee/Expr/ConstraintPartition.h"
 #include "klee/Expr/Expr.h"
 
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <vector>
+
 namespace klee {
 
+/// A block of constraints of a ConstraintSet. Blocks are linked through
+/// `prev` into a tree: constraint sets copied from one another share the
+/// blocks of their common prefix.
+class ConstraintChunk {
+public:
+  /// @brief Required by klee::ref-managed objects
+  class ReferenceCounter _refCount;
+
+  /// The preceding (full) chunk, if any.
+  ref<ConstraintChunk> prev;
+  /// Number of chunks before this one.
+  unsigned index;
+  /// Number of constraints before this chunk.
+  std::size_t start;
+  unsigned capacity;
+  /// The constraints stored in this chunk. Sets sharing the chunk may use
+  /// different prefixes of it, the entries beyond the prefix of a set
+  /// belong to the set it diverged from.
+  std::vector<ref<Expr>> items;
+
+  ConstraintChunk(ref<ConstraintChunk> prev, unsigned capacity);
+};
+
 /// Resembles a set of constraints that can be passed around
 ///
+/// Constraints are stored in chunks shared between copies, so copying a set
+/// (e.g. when a state forks) takes constant time. Appending to a set whose
+/// last chunk has been extended by another copy only duplicates that chunk.
 class ConstraintSet {
   friend class ConstraintManager;
 
 public:
   using constraints_ty = std::vector<ref<Expr>>;
-  using iterator = constraints_ty::iterator;
-  using const_iterator = constraints_ty::const_iterator;
-
+  /// Maps expressions known to be equal to a constant, and constraints
+  /// known to be true, to their value
+  using equalities_ty = ImmutableMap<ref<Expr>, ref<Expr>>;
+
+  class const_iterator {
+    friend class ConstraintSet;
+
+    const ConstraintChunk *const *spine = nullptr;
+    std::size_t chunk = 0;
+    unsigned offset = 0;
+
+    const_iterator(const ConstraintChunk *const *spine, std::size_t chunk,
+                   unsigned offset)
+        : spine(spine), chunk(chunk), offset(offset) {}
+
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = ref<Expr>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const ref<Expr> *;
+    using reference = const ref<Expr> &;
+
+    const_iterator() = default;
+
+    reference operator*() const { return spine[chunk]->items[offset]; }
+    pointer operator->() const { return &**this; }
+
+    const_iterator &operator++() {
+      if (++offset == spine[chunk]->capacity) {
+        ++chunk;
+        offset = 0;
+      }
+      return *this;
+    }
+    const_iterator operator++(int) {
+      const_iterator old = *this;
+      ++*this;
+      return old;
+    }
+
+    bool operator==(const const_iterator &b) const {
+      return chunk == b.chunk && offset == b.offset;
+    }
+    bool operator!=(const const_iterator &b) const { return !(*this == b); }
+  };
+
+  using iterator = const_iterator;
   using constraint_iterator = const_iterator;
 
   bool empty() const;
@@ -31,17 +108,83 @@ public:
   constraint_iterator end() const;
   size_t size() const noexcept;
 
-  explicit ConstraintSet(constraints_ty cs) : constraints(std::move(cs)) {}
+  explicit ConstraintSet(const constraints_ty &cs);
   ConstraintSet() = default;
 
+  ConstraintSet(const ConstraintSet &b)
+      : tail(b.tail), count(b.count), partition(b.partition),
+        equalities(b.equalities), simplifier(b.simplifier),
+        indexed(b.indexed) {}
+  ConstraintSet(ConstraintSet &&b) noexcept
+      : tail(std::move(b.tail)), count(b.count), spine(std::move(b.spine)),
+        partition(b.partition), equalities(b.equalities),
+        simplifier(std::move(b.simplifier)), indexed(b.indexed) {
+    b.clear();
+  }
+  ConstraintSet &operator=(const ConstraintSet &b) {
+    tail = b.tail;
+    count = b.count;
+    spine.clear();
+    partition = b.partition;
+    equalities = b.equalities;
+    simplifier = b.simplifier;
+    indexed = b.indexed;
+    return *this;
+  }
+  ConstraintSet &operator=(ConstraintSet &&b) noexcept {
+    tail = std::move(b.tail);
+    count = b.count;
+    spine = std::move(b.spine);
+    partition = b.partition;
+    equalities = b.equalities;
+    simplifier = std::move(b.simplifier);
+    indexed = b.indexed;
+    b.clear();
+    return *this;
+  }
+
+  /// Append a constraint. The independent factors and equalities of the
+  /// set are only tracked when constraints are added through a
+  /// ConstraintManager.
   void push_back(const ref<Expr> &e);
 
-  bool operator==(const ConstraintSet &b) const {
-    return constraints == b.constraints;
+  /// \return the independent factors of the constraints, or null if they
+  /// are not tracked for this set
+  const ConstraintPartition *getPartition() const {
+    return indexed ? &partition : nullptr;
   }
 
+  bool operator==(const ConstraintSet &b) const;
+
 private:
-  constraints_ty constraints;
+  /// The chunk holding the last constraint.
+  ref<ConstraintChunk> tail;
+  /// Number of constraints in the set.
+  std::size_t count = 0;
+  /// The chunks of the set in order, built on demand for iteration. It is
+  /// either empty or complete, and never copied along with the set.
+  mutable std::vector<const ConstraintChunk *> spine;
+  /// Independent factors of the constraints
+  ConstraintPartition partition;
+
+  /// Substitutions implied by the constraints
+  equalities_ty equalities;
+
+  /// Rewrites expressions with `equalities` and remembers the results, so
+  /// it is shared by all copies of the set until a constraint is added.
+  /// Only used from the thread executing the states.
+  class Simplifier;
+  mutable std::shared_ptr<Simplifier> simplifier;
+
+  /// Whether `partition` and `equalities` cover all constraints of the set
+  bool indexed = true;
+
+  /// Number of constraints of this set in its tail chunk.
+  unsigned tailSize() const { return count - tail->start; }
+  void buildSpine() const;
+  /// Append a constraint without updating the indices.
+  void append(const ref<Expr> &e);
+  void clear();
 };
 
 class ExprVisitor;
@@ -73,6 +216,9 @@ private:
   /// Add constraint to the set of constraints
   void addConstraintInternal(const ref<Expr> &constraint);
 
+  /// Append constraint to the set, keeping track of its factors
+  void pushConstraint(const ref<Expr> &constraint);
+
   ConstraintSet &constraints;
 };
 
@@ -95,7 +95,13 @@ Todo: Shouldn't bool \c Xor just be written as not equal?
 
 class Expr {
 public:
-  static unsigned count;
+#ifdef KLEE_ATOMIC_REFCOUNT
+  using CountType = std::atomic<unsigned>;
+#else
+  using CountType = unsigned;
+#endif
+  /// Number of live expressions.
+  static CountType count;
   static const unsigned MAGIC_HASH_CONSTANT = 39;
 
   /// The type of an expression is simply its width, in bits. 
@@ -190,6 +196,15 @@ public:
 protected:  
   unsigned hashValue;
 
+  /// True iff this expression is registered in the hash-consing table, i.e.
+  /// it is the unique representative of its structure (see
+  /// createCachedExpr()).
+  bool isCached = false;
+
+  /// True iff this is one of the shared small constants, which are unique
+  /// without being in the hash-consing table (see ConstantExpr::lookupSmall()).
+  bool isShared = false;
+
   /// Compares `b` to `this` Expr and determines how they are ordered
   /// (ignoring their kid expressions - i.e. those returned by `getKid()`).
   ///
@@ -216,7 +231,7 @@ protected:
 
 public:
   Expr() { Expr::count++; }
-  virtual ~Expr() { Expr::count--; } 
+  virtual ~Expr();
 
   virtual Kind getKind() const = 0;
   virtual Width getWidth() const = 0;
@@ -291,6 +306,16 @@ public:
   struct CreateArg;
   static ref<Expr> createFromKind(Kind k, std::vector<CreateArg> args);
 
+  /// Finishes the construction of a freshly allocated expression: computes
+  /// its hash and, if hash-consing is enabled (-use-expr-hash-consing),
+  /// returns the unique expression that is structurally identical to `e`.
+  /// All `alloc()` methods must go through this function.
+  static ref<Expr> createCachedExpr(ref<Expr> e);
+
+  /// Returns true if this expression is the hash-consed representative of
+  /// its structure. Two such expressions are equal iff they are identical.
+  bool isHashConsed() const { return isCached || isShared; }
+
   static bool isValidKidWidth(unsigned kid, Width w) { return true; }
   static bool needsResultType() { return false; }
 
@@ -426,9 +451,7 @@ public:
   ref<Expr> src;
 
   static ref<Expr> alloc(const ref<Expr> &src) {
-    ref<Expr> r(new NotOptimizedExpr(src));
-    r->computeHash();
-    return r;
+    return createCachedExpr(new NotOptimizedExpr(src));
   }
   
   static ref<Expr> create(ref<Expr> src);
@@ -584,9 +607,7 @@ public:
 
 public:
   static ref<Expr> alloc(const UpdateList &updates, const ref<Expr> &index) {
-    ref<Expr> r(new ReadExpr(updates, index));
-    r->computeHash();
-    return r;
+    return createCachedExpr(new ReadExpr(updates, index));
   }
   
   static ref<Expr> create(const UpdateList &updates, ref<Expr> i);
@@ -629,9 +650,7 @@ public:
 public:
   static ref<Expr> alloc(const ref<Expr> &c, const ref<Expr> &t, 
                          const ref<Expr> &f) {
-    ref<Expr> r(new SelectExpr(c, t, f));
-    r->computeHash();
-    return r;
+    return createCachedExpr(new SelectExpr(c, t, f));
   }
   
   static ref<Expr> create(ref<Expr> c, ref<Expr> t, ref<Expr> f);
@@ -692,9 +711,7 @@ private:
 
 public:
   static ref<Expr> alloc(const ref<Expr> &l, const ref<Expr> &r) {
-    ref<Expr> c(new ConcatExpr(l, r));
-    c->computeHash();
-    return c;
+    return createCachedExpr(new ConcatExpr(l, r));
   }
   
   static ref<Expr> create(const ref<Expr> &l, const ref<Expr> &r);
@@ -759,9 +776,7 @@ public:
 
 public:  
   static ref<Expr> alloc(const ref<Expr> &e, unsigned o, Width w) {
-    ref<Expr> r(new ExtractExpr(e, o, w));
-    r->computeHash();
-    return r;
+    return createCachedExpr(new ExtractExpr(e, o, w));
   }
   
   /// Creates an ExtractExpr with the given bit offset and width
@@ -810,9 +825,7 @@ public:
 
 public:  
   static ref<Expr> alloc(const ref<Expr> &e) {
-    ref<Expr> r(new NotExpr(e));
-    r->computeHash();
-    return r;
+    return createCachedExpr(new NotExpr(e));
   }
   
   static ref<Expr> create(const ref<Expr> &e);
@@ -887,9 +900,7 @@ public:                                                          \
 public:                                                          \
     _class_kind ## Expr(ref<Expr> e, Width w) : CastExpr(e,w) {} \
     static ref<Expr> alloc(const ref<Expr> &e, Width w) {        \
-      ref<Expr> r(new _class_kind ## Expr(e, w));                \
-      r->computeHash();                                          \
-      return r;                                                  \
+      return createCachedExpr(new _class_kind ## Expr(e, w));    \
     }                                                            \
     static ref<Expr> create(const ref<Expr> &e, Width w);        \
     Kind getKind() const { return _class_kind; }                 \
@@ -920,9 +931,7 @@ CAST_EXPR_CLASS(ZExt)
     _class_kind##Expr(const ref<Expr> &l, const ref<Expr> &r)                  \
         : BinaryExpr(l, r) {}                                                  \
     static ref<Expr> alloc(const ref<Expr> &l, const ref<Expr> &r) {           \
-      ref<Expr> res(new _class_kind##Expr(l, r));                              \
-      res->computeHash();                                                      \
-      return res;                                                              \
+      return createCachedExpr(new _class_kind##Expr(l, r));                    \
     }                                                                          \
     static ref<Expr> create(const ref<Expr> &l, const ref<Expr> &r);           \
     Width getWidth() const { return left->getWidth(); }                        \
@@ -969,9 +978,7 @@ ARITHMETIC_EXPR_CLASS(AShr)
     _class_kind##Expr(const ref<Expr> &l, const ref<Expr> &r)                  \
         : CmpExpr(l, r) {}                                                     \
     static ref<Expr> alloc(const ref<Expr> &l, const ref<Expr> &r) {           \
-      ref<Expr> res(new _class_kind##Expr(l, r));                              \
-      res->computeHash();                                                      \
-      return res;                                                              \
+      return createCachedExpr(new _class_kind##Expr(l, r));                    \
     }                                                                          \
     static ref<Expr> create(const ref<Expr> &l, const ref<Expr> &r);           \
     Kind getKind() const { return _class_kind; }                               \
@@ -1073,10 +1080,19 @@ public:
   static ref<Expr> fromMemory(void *address, Width w);
   void toMemory(void *address);
 
+  /// Return the shared expression of a small constant, or null if `v` of
+  /// width `w` is not one.
+  ///
+  /// The values below 256 and all ones of the widths 1, 8, 16, 32 and 64
+  /// are allocated once and never freed, so that concrete execution does
+  /// not allocate an expression for every loop counter, flag and byte.
+  static ConstantExpr *lookupSmall(uint64_t v, Width w);
+
   static ref<ConstantExpr> alloc(const llvm::APInt &v) {
-    ref<ConstantExpr> r(new ConstantExpr(v));
-    r->computeHash();
-    return r;
+    if (v.getBitWidth() <= 64)
+      if (ConstantExpr *small = lookupSmall(v.getZExtValue(), v.getBitWidth()))
+        return small;
+    return cast<ConstantExpr>(createCachedExpr(new ConstantExpr(v)));
   }
 
   static ref<ConstantExpr> alloc(const llvm::APFloat &f) {
@@ -1084,7 +1100,12 @@ public:
   }
 
   static ref<ConstantExpr> alloc(uint64_t v, Width w) {
-    return alloc(llvm::APInt(w, v));
+    // The node only keeps the low w bits, so those are looked up.
+    if (ConstantExpr *small =
+            lookupSmall(w <= 64 ? bits64::truncateToNBits(v, w) : v, w))
+      return small;
+    return cast<ConstantExpr>(
+        createCachedExpr(new ConstantExpr(llvm::APInt(w, v))));
   }
 
   static ref<ConstantExpr> create(uint64_t v, Width w) {
@@ -16,6 +16,8 @@
 #include "llvm/Support/DataTypes.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <cstdint>
+#include <utility>
 #include <vector>
 
 namespace llvm {
@@ -41,6 +43,10 @@ namespace klee {
     int *operands;
     /// Destination register index.
     unsigned dest;
+    /// The instruction's opcode, and its predicate if it is a comparison,
+    /// so that they are decoded without touching the LLVM instruction.
+    std::uint16_t opcode;
+    std::uint16_t predicate;
 
   public:
     virtual ~KInstruction();
@@ -48,6 +54,31 @@ namespace klee {
 
   };
 
+  /// KTerminatorInstruction - A branch, switch, indirect branch or invoke
+  /// with its successor blocks resolved to the instructions they start at.
+  struct KTerminatorInstruction : KInstruction {
+    struct Successor {
+      /// Index of the block's first instruction in KFunction::instructions
+      unsigned entry;
+      /// Index of the terminator's block among the incoming blocks of the
+      /// phi nodes starting the successor, or -1 if it starts with none
+      int incomingBBIndex;
+    };
+
+    /// Successors, in the order of llvm::Instruction::getSuccessor
+    std::vector<Successor> successors;
+  };
+
+  /// KSwitchInstruction - A switch on at most 64 bits with its case values
+  /// sorted for binary search.
+  struct KSwitchInstruction : KTerminatorInstruction {
+    /// Case values with the index of their successor. Values not listed go
+    /// to successor 0, the default destination.
+    std::vector<std::pair<uint64_t, unsigned>> cases;
+
+    unsigned getSuccessorIndex(uint64_t value) const;
+  };
+
   struct KGEPInstruction : KInstruction {
     /// indices - The list of variable sized adjustments to add to the pointer
     /// operand to execute the instruction. The first element is the operand
@@ -117,6 +117,12 @@ namespace klee {
     std::set<const llvm::Function*> internalFunctions;
 
   private:
+    // Function in which execution starts, set once the module is prepared
+    std::string entryPoint;
+    // Suffix of the runtime libraries the module was linked with (see
+    // Interpreter::ModuleOptions::OptSuffix), set once the module is prepared
+    std::string runtimeSuffix;
+
     // Mark function with functionName as part of the KLEE runtime
     void addInternalFunction(const char* functionName);
 
@@ -153,6 +159,17 @@ namespace klee {
 
     void instrument(const Interpreter::ModuleOptions &opts);
 
+    /// Use a module written by an earlier run with --output-module, which
+    /// was already linked, instrumented, optimised and prepared, in place of
+    /// link, instrument and optimiseAndPrepare.
+    ///
+    /// @param prepared the module as read from the file, which must have
+    /// been written by this build of KLEE
+    /// @param opts the options, whose entry point and runtime libraries must
+    /// be the ones the module was prepared for
+    void usePrepared(std::unique_ptr<llvm::Module> prepared,
+                     const Interpreter::ModuleOptions &opts);
+
     /// Return an id for the given constant, creating a new one if necessary.
     unsigned getConstantID(llvm::Constant *c, KInstruction* ki);
 
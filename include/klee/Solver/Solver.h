@@ -232,6 +232,17 @@ namespace klee {
   /// \param s - The underlying solver to use.
   std::unique_ptr<Solver> createCachingSolver(std::unique_ptr<Solver> s);
 
+  /// createPersistentCachingSolver - Create a solver which caches query
+  /// results in an on-disk SQLite database, so that they can be reused by
+  /// later or concurrent runs. Queries are keyed on a canonical serialization
+  /// in which arrays are identified by their order of appearance rather than
+  /// their names. A database written in another format is refused.
+  ///
+  /// \param s - The underlying solver to use.
+  /// \param path - The path of the database file.
+  std::unique_ptr<Solver> createPersistentCachingSolver(std::unique_ptr<Solver> s,
+                                                        const std::string &path);
+
   /// createCexCachingSolver - Create a counterexample caching solver. This is a
   /// more sophisticated cache which records counterexamples for a constraint
   /// set and uses subset/superset relations among constraints to try and
@@ -270,6 +281,16 @@ namespace klee {
   /// fails.
   std::unique_ptr<Solver> createDummySolver();
 
+  /// createPortfolioSolver - Create a solver which runs each query on all the
+  /// given core solvers at once, each in a forked process, and returns the
+  /// first answer. The remaining solvers are cancelled. As it forks for every
+  /// query, it must not be used while other threads run solvers or hold
+  /// locks the solvers need.
+  ///
+  /// \param backends - The core solvers to race.
+  std::unique_ptr<Solver>
+  createPortfolioSolver(const std::vector<CoreSolverType> &backends);
+
   // Create a solver based on the supplied ``CoreSolverType``.
   std::unique_ptr<Solver> createCoreSolver(CoreSolverType cst);
   } // namespace klee
@@ -24,9 +24,14 @@ namespace stats {
   extern Statistic queryCacheMisses;
   extern Statistic queryCexCacheHits;
   extern Statistic queryCexCacheMisses;
+  extern Statistic queryPersistentCacheHits;
+  extern Statistic queryPersistentCacheMisses;
   extern Statistic queryConstructs;
   extern Statistic queryCounterexamples;
   extern Statistic queryTime;
+  extern Statistic portfolioWinsSTP;
+  extern Statistic portfolioWinsMetaSMT;
+  extern Statistic portfolioWinsZ3;
   
 #ifdef KLEE_ARRAY_DEBUG
   extern Statistic arrayHashTime;
@@ -12,9 +12,13 @@
 
 #include "Statistic.h"
 
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <string>
 #include <string.h>
+#include <thread>
 
 namespace klee {
   class Statistic;
@@ -39,13 +43,28 @@ namespace klee {
 
   class StatisticManager {
   private:
-    bool enabled;
+    /// StatisticShard - Counters of a thread other than the main one.
+    struct StatisticShard {
+      std::unique_ptr<std::atomic<uint64_t>[]> data;
+      bool detached = false;
+    };
+
+    /// How increments are counted: directly while only the main thread
+    /// counts, through incrementThreadStatistic while other threads may, too
+    enum class Counting : unsigned char { MainThread, Threads };
+    Counting counting;
+    /// The thread that allowed other threads, the only unattached one
+    /// that may still count while they run
+    std::thread::id mainThread;
     std::vector<Statistic*> stats;
     uint64_t *globalStats;
     uint64_t *indexedStats;
     StatisticRecord *contextStats;
     unsigned index;
 
+    std::mutex shardsLock;
+    std::vector<std::unique_ptr<StatisticShard>> shards;
+
   public:
     StatisticManager();
     ~StatisticManager();
@@ -69,19 +88,45 @@ namespace klee {
     void setIndexedValue(const Statistic &s, unsigned index, uint64_t value);
     int getStatisticID(const std::string &name) const;
     Statistic *getStatisticByName(const std::string &name) const;
+
+    /// allowThreads - Set whether threads other than the main one may
+    /// increment statistics. Must be set by the main thread before such
+    /// threads start and cleared after they have been joined, which merges
+    /// the counts of all shards. While set, every increment takes the slower
+    /// incrementThreadStatistic path.
+    void allowThreads(bool allow);
+    /// incrementThreadStatistic - Increment a statistic from any thread:
+    /// in the shard of the calling thread if it is attached, as
+    /// incrementStatistic otherwise. Only the main thread may count
+    /// without being attached.
+    void incrementThreadStatistic(Statistic &s, uint64_t addend);
+    /// attachThread - Give the calling thread its own shard of counters.
+    /// Increments from an attached thread only reach the global values
+    /// (never the indexed or context statistics) and only become visible
+    /// after the main thread calls mergeThreadStats().
+    void attachThread();
+    /// detachThread - Release the shard of the calling thread. Its counts
+    /// are kept until the main thread merges them, at the latest when it
+    /// disallows threads.
+    void detachThread();
+    /// mergeThreadStats - Fold the counts of all shards into the global
+    /// values. Must be called from the main thread.
+    void mergeThreadStats();
   };
 
   extern StatisticManager *theStatisticManager;
 
   inline void StatisticManager::incrementStatistic(Statistic &s, 
                                                    uint64_t addend) {
-    if (enabled) {
+    if (counting == Counting::MainThread) {
       globalStats[s.id] += addend;
       if (indexedStats) {
         indexedStats[index*stats.size() + s.id] += addend;
         if (contextStats)
           contextStats->data[s.id] += addend;
       }
+    } else if (counting == Counting::Threads) {
+      incrementThreadStatistic(s, addend);
     }
   }
 
@@ -9,12 +9,14 @@
 
 #include "klee/Statistics/Statistics.h"
 
+#include <algorithm>
+#include <cassert>
 #include <vector>
 
 using namespace klee;
 
 StatisticManager::StatisticManager()
-  : enabled(true),
+  : counting(Counting::MainThread),
     globalStats(0),
     indexedStats(0),
     contextStats(0),
@@ -54,6 +56,73 @@ Statistic *StatisticManager::getStatisticByName(const std::string &name) const {
   return 0;
 }
 
+/// Shard of the calling thread, if it is attached
+static thread_local std::atomic<uint64_t> *threadStats = nullptr;
+
+void StatisticManager::allowThreads(bool allow) {
+  // all other threads have been joined, so no count may remain behind
+  if (!allow)
+    mergeThreadStats();
+  counting = allow ? Counting::Threads : Counting::MainThread;
+  mainThread = std::this_thread::get_id();
+}
+
+void StatisticManager::incrementThreadStatistic(Statistic &s,
+                                                uint64_t addend) {
+  if (threadStats) {
+    threadStats[s.id].fetch_add(addend, std::memory_order_relaxed);
+    return;
+  }
+  assert(std::this_thread::get_id() == mainThread &&
+         "statistic incremented from an unattached thread");
+  globalStats[s.id] += addend;
+  if (indexedStats) {
+    indexedStats[index*stats.size() + s.id] += addend;
+    if (contextStats)
+      contextStats->data[s.id] += addend;
+  }
+}
+
+void StatisticManager::attachThread() {
+  assert(counting == Counting::Threads && "threads are not allowed");
+  assert(!threadStats && "thread already attached");
+  auto shard = std::make_unique<StatisticShard>();
+  shard->data.reset(new std::atomic<uint64_t>[stats.size()]);
+  for (unsigned i = 0; i < stats.size(); i++)
+    shard->data[i].store(0, std::memory_order_relaxed);
+  threadStats = shard->data.get();
+
+  std::lock_guard<std::mutex> guard(shardsLock);
+  shards.push_back(std::move(shard));
+}
+
+void StatisticManager::detachThread() {
+  assert(threadStats && "thread not attached");
+  std::lock_guard<std::mutex> guard(shardsLock);
+  for (auto &shard : shards) {
+    if (shard->data.get() == threadStats) {
+      shard->detached = true;
+      break;
+    }
+  }
+  threadStats = nullptr;
+}
+
+void StatisticManager::mergeThreadStats() {
+  assert(!threadStats && "merging from an attached thread");
+  std::lock_guard<std::mutex> guard(shardsLock);
+  for (auto &shard : shards)
+    for (unsigned i = 0; i < stats.size(); i++)
+      globalStats[i] += shard->data[i].exchange(0, std::memory_order_relaxed);
+
+  // all counts of detached threads have been collected
+  shards.erase(std::remove_if(shards.begin(), shards.end(),
+                              [](const std::unique_ptr<StatisticShard> &s) {
+                                return s->detached;
+                              }),
+               shards.end());
+}
+
 StatisticManager *klee::theStatisticManager = 0;
 
 static StatisticManager &getStatisticManager() {
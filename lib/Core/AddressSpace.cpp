@@ -18,6 +18,8 @@
 
 #include "CoreStats.h"
 
+#include <algorithm>
+
 using namespace klee;
 
 ///
@@ -25,10 +27,16 @@ using namespace klee;
 void AddressSpace::bindObject(const MemoryObject *mo, ObjectState *os) {
   assert(os->copyOnWriteOwner==0 && "object already has owner");
   os->copyOnWriteOwner = cowKey;
+  if (const auto *old = objects.lookup(mo))
+    symbolicObjects -= old->second->countedSymbolic;
   objects = objects.replace(std::make_pair(mo, os));
+  // the caller initializes the object after binding it
+  markUncounted(mo, os);
 }
 
 void AddressSpace::unbindObject(const MemoryObject *mo) {
+  if (const auto *old = objects.lookup(mo))
+    symbolicObjects -= old->second->countedSymbolic;
   objects = objects.remove(mo);
 }
 
@@ -42,16 +50,56 @@ ObjectState *AddressSpace::getWriteable(const MemoryObject *mo,
   assert(!os->readOnly);
 
   // If this address space owns they object, return it
-  if (cowKey == os->copyOnWriteOwner)
-    return const_cast<ObjectState*>(os);
+  if (cowKey == os->copyOnWriteOwner) {
+    auto *wos = const_cast<ObjectState*>(os);
+    markUncounted(mo, wos);
+    return wos;
+  }
 
   // Add a copy of this object state that can be updated
   ref<ObjectState> newObjectState(new ObjectState(*os));
   newObjectState->copyOnWriteOwner = cowKey;
   objects = objects.replace(std::make_pair(mo, newObjectState));
+  markUncounted(mo, newObjectState.get());
   return newObjectState.get();
 }
 
+bool AddressSpace::trackSymbolic = false;
+
+void AddressSpace::markUncounted(const MemoryObject *mo, ObjectState *os) {
+  if (trackSymbolic && !os->uncounted) {
+    os->uncounted = true;
+    uncounted.push_back(mo);
+  }
+}
+
+void AddressSpace::countSymbolicObjects() const {
+  for (const MemoryObject *mo : uncounted) {
+    // the object may have been unbound since, or counted under another entry
+    const auto *res = objects.lookup(mo);
+    if (!res || !res->second->uncounted)
+      continue;
+    ObjectState &os = *res->second;
+    bool symbolic = !os.isConcrete();
+    symbolicObjects += symbolic;
+    symbolicObjects -= os.countedSymbolic;
+    os.countedSymbolic = symbolic;
+    os.uncounted = false;
+  }
+  uncounted.clear();
+}
+
+bool AddressSpace::hasSymbolicObjects() const {
+  if (!trackSymbolic) {
+    for (const auto &object : objects)
+      if (!object.second->isConcrete())
+        return true;
+    return false;
+  }
+  countSymbolicObjects();
+  return symbolicObjects != 0;
+}
+
 /// 
 
 bool AddressSpace::resolveOne(const ref<ConstantExpr> &addr, 
@@ -105,62 +153,20 @@ bool AddressSpace::resolveOne(ExecutionState &state,
     }
 
     // didn't work, now we have to search
-       
-    MemoryMap::iterator oi = objects.upper_bound(&hack);
-    MemoryMap::iterator begin = objects.begin();
-    MemoryMap::iterator end = objects.end();
-      
-    MemoryMap::iterator start = oi;
-    while (oi!=begin) {
-      --oi;
-      const auto &mo = oi->first;
-
-      bool mayBeTrue;
-      if (!solver->mayBeTrue(state.constraints,
-                             mo->getBoundsCheckPointer(address), mayBeTrue,
-                             state.queryMetaData))
-        return false;
-      if (mayBeTrue) {
-        result.first = oi->first;
-        result.second = oi->second.get();
-        success = true;
-        return true;
-      } else {
-        bool mustBeTrue;
-        if (!solver->mustBeTrue(state.constraints,
-                                UgeExpr::create(address, mo->getBaseExpr()),
-                                mustBeTrue, state.queryMetaData))
-          return false;
-        if (mustBeTrue)
-          break;
-      }
-    }
-
-    // search forwards
-    for (oi=start; oi!=end; ++oi) {
-      const auto &mo = oi->first;
 
-      bool mustBeTrue;
-      if (!solver->mustBeTrue(state.constraints,
-                              UltExpr::create(address, mo->getBaseExpr()),
-                              mustBeTrue, state.queryMetaData))
-        return false;
-      if (mustBeTrue) {
-        break;
-      } else {
-        bool mayBeTrue;
+    ResolutionList candidates;
+    if (!findCandidates(state, solver, address, example, candidates))
+      return false;
 
-        if (!solver->mayBeTrue(state.constraints,
-                               mo->getBoundsCheckPointer(address), mayBeTrue,
-                               state.queryMetaData))
-          return false;
-        if (mayBeTrue) {
-          result.first = oi->first;
-          result.second = oi->second.get();
-          success = true;
-          return true;
-        }
-      }
+    ResolutionList rl;
+    if (searchCandidates(state, solver, address, candidates, 0,
+                         candidates.size(), false, rl, 0, true,
+                         time::Point()) == 1)
+      return false;
+    if (!rl.empty()) {
+      result = rl.front();
+      success = true;
+      return true;
     }
 
     success = false;
@@ -204,6 +210,142 @@ int AddressSpace::checkPointerInObject(ExecutionState &state,
   return 2;
 }
 
+/// Collect the objects from `it` towards `limit`, nearest first, that may
+/// lie before the first one for which `holds` is true. `holds` must be
+/// monotonic: once true for an object, it is true for all further ones. The
+/// first object it holds for is kept if `keepFirstHolding` is set.
+///
+/// \return false iff `holds` failed.
+template <typename Holds>
+static bool collectUntil(MemoryMap::iterator it,
+                         const MemoryMap::iterator &limit, bool downwards,
+                         Holds holds, bool keepFirstHolding,
+                         ResolutionList &objects) {
+  auto reach = [&](std::size_t i) {
+    while (objects.size() <= i && it != limit) {
+      if (downwards)
+        --it;
+      objects.emplace_back(it->first, it->second.get());
+      if (!downwards)
+        ++it;
+    }
+    return i < objects.size();
+  };
+
+  // gallop until `holds` is true, then bisect the last step
+  std::size_t known = 0; // `holds` is false for all objects before this
+  std::size_t found = 0;
+  bool res = false;
+  for (std::size_t step = 1; reach(step - 1); step *= 2) {
+    if (!holds(objects[step - 1].first, res))
+      return false;
+    if (res) {
+      found = step - 1;
+      break;
+    }
+    known = step;
+  }
+  if (!res)
+    found = objects.size(); // all remaining objects have been collected
+  while (known < found) {
+    std::size_t mid = known + (found - known) / 2;
+    if (!holds(objects[mid].first, res))
+      return false;
+    if (res)
+      found = mid;
+    else
+      known = mid + 1;
+  }
+
+  if (found < objects.size())
+    objects.resize(found + (keepFirstHolding ? 1 : 0));
+  return true;
+}
+
+bool AddressSpace::findCandidates(ExecutionState &state, TimingSolver *solver,
+                                  ref<Expr> p, uint64_t example,
+                                  ResolutionList &candidates) const {
+  // Objects do not overlap, so once p must be at or above the base of an
+  // object, it cannot point into any object before it. Symmetrically, once
+  // p must be below the base of an object, that object and all later ones
+  // are ruled out.
+  auto mustBeAbove = [&](const MemoryObject *mo, bool &result) {
+    return solver->mustBeTrue(state.constraints,
+                              UgeExpr::create(p, mo->getBaseExpr()), result,
+                              state.queryMetaData);
+  };
+  auto mustBeBelow = [&](const MemoryObject *mo, bool &result) {
+    return solver->mustBeTrue(state.constraints,
+                              UltExpr::create(p, mo->getBaseExpr()), result,
+                              state.queryMetaData);
+  };
+
+  MemoryObject hack(example);
+  MemoryMap::iterator above = objects.upper_bound(&hack);
+  if (!collectUntil(above, objects.begin(), true, mustBeAbove, true,
+                    candidates))
+    return false;
+  std::reverse(candidates.begin(), candidates.end());
+  return collectUntil(above, objects.end(), false, mustBeBelow, false,
+                      candidates);
+}
+
+int AddressSpace::searchCandidates(ExecutionState &state, TimingSolver *solver,
+                                   ref<Expr> p,
+                                   const ResolutionList &candidates,
+                                   std::size_t first, std::size_t last,
+                                   bool knownFeasible, ResolutionList &rl,
+                                   unsigned maxResolutions, bool firstOnly,
+                                   time::Point deadline) const {
+  if (first == last)
+    return 2;
+  if (deadline != time::Point() && deadline < time::getWallTime())
+    return 1;
+
+  if (last - first == 1) {
+    const ObjectPair &op = candidates[first];
+    if (!firstOnly)
+      return checkPointerInObject(state, solver, p, op, rl, maxResolutions);
+
+    bool mayBeTrue = knownFeasible;
+    if (!mayBeTrue &&
+        !solver->mayBeTrue(state.constraints,
+                           op.first->getBoundsCheckPointer(p), mayBeTrue,
+                           state.queryMetaData))
+      return 1;
+    if (!mayBeTrue)
+      return 2;
+    rl.push_back(op);
+    return 0;
+  }
+
+  if (!knownFeasible) {
+    ref<Expr> inAny = candidates[first].first->getBoundsCheckPointer(p);
+    for (std::size_t i = first + 1; i != last; ++i)
+      inAny = OrExpr::create(inAny,
+                             candidates[i].first->getBoundsCheckPointer(p));
+    bool mayBeTrue;
+    if (!solver->mayBeTrue(state.constraints, inAny, mayBeTrue,
+                           state.queryMetaData))
+      return 1;
+    if (!mayBeTrue)
+      return 2;
+  }
+
+  std::size_t mid = first + (last - first) / 2;
+  std::size_t found = rl.size();
+  int incomplete = searchCandidates(state, solver, p, candidates, first, mid,
+                                    false, rl, maxResolutions, firstOnly,
+                                    deadline);
+  if (incomplete != 2)
+    return incomplete;
+  // the group is feasible, so if nothing was found in the lower half,
+  // the upper half has to be
+  return searchCandidates(state, solver, p, candidates, mid, last,
+                          rl.size() == found, rl, maxResolutions, firstOnly,
+                          deadline);
+}
+
 bool AddressSpace::resolve(ExecutionState &state, TimingSolver *solver,
                            ref<Expr> p, ResolutionList &rl,
                            unsigned maxResolutions, time::Span timeout) const {
@@ -234,58 +376,38 @@ bool AddressSpace::resolve(ExecutionState &state, TimingSolver *solver,
     if (!solver->getValue(state.constraints, p, cex, state.queryMetaData))
       return true;
     uint64_t example = cex->getZExtValue();
-    MemoryObject hack(example);
-
-    MemoryMap::iterator oi = objects.upper_bound(&hack);
-    MemoryMap::iterator begin = objects.begin();
-    MemoryMap::iterator end = objects.end();
-
-    MemoryMap::iterator start = oi;
-    // search backwards, start with one minus because this
-    // is the object that p *should* be within, which means we
-    // get write off the end with 4 queries
-    while (oi != begin) {
-      --oi;
-      const MemoryObject *mo = oi->first;
-      if (timeout && timeout < timer.delta())
-        return true;
-
-      auto op = std::make_pair<>(mo, oi->second.get());
 
-      int incomplete =
-          checkPointerInObject(state, solver, p, op, rl, maxResolutions);
-      if (incomplete != 2)
-        return incomplete ? true : false;
+    time::Point deadline;
+    if (timeout)
+      deadline = time::getWallTime() + timeout - timer.delta();
 
-      bool mustBeTrue;
-      if (!solver->mustBeTrue(state.constraints,
-                              UgeExpr::create(p, mo->getBaseExpr()), mustBeTrue,
-                              state.queryMetaData))
-        return true;
-      if (mustBeTrue)
-        break;
+    // check the object p *should* be within first, which means we
+    // get the in-bounds case with 2 queries
+    MemoryObject hack(example);
+    if (const auto res = objects.lookup_previous(&hack)) {
+      const MemoryObject *mo = res->first;
+      if (example - mo->address < mo->size) {
+        bool mustBeTrue;
+        if (!solver->mustBeTrue(state.constraints,
+                                mo->getBoundsCheckPointer(p), mustBeTrue,
+                                state.queryMetaData))
+          return true;
+        if (mustBeTrue) {
+          rl.emplace_back(mo, res->second.get());
+          return false;
+        }
+      }
     }
 
-    // search forwards
-    for (oi = start; oi != end; ++oi) {
-      const MemoryObject *mo = oi->first;
-      if (timeout && timeout < timer.delta())
-        return true;
-
-      bool mustBeTrue;
-      if (!solver->mustBeTrue(state.constraints,
-                              UltExpr::create(p, mo->getBaseExpr()), mustBeTrue,
-                              state.queryMetaData))
-        return true;
-      if (mustBeTrue)
-        break;
-      auto op = std::make_pair<>(mo, oi->second.get());
+    ResolutionList candidates;
+    if (!findCandidates(state, solver, p, example, candidates))
+      return true;
 
-      int incomplete =
-          checkPointerInObject(state, solver, p, op, rl, maxResolutions);
-      if (incomplete != 2)
-        return incomplete ? true : false;
-    }
+    int incomplete = searchCandidates(state, solver, p, candidates, 0,
+                                      candidates.size(), false, rl,
+                                      maxResolutions, false, deadline);
+    if (incomplete != 2)
+      return incomplete ? true : false;
   }
 
   return false;
@@ -297,7 +419,17 @@ bool AddressSpace::resolve(ExecutionState &state, TimingSolver *solver,
 // transparently avoid screwing up symbolics (if the byte is symbolic
 // then its concrete cache byte isn't being used) but is just a hack.
 
+std::uint64_t AddressSpace::lastNativeVersion = 0;
+
 std::size_t AddressSpace::copyOutConcretes() {
+  // Unless another address space was copied out in the meantime, the
+  // native memory still holds the pages not modified since the last copy.
+  std::uint64_t since = 0;
+  if (nativeVersion != 0 && nativeVersion == lastNativeVersion)
+    since = nativeVersion;
+  // Until copyInConcretes, the native memory may be written by the caller.
+  lastNativeVersion = 0;
+
   std::size_t numPages{};
   for (const auto &object : objects) {
     auto &mo = object.first;
@@ -306,7 +438,8 @@ std::size_t AddressSpace::copyOutConcretes() {
       auto size = std::max(os->size, mo->alignment);
       numPages +=
           (size + MemoryManager::pageSize - 1) / MemoryManager::pageSize;
-      copyOutConcrete(mo, os.get());
+      os->copyOutConcreteStore(reinterpret_cast<std::uint8_t *>(mo->address),
+                               since);
     }
   }
   return numPages;
@@ -315,33 +448,54 @@ std::size_t AddressSpace::copyOutConcretes() {
 void AddressSpace::copyOutConcrete(const MemoryObject *mo,
                                    const ObjectState *os) const {
   auto address = reinterpret_cast<std::uint8_t *>(mo->address);
-  std::memcpy(address, os->concreteStore, mo->size);
+  os->copyOutConcreteStore(address);
 }
 
-bool AddressSpace::copyInConcretes() {
-  for (auto &obj : objects) {
-    const MemoryObject *mo = obj.first;
-
-    if (!mo->isUserSpecified) {
-      const auto &os = obj.second;
-
-      if (!copyInConcrete(mo, os.get(), mo->address))
+bool AddressSpace::copyInConcretes(
+    const MemoryManager::AddressRanges &written) {
+  for (const auto &range : written) {
+    MemoryObject hack(range.first);
+    // The object below the range may reach into it.
+    auto it = objects.lower_bound(&hack);
+    const auto *below = objects.lookup_previous(&hack);
+    if (below && below->first->address < range.first)
+      --it;
+
+    for (auto ie = objects.end(); it != ie; ++it) {
+      const MemoryObject *mo = it->first;
+      const ObjectState *os = it->second.get();
+      if (mo->address >= range.second)
+        break;
+      if (mo->isUserSpecified)
+        continue;
+
+      std::uint64_t begin = std::max(mo->address, range.first) - mo->address;
+      std::uint64_t end =
+          std::min(mo->address + os->size, range.second) - mo->address;
+      auto address = reinterpret_cast<const std::uint8_t *>(mo->address);
+      if (begin >= end || os->isConcreteStoreEqual(address, begin, end))
+        continue;
+      if (os->readOnly)
         return false;
+      getWriteable(mo, os)->copyInConcreteStore(address, begin, end);
     }
   }
 
+  // The native memory now holds the concrete values, as the bytes not
+  // compared were neither copied out nor written.
+  nativeVersion = lastNativeVersion = ObjectState::newVersion();
   return true;
 }
 
 bool AddressSpace::copyInConcrete(const MemoryObject *mo, const ObjectState *os,
                                   uint64_t src_address) {
   auto address = reinterpret_cast<std::uint8_t*>(src_address);
-  if (memcmp(address, os->concreteStore, mo->size) != 0) {
+  if (!os->isConcreteStoreEqual(address, 0, os->size)) {
     if (os->readOnly) {
       return false;
     } else {
       ObjectState *wos = getWriteable(mo, os);
-      memcpy(wos->concreteStore, address, mo->size);
+      wos->copyInConcreteStore(address, 0, wos->size);
     }
   }
   return true;
@@ -11,6 +11,7 @@
 #define KLEE_ADDRESSSPACE_H
 
 #include "Memory.h"
+#include "MemoryManager.h"
 
 #include "klee/Expr/Expr.h"
 #include "klee/ADT/ImmutableMap.h"
@@ -40,9 +41,34 @@ namespace klee {
     /// Epoch counter used to control ownership of objects.
     mutable unsigned cowKey;
 
+    /// Page version (see ObjectStatePage::version) at which the native
+    /// memory last held the concrete values of this address space, or 0
+    std::uint64_t nativeVersion = 0;
+
+    /// Version at which the native memory last held the concrete values of
+    /// some address space, or 0 if it may have changed since
+    static std::uint64_t lastNativeVersion;
+
+    /// Whether address spaces keep count of their objects holding symbolic
+    /// bytes, see trackSymbolicObjects()
+    static bool trackSymbolic;
+
+    /// Number of bound objects counted as holding symbolic bytes (see
+    /// ObjectState::countedSymbolic)
+    mutable std::size_t symbolicObjects = 0;
+
+    /// Objects handed out for writing since they were last counted
+    mutable std::vector<const MemoryObject *> uncounted;
+
     /// Unsupported, use copy constructor
     AddressSpace &operator=(const AddressSpace &);
 
+    /// Mark an owned object for recounting once it may have been written.
+    void markUncounted(const MemoryObject *mo, ObjectState *os);
+
+    /// Recount the objects written since the last count.
+    void countSymbolicObjects() const;
+
     /// Check if pointer `p` can point to the memory object in the
     /// given object pair.  If so, add it to the given resolution list.
     ///
@@ -54,6 +80,30 @@ namespace klee {
                              ref<Expr> p, const ObjectPair &op,
                              ResolutionList &rl, unsigned maxResolutions) const;
 
+    /// Fill `candidates` with the window of objects, in address order,
+    /// that pointer `p` may point into. The window is found by galloping
+    /// over the objects outwards from `example`, a value of `p`, so it
+    /// takes a logarithmic number of queries in its size and only visits
+    /// the objects up to twice as far away as its ends.
+    ///
+    /// \return false iff a query failed.
+    bool findCandidates(ExecutionState &state, TimingSolver *solver,
+                        ref<Expr> p, uint64_t example,
+                        ResolutionList &candidates) const;
+
+    /// Add the objects in [`first`, `last`) of `candidates` that `p`
+    /// may point into to `rl`. Groups of objects are ruled out with a
+    /// single query and only split when one of them is feasible. If
+    /// `firstOnly` is set, the search stops at the first object found.
+    ///
+    /// \return the same as checkPointerInObject.
+    int searchCandidates(ExecutionState &state, TimingSolver *solver,
+                         ref<Expr> p, const ResolutionList &candidates,
+                         std::size_t first, std::size_t last,
+                         bool knownFeasible, ResolutionList &rl,
+                         unsigned maxResolutions, bool firstOnly,
+                         time::Point deadline) const;
+
   public:
     /// The MemoryObject -> ObjectState map that constitutes the
     /// address space.
@@ -65,7 +115,15 @@ namespace klee {
     MemoryMap objects;
 
     AddressSpace() : cowKey(1) {}
-    AddressSpace(const AddressSpace &b) : cowKey(++b.cowKey), objects(b.objects) { }
+    AddressSpace(const AddressSpace &b)
+        : cowKey(++b.cowKey), nativeVersion(b.nativeVersion),
+          objects(b.objects) {
+      // objects written by b are shared from now on and must be counted
+      if (trackSymbolic) {
+        b.countSymbolicObjects();
+        symbolicObjects = b.symbolicObjects;
+      }
+    }
     ~AddressSpace() {}
 
     /// Resolve address to an ObjectPair in result.
@@ -125,7 +183,9 @@ namespace klee {
     ObjectState *getWriteable(const MemoryObject *mo, const ObjectState *os);
 
     /// Copy the concrete values of all managed ObjectStates into the
-    /// actual system memory location they were allocated at.
+    /// actual system memory location they were allocated at. If no other
+    /// address space was copied out since the last copyInConcretes, only
+    /// the pages modified since are copied.
     /// Returns the (hypothetical) number of pages needed provided each written
     /// object occupies (at least) a single page.
     std::size_t copyOutConcretes();
@@ -138,9 +198,23 @@ namespace klee {
     /// potentially copied) if the memory values are different from
     /// the current concrete values.
     ///
+    /// \param written The native memory written since copyOutConcretes
+    /// (see MemoryManager::getWrittenRanges); no other bytes are compared.
     /// \retval true The copy succeeded. 
     /// \retval false The copy failed because a read-only object was modified.
-    bool copyInConcretes();
+    bool copyInConcretes(const MemoryManager::AddressRanges &written);
+
+    /// Return whether some bound object holds symbolic bytes. While
+    /// objects are tracked, this does not visit the objects that were not
+    /// written since the last call.
+    bool hasSymbolicObjects() const;
+
+    /// Set whether address spaces count their objects holding symbolic
+    /// bytes as they are written. Must be set before any object is bound.
+    static void trackSymbolicObjects(bool track) { trackSymbolic = track; }
+
+    /// Forget what the native memory holds, e.g. after it was released.
+    static void forgetNativeMemory() { lastNativeVersion = 0; }
 
     /// Updates the memory object with the raw memory from the address
     ///
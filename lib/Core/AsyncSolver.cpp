@@ -0,0 +1,177 @@
+//===-- AsyncSolver.cpp ---------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "AsyncSolver.h"
+
+#include "CoreStats.h"
+
+#include "klee/Statistics/Statistics.h"
+#include "klee/Statistics/TimerStatIncrementer.h"
+#include "klee/Support/Timer.h"
+
+#include <algorithm>
+
+using namespace klee;
+
+AsyncSolver::AsyncSolver(std::vector<std::unique_ptr<Solver>> _solvers)
+    : solvers(std::move(_solvers)) {
+  theStatisticManager->allowThreads(true);
+  for (auto &solver : solvers)
+    workers.emplace_back([this, &solver] { work(*solver); });
+}
+
+AsyncSolver::~AsyncSolver() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+    queue.clear();
+  }
+  queued.notify_all();
+  for (auto &worker : workers)
+    worker.join();
+  theStatisticManager->allowThreads(false);
+}
+
+void AsyncSolver::takeBatch(std::vector<std::shared_ptr<Job>> &batch) {
+  // share the queue fairly among the workers
+  std::size_t size = (queue.size() + solvers.size() - 1) / solvers.size();
+  if (size > MaxBatchSize)
+    size = MaxBatchSize;
+  for (std::size_t i = 0; i < size; ++i) {
+    batch.push_back(std::move(queue.front()));
+    queue.pop_front();
+  }
+
+  // Queries from states that branched off the same path share their
+  // constraints. Solving them one after the other lets the solver chain
+  // (e.g. caches and incremental Z3) reuse the work on those constraints.
+  for (std::size_t i = 1; i < batch.size(); ++i) {
+    const ConstraintSet &previous = batch[i - 1]->constraints;
+    for (std::size_t j = i; j < batch.size(); ++j) {
+      if (batch[j]->constraints == previous) {
+        std::rotate(batch.begin() + i, batch.begin() + j,
+                    batch.begin() + j + 1);
+        break;
+      }
+    }
+  }
+}
+
+void AsyncSolver::forget(const std::shared_ptr<Job> &job) {
+  auto range = inFlight.equal_range(job->hash);
+  for (auto it = range.first; it != range.second; ++it) {
+    if (it->second == job) {
+      inFlight.erase(it);
+      break;
+    }
+  }
+}
+
+void AsyncSolver::work(Solver &solver) {
+  theStatisticManager->attachThread();
+
+  std::vector<std::shared_ptr<Job>> batch;
+  std::unique_lock<std::mutex> guard(lock);
+  while (true) {
+    queued.wait(guard, [this] { return stopping || !queue.empty(); });
+    if (stopping)
+      break;
+    takeBatch(batch);
+    const std::uint64_t taken = generation;
+    ++running;
+
+    // every query is answered as soon as it is known
+    std::size_t next = 0;
+    for (; next < batch.size() && generation == taken; ++next) {
+      const std::shared_ptr<Job> &job = batch[next];
+      guard.unlock();
+
+      Solver::Validity validity = Solver::Unknown;
+      bool success;
+      WallTimer timer;
+      {
+        // the query itself is counted when its state resumes
+        TimerStatIncrementer solverTimer(stats::solverTime);
+        success = solver.evaluate(Query(job->constraints, job->expr), validity);
+      }
+      time::Span elapsed = timer.delta();
+
+      guard.lock();
+      forget(job);
+      for (Ticket ticket : job->tickets)
+        results.push_back({ticket, success, validity, elapsed});
+      hasResults.store(true, std::memory_order_release);
+      finished.notify_all();
+    }
+    // the rest of a cancelled batch is dropped like the queue
+    for (; next < batch.size(); ++next)
+      forget(batch[next]);
+    batch.clear();
+    --running;
+    finished.notify_all();
+  }
+  guard.unlock();
+
+  theStatisticManager->detachThread();
+}
+
+AsyncSolver::Ticket AsyncSolver::submit(const ConstraintSet &constraints,
+                                        ref<Expr> expr) {
+  unsigned hash = expr->hash();
+  for (const auto &constraint : constraints)
+    hash = hash * Expr::MAGIC_HASH_CONSTANT + constraint->hash();
+
+  std::lock_guard<std::mutex> guard(lock);
+  Ticket ticket = nextTicket++;
+
+  auto range = inFlight.equal_range(hash);
+  for (auto it = range.first; it != range.second; ++it) {
+    Job &job = *it->second;
+    if (job.expr == expr && job.constraints == constraints) {
+      job.tickets.push_back(ticket);
+      return ticket;
+    }
+  }
+
+  auto job = std::make_shared<Job>();
+  job->constraints = constraints;
+  job->expr = expr;
+  job->hash = hash;
+  job->tickets.push_back(ticket);
+  inFlight.emplace(hash, job);
+  queue.push_back(std::move(job));
+  queued.notify_one();
+  return ticket;
+}
+
+void AsyncSolver::collect(std::vector<Result> &out, bool wait) {
+  // cheap check, as this is polled between instructions
+  if (!wait && !hasResults.load(std::memory_order_acquire))
+    return;
+
+  std::unique_lock<std::mutex> guard(lock);
+  if (wait)
+    finished.wait(guard, [this] {
+      return !results.empty() || (queue.empty() && !running);
+    });
+  out.insert(out.end(), results.begin(), results.end());
+  results.clear();
+  hasResults.store(false, std::memory_order_relaxed);
+}
+
+void AsyncSolver::cancel() {
+  std::unique_lock<std::mutex> guard(lock);
+  for (const auto &job : queue)
+    forget(job);
+  queue.clear();
+  ++generation;
+  finished.wait(guard, [this] { return !running; });
+  results.clear();
+  hasResults.store(false, std::memory_order_relaxed);
+}
@@ -0,0 +1,109 @@
+//===-- AsyncSolver.h -------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_ASYNCSOLVER_H
+#define KLEE_ASYNCSOLVER_H
+
+#include "klee/Expr/Constraints.h"
+#include "klee/Expr/Expr.h"
+#include "klee/Solver/Solver.h"
+#include "klee/System/Time.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace klee {
+
+/// AsyncSolver - Answers validity queries on a pool of worker threads, so
+/// that the interpreter can keep running other states in the meantime.
+///
+/// Every worker owns a complete solver chain. Workers take queued queries
+/// in batches and answer the queries of a batch over the same constraints
+/// back to back. Expressions are shared with the interpreter thread, which
+/// requires atomic reference counts (see ENABLE_ATOMIC_REFCOUNT).
+class AsyncSolver {
+public:
+  using Ticket = std::uint64_t;
+
+  struct Result {
+    Ticket ticket;
+    bool success;
+    Solver::Validity validity;
+    /// Time the worker spent on the query.
+    time::Span time;
+  };
+
+private:
+  struct Job {
+    ConstraintSet constraints;
+    ref<Expr> expr;
+    unsigned hash;
+    /// All submissions answered by this query.
+    std::vector<Ticket> tickets;
+  };
+
+  /// Maximum number of queries a worker takes at once
+  static constexpr std::size_t MaxBatchSize = 8;
+
+  std::vector<std::unique_ptr<Solver>> solvers;
+  std::vector<std::thread> workers;
+
+  std::mutex lock;
+  std::condition_variable queued;
+  std::condition_variable finished;
+  std::deque<std::shared_ptr<Job>> queue;
+  /// Queued and running jobs by hash, to answer identical queries once.
+  std::unordered_multimap<unsigned, std::shared_ptr<Job>> inFlight;
+  std::vector<Result> results;
+  std::atomic<bool> hasResults{false};
+  Ticket nextTicket = 1;
+  /// Incremented by cancel(), so that workers drop the rest of their batch
+  std::uint64_t generation = 0;
+  /// Number of workers with a batch
+  unsigned running = 0;
+  bool stopping = false;
+
+  void work(Solver &solver);
+  /// Move the next batch of queued jobs into `batch`. Requires `lock`.
+  void takeBatch(std::vector<std::shared_ptr<Job>> &batch);
+  /// Remove `job` from inFlight. Requires `lock`.
+  void forget(const std::shared_ptr<Job> &job);
+
+public:
+  /// Start one worker per solver.
+  explicit AsyncSolver(std::vector<std::unique_ptr<Solver>> solvers);
+  ~AsyncSolver();
+
+  AsyncSolver(const AsyncSolver &) = delete;
+  AsyncSolver &operator=(const AsyncSolver &) = delete;
+
+  /// Queue the validity query for `expr` under `constraints`. A query
+  /// identical to one that is still queued or running is answered
+  /// together with it.
+  Ticket submit(const ConstraintSet &constraints, ref<Expr> expr);
+
+  /// Move the answers of finished queries into `out`. If `wait` is set
+  /// and queries are outstanding, block until at least one has finished.
+  void collect(std::vector<Result> &out, bool wait);
+
+  /// Drop all queries no worker has started yet and wait for the running
+  /// ones to finish. No ticket submitted so far is answered afterwards.
+  void cancel();
+};
+
+} // namespace klee
+
+#endif /* KLEE_ASYNCSOLVER_H */
@@ -32,6 +32,9 @@ namespace stats {
   /// The number of external calls.
   extern Statistic externalCalls;
 
+  /// The number of calls to module functions run as native code.
+  extern Statistic nativeCalls;
+
   /// The number of process forks.
   extern Statistic forks;
 
@@ -32,7 +32,6 @@ namespace klee {
 class Array;
 class CallPathNode;
 struct Cell;
-class ExecutionTreeNode;
 struct KFunction;
 struct KInstruction;
 class MemoryObject;
@@ -204,12 +203,16 @@ public:
   /// taken to reach/create this state
   TreeOStream symPathOS;
 
+  /// @brief History of all branch decisions (including internal forks and
+  /// switch targets), used to recreate this state in another process
+  TreeOStream branchOS;
+
   /// @brief Set containing which lines in which files are covered by this state
   std::map<const std::string *, std::set<std::uint32_t>> coveredLines;
 
-  /// @brief Pointer to the execution tree of the current state
+  /// @brief Index of the execution tree node of the current state, 0 if none
   /// Copies of ExecutionState should not copy executionTreeNode
-  ExecutionTreeNode *executionTreeNode = nullptr;
+  std::uint32_t executionTreeNode = 0;
 
   /// @brief Ordered list of symbolics: used to generate test cases.
   //
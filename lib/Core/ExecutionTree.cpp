@@ -61,24 +61,39 @@ Json::Value jsonData(Json::objectValue);
 
 Json::Value jsonMemoryObjects(Json::arrayValue);
 
-// ExecutionTreeNode
+// ExecutionTreeNodePool
 
-ExecutionTreeNode::ExecutionTreeNode(ExecutionTreeNode *parent,
-                                     ExecutionState *state) noexcept
-    : parent{parent}, left{nullptr}, right{nullptr}, state{state} {
-  state->executionTreeNode = this;
+ExecutionTreeNodeIndex ExecutionTreeNodePool::allocate() {
+  ExecutionTreeNodeIndex index = freeList;
+  if (index) {
+    freeList = (*this)[index].parent;
+  } else {
+    if (used > ExecutionTreeNodePtr::MaxIndex)
+      klee_error("ExecutionTree cannot hold more than %u nodes",
+                 ExecutionTreeNodePtr::MaxIndex);
+    if ((used & (ChunkSize - 1)) == 0 || chunks.empty())
+      chunks.emplace_back(new ExecutionTreeNode[ChunkSize]);
+    index = used++;
+  }
+  ++live;
+  (*this)[index] = ExecutionTreeNode();
+  return index;
 }
 
-// AnnotatedExecutionTreeNode
-
-AnnotatedExecutionTreeNode::AnnotatedExecutionTreeNode(
-    ExecutionTreeNode *parent, ExecutionState *state) noexcept
-    : ExecutionTreeNode(parent, state) {
-  id = nextID++;
+void ExecutionTreeNodePool::release(ExecutionTreeNodeIndex index) noexcept {
+  ExecutionTreeNode &node = (*this)[index];
+  node = ExecutionTreeNode();
+  node.parent = freeList;
+  freeList = index;
+  --live;
 }
 
 // NoopExecutionTree
 
+void NoopExecutionTree::dump(llvm::raw_ostream &os) noexcept {
+  os << "digraph G {\nTreeType=\"Noop\";\n}\n";
+}
+
 void NoopExecutionTree::dump() noexcept {
 }
 
@@ -86,73 +101,91 @@ void NoopExecutionTree::dump() noexcept {
 
 InMemoryExecutionTree::InMemoryExecutionTree(
     ExecutionState &initialState) noexcept {
-  root = ExecutionTreeNodePtr(createNode(nullptr, &initialState));
-  initialState.executionTreeNode = root.getPointer();
+  root = ExecutionTreeNodePtr(createNode(0, &initialState));
 }
 
-ExecutionTreeNode *InMemoryExecutionTree::createNode(ExecutionTreeNode *parent,
-                                                     ExecutionState *state) {
-  return new ExecutionTreeNode(parent, state);
+ExecutionTreeNodeIndex
+InMemoryExecutionTree::createNode(ExecutionTreeNodeIndex parent,
+                                  ExecutionState *state) {
+  ExecutionTreeNodeIndex index = nodes.allocate();
+  ExecutionTreeNode &node = nodes[index];
+  node.parent = parent;
+  node.state = state;
+  state->executionTreeNode = index;
+  return index;
 }
 
-void InMemoryExecutionTree::attach(ExecutionTreeNode *node,
+ExecutionTreeNodePtr &
+InMemoryExecutionTree::getPtrTo(ExecutionTreeNodeIndex index) {
+  ExecutionTreeNodeIndex parent = nodes[index].parent;
+  if (!parent)
+    return root;
+  ExecutionTreeNode &p = nodes[parent];
+  if (p.left.getIndex() == index)
+    return p.left;
+  assert(p.right.getIndex() == index);
+  return p.right;
+}
+
+void InMemoryExecutionTree::attach(ExecutionTreeNodeIndex index,
                                    ExecutionState *leftState,
                                    ExecutionState *rightState,
                                    BranchType reason) noexcept {
-  assert(node && !node->left.getPointer() && !node->right.getPointer());
-  assert(node == rightState->executionTreeNode &&
+  assert(index && !nodes[index].left && !nodes[index].right);
+  assert(index == rightState->executionTreeNode &&
          "Attach assumes the right state is the current state");
-  node->left = ExecutionTreeNodePtr(createNode(node, leftState));
+  ExecutionTreeNodeIndex left = createNode(index, leftState);
   // The current node inherits the tag
-  uint8_t currentNodeTag = root.getInt();
-  if (node->parent)
-    currentNodeTag = node->parent->left.getPointer() == node
-                         ? node->parent->left.getInt()
-                         : node->parent->right.getInt();
-  node->right =
-      ExecutionTreeNodePtr(createNode(node, rightState), currentNodeTag);
-  updateBranchingNode(*node, reason);
-  node->state = nullptr;
+  uint8_t currentNodeTag = getPtrTo(index).getInt();
+  ExecutionTreeNodeIndex right = createNode(index, rightState);
+
+  ExecutionTreeNode &node = nodes[index];
+  node.left = ExecutionTreeNodePtr(left);
+  node.right = ExecutionTreeNodePtr(right, currentNodeTag);
+  updateBranchingNode(index, reason);
+  node.state = nullptr;
 }
 
-void InMemoryExecutionTree::remove(ExecutionTreeNode *n) noexcept {
-  assert(!n->left.getPointer() && !n->right.getPointer());
-  updateTerminatingNode(*n);
+void InMemoryExecutionTree::remove(ExecutionTreeNodeIndex n) noexcept {
+  assert(!nodes[n].left && !nodes[n].right);
+  updateTerminatingNode(n);
   do {
-    ExecutionTreeNode *p = n->parent;
+    ExecutionTreeNodeIndex p = nodes[n].parent;
     if (p) {
-      if (n == p->left.getPointer()) {
-        p->left = ExecutionTreeNodePtr(nullptr);
+      ExecutionTreeNode &parent = nodes[p];
+      if (n == parent.left.getIndex()) {
+        parent.left = ExecutionTreeNodePtr();
       } else {
-        assert(n == p->right.getPointer());
-        p->right = ExecutionTreeNodePtr(nullptr);
+        assert(n == parent.right.getIndex());
+        parent.right = ExecutionTreeNodePtr();
       }
     }
-    delete n;
+    nodes.release(n);
     n = p;
-  } while (n && !n->left.getPointer() && !n->right.getPointer());
+  } while (n && !nodes[n].left && !nodes[n].right);
 
   if (n && CompressExecutionTree) {
     // We are now at a node that has exactly one child; we've just deleted the
     // other one. Eliminate the node and connect its child to the parent
     // directly (if it's not the root).
-    ExecutionTreeNodePtr child = n->left.getPointer() ? n->left : n->right;
-    ExecutionTreeNode *parent = n->parent;
+    ExecutionTreeNode &node = nodes[n];
+    ExecutionTreeNodePtr child = node.left ? node.left : node.right;
+    ExecutionTreeNodeIndex parent = node.parent;
 
-    child.getPointer()->parent = parent;
+    nodes[child.getIndex()].parent = parent;
     if (!parent) {
       // We are at the root
       root = child;
     } else {
-      if (n == parent->left.getPointer()) {
-        parent->left = child;
+      if (n == nodes[parent].left.getIndex()) {
+        nodes[parent].left = child;
       } else {
-        assert(n == parent->right.getPointer());
-        parent->right = child;
+        assert(n == nodes[parent].right.getIndex());
+        nodes[parent].right = child;
       }
     }
 
-    delete n;
+    nodes.release(n);
   }
 }
 
@@ -424,16 +457,44 @@ std::string parseExpression(const std::string &expression) {
   return exprStack.empty() ? "" : exprStack.top();
 }
 
+void InMemoryExecutionTree::dump(llvm::raw_ostream &os) noexcept {
+  os << "digraph G {\n"
+     << "\tsize=\"10,7.5\";\n"
+     << "\tratio=fill;\n"
+     << "\trotate=90;\n"
+     << "\tcenter = \"true\";\n"
+     << "\tnode [style=\"filled\",width=.1,height=.1,fontname=\"Terminus\"]\n"
+     << "\tedge [arrowsize=.3]\n";
+  std::vector<ExecutionTreeNodeIndex> stack;
+  stack.push_back(root.getIndex());
+  while (!stack.empty()) {
+    ExecutionTreeNodeIndex index = stack.back();
+    const ExecutionTreeNode &n = nodes[index];
+    stack.pop_back();
+    os << "\tn" << index << " [shape=diamond";
+    if (n.state)
+      os << ",fillcolor=green";
+    os << "];\n";
+    for (const ExecutionTreeNodePtr *child : {&n.left, &n.right}) {
+      if (!*child)
+        continue;
+      os << "\tn" << index << " -> n" << child->getIndex() << " [label=0b"
+         << std::bitset<PtrBitCount>(child->getInt()).to_string() << "];\n";
+      stack.push_back(child->getIndex());
+    }
+  }
+  os << "}\n";
+}
+
 void InMemoryExecutionTree::dump() noexcept {
 
-  std::vector<const ExecutionTreeNode *> stack;
-  stack.push_back(root.getPointer());
+  std::vector<ExecutionTreeNodeIndex> stack;
+  stack.push_back(root.getIndex());
   while (!stack.empty()) {
-    const ExecutionTreeNode *n = stack.back();
+    ExecutionTreeNodeIndex index = stack.back();
+    const ExecutionTreeNode *n = &nodes[index];
     stack.pop_back();
-    std::stringstream ss;
-    ss << n;
-    std::string npointerStr = ss.str();
+    std::string npointerStr = std::to_string(index);
     Json::Value jsonNode;
     Json::Value jsonConstraints(Json::arrayValue);
     Json::Value jsonChildren(Json::arrayValue);
@@ -497,21 +558,17 @@ void InMemoryExecutionTree::dump() noexcept {
       }
       // jsonNode["memoryObjects"] = jsonMemoryObjects;
     }
-    if (n->left.getPointer()) {
-      std::stringstream ssl;
-      ssl << n->left.getPointer();
-      std::string lpointerStr = ssl.str();
+    if (n->left) {
+      std::string lpointerStr = std::to_string(n->left.getIndex());
       Json::Value jsonValuelchild(lpointerStr);
       jsonChildren.append(jsonValuelchild);
-      stack.push_back(n->left.getPointer());
+      stack.push_back(n->left.getIndex());
     }
-    if (n->right.getPointer()) {
-      std::stringstream ssr;
-      ssr << n->right.getPointer();
-      std::string rpointerStr = ssr.str();
+    if (n->right) {
+      std::string rpointerStr = std::to_string(n->right.getIndex());
       Json::Value jsonValuerchild(rpointerStr);
       jsonChildren.append(jsonValuerchild);
-      stack.push_back(n->right.getPointer());
+      stack.push_back(n->right.getIndex());
     }
 
     bool isExists = false;
@@ -594,8 +651,12 @@ std::uint8_t InMemoryExecutionTree::getNextId() noexcept {
 PersistentExecutionTree::PersistentExecutionTree(
     ExecutionState &initialState, InterpreterHandler &ih) noexcept
     : writer(ih.getOutputFilename("exec_tree.db")) {
-  root = ExecutionTreeNodePtr(createNode(nullptr, &initialState));
-  initialState.executionTreeNode = root.getPointer();
+  root = ExecutionTreeNodePtr(createNode(0, &initialState));
+}
+
+void PersistentExecutionTree::dump(llvm::raw_ostream &os) noexcept {
+  writer.batchCommit(true);
+  InMemoryExecutionTree::dump(os);
 }
 
 void PersistentExecutionTree::dump() noexcept {
@@ -603,39 +664,49 @@ void PersistentExecutionTree::dump() noexcept {
   InMemoryExecutionTree::dump();
 }
 
-ExecutionTreeNode *
-PersistentExecutionTree::createNode(ExecutionTreeNode *parent,
+ExecutionTreeNodeIndex
+PersistentExecutionTree::createNode(ExecutionTreeNodeIndex parent,
                                     ExecutionState *state) {
-  return new AnnotatedExecutionTreeNode(parent, state);
+  ExecutionTreeNodeIndex index =
+      InMemoryExecutionTree::createNode(parent, state);
+  if (index >= annotations.size())
+    annotations.resize(index + 1);
+  annotations[index] = ExecutionTreeNodeAnnotation();
+  annotations[index].id = nextID++;
+  return index;
 }
 
 void PersistentExecutionTree::setTerminationType(ExecutionState &state,
                                                  StateTerminationType type) {
-  auto *annotatedNode =
-      llvm::cast<AnnotatedExecutionTreeNode>(state.executionTreeNode);
-  annotatedNode->kind = type;
+  annotations[state.executionTreeNode].kind = type;
+}
+
+void PersistentExecutionTree::writeNode(ExecutionTreeNodeIndex index) {
+  const ExecutionTreeNode &node = getNode(index);
+  writer.write(annotations[index],
+               node.left ? annotations[node.left.getIndex()].id : 0,
+               node.right ? annotations[node.right.getIndex()].id : 0);
 }
 
-void PersistentExecutionTree::updateBranchingNode(ExecutionTreeNode &node,
+void PersistentExecutionTree::updateBranchingNode(ExecutionTreeNodeIndex index,
                                                   BranchType reason) {
-  auto *annotatedNode = llvm::cast<AnnotatedExecutionTreeNode>(&node);
-  const auto &state = *node.state;
+  auto &annotation = annotations[index];
+  const auto &state = *getNode(index).state;
   const auto prevPC = state.prevPC;
-  annotatedNode->asmLine =
-      prevPC && prevPC->info ? prevPC->info->assemblyLine : 0;
-  annotatedNode->kind = reason;
-  writer.write(*annotatedNode);
+  annotation.asmLine = prevPC && prevPC->info ? prevPC->info->assemblyLine : 0;
+  annotation.kind = reason;
+  writeNode(index);
 }
 
-void PersistentExecutionTree::updateTerminatingNode(ExecutionTreeNode &node) {
-  assert(node.state);
-  auto *annotatedNode = llvm::cast<AnnotatedExecutionTreeNode>(&node);
-  const auto &state = *node.state;
+void PersistentExecutionTree::updateTerminatingNode(
+    ExecutionTreeNodeIndex index) {
+  assert(getNode(index).state);
+  auto &annotation = annotations[index];
+  const auto &state = *getNode(index).state;
   const auto prevPC = state.prevPC;
-  annotatedNode->asmLine =
-      prevPC && prevPC->info ? prevPC->info->assemblyLine : 0;
-  annotatedNode->stateID = state.getID();
-  writer.write(*annotatedNode);
+  annotation.asmLine = prevPC && prevPC->info ? prevPC->info->assemblyLine : 0;
+  annotation.stateID = state.getID();
+  writeNode(index);
 }
 
 // Factory
@@ -17,11 +17,13 @@
 #include "klee/Expr/Expr.h"
 #include "klee/Support/ErrorHandling.h"
 
-#include "llvm/ADT/PointerIntPair.h"
 #include "llvm/Support/Casting.h"
 
+#include <cassert>
 #include <cstdint>
+#include <memory>
 #include <variant>
+#include <vector>
 
 #include <jsoncpp/json/json.h>
 using namespace Json;
@@ -34,57 +36,105 @@ class InterpreterHandler;
 class ExecutionTreeNode;
 class Searcher;
 
+/// Index of a node in the node pool of an InMemoryExecutionTree, 0 for no
+/// node.
+using ExecutionTreeNodeIndex = std::uint32_t;
+
 /* ExecutionTreeNodePtr is used by the Random Path Searcher object to
 efficiently record which ExecutionTreeNode belongs to it. ExecutionTree is a
 global structure that captures all  states, whereas a Random Path Searcher might
 only care about a subset. The integer part of ExecutionTreeNodePtr is a bitmask
-(a "tag") of which Random Path Searchers ExecutionTreeNode belongs to. */
+(a "tag") of which Random Path Searchers ExecutionTreeNode belongs to. It is
+kept in the low bits of a 32-bit node index. */
 constexpr std::uint8_t PtrBitCount = 3;
-using ExecutionTreeNodePtr =
-    llvm::PointerIntPair<ExecutionTreeNode *, PtrBitCount, uint8_t>;
 
-class ExecutionTreeNode {
+class ExecutionTreeNodePtr {
+  std::uint32_t value{0};
+
 public:
-  enum class NodeType : std::uint8_t { Basic, Annotated };
+  static constexpr ExecutionTreeNodeIndex MaxIndex =
+      (std::uint32_t(1) << (32 - PtrBitCount)) - 1;
+
+  ExecutionTreeNodePtr() noexcept = default;
+  explicit ExecutionTreeNodePtr(ExecutionTreeNodeIndex index,
+                                std::uint8_t tag = 0) noexcept
+      : value{(index << PtrBitCount) | tag} {
+    assert(index <= MaxIndex && tag < (1u << PtrBitCount));
+  }
+
+  [[nodiscard]] ExecutionTreeNodeIndex getIndex() const noexcept {
+    return value >> PtrBitCount;
+  }
+  [[nodiscard]] std::uint8_t getInt() const noexcept {
+    return value & ((1u << PtrBitCount) - 1);
+  }
+  void setInt(std::uint8_t tag) noexcept {
+    assert(tag < (1u << PtrBitCount));
+    value = (value & ~((1u << PtrBitCount) - 1)) | tag;
+  }
+  explicit operator bool() const noexcept { return getIndex() != 0; }
+};
 
-  ExecutionTreeNode *parent{nullptr};
+class ExecutionTreeNode {
+public:
+  ExecutionState *state{nullptr};
+  ExecutionTreeNodeIndex parent{0};
   ExecutionTreeNodePtr left;
   ExecutionTreeNodePtr right;
-  ExecutionState *state{nullptr};
-
-  ExecutionTreeNode(ExecutionTreeNode *parent, ExecutionState *state) noexcept;
-  virtual ~ExecutionTreeNode() = default;
-  ExecutionTreeNode(const ExecutionTreeNode &) = delete;
-  ExecutionTreeNode &operator=(ExecutionTreeNode const &) = delete;
-  ExecutionTreeNode(ExecutionTreeNode &&) = delete;
-  ExecutionTreeNode &operator=(ExecutionTreeNode &&) = delete;
-
-  [[nodiscard]] virtual NodeType getType() const { return NodeType::Basic; }
-  static bool classof(const ExecutionTreeNode *N) { return true; }
 };
 
-class AnnotatedExecutionTreeNode : public ExecutionTreeNode {
-  inline static std::uint32_t nextID{1};
+/// @brief Storage for the nodes of an InMemoryExecutionTree
+///
+/// Nodes live in fixed-size chunks and are addressed by 32-bit indices, so
+/// that a node takes 24 bytes and stays at its address. Removed nodes are
+/// kept on a free list for reuse.
+class ExecutionTreeNodePool {
+  static constexpr unsigned ChunkBits = 12;
+  static constexpr ExecutionTreeNodeIndex ChunkSize = 1u << ChunkBits;
+
+  std::vector<std::unique_ptr<ExecutionTreeNode[]>> chunks;
+  /// Number of slots handed out so far, including index 0
+  ExecutionTreeNodeIndex used{1};
+  /// Head of the free list, linked through the parent indices
+  ExecutionTreeNodeIndex freeList{0};
+  std::size_t live{0};
 
 public:
-  std::uint32_t id{0};
-  std::uint32_t stateID{0};
-  std::uint32_t asmLine{0};
-  std::variant<BranchType, StateTerminationType> kind{BranchType::NONE};
-
-  AnnotatedExecutionTreeNode(ExecutionTreeNode *parent,
-                             ExecutionState *state) noexcept;
-  ~AnnotatedExecutionTreeNode() override = default;
+  ExecutionTreeNodePool() noexcept = default;
+  ExecutionTreeNodePool(const ExecutionTreeNodePool &) = delete;
+  ExecutionTreeNodePool &operator=(const ExecutionTreeNodePool &) = delete;
 
-  [[nodiscard]] NodeType getType() const override {
-    return NodeType::Annotated;
+  ExecutionTreeNode &operator[](ExecutionTreeNodeIndex index) noexcept {
+    assert(index && index < used && "invalid execution tree node");
+    return chunks[index >> ChunkBits][index & (ChunkSize - 1)];
+  }
+  const ExecutionTreeNode &
+  operator[](ExecutionTreeNodeIndex index) const noexcept {
+    assert(index && index < used && "invalid execution tree node");
+    return chunks[index >> ChunkBits][index & (ChunkSize - 1)];
   }
 
-  static bool classof(const ExecutionTreeNode *N) {
-    return N->getType() == NodeType::Annotated;
+  /// Return the index of a fresh node.
+  ExecutionTreeNodeIndex allocate();
+  /// Put a node on the free list.
+  void release(ExecutionTreeNodeIndex index) noexcept;
+
+  /// Number of nodes in use
+  [[nodiscard]] std::size_t size() const noexcept { return live; }
+  /// Bytes held by the pool
+  [[nodiscard]] std::size_t capacityInBytes() const noexcept {
+    return chunks.size() * ChunkSize * sizeof(ExecutionTreeNode);
   }
 };
 
+/// @brief Annotations of a node written by a PersistentExecutionTree
+struct ExecutionTreeNodeAnnotation {
+  std::uint32_t id{0};
+  std::uint32_t stateID{0};
+  std::uint32_t asmLine{0};
+  std::variant<BranchType, StateTerminationType> kind{BranchType::NONE};
+};
+
 class ExecutionTree {
 public:
   enum class ExecutionTreeType : std::uint8_t {
@@ -96,13 +146,13 @@ public:
 
   /// Branch from ExecutionTreeNode and attach states, convention: rightState is
   /// parent
-  virtual void attach(ExecutionTreeNode *node, ExecutionState *leftState,
+  virtual void attach(ExecutionTreeNodeIndex node, ExecutionState *leftState,
                       ExecutionState *rightState, BranchType reason) = 0;
   /// Dump execution tree in .dot format into os (debug)
-  // virtual void dump(llvm::raw_ostream &os) = 0;
+  virtual void dump(llvm::raw_ostream &os) = 0;
   virtual void dump() = 0;
   /// Remove node from tree
-  virtual void remove(ExecutionTreeNode *node) = 0;
+  virtual void remove(ExecutionTreeNodeIndex node) = 0;
   /// Set termination type (on state removal)
   virtual void setTerminationType(ExecutionState &state,
                                   StateTerminationType type) {}
@@ -125,12 +175,12 @@ class NoopExecutionTree final : public ExecutionTree {
 public:
   NoopExecutionTree() noexcept = default;
   ~NoopExecutionTree() override = default;
-  void attach(ExecutionTreeNode *node, ExecutionState *leftState,
+  void attach(ExecutionTreeNodeIndex node, ExecutionState *leftState,
               ExecutionState *rightState, BranchType reason) noexcept override {
   }
-  // void dump(llvm::raw_ostream &os) noexcept override;
+  void dump(llvm::raw_ostream &os) noexcept override;
   void dump() noexcept override;
-  void remove(ExecutionTreeNode *node) noexcept override {}
+  void remove(ExecutionTreeNodeIndex node) noexcept override {}
 
   [[nodiscard]] ExecutionTreeType getType() const override {
     return ExecutionTreeType::Noop;
@@ -147,14 +197,19 @@ public:
   ExecutionTreeNodePtr root;
 
 private:
+  ExecutionTreeNodePool nodes;
+
   /// Number of registered IDs ("users", e.g. RandomPathSearcher)
   std::uint8_t registeredIds = 0;
 
-  virtual ExecutionTreeNode *createNode(ExecutionTreeNode *parent,
-                                        ExecutionState *state);
-  virtual void updateBranchingNode(ExecutionTreeNode &node, BranchType reason) {
-  }
-  virtual void updateTerminatingNode(ExecutionTreeNode &node) {}
+  virtual void updateBranchingNode(ExecutionTreeNodeIndex node,
+                                   BranchType reason) {}
+  virtual void updateTerminatingNode(ExecutionTreeNodeIndex node) {}
+
+protected:
+  /// Allocate a node for a state and point the state to it.
+  virtual ExecutionTreeNodeIndex createNode(ExecutionTreeNodeIndex parent,
+                                            ExecutionState *state);
 
 public:
   InMemoryExecutionTree() noexcept = default;
@@ -163,12 +218,25 @@ public:
   void writeToJsonFile(const std::string &filename);
   ~InMemoryExecutionTree() override = default;
 
-  void attach(ExecutionTreeNode *node, ExecutionState *leftState,
+  [[nodiscard]] ExecutionTreeNode &getNode(ExecutionTreeNodeIndex index) {
+    return nodes[index];
+  }
+  [[nodiscard]] const ExecutionTreeNode &
+  getNode(ExecutionTreeNodeIndex index) const {
+    return nodes[index];
+  }
+  /// Return the pointer to a node in its parent, or the root pointer.
+  ExecutionTreeNodePtr &getPtrTo(ExecutionTreeNodeIndex index);
+  [[nodiscard]] const ExecutionTreeNodePool &getNodePool() const {
+    return nodes;
+  }
+
+  void attach(ExecutionTreeNodeIndex node, ExecutionState *leftState,
               ExecutionState *rightState, BranchType reason) noexcept override;
-  // void dump(llvm::raw_ostream &os) noexcept override;
+  void dump(llvm::raw_ostream &os) noexcept override;
   void dump() noexcept override;
   std::uint8_t getNextId() noexcept;
-  void remove(ExecutionTreeNode *node) noexcept override;
+  void remove(ExecutionTreeNodeIndex node) noexcept override;
   bool isSecondElementInJsonArray(Json::Value &jsonArray, std::string &value);
   [[nodiscard]] ExecutionTreeType getType() const override {
     return ExecutionTreeType::InMemory;
@@ -184,17 +252,22 @@ public:
 /// database (exec_tree.db) with a ExecutionTreeWriter
 class PersistentExecutionTree : public InMemoryExecutionTree {
   ExecutionTreeWriter writer;
+  /// Annotations by node index
+  std::vector<ExecutionTreeNodeAnnotation> annotations;
+  std::uint32_t nextID{1};
 
-  ExecutionTreeNode *createNode(ExecutionTreeNode *parent,
-                                ExecutionState *state) override;
-  void updateBranchingNode(ExecutionTreeNode &node, BranchType reason) override;
-  void updateTerminatingNode(ExecutionTreeNode &node) override;
+  ExecutionTreeNodeIndex createNode(ExecutionTreeNodeIndex parent,
+                                    ExecutionState *state) override;
+  void updateBranchingNode(ExecutionTreeNodeIndex node,
+                           BranchType reason) override;
+  void updateTerminatingNode(ExecutionTreeNodeIndex node) override;
+  void writeNode(ExecutionTreeNodeIndex node);
 
 public:
   explicit PersistentExecutionTree(ExecutionState &initialState,
                                    InterpreterHandler &ih) noexcept;
   ~PersistentExecutionTree() override = default;
-  // void dump(llvm::raw_ostream &os) noexcept override;
+  void dump(llvm::raw_ostream &os) noexcept override;
   void dump() noexcept override;
   void setTerminationType(ExecutionState &state,
                           StateTerminationType type) override;
@@ -146,23 +146,16 @@ void ExecutionTreeWriter::batchCommit(bool force) {
   flushed = true;
 }
 
-void ExecutionTreeWriter::write(const AnnotatedExecutionTreeNode &node) {
+void ExecutionTreeWriter::write(const ExecutionTreeNodeAnnotation &node,
+                                std::uint32_t leftID, std::uint32_t rightID) {
   unsigned rc = 0;
 
   // bind values (SQLITE_OK is defined as 0 - just check success once at the
   // end)
   rc |= sqlite3_bind_int64(insertStmt, 1, node.id);
   rc |= sqlite3_bind_int(insertStmt, 2, node.stateID);
-  rc |= sqlite3_bind_int64(
-      insertStmt, 3,
-      node.left.getPointer()
-          ? (static_cast<AnnotatedExecutionTreeNode *>(node.left.getPointer()))->id
-          : 0);
-  rc |= sqlite3_bind_int64(
-      insertStmt, 4,
-      node.right.getPointer()
-          ? (static_cast<AnnotatedExecutionTreeNode *>(node.right.getPointer()))->id
-          : 0);
+  rc |= sqlite3_bind_int64(insertStmt, 3, leftID);
+  rc |= sqlite3_bind_int64(insertStmt, 4, rightID);
   rc |= sqlite3_bind_int(insertStmt, 5, node.asmLine);
   std::uint8_t value{0};
   if (std::holds_alternative<BranchType>(node.kind)) {
@@ -15,7 +15,7 @@
 #include <string>
 
 namespace klee {
-class AnnotatedExecutionTreeNode;
+struct ExecutionTreeNodeAnnotation;
 
 /// @brief Writes execution tree nodes into an SQLite database
 class ExecutionTreeWriter {
@@ -40,7 +40,9 @@ public:
   ExecutionTreeWriter &operator=(ExecutionTreeWriter &&other) noexcept = delete;
 
   /// Write new node into database
-  void write(const AnnotatedExecutionTreeNode &node);
+  /// \param leftID, rightID ids of the children, 0 if none
+  void write(const ExecutionTreeNodeAnnotation &node, std::uint32_t leftID,
+             std::uint32_t rightID);
 };
 
 } // namespace klee
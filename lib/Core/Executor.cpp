@@ -232,6 +232,27 @@ cl::opt<std::size_t> ExternalPageThreshold(
         "used for external calls is above the given threshold (default=1024)."),
     cl::cat(ExtCallsCat));
 
+cl::opt<bool> NativeConcreteCalls(
+    "native-concrete-calls", cl::init(false),
+    cl::desc("Compile calls to module functions to native code and run them "
+             "on the concrete memory of the state when their arguments and "
+             "all memory are concrete. Calls that cannot run natively fall "
+             "back to interpretation. Native code is not checked for memory "
+             "errors and is not covered (default=false)"),
+    cl::cat(ExtCallsCat));
+
+cl::opt<bool> NativeMemoryFunctions(
+    "native-memory-functions", cl::init(true),
+    cl::desc("Execute calls to memcpy, memmove and memset with concrete "
+             "arguments directly on the memory objects instead of "
+             "interpreting them. Definitions in the program under test are "
+             "always interpreted (default=true)"),
+    cl::cat(MiscCat));
+
+/// Function attribute marking the memory functions that the program under
+/// test defines itself. It is kept in modules written by --output-module.
+const char *const ProgramDefinedAttribute = "klee-program-defined";
+
 /*** Seeding options ***/
 
 cl::opt<bool> AlwaysOutputSeeds(
@@ -455,8 +476,20 @@ cl::opt<bool> DebugCheckForImpliedValues(
     "debug-check-for-implied-values", cl::init(false),
     cl::desc("Debug the implied value optimization"), cl::cat(DebugCat));
 
+cl::opt<unsigned> AsyncSolverThreads(
+    "async-solver-threads", cl::init(0),
+    cl::desc("Solve the conditions of symbolic branches on this many worker "
+             "threads while other states keep running. Requires Z3 and a "
+             "build with atomic reference counts (default=0 (off))"),
+    cl::cat(SolvingCat));
+
 } // namespace
 
+namespace klee {
+extern cl::opt<bool> UseExprHashConsing;
+extern cl::opt<bool> UncoveredUpdateInBackground;
+}
+
 // XXX hack
 extern "C" unsigned dumpStates, dumpExecutionTree;
 unsigned dumpStates = 0, dumpExecutionTree = 1;
@@ -465,10 +498,12 @@ Executor::Executor(LLVMContext &ctx, const InterpreterOptions &opts,
                    InterpreterHandler *ih)
     : Interpreter(opts), interpreterHandler(ih), searcher(0),
       externalDispatcher(new ExternalDispatcher(ctx)), statsTracker(0),
-      pathWriter(0), symPathWriter(0), specialFunctionHandler(0),
-      timers{time::Span(TimerInterval)}, replayKTest(0), replayPath(0),
-      usingSeeds(0), atMemoryLimit(false), inhibitForking(false),
-      haltExecution(false), ivcEnabled(false),
+      pathWriter(0), symPathWriter(0), branchWriter(0),
+      specialFunctionHandler(0), timers{time::Span(TimerInterval)},
+      replayKTest(0), replayPath(0), replayBranches(0),
+      replayBranchPosition(0), usingSeeds(0), atMemoryLimit(false),
+      inhibitForking(false), haltExecution(false), donationRequested(0),
+      ivcEnabled(false),
       debugLogBuffer(debugBufferString) {
 
   const time::Span maxTime{MaxTime};
@@ -481,6 +516,15 @@ Executor::Executor(LLVMContext &ctx, const InterpreterOptions &opts,
   coreSolverTimeout = time::Span{MaxCoreSolverTime};
   if (coreSolverTimeout)
     UseForkedCoreSolver = true;
+  if (CoreSolverToUse == PORTFOLIO_SOLVER) {
+    // The portfolio forks for every query, which is only safe while no other
+    // thread may hold locks the solvers need.
+    if (UncoveredUpdateInBackground.getNumOccurrences() &&
+        UncoveredUpdateInBackground)
+      klee_error("--solver-backend=portfolio cannot be combined with "
+                 "--uncovered-update-background");
+    UncoveredUpdateInBackground = false;
+  }
   std::unique_ptr<Solver> coreSolver = klee::createCoreSolver(CoreSolverToUse);
   if (!coreSolver) {
     klee_error("Failed to create core solver\n");
@@ -495,7 +539,39 @@ Executor::Executor(LLVMContext &ctx, const InterpreterOptions &opts,
 
   this->solver =
       std::make_unique<TimingSolver>(std::move(solver), EqualitySubstitution);
+
+  if (AsyncSolverThreads) {
+#ifndef KLEE_ATOMIC_REFCOUNT
+    klee_error("--async-solver-threads requires KLEE to be built with "
+               "-DENABLE_ATOMIC_REFCOUNT=ON");
+#endif
+    if (CoreSolverToUse != Z3_SOLVER)
+      klee_error("--async-solver-threads is only supported with Z3");
+    if (UseExprHashConsing)
+      klee_error("--async-solver-threads cannot be combined with "
+                 "--use-expr-hash-consing");
+
+    std::vector<std::unique_ptr<Solver>> workerSolvers;
+    for (unsigned i = 0; i < AsyncSolverThreads; ++i) {
+      std::string prefix = "worker" + llvm::utostr(i) + "-";
+      std::unique_ptr<Solver> workerSolver = constructSolverChain(
+          klee::createCoreSolver(CoreSolverToUse),
+          interpreterHandler->getOutputFilename(prefix +
+                                                ALL_QUERIES_SMT2_FILE_NAME),
+          interpreterHandler->getOutputFilename(prefix +
+                                                SOLVER_QUERIES_SMT2_FILE_NAME),
+          interpreterHandler->getOutputFilename(prefix +
+                                                ALL_QUERIES_KQUERY_FILE_NAME),
+          interpreterHandler->getOutputFilename(
+              prefix + SOLVER_QUERIES_KQUERY_FILE_NAME));
+      workerSolver->setCoreSolverTimeout(coreSolverTimeout);
+      workerSolvers.push_back(std::move(workerSolver));
+    }
+    asyncSolver = std::make_unique<AsyncSolver>(std::move(workerSolvers));
+  }
   memory = std::make_unique<MemoryManager>(&arrayCache);
+  // only native calls check whether all memory is concrete
+  AddressSpace::trackSymbolicObjects(NativeConcreteCalls);
 
   initializeSearchOptions();
 
@@ -526,14 +602,8 @@ Executor::Executor(LLVMContext &ctx, const InterpreterOptions &opts,
   }
 }
 
-llvm::Module *
-Executor::setModule(std::vector<std::unique_ptr<llvm::Module>> &modules,
-                    const ModuleOptions &opts) {
-  assert(!kmodule && !modules.empty() &&
-         "can only register one module"); // XXX gross
-
-  kmodule = std::unique_ptr<KModule>(new KModule());
-
+void Executor::prepareModule(std::vector<std::unique_ptr<llvm::Module>> &modules,
+                             const ModuleOptions &opts) {
   // Preparing the final module happens in multiple stages
 
   // Link with KLEE intrinsics library before running any optimizations
@@ -556,7 +626,6 @@ Executor::setModule(std::vector<std::unique_ptr<llvm::Module>> &modules,
 
   // Create a list of functions that should be preserved if used
   std::vector<const char *> preservedFunctions;
-  specialFunctionHandler = new SpecialFunctionHandler(*this);
   specialFunctionHandler->prepare(preservedFunctions);
 
   preservedFunctions.push_back(opts.EntryPoint.c_str());
@@ -568,6 +637,32 @@ Executor::setModule(std::vector<std::unique_ptr<llvm::Module>> &modules,
   preservedFunctions.push_back("memmove");
 
   kmodule->optimiseAndPrepare(opts, preservedFunctions);
+}
+
+llvm::Module *
+Executor::setModule(std::vector<std::unique_ptr<llvm::Module>> &modules,
+                    const ModuleOptions &opts) {
+  assert(!kmodule && !modules.empty() &&
+         "can only register one module"); // XXX gross
+
+  kmodule = std::unique_ptr<KModule>(new KModule());
+  specialFunctionHandler = new SpecialFunctionHandler(*this);
+
+  if (opts.Prepared) {
+    // The module is already in its final form.
+    assert(modules.size() == 1 && "a prepared module is not linked");
+    kmodule->usePrepared(std::move(modules.front()), opts);
+    modules.clear();
+  } else {
+    // The first module is the program under test, whose own memory
+    // functions must not be replaced by native ones.
+    for (const char *name : {"memcpy", "memmove", "memset"}) {
+      Function *f = modules.front()->getFunction(name);
+      if (f && !f->isDeclaration())
+        f->addFnAttr(ProgramDefinedAttribute);
+    }
+    prepareModule(modules, opts);
+  }
   kmodule->checkModule();
 
   // 4.) Manifest the module
@@ -575,6 +670,16 @@ Executor::setModule(std::vector<std::unique_ptr<llvm::Module>> &modules,
 
   specialFunctionHandler->bind();
 
+  if (NativeMemoryFunctions) {
+    for (const auto &entry : {std::make_pair("memcpy", MemoryFunction::Memcpy),
+                              std::make_pair("memmove", MemoryFunction::Memmove),
+                              std::make_pair("memset", MemoryFunction::Memset)}) {
+      Function *f = kmodule->module->getFunction(entry.first);
+      if (f && !f->hasFnAttribute(ProgramDefinedAttribute))
+        memoryFunctions[f] = entry.second;
+    }
+  }
+
   if (StatsTracker::useStatistics() || userSearcherRequiresMD2U()) {
     statsTracker = new StatsTracker(
         *this, interpreterHandler->getOutputFilename("assembly.ll"),
@@ -873,6 +978,60 @@ bool Executor::branchingPermitted(const ExecutionState &state) const {
   return true;
 }
 
+void Executor::recordBranch(ExecutionState &state, std::uint32_t decision,
+                            bool wide) {
+  if (!branchWriter)
+    return;
+
+  if (wide) {
+    char buffer[4];
+    for (unsigned i = 0; i < 4; ++i)
+      buffer[i] = static_cast<char>((decision >> (8 * i)) & 0xFF);
+    state.branchOS.write(buffer, 4);
+  } else {
+    char c = static_cast<char>(decision);
+    state.branchOS.write(&c, 1);
+  }
+}
+
+std::uint32_t Executor::nextReplayBranch(bool wide) {
+  const std::vector<unsigned char> &branches = *replayBranches;
+  unsigned size = wide ? 4 : 1;
+  if (replayBranchPosition + size > branches.size())
+    klee_error("branch trail does not match the executed program");
+
+  std::uint32_t decision = 0;
+  for (unsigned i = 0; i < size; ++i)
+    decision |= std::uint32_t(branches[replayBranchPosition++]) << (8 * i);
+  return decision;
+}
+
+void Executor::donateState() {
+  donationRequested = 0;
+
+  // keep at least one state and never hand out a half-replayed trail
+  if (!branchWriter || states.size() < 2 || isReplayingBranches())
+    return;
+
+  // the shallowest state most likely has the largest subtree left
+  ExecutionState *donated = nullptr;
+  for (const auto &es : states) {
+    if (seedMap.count(es))
+      continue;
+    if (!donated || es->depth < donated->depth)
+      donated = es;
+  }
+  if (!donated)
+    return;
+
+  std::vector<unsigned char> branches;
+  branchWriter->readStream(donated->branchOS.getID(), branches);
+  interpreterHandler->processDonatedState(branches);
+  terminateStateEarlyAlgorithm(*donated, "State donated.",
+                               StateTerminationType::Donation);
+  updateStates(nullptr);
+}
+
 void Executor::branch(ExecutionState &state,
                       const std::vector<ref<Expr>> &conditions,
                       std::vector<ExecutionState *> &result,
@@ -881,7 +1040,13 @@ void Executor::branch(ExecutionState &state,
   unsigned N = conditions.size();
   assert(N);
 
-  if (!branchingPermitted(state)) {
+  if (N > 1 && isReplayingBranches()) {
+    unsigned next = nextReplayBranch(true);
+    assert(next < N && "hit invalid branch in branch replay");
+    for (unsigned i = 0; i < N; ++i)
+      result.push_back(i == next ? &state : nullptr);
+    recordBranch(state, next, true);
+  } else if (!branchingPermitted(state)) {
     unsigned next = theRNG.getInt32() % N;
     for (unsigned i = 0; i < N; ++i) {
       if (i == next) {
@@ -891,6 +1056,8 @@ void Executor::branch(ExecutionState &state,
       }
     }
     stats::inhibitedForks += N - 1;
+    if (N > 1)
+      recordBranch(state, next, true);
   } else {
     stats::forks += N - 1;
     stats::incBranchStat(reason, N - 1);
@@ -900,10 +1067,15 @@ void Executor::branch(ExecutionState &state,
     for (unsigned i = 1; i < N; ++i) {
       ExecutionState *es = result[theRNG.getInt32() % i];
       ExecutionState *ns = es->branch();
+      if (branchWriter)
+        ns->branchOS = branchWriter->open(es->branchOS);
       addedStates.push_back(ns);
       result.push_back(ns);
       executionTree->attach(es->executionTreeNode, ns, es, reason);
     }
+    if (N > 1)
+      for (unsigned i = 0; i < N; ++i)
+        recordBranch(*result[i], i, true);
   }
 
   // If necessary redistribute seeds to match conditions, killing
@@ -1018,30 +1190,45 @@ ref<Expr> Executor::maxStaticPctChecks(ExecutionState &current,
 }
 
 Executor::StatePair Executor::fork(ExecutionState &current, ref<Expr> condition,
-                                   bool isInternal, BranchType reason) {
+                                   bool isInternal, BranchType reason,
+                                   const Solver::Validity *knownValidity) {
   Solver::Validity res;
   std::map<ExecutionState *, std::vector<SeedInfo>>::iterator it =
       seedMap.find(&current);
   bool isSeeding = it != seedMap.end();
 
-  if (!isSeeding)
-    condition = maxStaticPctChecks(current, condition);
-
-  time::Span timeout = coreSolverTimeout;
-  if (isSeeding)
-    timeout *= static_cast<unsigned>(it->second.size());
-  solver->setTimeout(timeout);
-  bool success = solver->evaluate(current.constraints, condition, res,
-                                  current.queryMetaData);
-  solver->setTimeout(time::Span());
-  if (!success) {
-    current.pc = current.prevPC;
-    terminateStateOnSolverError(current, "Query timed out (fork).");
-    return StatePair(nullptr, nullptr);
+  if (knownValidity) {
+    // the static limits were applied before the condition was solved
+    res = *knownValidity;
+  } else {
+    if (!isSeeding)
+      condition = maxStaticPctChecks(current, condition);
+
+    time::Span timeout = coreSolverTimeout;
+    if (isSeeding)
+      timeout *= static_cast<unsigned>(it->second.size());
+    solver->setTimeout(timeout);
+    bool success = solver->evaluate(current.constraints, condition, res,
+                                    current.queryMetaData);
+    solver->setTimeout(time::Span());
+    if (!success) {
+      current.pc = current.prevPC;
+      terminateStateOnSolverError(current, "Query timed out (fork).");
+      return StatePair(nullptr, nullptr);
+    }
   }
 
   if (!isSeeding) {
-    if (replayPath && !isInternal) {
+    if (res == Solver::Unknown && isReplayingBranches()) {
+      if (nextReplayBranch(false)) {
+        res = Solver::True;
+        addConstraint(current, condition);
+      } else {
+        res = Solver::False;
+        addConstraint(current, Expr::createIsZero(condition));
+      }
+      recordBranch(current, res == Solver::True, false);
+    } else if (replayPath && !isInternal) {
       assert(replayPosition < replayPath->size() &&
              "ran out of branches in replay path mode");
       bool branch = (*replayPath)[replayPosition++];
@@ -1073,6 +1260,7 @@ Executor::StatePair Executor::fork(ExecutionState &current, ref<Expr> condition,
           res = Solver::False;
         }
         ++stats::inhibitedForks;
+        recordBranch(current, res == Solver::True, false);
       }
     }
   }
@@ -1199,6 +1387,11 @@ Executor::StatePair Executor::fork(ExecutionState &current, ref<Expr> condition,
         falseState->symPathOS << "0";
       }
     }
+    if (branchWriter) {
+      falseState->branchOS = branchWriter->open(current.branchOS);
+      recordBranch(*trueState, 1, false);
+      recordBranch(*falseState, 0, false);
+    }
 
     addConstraint(*trueState, condition);
     addConstraint(*falseState, Expr::createIsZero(condition));
@@ -1216,6 +1409,78 @@ Executor::StatePair Executor::fork(ExecutionState &current, ref<Expr> condition,
   }
 }
 
+void Executor::executeBranch(ExecutionState &state, KInstruction *ki,
+                             ref<Expr> condition,
+                             const Solver::Validity *knownValidity) {
+  Executor::StatePair branches =
+      fork(state, condition, false, BranchType::Conditional, knownValidity);
+
+  // NOTE: There is a hidden dependency here, markBranchVisited
+  // requires that we still be in the context of the branch
+  // instruction (it reuses its statistic id). Should be cleaned
+  // up with convenient instruction specific data.
+  if (statsTracker && state.stack.back().kf->trackCoverage)
+    statsTracker->markBranchVisited(branches.first, branches.second);
+
+  if (branches.first)
+    transferToBasicBlock(ki, 0, *branches.first);
+  if (branches.second)
+    transferToBasicBlock(ki, 1, *branches.second);
+}
+
+bool Executor::suspendOnBranch(ExecutionState &state, KInstruction *ki,
+                               ref<Expr> condition) {
+  // seeding and replay decide branches in lock step with the solver, and
+  // merging tracks the states of a merge region itself
+  if (!searcher || seedMap.count(&state) || replayPath ||
+      isReplayingBranches() || !state.openMergeStack.empty())
+    return false;
+
+  condition = maxStaticPctChecks(state, condition);
+  if (isa<ConstantExpr>(condition))
+    return false;
+  ref<Expr> query = solver->simplifyExprs
+                        ? ConstraintManager::simplifyExpr(state.constraints,
+                                                          condition)
+                        : condition;
+  if (isa<ConstantExpr>(query))
+    return false;
+
+  AsyncSolver::Ticket ticket = asyncSolver->submit(state.constraints, query);
+  suspendedStates[&state] = {ticket, ki, condition};
+  suspendedTickets[ticket] = &state;
+  newlySuspendedStates.push_back(&state);
+  return true;
+}
+
+void Executor::resumeStates(bool wait) {
+  std::vector<AsyncSolver::Result> results;
+  asyncSolver->collect(results, wait);
+
+  for (const auto &result : results) {
+    auto ticket = suspendedTickets.find(result.ticket);
+    if (ticket == suspendedTickets.end())
+      continue; // the state has been terminated in the meantime
+    ExecutionState &state = *ticket->second;
+    suspendedTickets.erase(ticket);
+    auto suspended = suspendedStates.find(&state);
+    SuspendedBranch branch = suspended->second;
+    suspendedStates.erase(suspended);
+
+    searcher->update(nullptr, {&state}, {});
+    ++stats::queries;
+    state.queryMetaData.queryCost += result.time;
+    theStatisticManager->setIndex(branch.ki->info->id);
+    if (result.success) {
+      executeBranch(state, branch.ki, branch.condition, &result.validity);
+    } else {
+      state.pc = state.prevPC;
+      terminateStateOnSolverError(state, "Query timed out (fork).");
+    }
+    updateStates(nullptr);
+  }
+}
+
 void Executor::addConstraint(ExecutionState &state, ref<Expr> condition) {
   if (ConstantExpr *CE = dyn_cast<ConstantExpr>(condition)) {
     if (!CE->isTrue())
@@ -1677,11 +1942,159 @@ ref<klee::ConstantExpr> Executor::getEhTypeidFor(ref<Expr> type_info) {
   return res;
 }
 
+bool Executor::executeMemoryFunction(ExecutionState &state, KInstruction *ki,
+                                     MemoryFunction kind,
+                                     const std::vector<ref<Expr>> &arguments) {
+  // Symbolic pointers and sizes, and accesses out of bounds, are left to the
+  // interpreted function, which forks and reports errors per access.
+  if (arguments.size() != 3)
+    return false;
+  auto dst = dyn_cast<ConstantExpr>(arguments[0]);
+  auto size = dyn_cast<ConstantExpr>(arguments[2]);
+  if (!dst || !size || size->getWidth() > Expr::Int64)
+    return false;
+  uint64_t n = size->getZExtValue();
+
+  auto resolveRange = [&](const ref<ConstantExpr> &address, ObjectPair &op,
+                          unsigned &offset) {
+    if (address->getWidth() != Context::get().getPointerWidth() ||
+        !state.addressSpace.resolveOne(address, op))
+      return false;
+    uint64_t base = address->getZExtValue() - op.first->address;
+    if (n > op.first->size || base > op.first->size - n)
+      return false;
+    offset = base;
+    return true;
+  };
+
+  if (n) {
+    ObjectPair dstOp;
+    unsigned dstOffset;
+    if (!resolveRange(dst, dstOp, dstOffset) || dstOp.second->readOnly)
+      return false;
+
+    if (kind == MemoryFunction::Memset) {
+      ref<Expr> value = ExtractExpr::create(arguments[1], 0, Expr::Int8);
+      ObjectState *wos =
+          state.addressSpace.getWriteable(dstOp.first, dstOp.second);
+      if (auto CE = dyn_cast<ConstantExpr>(value)) {
+        std::vector<uint8_t> bytes(n, CE->getZExtValue(8));
+        wos->writeConcrete(dstOffset, bytes.data(), n);
+      } else {
+        for (unsigned i = 0; i < n; ++i)
+          wos->write(dstOffset + i, value);
+      }
+    } else {
+      auto src = dyn_cast<ConstantExpr>(arguments[1]);
+      ObjectPair srcOp;
+      unsigned srcOffset;
+      if (!src || !resolveRange(src, srcOp, srcOffset))
+        return false;
+
+      // Read the whole source first, the ranges may overlap.
+      const ObjectState *os = srcOp.second;
+      std::vector<uint8_t> bytes(n);
+      if (os->readConcrete(srcOffset, bytes.data(), n)) {
+        ObjectState *wos =
+            state.addressSpace.getWriteable(dstOp.first, dstOp.second);
+        wos->writeConcrete(dstOffset, bytes.data(), n);
+      } else {
+        std::vector<ref<Expr>> values;
+        values.reserve(n);
+        for (unsigned i = 0; i < n; ++i)
+          values.push_back(os->read8(srcOffset + i));
+        ObjectState *wos =
+            state.addressSpace.getWriteable(dstOp.first, dstOp.second);
+        for (unsigned i = 0; i < n; ++i)
+          wos->write(dstOffset + i, values[i]);
+      }
+    }
+  }
+
+  // All three functions return the destination.
+  if (!ki->inst->getType()->isVoidTy())
+    bindLocal(ki, state, arguments[0]);
+  return true;
+}
+
+bool Executor::executeNativeCall(ExecutionState &state, KInstruction *ki,
+                                 KFunction *kf,
+                                 const std::vector<ref<Expr>> &arguments) {
+  // The arguments are passed like those of external calls, which support
+  // neither variadic functions nor aggregates passed by value.
+  const Function *f = kf->function;
+  if (f->isVarArg() || arguments.size() != f->arg_size())
+    return false;
+  for (const Argument &arg : f->args())
+    if (arg.hasByValAttr() || arg.hasInAllocaAttr() ||
+        arg.hasPreallocatedAttr() || arg.getType()->isAggregateType() ||
+        arg.getType()->isVectorTy())
+      return false;
+  Type *resultType = f->getReturnType();
+  if (resultType->isAggregateType() || resultType->isVectorTy())
+    return false;
+
+  size_t allocatedBytes = Expr::MaxWidth / 8 * (arguments.size() + 1);
+  uint64_t *args = (uint64_t *)alloca(allocatedBytes);
+  memset(args, 0, allocatedBytes);
+  unsigned wordIndex = 2;
+  for (const ref<Expr> &arg : arguments) {
+    auto *ce = dyn_cast<ConstantExpr>(arg.get());
+    if (!ce)
+      return false;
+    // fp80 must be aligned to 16 according to the System V AMD 64 ABI
+    if (ce->getWidth() == Expr::Fl80 && wordIndex & 0x01)
+      wordIndex++;
+    ce->toMemory(&args[wordIndex]);
+    wordIndex += (ce->getWidth() + 63) / 64;
+  }
+
+  // Symbolic bytes cannot be represented in native memory.
+  if (state.addressSpace.hasSymbolicObjects())
+    return false;
+
+  state.addressSpace.copyOutConcretes();
+  memory->trackWrites();
+  bool success = externalDispatcher->executeNativeCall(
+      kf, ki->inst, args,
+      [this](const GlobalValue *gv, uint64_t &address) {
+        auto it = globalAddresses.find(gv);
+        if (it == globalAddresses.end())
+          return false;
+        address = it->second->getZExtValue();
+        return true;
+      });
+  if (!success)
+    return false;
+
+  MemoryManager::AddressRanges written;
+  memory->getWrittenRanges(written);
+  if (!state.addressSpace.copyInConcretes(written)) {
+    terminateStateOnExecError(state, "native call modified read-only object",
+                              StateTerminationType::External);
+    return true;
+  }
+  if (!resultType->isVoidTy())
+    bindLocal(ki, state,
+              ConstantExpr::fromMemory((void *)args,
+                                       getWidthForLLVMType(resultType)));
+  return true;
+}
+
 void Executor::executeCall(ExecutionState &state, KInstruction *ki, Function *f,
                            std::vector<ref<Expr>> &arguments) {
   Instruction *i = ki->inst;
   if (isa_and_nonnull<DbgInfoIntrinsic>(i))
     return;
+  if (f && !memoryFunctions.empty()) {
+    auto it = memoryFunctions.find(f);
+    if (it != memoryFunctions.end() &&
+        executeMemoryFunction(state, ki, it->second, arguments)) {
+      if (isa<InvokeInst>(i))
+        transferToBasicBlock(ki, 0, state);
+      return;
+    }
+  }
   if (f && f->isDeclaration()) {
     switch (f->getIntrinsicID()) {
     case Intrinsic::not_intrinsic: {
@@ -1894,8 +2307,8 @@ void Executor::executeCall(ExecutionState &state, KInstruction *ki, Function *f,
       return;
     }
 
-    if (InvokeInst *ii = dyn_cast<InvokeInst>(i)) {
-      transferToBasicBlock(ii->getNormalDest(), i->getParent(), state);
+    if (isa<InvokeInst>(i)) {
+      transferToBasicBlock(ki, 0, state);
     }
   } else {
     // Check if maximum stack size was reached.
@@ -1913,6 +2326,10 @@ void Executor::executeCall(ExecutionState &state, KInstruction *ki, Function *f,
     // from just an instruction (unlike LLVM).
     KFunction *kf = kmodule->functionMap[f];
 
+    if (NativeConcreteCalls && isa<CallInst>(i) &&
+        executeNativeCall(state, ki, kf, arguments))
+      return;
+
     state.pushFrame(state.prevPC, kf);
     state.pc = kf->instructions;
 
@@ -2051,16 +2468,27 @@ void Executor::transferToBasicBlock(BasicBlock *dst, BasicBlock *src,
   // With that done we simply set an index in the state so that PHI
   // instructions know which argument to eval, set the pc, and continue.
 
-  // XXX this lookup has to go ?
+  // Only used where the destination is known at run time alone, such as
+  // for indirect branches and unwinding. Other transfers use the
+  // successors resolved in their KTerminatorInstruction.
   KFunction *kf = state.stack.back().kf;
   unsigned entry = kf->basicBlockEntry[dst];
   state.pc = &kf->instructions[entry];
-  if (state.pc->inst->getOpcode() == Instruction::PHI) {
+  if (state.pc->opcode == Instruction::PHI) {
     PHINode *first = static_cast<PHINode *>(state.pc->inst);
     state.incomingBBIndex = first->getBasicBlockIndex(src);
   }
 }
 
+void Executor::transferToBasicBlock(KInstruction *ki, unsigned successor,
+                                    ExecutionState &state) {
+  const KTerminatorInstruction::Successor &dst =
+      static_cast<KTerminatorInstruction *>(ki)->successors[successor];
+  state.pc = &state.stack.back().kf->instructions[dst.entry];
+  if (dst.incomingBBIndex >= 0)
+    state.incomingBBIndex = dst.incomingBBIndex;
+}
+
 /// Compute the true target of a function call, resolving LLVM aliases
 /// and bitcasts.
 Function *Executor::getTargetFunction(llvm::Value *calledVal) {
@@ -2093,7 +2521,7 @@ Function *Executor::getTargetFunction(llvm::Value *calledVal) {
 
 void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   Instruction *i = ki->inst;
-  switch (i->getOpcode()) {
+  switch (ki->opcode) {
     // Control flow
   case Instruction::Ret: {
     ReturnInst *ri = cast<ReturnInst>(i);
@@ -2115,8 +2543,8 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
       if (statsTracker)
         statsTracker->framePopped(state);
 
-      if (InvokeInst *ii = dyn_cast<InvokeInst>(caller)) {
-        transferToBasicBlock(ii->getNormalDest(), caller->getParent(), state);
+      if (isa<InvokeInst>(caller)) {
+        transferToBasicBlock(kcaller, 0, state);
       } else {
         state.pc = kcaller;
         ++state.pc;
@@ -2194,29 +2622,15 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   case Instruction::Br: {
     BranchInst *bi = cast<BranchInst>(i);
     if (bi->isUnconditional()) {
-      transferToBasicBlock(bi->getSuccessor(0), bi->getParent(), state);
+      transferToBasicBlock(ki, 0, state);
     } else {
       // FIXME: Find a way that we don't have this hidden dependency.
       assert(bi->getCondition() == bi->getOperand(0) && "Wrong operand index!");
       ref<Expr> cond = eval(ki, 0, state).value;
 
       cond = optimizer.optimizeExpr(cond, false);
-      Executor::StatePair branches =
-          fork(state, cond, false, BranchType::Conditional);
-
-      // NOTE: There is a hidden dependency here, markBranchVisited
-      // requires that we still be in the context of the branch
-      // instruction (it reuses its statistic id). Should be cleaned
-      // up with convenient instruction specific data.
-      if (statsTracker && state.stack.back().kf->trackCoverage)
-        statsTracker->markBranchVisited(branches.first, branches.second);
-
-      if (branches.first)
-        transferToBasicBlock(bi->getSuccessor(0), bi->getParent(),
-                             *branches.first);
-      if (branches.second)
-        transferToBasicBlock(bi->getSuccessor(1), bi->getParent(),
-                             *branches.second);
+      if (!asyncSolver || !suspendOnBranch(state, ki, cond))
+        executeBranch(state, ki, cond);
     }
     break;
   }
@@ -2306,12 +2720,15 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
 
     cond = toUnique(state, cond);
     if (ConstantExpr *CE = dyn_cast<ConstantExpr>(cond)) {
-      // Somewhat gross to create these all the time, but fine till we
-      // switch to an internal rep.
-      llvm::IntegerType *Ty = cast<IntegerType>(si->getCondition()->getType());
-      ConstantInt *ci = ConstantInt::get(Ty, CE->getZExtValue());
-      unsigned index = si->findCaseValue(ci)->getSuccessorIndex();
-      transferToBasicBlock(si->getSuccessor(index), si->getParent(), state);
+      unsigned index;
+      if (CE->getWidth() <= 64) {
+        index = static_cast<KSwitchInstruction *>(ki)->getSuccessorIndex(
+            CE->getZExtValue());
+      } else {
+        ConstantInt *ci = ConstantInt::get(si->getContext(), CE->getAPValue());
+        index = si->findCaseValue(ci)->getSuccessorIndex();
+      }
+      transferToBasicBlock(ki, index, state);
     } else {
       // Handle possible different branch targets
 
@@ -2666,10 +3083,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     // Compare
 
   case Instruction::ICmp: {
-    CmpInst *ci = cast<CmpInst>(i);
-    ICmpInst *ii = cast<ICmpInst>(ci);
-
-    switch (ii->getPredicate()) {
+    switch (ki->predicate) {
     case ICmpInst::ICMP_EQ: {
       ref<Expr> left = eval(ki, 0, state).value;
       ref<Expr> right = eval(ki, 1, state).value;
@@ -3088,7 +3502,6 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
 
   case Instruction::FCmp: {
-    FCmpInst *fi = cast<FCmpInst>(i);
     ref<ConstantExpr> left =
         toConstant(state, eval(ki, 0, state).value, "floating point");
     ref<ConstantExpr> right =
@@ -3102,7 +3515,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     APFloat::cmpResult CmpRes = LHS.compare(RHS);
 
     bool Result = false;
-    switch (fi->getPredicate()) {
+    switch (ki->predicate) {
       // Predicates which only care about whether or not the operands are NaNs.
     case FCmpInst::FCMP_ORD:
       Result = (CmpRes != APFloat::cmpUnordered);
@@ -3407,7 +3820,10 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
 void Executor::updateStates(ExecutionState *current) {
   if (searcher) {
     searcher->update(current, addedStates, removedStates);
+    if (!newlySuspendedStates.empty())
+      searcher->update(nullptr, {}, newlySuspendedStates);
   }
+  newlySuspendedStates.clear();
 
   states.insert(addedStates.begin(), addedStates.end());
   addedStates.clear();
@@ -3709,15 +4125,25 @@ void Executor::run(ExecutionState &initialState) {
   std::vector<ExecutionState *> newStates(states.begin(), states.end());
   searcher->update(0, newStates, std::vector<ExecutionState *>());
 
-  std::thread commandListener(listenForCommands);
+  // Jobs of a distributed exploration (see setBranchWriter()) run
+  // unattended and do not take debugger commands.
+  std::thread commandListener;
+  if (!branchWriter) {
+    commandListener = std::thread(listenForCommands);
 
-  {
     std::unique_lock<std::mutex> lock(mtx);
     cv.wait(lock, [] { return initialBreakpointReceived; });
   }
 
   // main interpreter loop
   while (!states.empty() && !haltExecution) {
+    if (asyncSolver) {
+      // only wait for the solver when every state is suspended
+      resumeStates(searcher->empty());
+      if (searcher->empty())
+        continue;
+    }
+
     ExecutionState &state = searcher->selectState();
     KInstruction *ki = state.pc;
 
@@ -3809,15 +4235,25 @@ void Executor::run(ExecutionState &initialState) {
       // pressure
       updateStates(nullptr);
     }
+
+    if (donationRequested)
+      donateState();
   }
 
-  {
-    std::lock_guard<std::mutex> lock(mtx);
-    listening = false;
+  if (commandListener.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      listening = false;
+    }
+    cv.notify_one();
+
+    commandListener.join();
   }
-  cv.notify_one(); 
 
-  commandListener.join();
+  if (asyncSolver)
+    asyncSolver->cancel();
+  // count what the solver workers did before statistics are written
+  theStatisticManager->mergeThreadStats();
 
   delete searcher;
   searcher = nullptr;
@@ -3885,6 +4321,20 @@ void Executor::terminateState(ExecutionState &state,
   interpreterHandler->incPathsExplored();
   executionTree->setTerminationType(state, reason);
 
+  auto suspended = suspendedStates.find(&state);
+  if (suspended != suspendedStates.end()) {
+    // drop the outstanding query and hand the state back to the searcher,
+    // so that it is removed like any other
+    suspendedTickets.erase(suspended->second.ticket);
+    suspendedStates.erase(suspended);
+    auto it = std::find(newlySuspendedStates.begin(),
+                        newlySuspendedStates.end(), &state);
+    if (it != newlySuspendedStates.end())
+      newlySuspendedStates.erase(it);
+    else if (searcher)
+      searcher->update(nullptr, {&state}, {});
+  }
+
   std::vector<ExecutionState *>::iterator it =
       std::find(addedStates.begin(), addedStates.end(), &state);
   if (it == addedStates.end()) {
@@ -4187,7 +4637,12 @@ void Executor::callExternalFunction(ExecutionState &state, KInstruction *target,
     std::size_t neededPages = state.addressSpace.copyOutConcretes();
     auto newPages = minflt() - tmp;
     assert(newPages >= 0);
-    residentPages += newPages;
+    // Writing to write-protected pages faults as well, so count the resident
+    // pages instead when writes are tracked.
+    if (memory->trackWrites())
+      residentPages = memory->getResidentPages();
+    else
+      residentPages += newPages;
     assert(residentPages >= neededPages &&
            "allocator too full, assumption that each object occupies its own "
            "page is no longer true");
@@ -4247,7 +4702,9 @@ void Executor::callExternalFunction(ExecutionState &state, KInstruction *target,
     return;
   }
 
-  if (!state.addressSpace.copyInConcretes()) {
+  MemoryManager::AddressRanges written;
+  memory->getWrittenRanges(written);
+  if (!state.addressSpace.copyInConcretes(written)) {
     terminateStateOnExecError(state, "external modified read-only object",
                               StateTerminationType::External);
     return;
@@ -4256,6 +4713,7 @@ void Executor::callExternalFunction(ExecutionState &state, KInstruction *target,
   if (MemoryManager::isDeterministic && residentPages > ExternalPageThreshold &&
       residentPages > 2 * avgNeededPages) {
     if (memory->markMappingsAsUnneeded()) {
+      AddressSpace::forgetNativeMemory();
       residentPages = 0;
     }
   }
@@ -4851,6 +5309,8 @@ void Executor::runFunctionAsMain(Function *f, int argc, char **argv,
     state->pathOS = pathWriter->open();
   if (symPathWriter)
     state->symPathOS = symPathWriter->open();
+  if (branchWriter)
+    state->branchOS = branchWriter->open();
 
   if (statsTracker)
     statsTracker->framePushed(*state, 0);
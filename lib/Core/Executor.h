@@ -15,6 +15,7 @@
 #ifndef KLEE_EXECUTOR_H
 #define KLEE_EXECUTOR_H
 
+#include "AsyncSolver.h"
 #include "ExecutionState.h"
 #include "UserSearcher.h"
 
@@ -32,6 +33,7 @@
 #include "llvm/ADT/Twine.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <csignal>
 #include <map>
 #include <memory>
 #include <set>
@@ -112,8 +114,13 @@ private:
   std::unique_ptr<MemoryManager> memory;
   std::set<ExecutionState*, ExecutionStateIDCompare> states;
   StatsTracker *statsTracker;
-  TreeStreamWriter *pathWriter, *symPathWriter;
+  TreeStreamWriter *pathWriter, *symPathWriter, *branchWriter;
   SpecialFunctionHandler *specialFunctionHandler;
+
+  /// The libc memory functions executed natively, i.e. those not defined
+  /// by the program under test
+  enum class MemoryFunction { Memcpy, Memmove, Memset };
+  std::map<const llvm::Function *, MemoryFunction> memoryFunctions;
   TimerGroup timers;
   std::unique_ptr<ExecutionTree> executionTree;
 
@@ -128,6 +135,30 @@ private:
   /// \invariant \ref addedStates and \ref removedStates are disjoint.
   std::vector<ExecutionState *> removedStates;
 
+  /// Answers conditional branch queries on worker threads if
+  /// --async-solver-threads is set, null otherwise.
+  std::unique_ptr<AsyncSolver> asyncSolver;
+
+  /// A conditional branch waiting for the feasibility of its condition.
+  struct SuspendedBranch {
+    AsyncSolver::Ticket ticket;
+    KInstruction *ki;
+    ref<Expr> condition;
+  };
+
+  /// States suspended on a conditional branch. They stay in \ref states
+  /// but are held back from the searcher until their query is answered.
+  std::map<ExecutionState *, SuspendedBranch> suspendedStates;
+
+  /// The suspended state waiting for each outstanding query.
+  std::unordered_map<AsyncSolver::Ticket, ExecutionState *> suspendedTickets;
+
+  /// States suspended during the current instruction step, which still
+  /// have to be taken out of the searcher.
+  /// \invariant \ref newlySuspendedStates is a subset of the keys of
+  /// \ref suspendedStates.
+  std::vector<ExecutionState *> newlySuspendedStates;
+
   /// When non-empty the Executor is running in "seed" mode. The
   /// states in this map will be executed in an arbitrary order
   /// (outside the normal search interface) until they terminate. When
@@ -159,6 +190,13 @@ private:
   /// object.
   unsigned replayPosition;
 
+  /// When non-null a recorded branch trail (see \ref branchWriter) that
+  /// the initial state follows before exploring on its own.
+  const std::vector<unsigned char> *replayBranches;
+
+  /// The index into \ref replayBranches.
+  unsigned replayBranchPosition;
+
   /// When non-null a list of "seed" inputs which will be used to
   /// drive execution.
   const std::vector<struct KTest *> *usingSeeds;  
@@ -174,6 +212,10 @@ private:
   /// step.
   bool haltExecution;  
 
+  /// Signals the executor to hand one of its states to the interpreter
+  /// handler at the next instruction step. \see donateState()
+  volatile std::sig_atomic_t donationRequested;
+
   /// Whether implied-value concretization is enabled. Currently
   /// false, it is buggy (it needs to validate its writes).
   bool ivcEnabled;
@@ -235,6 +277,10 @@ private:
   void transferToBasicBlock(llvm::BasicBlock *dst, 
 			    llvm::BasicBlock *src,
 			    ExecutionState &state);
+  /// Continue at successor `successor` of the terminator `ki`, a
+  /// KTerminatorInstruction.
+  void transferToBasicBlock(KInstruction *ki, unsigned successor,
+                            ExecutionState &state);
 
   void callExternalFunction(ExecutionState &state,
                             KInstruction *target,
@@ -309,6 +355,19 @@ private:
                    KInstruction *ki,
                    llvm::Function *f,
                    std::vector< ref<Expr> > &arguments);
+
+  /// Execute a call to memcpy, memmove or memset with concrete pointers and
+  /// size in bulk on the object states.
+  /// \return false if the call has to be interpreted instead
+  bool executeMemoryFunction(ExecutionState &state, KInstruction *ki,
+                             MemoryFunction kind,
+                             const std::vector<ref<Expr>> &arguments);
+
+  /// Run a call to the module function `kf` as native code if its arguments
+  /// and all memory of the state are concrete (see --native-concrete-calls).
+  /// \return false if the call has to be interpreted instead
+  bool executeNativeCall(ExecutionState &state, KInstruction *ki,
+                         KFunction *kf, const std::vector<ref<Expr>> &arguments);
                    
   // do address resolution / object binding / out of bounds checking
   // and perform the operation
@@ -328,11 +387,47 @@ private:
   void branch(ExecutionState &state, const std::vector<ref<Expr>> &conditions,
               std::vector<ExecutionState *> &result, BranchType reason);
 
+  /// Append a branch decision to the branch trail of a state.
+  void recordBranch(ExecutionState &state, std::uint32_t decision,
+                    bool wide);
+
+  /// Return the next decision of \ref replayBranches.
+  std::uint32_t nextReplayBranch(bool wide);
+
+  /// Return whether the initial state is still following
+  /// \ref replayBranches.
+  bool isReplayingBranches() const {
+    return replayBranches && replayBranchPosition < replayBranches->size();
+  }
+
+  /// Hand the shallowest state over to the interpreter handler and
+  /// terminate it locally.
+  void donateState();
+
   /// Fork current and return states in which condition holds / does
   /// not hold, respectively. One of the states is necessarily the
-  /// current state, and one of the states may be null.
+  /// current state, and one of the states may be null. If
+  /// `knownValidity` is given, the condition is not evaluated again.
   StatePair fork(ExecutionState &current, ref<Expr> condition, bool isInternal,
-                 BranchType reason);
+                 BranchType reason,
+                 const Solver::Validity *knownValidity = nullptr);
+
+  /// Fork on the condition of the conditional branch `ki` and transfer
+  /// the resulting states to its successors. `knownValidity` is passed
+  /// on to fork().
+  void executeBranch(ExecutionState &state, KInstruction *ki,
+                     ref<Expr> condition,
+                     const Solver::Validity *knownValidity = nullptr);
+
+  /// Hand the query for the conditional branch `ki` to the asynchronous
+  /// solver and suspend `state` until it is answered.
+  /// \return false if the branch has to be executed right away.
+  bool suspendOnBranch(ExecutionState &state, KInstruction *ki,
+                       ref<Expr> condition);
+
+  /// Complete the branches of suspended states whose queries have been
+  /// answered. If `wait` is set, block until an answer arrives.
+  void resumeStates(bool wait);
 
   // If the MaxStatic*Pct limits have been reached, concretize the condition and
   // return it. Otherwise, return the unmodified condition.
@@ -468,6 +563,11 @@ private:
                                  const llvm::Twine &message,
                                  bool writeErr = true);
 
+  /// Link the modules with the KLEE intrinsics, instrument and optimise
+  /// them into the final module.
+  void prepareModule(std::vector<std::unique_ptr<llvm::Module>> &modules,
+                     const ModuleOptions &opts);
+
   /// bindModuleConstants - Initialize the module constant table.
   void bindModuleConstants();
 
@@ -528,6 +628,15 @@ public:
     replayPosition = 0;
   }
 
+  void setBranchWriter(TreeStreamWriter *tsw) override { branchWriter = tsw; }
+
+  void setReplayBranches(const std::vector<unsigned char> *branches) override {
+    assert(!replayKTest && !replayPath &&
+           "cannot replay branches together with buffer or path");
+    replayBranches = branches;
+    replayBranchPosition = 0;
+  }
+
   llvm::Module *setModule(std::vector<std::unique_ptr<llvm::Module>> &modules,
                           const ModuleOptions &opts) override;
 
@@ -544,6 +653,8 @@ public:
 
   void setInhibitForking(bool value) override { inhibitForking = value; }
 
+  void requestStateDonation() override { donationRequested = 1; }
+
   void prepareForEarlyExit() override;
 
   /*** State accessor methods ***/
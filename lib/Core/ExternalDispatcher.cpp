@@ -20,19 +20,25 @@ DISABLE_WARNING_DEPRECATED_DECLARATIONS
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/DebugInfo.h"
 #include "llvm/IR/InlineAsm.h"
+#include "llvm/IR/InstIterator.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
 #include "llvm/ExecutionEngine/GenericValue.h"
 #include "llvm/ExecutionEngine/MCJIT.h"
 #include "llvm/Support/DynamicLibrary.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/TargetSelect.h"
+#include "llvm/Transforms/Utils/Cloning.h"
 DISABLE_WARNING_POP
 
 #include <csetjmp>
 #include <csignal>
+#include <set>
 
 using namespace llvm;
 using namespace klee;
@@ -48,18 +54,114 @@ static void sigsegv_handler(int signal, siginfo_t *info, void *context) {
 }
 }
 
+/// Called by native code in place of the calls it cannot make
+static void escapeNativeCall() { siglongjmp(escapeCallJmpBuf, 1); }
+
+static const char *const escapeNativeCallName = "klee_native_escape";
+
+/// Return whether native code may call the intrinsic `id` itself.
+static bool isNativeIntrinsic(Intrinsic::ID id) {
+  switch (id) {
+  case Intrinsic::abs:
+  case Intrinsic::bitreverse:
+  case Intrinsic::bswap:
+  case Intrinsic::ctlz:
+  case Intrinsic::ctpop:
+  case Intrinsic::cttz:
+  case Intrinsic::fabs:
+  case Intrinsic::fma:
+  case Intrinsic::fmuladd:
+  case Intrinsic::fshl:
+  case Intrinsic::fshr:
+  case Intrinsic::lifetime_end:
+  case Intrinsic::lifetime_start:
+  case Intrinsic::memcpy:
+  case Intrinsic::memmove:
+  case Intrinsic::memset:
+  case Intrinsic::sadd_with_overflow:
+  case Intrinsic::smax:
+  case Intrinsic::smin:
+  case Intrinsic::smul_with_overflow:
+  case Intrinsic::ssub_with_overflow:
+  case Intrinsic::stackrestore:
+  case Intrinsic::stacksave:
+  case Intrinsic::uadd_with_overflow:
+  case Intrinsic::umax:
+  case Intrinsic::umin:
+  case Intrinsic::umul_with_overflow:
+  case Intrinsic::usub_with_overflow:
+  case Intrinsic::vacopy:
+  case Intrinsic::vaend:
+  case Intrinsic::vastart:
+    return true;
+  default:
+    return false;
+  }
+}
+
+/// Add the globals `c` refers to to `globals`. Return false if it refers to
+/// a block address, which cannot be translated to native code.
+static bool collectGlobals(const Constant *c,
+                           std::set<const GlobalValue *> &globals) {
+  if (isa<BlockAddress>(c))
+    return false;
+  if (const auto *gv = dyn_cast<GlobalValue>(c)) {
+    globals.insert(gv);
+    return true;
+  }
+  for (const Use &op : c->operands())
+    if (!collectGlobals(cast<Constant>(op), globals))
+      return false;
+  return true;
+}
+
+/// Add the globals the instructions of `f` refer to to `globals`. Return
+/// false if one refers to a block address.
+static bool collectGlobals(const Function &f,
+                           std::set<const GlobalValue *> &globals) {
+  for (const Instruction &i : instructions(f))
+    for (const Use &op : i.operands())
+      if (const auto *c = dyn_cast<Constant>(op))
+        if (!collectGlobals(c, globals))
+          return false;
+  return true;
+}
+
 namespace klee {
 
 class ExternalDispatcherImpl {
 private:
   typedef std::map<const llvm::Instruction *, llvm::Function *> dispatchers_ty;
   dispatchers_ty dispatchers;
+  /// Dispatchers to native code by call site and callee
+  std::map<std::pair<const llvm::Instruction *, const llvm::Function *>,
+           llvm::Function *>
+      nativeDispatchers;
+  /// Whether module functions can be translated to native code
+  std::map<const llvm::Function *, bool> nativeCandidates;
+  /// Names of the native code of module functions
+  std::map<const llvm::Function *, std::string> nativeFunctions;
+  /// Names bound to the addresses of globals
+  std::map<const llvm::GlobalValue *, std::string> nativeGlobals;
   llvm::Function *createDispatcher(KCallable *target, llvm::Instruction *i,
-                                   llvm::Module *module);
+                                   llvm::Module *module,
+                                   const std::string &nativeName = "");
+  bool canRunNatively(const llvm::Function *f,
+                      const ExternalDispatcher::GlobalResolver &resolve);
+  const std::string &
+  getNativeFunction(const llvm::Function *f,
+                    std::vector<const llvm::Function *> &pending);
+  llvm::Constant *
+  getNativeGlobal(const llvm::GlobalValue *gv, llvm::Module *module,
+                  const ExternalDispatcher::GlobalResolver &resolve);
+  void compileNative(const llvm::Function *f, const std::string &name,
+                     std::vector<const llvm::Function *> &pending,
+                     const ExternalDispatcher::GlobalResolver &resolve);
   llvm::ExecutionEngine *executionEngine;
   LLVMContext &ctx;
   std::map<std::string, void *> preboundFunctions;
-  bool runProtectedCall(llvm::Function *f, uint64_t *args);
+  bool runProtectedCall(llvm::Function *f, uint64_t *args,
+                        bool native = false);
   llvm::Module *singleDispatchModule;
   std::vector<std::string> moduleIDs;
   std::string &getFreshModuleID();
@@ -70,6 +172,9 @@ public:
   ~ExternalDispatcherImpl();
   bool executeCall(KCallable *callable, llvm::Instruction *i,
                    uint64_t *args);
+  bool executeNativeCall(KCallable *callable, llvm::Instruction *i,
+                         uint64_t *args,
+                         const ExternalDispatcher::GlobalResolver &resolve);
   void *resolveSymbol(const std::string &name);
   int getLastErrno();
   void setLastErrno(int newErrno);
@@ -147,6 +252,9 @@ ExternalDispatcherImpl::ExternalDispatcherImpl(LLVMContext &ctx)
     sys::DynamicLibrary::LoadLibraryPermanently(0);
   }
 
+  executionEngine->addGlobalMapping(
+      escapeNativeCallName, reinterpret_cast<uint64_t>(&escapeNativeCall));
+
 #ifdef WINDOWS
   preboundFunctions["getpid"] = (void *)(long)getpid;
   preboundFunctions["putchar"] = (void *)(long)putchar;
@@ -218,8 +326,17 @@ bool ExternalDispatcherImpl::executeCall(KCallable *callable, Instruction *i,
 
 // FIXME: This is not reentrant.
 static uint64_t *gTheArgsP;
-bool ExternalDispatcherImpl::runProtectedCall(Function *f, uint64_t *args) {
-  struct sigaction segvAction, segvActionOld;
+bool ExternalDispatcherImpl::runProtectedCall(Function *f, uint64_t *args,
+                                              bool native) {
+  // Native code of the module is also stopped by arithmetic faults, and
+  // handles them on a separate stack in case it overflowed the stack.
+  static const int externalSignals[] = {SIGSEGV};
+  static const int nativeSignals[] = {SIGSEGV, SIGBUS, SIGFPE};
+  static char signalStack[1 << 16];
+  const int *signals = native ? nativeSignals : externalSignals;
+  unsigned numSignals = native ? 3 : 1;
+  struct sigaction segvAction, segvActionOld[3];
+  stack_t altStack, altStackOld;
   bool res;
 
   if (!f)
@@ -230,10 +347,19 @@ bool ExternalDispatcherImpl::runProtectedCall(Function *f, uint64_t *args) {
 
   segvAction.sa_handler = nullptr;
   sigemptyset(&(segvAction.sa_mask));
-  sigaddset(&(segvAction.sa_mask), SIGSEGV);
+  for (unsigned i = 0; i < numSignals; ++i)
+    sigaddset(&(segvAction.sa_mask), signals[i]);
   segvAction.sa_flags = SA_SIGINFO;
   segvAction.sa_sigaction = ::sigsegv_handler;
-  sigaction(SIGSEGV, &segvAction, &segvActionOld);
+  if (native) {
+    altStack.ss_sp = signalStack;
+    altStack.ss_size = sizeof(signalStack);
+    altStack.ss_flags = 0;
+    sigaltstack(&altStack, &altStackOld);
+    segvAction.sa_flags |= SA_ONSTACK;
+  }
+  for (unsigned i = 0; i < numSignals; ++i)
+    sigaction(signals[i], &segvAction, &segvActionOld[i]);
 
   if (sigsetjmp(escapeCallJmpBuf, 1)) {
     res = false;
@@ -245,10 +371,200 @@ bool ExternalDispatcherImpl::runProtectedCall(Function *f, uint64_t *args) {
     res = true;
   }
 
-  sigaction(SIGSEGV, &segvActionOld, nullptr);
+  for (unsigned i = 0; i < numSignals; ++i)
+    sigaction(signals[i], &segvActionOld[i], nullptr);
+  if (native)
+    sigaltstack(&altStackOld, nullptr);
   return res;
 }
 
+bool ExternalDispatcherImpl::canRunNatively(
+    const Function *f, const ExternalDispatcher::GlobalResolver &resolve) {
+  auto it = nativeCandidates.find(f);
+  if (it != nativeCandidates.end())
+    return it->second;
+
+  // Exceptions and indirect branches are left to the interpreter.
+  bool result = !f->isDeclaration() && !f->hasPersonalityFn();
+  for (const Instruction &i : instructions(f)) {
+    if (!result)
+      break;
+    if (isa<InvokeInst>(i) || isa<CallBrInst>(i) || isa<IndirectBrInst>(i) ||
+        isa<LandingPadInst>(i) || isa<ResumeInst>(i))
+      result = false;
+  }
+
+  // Every global needs an address in the state's memory.
+  std::set<const GlobalValue *> globals;
+  if (result && !collectGlobals(*f, globals))
+    result = false;
+  for (const GlobalValue *gv : globals) {
+    if (!result)
+      break;
+    if (isa<Function>(gv) && cast<Function>(gv)->isIntrinsic())
+      continue;
+    uint64_t address;
+    if (isa<GlobalIFunc>(gv) || gv->isThreadLocal() || !resolve(gv, address))
+      result = false;
+  }
+
+  nativeCandidates.emplace(f, result);
+  return result;
+}
+
+const std::string &ExternalDispatcherImpl::getNativeFunction(
+    const Function *f, std::vector<const Function *> &pending) {
+  auto res = nativeFunctions.emplace(f, "");
+  if (res.second) {
+    res.first->second = "klee_native_fn_" + std::to_string(nativeFunctions.size());
+    pending.push_back(f);
+  }
+  return res.first->second;
+}
+
+Constant *ExternalDispatcherImpl::getNativeGlobal(
+    const GlobalValue *gv, Module *module,
+    const ExternalDispatcher::GlobalResolver &resolve) {
+  auto res = nativeGlobals.emplace(gv, "");
+  if (res.second) {
+    uint64_t address = 0;
+    [[maybe_unused]] bool found = resolve(gv, address);
+    assert(found && "global without an address");
+    res.first->second =
+        "klee_native_global_" + std::to_string(nativeGlobals.size());
+    executionEngine->addGlobalMapping(res.first->second, address);
+  }
+
+  const std::string &name = res.first->second;
+  Type *type = gv->getValueType();
+  if (auto *ft = dyn_cast<FunctionType>(type))
+    return Function::Create(ft, GlobalValue::ExternalLinkage,
+                            gv->getAddressSpace(), name, module);
+  return new GlobalVariable(*module, type, false, GlobalValue::ExternalLinkage,
+                            nullptr, name, nullptr,
+                            GlobalValue::NotThreadLocal,
+                            gv->getAddressSpace());
+}
+
+/// Clone `f` into its own module under `name`. Its globals are bound to
+/// their addresses in the state's memory, including the functions whose
+/// addresses it takes, while its direct calls go to the native code of the
+/// callees, which are added to `pending`. Calls that cannot run natively
+/// are replaced by escapes from the native call.
+void ExternalDispatcherImpl::compileNative(
+    const Function *f, const std::string &name,
+    std::vector<const Function *> &pending,
+    const ExternalDispatcher::GlobalResolver &resolve) {
+  Module *module = new Module(getFreshModuleID(), ctx);
+  module->setDataLayout(f->getParent()->getDataLayout());
+  module->setTargetTriple(f->getParent()->getTargetTriple());
+  Function *nf = Function::Create(f->getFunctionType(),
+                                  GlobalValue::ExternalLinkage, name, module);
+
+  ValueToValueMapTy vmap;
+  auto nai = nf->arg_begin();
+  for (const Argument &arg : f->args())
+    vmap[&arg] = &*nai++;
+  std::set<const GlobalValue *> globals;
+  collectGlobals(*f, globals);
+  std::map<const Value *, const GlobalValue *> origins;
+  for (const GlobalValue *gv : globals) {
+    Value *mapped;
+    const auto *callee = dyn_cast<Function>(gv);
+    if (callee && callee->isIntrinsic())
+      mapped = module
+                   ->getOrInsertFunction(callee->getName(),
+                                         callee->getFunctionType(),
+                                         callee->getAttributes())
+                   .getCallee();
+    else
+      mapped = getNativeGlobal(gv, module, resolve);
+    vmap[gv] = mapped;
+    origins[mapped] = gv;
+  }
+
+  SmallVector<ReturnInst *, 8> returns;
+  CloneFunctionInto(nf, f, vmap, CloneFunctionChangeType::DifferentModule,
+                    returns);
+  nf->setLinkage(GlobalValue::ExternalLinkage);
+  StripDebugInfo(*module);
+
+  FunctionCallee escape = module->getOrInsertFunction(
+      escapeNativeCallName, FunctionType::get(Type::getVoidTy(ctx), false));
+  std::vector<CallInst *> escapes;
+  for (Instruction &i : instructions(nf)) {
+    auto *call = dyn_cast<CallInst>(&i);
+    if (!call || call->isInlineAsm())
+      continue;
+    Function *callee = call->getCalledFunction();
+    if (callee && callee->isIntrinsic()) {
+      if (!isNativeIntrinsic(callee->getIntrinsicID()))
+        escapes.push_back(call);
+      continue;
+    }
+    auto it = callee ? origins.find(callee) : origins.end();
+    const auto *target =
+        it != origins.end() ? dyn_cast<Function>(it->second) : nullptr;
+    if (!target || !canRunNatively(target, resolve)) {
+      escapes.push_back(call);
+      continue;
+    }
+    if (target == f) {
+      call->setCalledFunction(nf);
+    } else {
+      FunctionCallee native = module->getOrInsertFunction(
+          getNativeFunction(target, pending), target->getFunctionType());
+      call->setCalledFunction(native);
+    }
+  }
+  for (CallInst *call : escapes) {
+    CallInst::Create(escape, "", call);
+    if (!call->getType()->isVoidTy())
+      call->replaceAllUsesWith(UndefValue::get(call->getType()));
+    call->eraseFromParent();
+  }
+
+  assert(!verifyModule(*module, &llvm::errs()) && "invalid native code");
+  executionEngine->addModule(std::unique_ptr<Module>(module));
+}
+
+bool ExternalDispatcherImpl::executeNativeCall(
+    KCallable *callable, Instruction *i, uint64_t *args,
+    const ExternalDispatcher::GlobalResolver &resolve) {
+  const Function *f = cast<KFunction>(callable)->function;
+  auto key = std::make_pair(i, f);
+  auto it = nativeDispatchers.find(key);
+  if (it == nativeDispatchers.end()) {
+    Function *dispatcher = nullptr;
+    if (canRunNatively(f, resolve)) {
+      // Translate the function and everything it calls that is not native
+      // yet.
+      std::vector<const Function *> pending;
+      std::string name = getNativeFunction(f, pending);
+      while (!pending.empty()) {
+        const Function *next = pending.back();
+        pending.pop_back();
+        compileNative(next, nativeFunctions[next], pending, resolve);
+      }
+
+      Module *dispatchModule = new Module(getFreshModuleID(), ctx);
+      dispatcher = createDispatcher(callable, i, dispatchModule, name);
+      executionEngine->addModule(std::unique_ptr<Module>(dispatchModule));
+      uint64_t fnAddr =
+          executionEngine->getFunctionAddress(dispatcher->getName().str());
+      executionEngine->finalizeObject();
+      assert(fnAddr && "failed to get function address");
+      (void)fnAddr;
+    }
+    it = nativeDispatchers.emplace(key, dispatcher).first;
+  }
+  if (!it->second)
+    return false;
+
+  ++stats::nativeCalls;
+  return runProtectedCall(it->second, args, true);
+}
+
 // FIXME: This might have been relevant for the old JIT but the MCJIT
 // has a completly different implementation so this comment below is
 // likely irrelevant and misleading.
@@ -259,10 +575,11 @@ bool ExternalDispatcherImpl::runProtectedCall(Function *f, uint64_t *args) {
 // the special cases that the JIT knows how to directly call. If this is not
 // done, then the jit will end up generating a nullary stub just to call our
 // stub, for every single function call.
-Function *ExternalDispatcherImpl::createDispatcher(KCallable *target,
-                                                   Instruction *inst,
-                                                   Module *module) {
-  if (isa<KFunction>(target) && !resolveSymbol(target->getName().str()))
+Function *ExternalDispatcherImpl::createDispatcher(
+    KCallable *target, Instruction *inst, Module *module,
+    const std::string &nativeName) {
+  if (nativeName.empty() && isa<KFunction>(target) &&
+      !resolveSymbol(target->getName().str()))
     return 0;
 
   const CallBase &cb = cast<CallBase>(*inst);
@@ -320,8 +637,9 @@ Function *ExternalDispatcherImpl::createDispatcher(KCallable *target,
 
   llvm::CallInst *result;
   if (auto* func = dyn_cast<KFunction>(target)) {
-    auto dispatchTarget = module->getOrInsertFunction(target->getName(), FTy,
-                                                      func->function->getAttributes());
+    auto dispatchTarget = module->getOrInsertFunction(
+        nativeName.empty() ? target->getName() : StringRef(nativeName), FTy,
+        func->function->getAttributes());
     result = Builder.CreateCall(dispatchTarget,
                                 llvm::ArrayRef<Value *>(args, args + i));
   } else if (auto* asmValue = dyn_cast<KInlineAsm>(target)) {
@@ -358,6 +676,13 @@ bool ExternalDispatcher::executeCall(KCallable *callable,
   return impl->executeCall(callable, i, args);
 }
 
+bool ExternalDispatcher::executeNativeCall(KCallable *callable,
+                                           llvm::Instruction *i,
+                                           uint64_t *args,
+                                           const GlobalResolver &resolve) {
+  return impl->executeNativeCall(callable, i, args, resolve);
+}
+
 void *ExternalDispatcher::resolveSymbol(const std::string &name) {
   return impl->resolveSymbol(name);
 }
@@ -12,12 +12,14 @@
 
 #include "klee/Config/Version.h"
 
+#include <functional>
 #include <map>
 #include <memory>
 #include <stdint.h>
 #include <string>
 
 namespace llvm {
+class GlobalValue;
 class Instruction;
 class LLVMContext;
 }
@@ -39,6 +41,22 @@ public:
    */
   bool executeCall(KCallable *callable, llvm::Instruction *i,
                    uint64_t *args);
+
+  /// Returns the address of a global in the memory of the execution state,
+  /// or false if it has none.
+  using GlobalResolver =
+      std::function<bool(const llvm::GlobalValue *, uint64_t &)>;
+
+  /* Call the module function `callable` at call site i like executeCall,
+   * after compiling it and the functions it calls to native code that
+   * refers to globals at the addresses given by `resolve`. Calls that cannot
+   * run natively (external and special functions, indirect calls, most
+   * intrinsics) abandon the native call when they are reached. Returns false
+   * if the function cannot be compiled or the call was abandoned or faulted,
+   * in which case the function must be interpreted instead.
+   */
+  bool executeNativeCall(KCallable *callable, llvm::Instruction *i,
+                         uint64_t *args, const GlobalResolver &resolve);
   void *resolveSymbol(const std::string &name);
 
   int getLastErrno();
@@ -30,6 +30,7 @@ DISABLE_WARNING_DEPRECATED_DECLARATIONS
 #include "llvm/Support/raw_ostream.h"
 DISABLE_WARNING_POP
 
+#include <algorithm>
 #include <cassert>
 #include <sstream>
 
@@ -77,12 +78,104 @@ void MemoryObject::getAllocInfo(std::string &result) const {
 
 /***/
 
+std::uint64_t ObjectStatePage::clock = 0;
+
+ObjectStatePage::ObjectStatePage(unsigned size)
+  : concreteStore(new uint8_t[size]),
+    concreteMask(nullptr),
+    knownSymbolics(nullptr),
+    size(size),
+    version(++clock) {
+  memset(concreteStore, 0, size);
+}
+
+ObjectStatePage::ObjectStatePage(const ObjectStatePage &page)
+  : concreteStore(new uint8_t[page.size]),
+    concreteMask(page.concreteMask ? new BitArray(*page.concreteMask, page.size)
+                                   : nullptr),
+    knownSymbolics(nullptr),
+    size(page.size),
+    version(++clock) {
+  if (page.knownSymbolics) {
+    knownSymbolics = new ref<Expr>[size];
+    for (unsigned i=0; i<size; i++)
+      knownSymbolics[i] = page.knownSymbolics[i];
+  }
+
+  memcpy(concreteStore, page.concreteStore, size*sizeof(*concreteStore));
+}
+
+ObjectStatePage::~ObjectStatePage() {
+  delete concreteMask;
+  delete[] knownSymbolics;
+  delete[] concreteStore;
+}
+
+bool ObjectStatePage::isByteConcrete(unsigned index) const {
+  return !concreteMask || concreteMask->get(index);
+}
+
+bool ObjectStatePage::isByteKnownSymbolic(unsigned index) const {
+  return knownSymbolics && knownSymbolics[index].get();
+}
+
+void ObjectStatePage::markByteConcrete(unsigned index) {
+  if (concreteMask)
+    concreteMask->set(index);
+}
+
+void ObjectStatePage::markByteSymbolic(unsigned index) {
+  if (!concreteMask)
+    concreteMask = new BitArray(size, true);
+  concreteMask->unset(index);
+}
+
+void ObjectStatePage::setKnownSymbolic(unsigned index,
+                                       Expr *value /* can be null */) {
+  if (knownSymbolics) {
+    knownSymbolics[index] = value;
+  } else {
+    if (value) {
+      knownSymbolics = new ref<Expr>[size];
+      knownSymbolics[index] = value;
+    }
+  }
+}
+
+bool ObjectStatePage::isConcrete(unsigned begin, unsigned end) const {
+  return !concreteMask || concreteMask->allSet(begin, end);
+}
+
+bool ObjectStatePage::hasCachedBytes(unsigned begin, unsigned end) const {
+  if (!concreteMask || !concreteMask->noneSet(begin, end))
+    return true;
+  return knownSymbolics &&
+         std::any_of(knownSymbolics + begin, knownSymbolics + end,
+                     [](const ref<Expr> &e) { return !e.isNull(); });
+}
+
+void ObjectStatePage::writeConcrete(unsigned begin, unsigned end,
+                                    const uint8_t *bytes) {
+  memcpy(concreteStore + begin, bytes, end - begin);
+  if (concreteMask)
+    concreteMask->setRange(begin, end);
+  if (knownSymbolics)
+    std::fill(knownSymbolics + begin, knownSymbolics + end, ref<Expr>());
+}
+
+void ObjectStatePage::dropCachedBytes(unsigned begin, unsigned end) {
+  if (!concreteMask)
+    concreteMask = new BitArray(size, true);
+  concreteMask->unsetRange(begin, end);
+  if (knownSymbolics)
+    std::fill(knownSymbolics + begin, knownSymbolics + end, ref<Expr>());
+}
+
+/***/
+
 ObjectState::ObjectState(const MemoryObject *mo)
   : copyOnWriteOwner(0),
     object(mo),
-    concreteStore(new uint8_t[mo->size]),
-    concreteMask(nullptr),
-    knownSymbolics(nullptr),
     unflushedMask(nullptr),
     updates(nullptr, nullptr),
     size(mo->size),
@@ -93,49 +186,88 @@ ObjectState::ObjectState(const MemoryObject *mo)
         getArrayCache()->CreateArray("tmp_arr" + llvm::utostr(++id), size);
     updates = UpdateList(array, 0);
   }
-  memset(concreteStore, 0, size);
+  resetPages();
 }
 
 
 ObjectState::ObjectState(const MemoryObject *mo, const Array *array)
   : copyOnWriteOwner(0),
     object(mo),
-    concreteStore(new uint8_t[mo->size]),
-    concreteMask(nullptr),
-    knownSymbolics(nullptr),
     unflushedMask(nullptr),
     updates(array, nullptr),
     size(mo->size),
     readOnly(false) {
+  resetPages();
   makeSymbolic();
-  memset(concreteStore, 0, size);
 }
 
 ObjectState::ObjectState(const ObjectState &os) 
   : copyOnWriteOwner(0),
+    countedSymbolic(os.countedSymbolic),
     object(os.object),
-    concreteStore(new uint8_t[os.size]),
-    concreteMask(os.concreteMask ? new BitArray(*os.concreteMask, os.size) : nullptr),
-    knownSymbolics(nullptr),
+    pages(os.pages),
     unflushedMask(os.unflushedMask ? new BitArray(*os.unflushedMask, os.size) : nullptr),
     updates(os.updates),
     size(os.size),
     readOnly(false) {
   assert(!os.readOnly && "no need to copy read only object?");
-  if (os.knownSymbolics) {
-    knownSymbolics = new ref<Expr>[size];
-    for (unsigned i=0; i<size; i++)
-      knownSymbolics[i] = os.knownSymbolics[i];
-  }
-
-  memcpy(concreteStore, os.concreteStore, size*sizeof(*concreteStore));
 }
 
 ObjectState::~ObjectState() {
-  delete concreteMask;
   delete unflushedMask;
-  delete[] knownSymbolics;
-  delete[] concreteStore;
+}
+
+void ObjectState::resetPages() {
+  pages.clear();
+  for (unsigned offset = 0; offset < size; offset += pageSize)
+    pages.push_back(new ObjectStatePage(std::min(pageSize, size - offset)));
+}
+
+ObjectStatePage &ObjectState::getWriteablePage(unsigned offset) {
+  ref<ObjectStatePage> &page = pages[offset >> pageShift];
+  if (page->_refCount.getCount() > 1)
+    page = new ObjectStatePage(*page);
+  else
+    page->version = ++ObjectStatePage::clock;
+  return *page;
+}
+
+void ObjectState::copyOutConcreteStore(uint8_t *address,
+                                       std::uint64_t since) const {
+  for (const auto &page : pages) {
+    // flushToConcreteStore writes the values of known symbolic bytes
+    // without a new version.
+    if (page->version > since || page->knownSymbolics)
+      memcpy(address, page->concreteStore, page->size);
+    address += page->size;
+  }
+}
+
+bool ObjectState::isConcreteStoreEqual(const uint8_t *address, unsigned begin,
+                                       unsigned end) const {
+  while (begin < end) {
+    const ObjectStatePage &page = getPage(begin);
+    unsigned index = pageIndex(begin);
+    unsigned chunk = std::min(end - begin, page.size - index);
+    if (memcmp(address + begin, page.concreteStore + index, chunk) != 0)
+      return false;
+    begin += chunk;
+  }
+  return true;
+}
+
+void ObjectState::copyInConcreteStore(const uint8_t *address, unsigned begin,
+                                      unsigned end) {
+  while (begin < end) {
+    unsigned index = pageIndex(begin);
+    unsigned chunk = std::min(end - begin, getPage(begin).size - index);
+    if (memcmp(address + begin, getPage(begin).concreteStore + index,
+               chunk) != 0) {
+      ObjectStatePage &page = getWriteablePage(begin);
+      memcpy(page.concreteStore + index, address + begin, chunk);
+    }
+    begin += chunk;
+  }
 }
 
 ArrayCache *ObjectState::getArrayCache() const {
@@ -198,8 +330,14 @@ const UpdateList &ObjectState::getUpdates() const {
 
 void ObjectState::flushToConcreteStore(TimingSolver *solver,
                                        const ExecutionState &state) const {
-  for (unsigned i = 0; i < size; i++) {
-    if (isByteKnownSymbolic(i)) {
+  for (unsigned offset = 0; offset < size; offset += pageSize) {
+    const ObjectStatePage &page = getPage(offset);
+    if (!page.knownSymbolics)
+      continue;
+    for (unsigned index = 0; index < page.size; index++) {
+      if (!page.isByteKnownSymbolic(index))
+        continue;
+      unsigned i = offset + index;
       ref<ConstantExpr> ce;
       bool success = solver->getValue(state.constraints, read8(i), ce,
                                       state.queryMetaData);
@@ -208,42 +346,37 @@ void ObjectState::flushToConcreteStore(TimingSolver *solver,
                      "byte %p+%u will have random value",
                      (void *)object->address, i);
       else
-        ce->toMemory(concreteStore + i);
+        ce->toMemory(page.concreteStore + index);
     }
   }
 }
 
 void ObjectState::makeConcrete() {
-  delete concreteMask;
   delete unflushedMask;
-  delete[] knownSymbolics;
-  concreteMask = nullptr;
   unflushedMask = nullptr;
-  knownSymbolics = nullptr;
+  resetPages();
 }
 
 void ObjectState::makeSymbolic() {
   assert(!updates.head &&
          "XXX makeSymbolic of objects with symbolic values is unsupported");
 
-  // XXX simplify this, can just delete various arrays I guess
-  for (unsigned i=0; i<size; i++) {
-    markByteSymbolic(i);
-    setKnownSymbolic(i, 0);
-    markByteFlushed(i);
-  }
+  dropCachedRange(0, size);
+  if (!unflushedMask)
+    unflushedMask = new BitArray(size, false);
+  else
+    unflushedMask->unsetRange(0, size);
 }
 
 void ObjectState::initializeToZero() {
   makeConcrete();
-  memset(concreteStore, 0, size);
 }
 
 void ObjectState::initializeToRandom() {  
   makeConcrete();
-  for (unsigned i=0; i<size; i++) {
+  for (auto &page : pages) {
     // randomly selected by 256 sided die
-    concreteStore[i] = 0xAB;
+    memset(page->concreteStore, 0xAB, page->size);
   }
 }
 
@@ -267,20 +400,24 @@ void ObjectState::flushRangeForRead(unsigned rangeBase,
   if (!unflushedMask)
     unflushedMask = new BitArray(size, true);
 
-  for (unsigned offset = rangeBase; offset < rangeBase + rangeSize; offset++) {
-    if (isByteUnflushed(offset)) {
-      if (isByteConcrete(offset)) {
-        updates.extend(ConstantExpr::create(offset, Expr::Int32),
-                       ConstantExpr::create(concreteStore[offset], Expr::Int8));
-      } else {
-        assert(isByteKnownSymbolic(offset) &&
-               "invalid bit set in unflushedMask");
-        updates.extend(ConstantExpr::create(offset, Expr::Int32),
-                       knownSymbolics[offset]);
-      }
-
-      unflushedMask->unset(offset);
+  unsigned rangeEnd = rangeBase + rangeSize;
+  for (unsigned offset = unflushedMask->findNextSet(rangeBase, rangeEnd);
+       offset < rangeEnd;
+       offset = unflushedMask->findNextSet(offset + 1, rangeEnd)) {
+    const ObjectStatePage &page = getPage(offset);
+    unsigned index = pageIndex(offset);
+    if (page.isByteConcrete(index)) {
+      updates.extend(ConstantExpr::create(offset, Expr::Int32),
+                     ConstantExpr::create(page.concreteStore[index],
+                                          Expr::Int8));
+    } else {
+      assert(page.isByteKnownSymbolic(index) &&
+             "invalid bit set in unflushedMask");
+      updates.extend(ConstantExpr::create(offset, Expr::Int32),
+                     page.knownSymbolics[index]);
     }
+
+    unflushedMask->unset(offset);
   }
 }
 
@@ -288,35 +425,46 @@ void ObjectState::flushRangeForWrite(unsigned rangeBase, unsigned rangeSize) {
   if (!unflushedMask)
     unflushedMask = new BitArray(size, true);
 
-  for (unsigned offset = rangeBase; offset < rangeBase + rangeSize; offset++) {
-    if (isByteUnflushed(offset)) {
-      if (isByteConcrete(offset)) {
-        updates.extend(ConstantExpr::create(offset, Expr::Int32),
-                       ConstantExpr::create(concreteStore[offset], Expr::Int8));
-        markByteSymbolic(offset);
-      } else {
-        assert(isByteKnownSymbolic(offset) &&
-               "invalid bit set in unflushedMask");
-        updates.extend(ConstantExpr::create(offset, Expr::Int32),
-                       knownSymbolics[offset]);
-        setKnownSymbolic(offset, 0);
-      }
-
-      unflushedMask->unset(offset);
+  unsigned rangeEnd = rangeBase + rangeSize;
+  for (unsigned offset = unflushedMask->findNextSet(rangeBase, rangeEnd);
+       offset < rangeEnd;
+       offset = unflushedMask->findNextSet(offset + 1, rangeEnd)) {
+    const ObjectStatePage &page = getPage(offset);
+    unsigned index = pageIndex(offset);
+    if (page.isByteConcrete(index)) {
+      updates.extend(ConstantExpr::create(offset, Expr::Int32),
+                     ConstantExpr::create(page.concreteStore[index],
+                                          Expr::Int8));
     } else {
-      // flushed bytes that are written over still need
-      // to be marked out
-      if (isByteConcrete(offset)) {
-        markByteSymbolic(offset);
-      } else if (isByteKnownSymbolic(offset)) {
-        setKnownSymbolic(offset, 0);
-      }
+      assert(page.isByteKnownSymbolic(index) &&
+             "invalid bit set in unflushedMask");
+      updates.extend(ConstantExpr::create(offset, Expr::Int32),
+                     page.knownSymbolics[index]);
     }
+
+    unflushedMask->unset(offset);
+  }
+
+  // flushed bytes that are written over still need
+  // to be marked out
+  dropCachedRange(rangeBase, rangeSize);
+}
+
+void ObjectState::dropCachedRange(unsigned rangeBase, unsigned rangeSize) {
+  unsigned rangeEnd = rangeBase + rangeSize;
+  for (unsigned offset = rangeBase; offset < rangeEnd;) {
+    const ObjectStatePage &page = getPage(offset);
+    unsigned index = pageIndex(offset);
+    unsigned chunk = std::min(rangeEnd - offset, page.size - index);
+    // avoid copying a shared page if nothing changes
+    if (page.hasCachedBytes(index, index + chunk))
+      getWriteablePage(offset).dropCachedBytes(index, index + chunk);
+    offset += chunk;
   }
 }
 
 bool ObjectState::isByteConcrete(unsigned offset) const {
-  return !concreteMask || concreteMask->get(offset);
+  return getPage(offset).isByteConcrete(pageIndex(offset));
 }
 
 bool ObjectState::isByteUnflushed(unsigned offset) const {
@@ -324,18 +472,17 @@ bool ObjectState::isByteUnflushed(unsigned offset) const {
 }
 
 bool ObjectState::isByteKnownSymbolic(unsigned offset) const {
-  return knownSymbolics && knownSymbolics[offset].get();
+  return getPage(offset).isByteKnownSymbolic(pageIndex(offset));
 }
 
 void ObjectState::markByteConcrete(unsigned offset) {
-  if (concreteMask)
-    concreteMask->set(offset);
+  if (!getPage(offset).isByteConcrete(pageIndex(offset)))
+    getWriteablePage(offset).markByteConcrete(pageIndex(offset));
 }
 
 void ObjectState::markByteSymbolic(unsigned offset) {
-  if (!concreteMask)
-    concreteMask = new BitArray(size, true);
-  concreteMask->unset(offset);
+  if (getPage(offset).isByteConcrete(pageIndex(offset)))
+    getWriteablePage(offset).markByteSymbolic(pageIndex(offset));
 }
 
 void ObjectState::markByteUnflushed(unsigned offset) {
@@ -343,33 +490,75 @@ void ObjectState::markByteUnflushed(unsigned offset) {
     unflushedMask->set(offset);
 }
 
-void ObjectState::markByteFlushed(unsigned offset) {
-  if (!unflushedMask) {
-    unflushedMask = new BitArray(size, false);
-  } else {
-    unflushedMask->unset(offset);
+void ObjectState::setKnownSymbolic(unsigned offset, 
+                                   Expr *value /* can be null */) {
+  const ObjectStatePage &page = getPage(offset);
+  unsigned index = pageIndex(offset);
+  // avoid copying a shared page if nothing changes
+  if (!value && !page.isByteKnownSymbolic(index))
+    return;
+  getWriteablePage(offset).setKnownSymbolic(index, value);
+}
+
+/***/
+
+bool ObjectState::readConcrete(unsigned offset, uint8_t *buffer,
+                               unsigned n) const {
+  assert(n <= size && offset <= size - n && "read out of bounds");
+  while (n) {
+    const ObjectStatePage &page = getPage(offset);
+    unsigned index = pageIndex(offset);
+    unsigned chunk = std::min(n, page.size - index);
+    if (!page.isConcrete(index, index + chunk))
+      return false;
+    memcpy(buffer, page.concreteStore + index, chunk);
+    buffer += chunk;
+    offset += chunk;
+    n -= chunk;
   }
+  return true;
 }
 
-void ObjectState::setKnownSymbolic(unsigned offset, 
-                                   Expr *value /* can be null */) {
-  if (knownSymbolics) {
-    knownSymbolics[offset] = value;
-  } else {
-    if (value) {
-      knownSymbolics = new ref<Expr>[size];
-      knownSymbolics[offset] = value;
-    }
+bool ObjectState::isConcrete() const {
+  return std::all_of(pages.begin(), pages.end(),
+                     [](const ref<ObjectStatePage> &page) {
+                       return page->isConcrete(0, page->size);
+                     });
+}
+
+void ObjectState::writeConcrete(unsigned offset, const uint8_t *buffer,
+                                unsigned n) {
+  assert(n <= size && offset <= size - n && "write out of bounds");
+  if (unflushedMask)
+    unflushedMask->setRange(offset, offset + n);
+  while (n) {
+    ObjectStatePage &page = getWriteablePage(offset);
+    unsigned index = pageIndex(offset);
+    unsigned chunk = std::min(n, page.size - index);
+    page.writeConcrete(index, index + chunk, buffer);
+    buffer += chunk;
+    offset += chunk;
+    n -= chunk;
   }
 }
 
-/***/
+void ObjectState::writeConcreteValue(unsigned offset, uint64_t value,
+                                     unsigned numBytes) {
+  uint8_t bytes[8];
+  for (unsigned i = 0; i != numBytes; ++i) {
+    unsigned idx = Context::get().isLittleEndian() ? i : (numBytes - i - 1);
+    bytes[idx] = (uint8_t) (value >> (8 * i));
+  }
+  writeConcrete(offset, bytes, numBytes);
+}
 
 ref<Expr> ObjectState::read8(unsigned offset) const {
-  if (isByteConcrete(offset)) {
-    return ConstantExpr::create(concreteStore[offset], Expr::Int8);
-  } else if (isByteKnownSymbolic(offset)) {
-    return knownSymbolics[offset];
+  const ObjectStatePage &page = getPage(offset);
+  unsigned index = pageIndex(offset);
+  if (page.isByteConcrete(index)) {
+    return ConstantExpr::create(page.concreteStore[index], Expr::Int8);
+  } else if (page.isByteKnownSymbolic(index)) {
+    return page.knownSymbolics[index];
   } else {
     assert(!isByteUnflushed(offset) && "unflushed byte without cache value");
     
@@ -401,10 +590,12 @@ ref<Expr> ObjectState::read8(ref<Expr> offset) const {
 
 void ObjectState::write8(unsigned offset, uint8_t value) {
   //assert(read_only == false && "writing to read-only object!");
-  concreteStore[offset] = value;
-  setKnownSymbolic(offset, 0);
+  ObjectStatePage &page = getWriteablePage(offset);
+  unsigned index = pageIndex(offset);
+  page.concreteStore[index] = value;
+  page.setKnownSymbolic(index, 0);
 
-  markByteConcrete(offset);
+  page.markByteConcrete(index);
   markByteUnflushed(offset);
 }
 
@@ -475,9 +666,21 @@ ref<Expr> ObjectState::read(unsigned offset, Expr::Width width) const {
   if (width == Expr::Bool)
     return ExtractExpr::create(read8(offset), 0, Expr::Bool);
 
-  // Otherwise, follow the slow general case.
   unsigned NumBytes = width / 8;
   assert(width == NumBytes * 8 && "Invalid width for read size!");
+
+  // Read concrete values without building an expression per byte.
+  uint8_t bytes[8];
+  if (NumBytes <= sizeof(bytes) && readConcrete(offset, bytes, NumBytes)) {
+    uint64_t value = 0;
+    for (unsigned i = 0; i != NumBytes; ++i) {
+      unsigned idx = Context::get().isLittleEndian() ? i : (NumBytes - i - 1);
+      value |= (uint64_t) bytes[idx] << (8 * i);
+    }
+    return ConstantExpr::create(value, width);
+  }
+
+  // Otherwise, follow the slow general case.
   ref<Expr> Res(0);
   for (unsigned i = 0; i != NumBytes; ++i) {
     unsigned idx = Context::get().isLittleEndian() ? i : (NumBytes - i - 1);
@@ -549,27 +752,15 @@ void ObjectState::write(unsigned offset, ref<Expr> value) {
 } 
 
 void ObjectState::write16(unsigned offset, uint16_t value) {
-  unsigned NumBytes = 2;
-  for (unsigned i = 0; i != NumBytes; ++i) {
-    unsigned idx = Context::get().isLittleEndian() ? i : (NumBytes - i - 1);
-    write8(offset + idx, (uint8_t) (value >> (8 * i)));
-  }
+  writeConcreteValue(offset, value, 2);
 }
 
 void ObjectState::write32(unsigned offset, uint32_t value) {
-  unsigned NumBytes = 4;
-  for (unsigned i = 0; i != NumBytes; ++i) {
-    unsigned idx = Context::get().isLittleEndian() ? i : (NumBytes - i - 1);
-    write8(offset + idx, (uint8_t) (value >> (8 * i)));
-  }
+  writeConcreteValue(offset, value, 4);
 }
 
 void ObjectState::write64(unsigned offset, uint64_t value) {
-  unsigned NumBytes = 8;
-  for (unsigned i = 0; i != NumBytes; ++i) {
-    unsigned idx = Context::get().isLittleEndian() ? i : (NumBytes - i - 1);
-    write8(offset + idx, (uint8_t) (value >> (8 * i)));
-  }
+  writeConcreteValue(offset, value, 8);
 }
 
 void ObjectState::print() const {
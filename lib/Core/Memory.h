@@ -15,8 +15,10 @@
 
 #include "klee/Expr/Expr.h"
 
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringExtras.h"
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -163,18 +165,17 @@ public:
   }
 };
 
-class ObjectState {
-private:
-  friend class AddressSpace;
-  friend class ref<ObjectState>;
-
-  unsigned copyOnWriteOwner; // exclusively for AddressSpace
+/// A fixed-size chunk of the contents of an ObjectState. Pages are shared
+/// between copies of an object state and only copied by the first write to
+/// them, so forking a state does not copy large objects as a whole.
+class ObjectStatePage {
+  friend class ObjectState;
+  friend class ref<ObjectStatePage>;
 
+private:
   /// @brief Required by klee::ref-managed objects
   class ReferenceCounter _refCount;
 
-  ref<const MemoryObject> object;
-
   /// @brief Holds all known concrete bytes
   uint8_t *concreteStore;
 
@@ -185,8 +186,68 @@ private:
   /// if byte is known to be symbolic
   ref<Expr> *knownSymbolics;
 
+  unsigned size;
+
+  /// Value of `clock` when the page was created or last handed out for
+  /// writing, so that the pages modified after a point in time are those
+  /// with a greater version
+  std::uint64_t version;
+
+  /// Increased for every page creation and write access
+  static std::uint64_t clock;
+
+public:
+  /// Create a page of \p size concrete and zero bytes.
+  explicit ObjectStatePage(unsigned size);
+  ObjectStatePage(const ObjectStatePage &page);
+  ~ObjectStatePage();
+
+private:
+  bool isByteConcrete(unsigned index) const;
+  bool isByteKnownSymbolic(unsigned index) const;
+  void markByteConcrete(unsigned index);
+  void markByteSymbolic(unsigned index);
+  void setKnownSymbolic(unsigned index, Expr *value);
+
+  /// Return whether all bytes in [begin, end) are concrete.
+  bool isConcrete(unsigned begin, unsigned end) const;
+  /// Return whether some byte in [begin, end) is concrete or known symbolic.
+  bool hasCachedBytes(unsigned begin, unsigned end) const;
+  /// Make the bytes in [begin, end) concrete with the values in \p bytes.
+  void writeConcrete(unsigned begin, unsigned end, const uint8_t *bytes);
+  /// Make the bytes in [begin, end) neither concrete nor known symbolic.
+  void dropCachedBytes(unsigned begin, unsigned end);
+};
+
+class ObjectState {
+private:
+  friend class AddressSpace;
+  friend class ref<ObjectState>;
+
+  /// Number of bytes per page is 2^pageShift.
+  static constexpr unsigned pageShift = 12;
+  static constexpr unsigned pageSize = 1U << pageShift;
+
+  unsigned copyOnWriteOwner; // exclusively for AddressSpace
+
+  /// Whether the address spaces holding this object count it as holding
+  /// symbolic bytes, and whether its owner has to count it again since it
+  /// may have been written (exclusively for AddressSpace)
+  bool countedSymbolic = false;
+  bool uncounted = false;
+
+  /// @brief Required by klee::ref-managed objects
+  class ReferenceCounter _refCount;
+
+  ref<const MemoryObject> object;
+
+  /// @brief Concrete and known symbolic contents, split into pages of
+  /// pageSize bytes (the last page may be shorter)
+  llvm::SmallVector<ref<ObjectStatePage>, 1> pages;
+
   /// unflushedMask[byte] is set if byte is unflushed
   /// mutable because may need flushed during read of const
+  /// (not paged, as it belongs to the update list of this object state)
   mutable BitArray *unflushedMask;
 
   // mutable because we may need flush during read of const
@@ -227,6 +288,15 @@ public:
   void write(unsigned offset, ref<Expr> value);
   void write(ref<Expr> offset, ref<Expr> value);
 
+  /// Copy \p n bytes at \p offset to \p buffer, if they are all concrete.
+  /// \return false if some byte is symbolic
+  bool readConcrete(unsigned offset, uint8_t *buffer, unsigned n) const;
+  /// Overwrite \p n bytes at \p offset with the concrete bytes in \p buffer.
+  void writeConcrete(unsigned offset, const uint8_t *buffer, unsigned n);
+
+  /// Return whether every byte is concrete.
+  bool isConcrete() const;
+
   void write8(unsigned offset, uint8_t value);
   void write16(unsigned offset, uint16_t value);
   void write32(unsigned offset, uint32_t value);
@@ -243,8 +313,46 @@ public:
 private:
   const UpdateList &getUpdates() const;
 
+  /// Replace the contents by fresh (concrete and zero) pages.
+  void resetPages();
+
+  const ObjectStatePage &getPage(unsigned offset) const {
+    return *pages[offset >> pageShift];
+  }
+
+  /// Return the page holding \p offset, copying it first if it is shared.
+  ObjectStatePage &getWriteablePage(unsigned offset);
+
+  static unsigned pageIndex(unsigned offset) {
+    return offset & (pageSize - 1);
+  }
+
+  /// Return a version greater than that of every existing page.
+  static std::uint64_t newVersion() { return ++ObjectStatePage::clock; }
+
+  /// Copy the concrete store to \p address, skipping the pages whose
+  /// concrete store did not change after version \p since.
+  void copyOutConcreteStore(uint8_t *address, std::uint64_t since = 0) const;
+
+  /// Return whether the bytes [begin, end) of the concrete store equal those
+  /// at the same offsets from \p address.
+  bool isConcreteStoreEqual(const uint8_t *address, unsigned begin,
+                            unsigned end) const;
+
+  /// Copy the bytes [begin, end) at the same offsets from \p address into
+  /// the concrete store, only copying shared pages that actually change.
+  void copyInConcreteStore(const uint8_t *address, unsigned begin,
+                           unsigned end);
+
   void makeConcrete();
 
+  /// Write the \p numBytes low bytes of \p value in target byte order.
+  void writeConcreteValue(unsigned offset, uint64_t value, unsigned numBytes);
+
+  /// Leave the bytes in [rangeBase, rangeBase + rangeSize) to the update
+  /// list only.
+  void dropCachedRange(unsigned rangeBase, unsigned rangeSize);
+
   void makeSymbolic();
 
   ref<Expr> read8(ref<Expr> offset) const;
@@ -267,7 +375,6 @@ private:
 
   void markByteConcrete(unsigned offset);
   void markByteSymbolic(unsigned offset);
-  void markByteFlushed(unsigned offset);
   void markByteUnflushed(unsigned offset);
   void setKnownSymbolic(unsigned offset, Expr *value);
 
@@ -31,10 +31,19 @@ DISABLE_WARNING_POP
 
 #include <cinttypes>
 #include <algorithm>
+#include <limits>
 #include <sys/mman.h>
 #include <tuple>
 #include <string>
 
+#if defined(__linux__)
+#include <fcntl.h>
+#include <linux/userfaultfd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 using namespace klee;
 
 namespace klee {
@@ -126,12 +135,62 @@ llvm::cl::opt<std::uint32_t, true, QuarantineSizeParser>
         llvm::cl::value_desc("size"), llvm::cl::init(8),
         llvm::cl::cat(MemoryCat));
 
+llvm::cl::opt<bool> DeterministicAllocationTrackWrites(
+    "kdalloc-track-writes",
+    llvm::cl::desc("Find the memory written by external calls by "
+                   "write-protecting it instead of comparing all objects, if "
+                   "the kernel supports it (default=true)"),
+    llvm::cl::init(true), llvm::cl::cat(MemoryCat));
+
 llvm::cl::opt<bool> NullOnZeroMalloc(
     "return-null-on-zero-malloc",
     llvm::cl::desc("Returns NULL if malloc(0) is called (default=false)"),
     llvm::cl::init(false), llvm::cl::cat(MemoryCat));
 } // namespace
 
+#if defined(__linux__)
+namespace {
+// Asynchronous write protection and PAGEMAP_SCAN appeared in Linux 6.7, so
+// the definitions of <linux/fs.h> and <linux/userfaultfd.h> are repeated for
+// older headers.
+#ifndef UFFD_USER_MODE_ONLY
+#define UFFD_USER_MODE_ONLY 1
+#endif
+#ifndef UFFDIO_REGISTER_MODE_WP
+#define UFFDIO_REGISTER_MODE_WP ((__u64)1 << 1)
+#endif
+constexpr std::uint64_t featureWPAsync = 1 << 15;
+
+struct PageRegion {
+  std::uint64_t start;
+  std::uint64_t end;
+  std::uint64_t categories;
+};
+
+struct PageMapScanArg {
+  std::uint64_t size;
+  std::uint64_t flags;
+  std::uint64_t start;
+  std::uint64_t end;
+  std::uint64_t walkEnd;
+  std::uint64_t vec;
+  std::uint64_t vecLen;
+  std::uint64_t maxPages;
+  std::uint64_t categoryInverted;
+  std::uint64_t categoryMask;
+  std::uint64_t categoryAnyofMask;
+  std::uint64_t returnMask;
+};
+
+constexpr unsigned long pageMapScan = _IOWR('f', 16, PageMapScanArg);
+constexpr std::uint64_t scanWPMatching = 1 << 0;
+constexpr std::uint64_t scanCheckWPAsync = 1 << 1;
+constexpr std::uint64_t pageIsWritten = 1 << 1;
+constexpr std::uint64_t pageIsPresent = 1 << 3;
+constexpr std::uint64_t pageIsSwapped = 1 << 4;
+} // namespace
+#endif
+
 /***/
 MemoryManager::MemoryManager(ArrayCache *_arrayCache)
     : arrayCache(_arrayCache) {
@@ -268,10 +327,14 @@ MemoryManager::MemoryManager(ArrayCache *_arrayCache)
         *allocator = factory.get().makeAllocator();
       }
     }
+
+    if (DeterministicAllocationTrackWrites)
+      initializeWriteTracking();
   }
 }
 
 MemoryManager::~MemoryManager() {
+  disableWriteTracking();
   while (!objects.empty()) {
     MemoryObject *mo = *objects.begin();
     if (!mo->isFixed && !DeterministicAllocation)
@@ -387,6 +450,153 @@ bool MemoryManager::markMappingsAsUnneeded() {
   return true;
 }
 
+void MemoryManager::initializeWriteTracking() {
+#if defined(__linux__) && defined(__NR_userfaultfd)
+  // User mode only needs no privileges. Writes from the kernel, e.g. by
+  // read(), are tracked nonetheless, as asynchronous write protection is
+  // resolved without userfaultfd events.
+  userfaultFd = syscall(__NR_userfaultfd, O_CLOEXEC | UFFD_USER_MODE_ONLY);
+  if (userfaultFd < 0)
+    return;
+
+  uffdio_api api = {};
+  api.api = UFFD_API;
+  api.features = featureWPAsync;
+  if (ioctl(userfaultFd, UFFDIO_API, &api) != 0 ||
+      (pagemapFd = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC)) < 0) {
+    disableWriteTracking();
+    return;
+  }
+
+  for (auto *factory : {&globalsFactory, &constantsFactory, &heapFactory,
+                        &stackFactory}) {
+    auto &mapping = factory->getMapping();
+    auto begin = reinterpret_cast<std::uint64_t>(mapping.getBaseAddress());
+    trackedMappings.emplace_back(begin, begin + mapping.getSize());
+  }
+  std::sort(trackedMappings.begin(), trackedMappings.end());
+
+  for (const auto &mapping : trackedMappings) {
+    uffdio_register reg = {};
+    reg.range.start = mapping.first;
+    reg.range.len = mapping.second - mapping.first;
+    reg.mode = UFFDIO_REGISTER_MODE_WP;
+    if (ioctl(userfaultFd, UFFDIO_REGISTER, &reg) != 0) {
+      disableWriteTracking();
+      return;
+    }
+  }
+
+  // Fail now rather than at the first external call without PAGEMAP_SCAN.
+  for (const auto &mapping : trackedMappings) {
+    if (!protectPages(mapping.first, mapping.second, nullptr,
+                      residentPages)) {
+      disableWriteTracking();
+      return;
+    }
+  }
+  klee_message("Deterministic allocator: Tracking writes by external calls");
+#endif
+}
+
+void MemoryManager::disableWriteTracking() {
+#if defined(__linux__)
+  if (pagemapFd >= 0)
+    close(pagemapFd);
+  // Closing the userfaultfd unregisters the mappings.
+  if (userfaultFd >= 0)
+    close(userfaultFd);
+#endif
+  userfaultFd = pagemapFd = -1;
+  trackedMappings.clear();
+  writesTracked = false;
+}
+
+bool MemoryManager::protectPages(std::uint64_t begin, std::uint64_t end,
+                                 AddressRanges *written,
+                                 std::size_t &resident) {
+#if defined(__linux__)
+  PageRegion regions[64];
+  PageMapScanArg arg = {};
+  arg.size = sizeof(arg);
+  arg.flags = scanWPMatching | scanCheckWPAsync;
+  arg.start = begin;
+  arg.end = end;
+  arg.vec = reinterpret_cast<std::uint64_t>(regions);
+  arg.vecLen = sizeof(regions) / sizeof(regions[0]);
+  // Only resident pages, as protecting the others would populate the page
+  // tables of the whole mapping.
+  arg.categoryAnyofMask = pageIsPresent | pageIsSwapped;
+  arg.returnMask = pageIsWritten;
+  while (arg.start < arg.end) {
+    long count = ioctl(pagemapFd, pageMapScan, &arg);
+    if (count < 0)
+      return false;
+    for (long i = 0; i < count; ++i) {
+      const PageRegion &region = regions[i];
+      resident += (region.end - region.start) / pageSize;
+      if (!written || !(region.categories & pageIsWritten))
+        continue;
+      if (!written->empty() && written->back().second == region.start)
+        written->back().second = region.end;
+      else
+        written->emplace_back(region.start, region.end);
+    }
+    // The scan stops early when the regions are full.
+    arg.start = arg.walkEnd;
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool MemoryManager::trackWrites() {
+  writesTracked = false;
+  if (pagemapFd < 0)
+    return false;
+
+  residentPages = 0;
+  for (const auto &mapping : trackedMappings) {
+    if (!protectPages(mapping.first, mapping.second, nullptr,
+                      residentPages)) {
+      klee_warning("Deterministic allocator: Could not write-protect memory, "
+                   "comparing all objects after external calls");
+      disableWriteTracking();
+      return false;
+    }
+  }
+  writesTracked = true;
+  return true;
+}
+
+void MemoryManager::getWrittenRanges(AddressRanges &ranges) {
+  ranges.clear();
+  if (writesTracked) {
+    writesTracked = false;
+    std::size_t resident = 0;
+    std::uint64_t untracked = 0;
+    bool success = true;
+    for (const auto &mapping : trackedMappings) {
+      if (untracked < mapping.first)
+        ranges.emplace_back(untracked, mapping.first);
+      success = protectPages(mapping.first, mapping.second, &ranges, resident);
+      if (!success)
+        break;
+      untracked = mapping.second;
+    }
+    if (success) {
+      ranges.emplace_back(untracked, std::numeric_limits<std::uint64_t>::max());
+      return;
+    }
+    klee_warning("Deterministic allocator: Could not find written memory, "
+                 "comparing all objects after external calls");
+    disableWriteTracking();
+    ranges.clear();
+  }
+  ranges.emplace_back(0, std::numeric_limits<std::uint64_t>::max());
+}
+
 size_t MemoryManager::getUsedDeterministicSize() {
   // TODO: implement
   return 0;
@@ -15,6 +15,8 @@
 #include <cstddef>
 #include <set>
 #include <cstdint>
+#include <utility>
+#include <vector>
 
 namespace llvm {
 class Value;
@@ -26,6 +28,10 @@ class ExecutionState;
 class MemoryObject;
 
 class MemoryManager {
+public:
+  /// Native address ranges [first, second) in address order
+  typedef std::vector<std::pair<std::uint64_t, std::uint64_t>> AddressRanges;
+
 private:
   typedef std::set<MemoryObject *> objects_ty;
   objects_ty objects;
@@ -37,6 +43,25 @@ private:
   kdalloc::AllocatorFactory constantsFactory;
   kdalloc::Allocator constantsAllocator;
 
+  /// The userfaultfd write-protecting the deterministically allocated
+  /// mappings, and /proc/self/pagemap for finding the written pages, or -1
+  /// if writes are not tracked
+  int userfaultFd = -1;
+  int pagemapFd = -1;
+  /// The tracked mappings in address order
+  AddressRanges trackedMappings;
+  /// Whether the writes since the last call to trackWrites are known
+  bool writesTracked = false;
+  std::size_t residentPages = 0;
+
+  void initializeWriteTracking();
+  void disableWriteTracking();
+  /// Write-protect the resident pages in [begin, end), appending the ranges
+  /// written since they were last protected to \p written if not null and
+  /// adding the number of resident pages to \p resident.
+  bool protectPages(std::uint64_t begin, std::uint64_t end,
+                    AddressRanges *written, std::size_t &resident);
+
 public:
   explicit MemoryManager(ArrayCache *arrayCache);
   ~MemoryManager();
@@ -61,6 +86,23 @@ public:
                               const llvm::Value *allocSite);
   void markFreed(MemoryObject *mo);
   bool markMappingsAsUnneeded();
+
+  /// Start tracking the native writes to the deterministically allocated
+  /// memory, e.g. by an external call. This write-protects the memory with
+  /// userfaultfd, and is only supported by Linux 6.7 and later.
+  /// \return true iff writes are tracked
+  bool trackWrites();
+
+  /// Number of resident pages of the deterministically allocated memory
+  /// when trackWrites last succeeded
+  std::size_t getResidentPages() const { return residentPages; }
+
+  /// Set \p ranges to the native memory that may have been written since
+  /// the last call to trackWrites: its written pages if it succeeded, and
+  /// all memory outside the tracked mappings. Everything may have been
+  /// written if it did not.
+  void getWrittenRanges(AddressRanges &ranges);
+
   ArrayCache *getArrayCache() const { return arrayCache; }
 
   /*
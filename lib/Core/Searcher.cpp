@@ -259,7 +259,7 @@ void WeightedRandomSearcher::printName(llvm::raw_ostream &os) {
 
 // Check if n is a valid pointer and a node belonging to us
 #define IS_OUR_NODE_VALID(n)                                                   \
-  (((n).getPointer() != nullptr) && (((n).getInt() & idBitMask) != 0))
+  ((bool)(n) && (((n).getInt() & idBitMask) != 0))
 
 RandomPathSearcher::RandomPathSearcher(InMemoryExecutionTree *executionTree, RNG &rng)
     : executionTree{executionTree}, theRNG{rng},
@@ -271,24 +271,26 @@ ExecutionState &RandomPathSearcher::selectState() {
   unsigned flips=0, bits=0;
   assert(executionTree->root.getInt() & idBitMask &&
          "Root should belong to the searcher");
-  ExecutionTreeNode *n = executionTree->root.getPointer();
+  const ExecutionTreeNodePool &nodes = executionTree->getNodePool();
+  const ExecutionTreeNode *n = &nodes[executionTree->root.getIndex()];
   while (!n->state) {
+    ExecutionTreeNodePtr next;
     if (!IS_OUR_NODE_VALID(n->left)) {
       assert(IS_OUR_NODE_VALID(n->right) && "Both left and right nodes invalid");
-      assert(n != n->right.getPointer());
-      n = n->right.getPointer();
+      next = n->right;
     } else if (!IS_OUR_NODE_VALID(n->right)) {
       assert(IS_OUR_NODE_VALID(n->left) && "Both right and left nodes invalid");
-      assert(n != n->left.getPointer());
-      n = n->left.getPointer();
+      next = n->left;
     } else {
       if (bits==0) {
         flips = theRNG.getInt32();
         bits = 32;
       }
       --bits;
-      n = ((flips & (1U << bits)) ? n->left : n->right).getPointer();
+      next = (flips & (1U << bits)) ? n->left : n->right;
     }
+    assert(n != &nodes[next.getIndex()]);
+    n = &nodes[next.getIndex()];
   }
 
   return *n->state;
@@ -299,41 +301,27 @@ void RandomPathSearcher::update(ExecutionState *current,
                                 const std::vector<ExecutionState *> &removedStates) {
   // insert states
   for (auto es : addedStates) {
-    ExecutionTreeNode *etnode = es->executionTreeNode, *parent = etnode->parent;
-    ExecutionTreeNodePtr *childPtr;
-
-    childPtr = parent ? ((parent->left.getPointer() == etnode) ? &parent->left
-                                                               : &parent->right)
-                      : &executionTree->root;
-    while (etnode && !IS_OUR_NODE_VALID(*childPtr)) {
-      childPtr->setInt(childPtr->getInt() | idBitMask);
-      etnode = parent;
-      if (etnode)
-        parent = etnode->parent;
-
-      childPtr = parent
-                     ? ((parent->left.getPointer() == etnode) ? &parent->left
-                                                              : &parent->right)
-                     : &executionTree->root;
+    ExecutionTreeNodeIndex etnode = es->executionTreeNode;
+    while (etnode) {
+      ExecutionTreeNodePtr &childPtr = executionTree->getPtrTo(etnode);
+      if (IS_OUR_NODE_VALID(childPtr))
+        break;
+      childPtr.setInt(childPtr.getInt() | idBitMask);
+      etnode = executionTree->getNode(etnode).parent;
     }
   }
 
   // remove states
   for (auto es : removedStates) {
-    ExecutionTreeNode *etnode = es->executionTreeNode, *parent = etnode->parent;
-
-    while (etnode && !IS_OUR_NODE_VALID(etnode->left) &&
-           !IS_OUR_NODE_VALID(etnode->right)) {
-      auto childPtr =
-          parent ? ((parent->left.getPointer() == etnode) ? &parent->left
-                                                          : &parent->right)
-                 : &executionTree->root;
-      assert(IS_OUR_NODE_VALID(*childPtr) &&
+    ExecutionTreeNodeIndex etnode = es->executionTreeNode;
+
+    while (etnode && !IS_OUR_NODE_VALID(executionTree->getNode(etnode).left) &&
+           !IS_OUR_NODE_VALID(executionTree->getNode(etnode).right)) {
+      ExecutionTreeNodePtr &childPtr = executionTree->getPtrTo(etnode);
+      assert(IS_OUR_NODE_VALID(childPtr) &&
              "Removing executionTree child not ours");
-      childPtr->setInt(childPtr->getInt() & ~idBitMask);
-      etnode = parent;
-      if (etnode)
-        parent = etnode->parent;
+      childPtr.setInt(childPtr.getInt() & ~idBitMask);
+      etnode = executionTree->getNode(etnode).parent;
     }
   }
 }
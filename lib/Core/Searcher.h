@@ -165,14 +165,11 @@ namespace klee {
   /// To support this, RandomPathSearcher has a subgraph view of ExecutionTree,
   /// in that it only walks the ExecutionTreeNodes that it "owns". Ownership is
   /// stored in the getInt method of the ExecutionTreeNodePtr class (which hides
-  /// it in the pointer itself).
+  /// it in the low bits of the node index).
   ///
   /// The current implementation of ExecutionTreeNodePtr supports only 3
-  /// instances of the RandomPathSearcher. This is because the current
-  /// ExecutionTreeNodePtr implementation conforms to C++ and only steals the
-  /// last 3 alignment bits. This restriction could be relaxed slightly by an
-  /// architecture-specific implementation of ExecutionTreeNodePtr that also
-  /// steals the top bits of the pointer.
+  /// instances of the RandomPathSearcher, as it reserves 3 of the 32 bits for
+  /// the tag. More tag bits would lower the maximum number of nodes.
   ///
   /// The ownership bits are maintained in the update method.
   class RandomPathSearcher final : public Searcher {
@@ -26,6 +26,7 @@
 #include "CoreStats.h"
 #include "Executor.h"
 #include "MemoryManager.h"
+#include "UncoveredDistances.h"
 #include "UserSearcher.h"
 
 #include "klee/Support/CompilerWarning.h"
@@ -111,6 +112,12 @@ cl::opt<std::string> UncoveredUpdateInterval(
     cl::desc("Update interval for uncovered instructions (default=30s)"),
     cl::cat(StatsCat));
 
+cl::opt<bool> UncoveredUpdateInBackground(
+    "uncovered-update-background", cl::init(true),
+    cl::desc("Update the distances to uncovered instructions on a background "
+             "thread (default=true)"),
+    cl::cat(StatsCat));
+
 cl::opt<bool> UseCallPaths("use-call-paths", cl::init(true),
                            cl::desc("Enable calltree tracking for instruction "
                                     "level statistics (default=true)"),
@@ -310,12 +317,13 @@ StatsTracker::~StatsTracker() {
 }
 
 void StatsTracker::done() {
+  theStatisticManager->mergeThreadStats();
   if (statsFile)
     writeStatsLine();
 
   if (OutputIStats) {
     if (updateMinDistToUncovered)
-      computeReachableUncovered();
+      computeReachableUncovered(/*wait=*/true);
     if (istatsFile)
       writeIStats();
   }
@@ -363,6 +371,8 @@ void StatsTracker::stepInstruction(ExecutionState &es) {
         es.instsSinceCovNew = 1;
 	++stats::coveredInstructions;
 	stats::uncoveredInstructions += (uint64_t)-1;
+        if (uncoveredDistances)
+          uncoveredDistances->cover(ii.id);
       }
     }
   }
@@ -463,10 +473,16 @@ void StatsTracker::writeStatsHeader() {
          << "QueryCacheHits INTEGER,"
          << "QueryCexCacheMisses INTEGER,"
          << "QueryCexCacheHits INTEGER,"
+         << "QueryPersistentCacheMisses INTEGER,"
+         << "QueryPersistentCacheHits INTEGER,"
          << "InhibitedForks INTEGER,"
          << "ExternalCalls INTEGER,"
+         << "NativeCalls INTEGER,"
          << "Allocations INTEGER,"
          << "States INTEGER,"
+         << "PortfolioWinsSTP INTEGER,"
+         << "PortfolioWinsMetaSMT INTEGER,"
+         << "PortfolioWinsZ3 INTEGER,"
          BRANCH_TYPES
          TERMINATION_CLASSES
          << "ArrayHashTime INTEGER"
@@ -509,10 +525,16 @@ void StatsTracker::writeStatsHeader() {
          << "QueryCacheHits,"
          << "QueryCexCacheMisses,"
          << "QueryCexCacheHits,"
+         << "QueryPersistentCacheMisses,"
+         << "QueryPersistentCacheHits,"
          << "InhibitedForks,"
          << "ExternalCalls,"
+         << "NativeCalls,"
          << "Allocations,"
          << "States,"
+         << "PortfolioWinsSTP,"
+         << "PortfolioWinsMetaSMT,"
+         << "PortfolioWinsZ3,"
          BRANCH_TYPES
          TERMINATION_CLASSES
          << "ArrayHashTime"
@@ -548,6 +570,12 @@ void StatsTracker::writeStatsHeader() {
          << "?,"
          << "?,"
          << "?,"
+         << "?,"
+         << "?,"
+         << "?,"
+         << "?,"
+         << "?,"
+         << "?,"
          BRANCH_TYPES
          TERMINATION_CLASSES
          << "? "
@@ -563,6 +591,8 @@ time::Span StatsTracker::elapsed() {
 }
 
 void StatsTracker::writeStatsLine() {
+  theStatisticManager->mergeThreadStats();
+
   #undef BTYPE
   #define BTYPE(Name,I) sqlite3_bind_int64(insertStmt, arg++, stats::branches ## Name);
   #undef TCLASS
@@ -590,10 +620,16 @@ void StatsTracker::writeStatsLine() {
   sqlite3_bind_int64(insertStmt, arg++, stats::queryCacheHits);
   sqlite3_bind_int64(insertStmt, arg++, stats::queryCexCacheMisses);
   sqlite3_bind_int64(insertStmt, arg++, stats::queryCexCacheHits);
+  sqlite3_bind_int64(insertStmt, arg++, stats::queryPersistentCacheMisses);
+  sqlite3_bind_int64(insertStmt, arg++, stats::queryPersistentCacheHits);
   sqlite3_bind_int64(insertStmt, arg++, stats::inhibitedForks);
   sqlite3_bind_int64(insertStmt, arg++, stats::externalCalls);
+  sqlite3_bind_int64(insertStmt, arg++, stats::nativeCalls);
   sqlite3_bind_int64(insertStmt, arg++, stats::allocations);
   sqlite3_bind_int64(insertStmt, arg++, ExecutionState::getLastID());
+  sqlite3_bind_int64(insertStmt, arg++, stats::portfolioWinsSTP);
+  sqlite3_bind_int64(insertStmt, arg++, stats::portfolioWinsMetaSMT);
+  sqlite3_bind_int64(insertStmt, arg++, stats::portfolioWinsZ3);
   BRANCH_TYPES
   TERMINATION_CLASSES
 #ifdef KLEE_ARRAY_DEBUG
@@ -824,16 +860,13 @@ uint64_t klee::computeMinDistToUncovered(const KInstruction *ki,
   }
 }
 
-void StatsTracker::computeReachableUncovered() {
+void StatsTracker::computeReachableUncovered(bool wait) {
   KModule *km = executor.kmodule.get();
   const auto m = km->module.get();
-  static bool init = true;
   const InstructionInfoTable &infos = *km->infos;
   StatisticManager &sm = *theStatisticManager;
   
-  if (init) {
-    init = false;
-
+  if (!uncoveredDistances) {
     // Compute call targets. It would be nice to use alias information
     // instead of assuming all indirect calls hit all escaping
     // functions, eh?
@@ -960,86 +993,59 @@ void StatsTracker::computeReachableUncovered() {
         }
       }
     } while (changed);
-  }
 
-  // compute minDistToUncovered, 0 is unreachable
-  std::vector<Instruction *> instructions;
-  for (Module::iterator fnIt = m->begin(), fn_ie = m->end(); 
-       fnIt != fn_ie; ++fnIt) {
-    // Not sure if I should bother to preorder here.
-    for (Function::iterator bbIt = fnIt->begin(), bb_ie = fnIt->end(); 
-         bbIt != bb_ie; ++bbIt) {
-      for (BasicBlock::iterator it = bbIt->begin(), ie = bbIt->end(); 
-           it != ie; ++it) {
-        Instruction *inst = &*it;
-        unsigned id = infos.getInfo(*inst).id;
-        instructions.push_back(inst);
-        sm.setIndexedValue(stats::minDistToUncovered, 
-                           id, 
-                           sm.getIndexedValue(stats::uncoveredInstructions, id));
-      }
+    // Hand the module to the incremental computation of minDistToUncovered,
+    // 0 is unreachable.
+    UncoveredDistances::Graph graph;
+    std::map<Function *, unsigned> functionIndex;
+    for (Function &fn : *m) {
+      functionIndex[&fn] = graph.entries.size();
+      graph.entries.push_back(fn.isDeclaration()
+                                  ? UncoveredDistances::None
+                                  : infos.getInfo(fn.front().front()).id);
     }
-  }
-  
-  std::reverse(instructions.begin(), instructions.end());
-  
-  // I'm so lazy it's not even worklisted.
-  bool changed;
-  do {
-    changed = false;
-    for (std::vector<Instruction*>::iterator it = instructions.begin(),
-           ie = instructions.end(); it != ie; ++it) {
-      Instruction *inst = *it;
-      uint64_t best, cur = best = sm.getIndexedValue(stats::minDistToUncovered,
-                                                     infos.getInfo(*inst).id);
-      unsigned bestThrough = 0;
-      
+
+    unsigned numIds = infos.getMaxID();
+    graph.functionOf.assign(numIds, UncoveredDistances::None);
+    graph.through.assign(numIds, 0);
+    std::vector<bool> uncovered(numIds, false);
+    for (Instruction *inst : instructions) {
+      unsigned id = infos.getInfo(*inst).id;
+      graph.functionOf[id] = functionIndex[inst->getFunction()];
+      uncovered[id] = sm.getIndexedValue(stats::uncoveredInstructions, id);
+
+      uint64_t bestThrough = 0;
       if (isa<CallInst>(inst) || isa<InvokeInst>(inst)) {
-        std::vector<Function*> &targets = callTargets[inst];
-        for (std::vector<Function*>::iterator fnIt = targets.begin(),
-               ie = targets.end(); fnIt != ie; ++fnIt) {
-          uint64_t dist = functionShortestPath[*fnIt];
+        for (Function *target : callTargets[inst]) {
+          graph.calls.emplace_back(id, functionIndex[target]);
+          uint64_t dist = functionShortestPath[target];
           if (dist) {
             dist = 1+dist; // count instruction itself
             if (bestThrough==0 || dist<bestThrough)
               bestThrough = dist;
           }
-
-          if (!(*fnIt)->isDeclaration()) {
-            uint64_t calleeDist = sm.getIndexedValue(
-                stats::minDistToUncovered, infos.getFunctionInfo(*(*fnIt)).id);
-            if (calleeDist) {
-              calleeDist = 1+calleeDist; // count instruction itself
-              if (best==0 || calleeDist<best)
-                best = calleeDist;
-            }
-          }
         }
       } else {
         bestThrough = 1;
       }
-      
-      if (bestThrough) {
-        std::vector<Instruction*> succs = getSuccs(inst);
-        for (std::vector<Instruction*>::iterator it2 = succs.begin(),
-               ie = succs.end(); it2 != ie; ++it2) {
-          uint64_t dist = sm.getIndexedValue(stats::minDistToUncovered,
-                                             infos.getInfo(*(*it2)).id);
-          if (dist) {
-            uint64_t val = bestThrough + dist;
-            if (best==0 || val<best)
-              best = val;
-          }
-        }
-      }
+      graph.through[id] = bestThrough;
 
-      if (best != cur) {
-        sm.setIndexedValue(stats::minDistToUncovered, infos.getInfo(*inst).id,
-                           best);
-        changed = true;
-      }
+      for (Instruction *succ : getSuccs(inst))
+        graph.successors.emplace_back(id, infos.getInfo(*succ).id);
     }
-  } while (changed);
+
+    uncoveredDistances = std::make_unique<UncoveredDistances>(
+        graph, std::move(uncovered), UncoveredUpdateInBackground);
+    wait = true;
+  }
+
+  std::vector<UncoveredDistances::Change> changes;
+  uncoveredDistances->collect(changes, wait);
+  if (changes.empty())
+    return;
+  for (const auto &change : changes)
+    sm.setIndexedValue(stats::minDistToUncovered, change.first,
+                       change.second);
 
   for (std::set<ExecutionState*>::iterator it = executor.states.begin(),
          ie = executor.states.end(); it != ie; ++it) {
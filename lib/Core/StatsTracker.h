@@ -31,6 +31,7 @@ namespace klee {
   class InterpreterHandler;
   struct KInstruction;
   struct StackFrame;
+  class UncoveredDistances;
 
   class StatsTracker {
     friend class WriteStatsTimer;
@@ -54,6 +55,7 @@ namespace klee {
     CallPathManager callPathManager;
 
     bool updateMinDistToUncovered;
+    std::unique_ptr<UncoveredDistances> uncoveredDistances;
 
   public:
     static bool useStatistics();
@@ -97,7 +99,10 @@ namespace klee {
     /// Return duration since execution start.
     time::Span elapsed();
 
-    void computeReachableUncovered();
+    /// Update the distances to uncovered instructions with the changes the
+    /// background update has finished so far, or all changes if `wait` is
+    /// set.
+    void computeReachableUncovered(bool wait = false);
   };
 
   uint64_t computeMinDistToUncovered(const KInstruction *ki,
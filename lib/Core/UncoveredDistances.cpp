@@ -0,0 +1,213 @@
+//===-- UncoveredDistances.cpp --------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "UncoveredDistances.h"
+
+#include <cassert>
+#include <functional>
+#include <queue>
+
+using namespace klee;
+
+void UncoveredDistances::Adjacency::build(
+    unsigned size, const std::vector<std::pair<unsigned, unsigned>> &edges) {
+  offsets.assign(size + 1, 0);
+  for (const auto &edge : edges)
+    ++offsets[edge.first + 1];
+  for (unsigned i = 0; i < size; ++i)
+    offsets[i + 1] += offsets[i];
+
+  targets.resize(edges.size());
+  std::vector<unsigned> next(offsets.begin(), offsets.end() - 1);
+  for (const auto &edge : edges)
+    targets[next[edge.first]++] = edge.second;
+}
+
+UncoveredDistances::UncoveredDistances(const Graph &graph,
+                                       std::vector<bool> _uncovered,
+                                       bool background)
+    : functionOf(graph.functionOf), through(graph.through),
+      entries(graph.entries), uncovered(std::move(_uncovered)),
+      distances(graph.functionOf.size(), 0) {
+  unsigned numIds = functionOf.size();
+  unsigned numFunctions = entries.size();
+  assert(through.size() == numIds && uncovered.size() == numIds &&
+         "inconsistent graph");
+
+  std::vector<std::pair<unsigned, unsigned>> edges;
+  edges.reserve(graph.successors.size());
+  for (const auto &edge : graph.successors)
+    edges.emplace_back(edge.second, edge.first);
+  predecessors.build(numIds, edges);
+
+  callees.build(numIds, graph.calls);
+  edges.clear();
+  for (const auto &call : graph.calls)
+    edges.emplace_back(call.second, call.first);
+  callSites.build(numFunctions, edges);
+
+  edges.clear();
+  for (unsigned id = 0; id < numIds; ++id)
+    if (functionOf[id] != None)
+      edges.emplace_back(functionOf[id], id);
+  instructions.build(numFunctions, edges);
+
+  std::vector<unsigned> functions(numFunctions);
+  for (unsigned f = 0; f < numFunctions; ++f)
+    functions[f] = f;
+  recompute(functions, std::vector<bool>(numFunctions, true), changes);
+
+  if (background)
+    worker = std::thread([this] { work(); });
+}
+
+UncoveredDistances::~UncoveredDistances() {
+  if (!worker.joinable())
+    return;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  submitted.notify_all();
+  worker.join();
+}
+
+void UncoveredDistances::work() {
+  std::unique_lock<std::mutex> guard(lock);
+  while (true) {
+    submitted.wait(guard, [this] { return stopping || !queue.empty(); });
+    if (stopping)
+      break;
+    std::vector<unsigned> covered;
+    covered.swap(queue);
+    busy = true;
+    guard.unlock();
+
+    std::vector<Change> out;
+    update(covered, out);
+
+    guard.lock();
+    changes.insert(changes.end(), out.begin(), out.end());
+    busy = false;
+    finished.notify_all();
+  }
+}
+
+void UncoveredDistances::collect(std::vector<Change> &out, bool wait) {
+  if (!worker.joinable()) {
+    update(pending, changes);
+    pending.clear();
+    out.insert(out.end(), changes.begin(), changes.end());
+    changes.clear();
+    return;
+  }
+
+  std::unique_lock<std::mutex> guard(lock);
+  if (!pending.empty()) {
+    queue.insert(queue.end(), pending.begin(), pending.end());
+    pending.clear();
+    submitted.notify_one();
+  }
+  if (wait)
+    finished.wait(guard, [this] { return !busy && queue.empty(); });
+  out.insert(out.end(), changes.begin(), changes.end());
+  changes.clear();
+}
+
+void UncoveredDistances::update(const std::vector<unsigned> &covered,
+                                std::vector<Change> &out) {
+  std::vector<bool> affected(entries.size(), false);
+  std::vector<unsigned> functions;
+  for (unsigned id : covered) {
+    if (id >= uncovered.size() || !uncovered[id])
+      continue;
+    uncovered[id] = false;
+    unsigned f = functionOf[id];
+    if (f != None && !affected[f]) {
+      affected[f] = true;
+      functions.push_back(f);
+    }
+  }
+  if (functions.empty())
+    return;
+
+  // Callers depend on the entry distances of their callees.
+  for (std::size_t i = 0; i < functions.size(); ++i) {
+    for (auto it = callSites.begin(functions[i]),
+              ie = callSites.end(functions[i]);
+         it != ie; ++it) {
+      unsigned caller = functionOf[*it];
+      if (!affected[caller]) {
+        affected[caller] = true;
+        functions.push_back(caller);
+      }
+    }
+  }
+
+  recompute(functions, affected, out);
+}
+
+void UncoveredDistances::recompute(const std::vector<unsigned> &functions,
+                                   const std::vector<bool> &affected,
+                                   std::vector<Change> &out) {
+  using Item = std::pair<std::uint64_t, unsigned>;
+  std::priority_queue<Item, std::vector<Item>, std::greater<Item>> heap;
+
+  auto relax = [&](unsigned id, std::uint64_t dist) {
+    if (distances[id] == 0 || dist < distances[id]) {
+      distances[id] = dist;
+      heap.emplace(dist, id);
+    }
+  };
+
+  // Reset the affected instructions to their own coverage, seeded with the
+  // distances of callees that stay as they are.
+  std::vector<Change> previous;
+  for (unsigned f : functions) {
+    for (auto it = instructions.begin(f), ie = instructions.end(f); it != ie;
+         ++it) {
+      unsigned id = *it;
+      previous.emplace_back(id, distances[id]);
+      distances[id] = 0;
+      if (uncovered[id]) {
+        relax(id, 1);
+        continue;
+      }
+      for (auto cit = callees.begin(id), cie = callees.end(id); cit != cie;
+           ++cit) {
+        unsigned entry = entries[*cit];
+        if (!affected[*cit] && entry != None && distances[entry])
+          relax(id, 1 + distances[entry]);
+      }
+    }
+  }
+
+  while (!heap.empty()) {
+    Item item = heap.top();
+    heap.pop();
+    std::uint64_t dist = item.first;
+    unsigned id = item.second;
+    if (dist != distances[id])
+      continue;
+
+    for (auto it = predecessors.begin(id), ie = predecessors.end(id); it != ie;
+         ++it)
+      if (through[*it])
+        relax(*it, through[*it] + dist);
+
+    unsigned f = functionOf[id];
+    if (entries[f] == id)
+      for (auto it = callSites.begin(f), ie = callSites.end(f); it != ie; ++it)
+        relax(*it, 1 + dist);
+  }
+
+  for (const auto &p : previous)
+    if (distances[p.first] != p.second)
+      out.emplace_back(p.first, distances[p.first]);
+}
@@ -0,0 +1,130 @@
+//===-- UncoveredDistances.h ------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_UNCOVEREDDISTANCES_H
+#define KLEE_UNCOVEREDDISTANCES_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace klee {
+
+/// UncoveredDistances - Maintains the distance from every instruction to the
+/// nearest uncovered instruction as coverage grows.
+///
+/// The distance of an instruction only depends on the instructions of its
+/// function and, through call sites, on the entries of its callees. Newly
+/// covered instructions therefore only require recomputing their functions
+/// and the transitive callers of those, which is done with a shortest path
+/// search restricted to these functions. Distances are counted in
+/// instructions, with 1 for an uncovered instruction and 0 if no uncovered
+/// instruction is reachable.
+///
+/// Updates can run on a background thread. The interpreter reports covered
+/// instructions with cover() and picks up the resulting distance changes
+/// with collect(); the worker owns all distances in between.
+class UncoveredDistances {
+public:
+  static constexpr unsigned None = ~0u;
+
+  struct Graph {
+    /// Function of every id, `None` for ids that are not instructions
+    std::vector<unsigned> functionOf;
+    /// Distance added by stepping over an instruction: 1, or for calls
+    /// the shortest path through a callee, 0 if it never returns
+    std::vector<std::uint64_t> through;
+    /// Id of the entry instruction of every function, `None` for
+    /// declarations
+    std::vector<unsigned> entries;
+    /// Control flow edges between instructions of the same function
+    std::vector<std::pair<unsigned, unsigned>> successors;
+    /// (call site, callee function) pairs
+    std::vector<std::pair<unsigned, unsigned>> calls;
+  };
+
+  using Change = std::pair<unsigned, std::uint64_t>;
+
+private:
+  /// Compressed adjacency lists: the neighbours of `i` are
+  /// `targets[offsets[i]]` to `targets[offsets[i + 1]]`.
+  struct Adjacency {
+    std::vector<unsigned> offsets;
+    std::vector<unsigned> targets;
+
+    void build(unsigned size,
+               const std::vector<std::pair<unsigned, unsigned>> &edges);
+    const unsigned *begin(unsigned i) const {
+      return targets.data() + offsets[i];
+    }
+    const unsigned *end(unsigned i) const {
+      return targets.data() + offsets[i + 1];
+    }
+  };
+
+  std::vector<unsigned> functionOf;
+  std::vector<std::uint64_t> through;
+  std::vector<unsigned> entries;
+  Adjacency predecessors;
+  Adjacency callees;
+  Adjacency callSites;
+  Adjacency instructions;
+
+  // Owned by the worker, or by the caller without a worker.
+  std::vector<bool> uncovered;
+  std::vector<std::uint64_t> distances;
+
+  /// Covered instructions not handed to the worker yet
+  std::vector<unsigned> pending;
+
+  std::mutex lock;
+  std::condition_variable submitted;
+  std::condition_variable finished;
+  /// Covered instructions handed to the worker
+  std::vector<unsigned> queue;
+  /// Distance changes not collected yet, in the order they happened
+  std::vector<Change> changes;
+  bool busy = false;
+  bool stopping = false;
+  std::thread worker;
+
+  void work();
+  /// Recompute the distances of the functions affected by covering
+  /// `covered` and append the changed distances to `out`.
+  void update(const std::vector<unsigned> &covered, std::vector<Change> &out);
+  /// Recompute the distances of `functions`, which must contain all
+  /// callers of its members. `affected` marks the members.
+  void recompute(const std::vector<unsigned> &functions,
+                 const std::vector<bool> &affected, std::vector<Change> &out);
+
+public:
+  /// Compute the initial distances, which the first collect() returns.
+  /// \param background update on a worker thread
+  UncoveredDistances(const Graph &graph, std::vector<bool> uncovered,
+                     bool background);
+  ~UncoveredDistances();
+
+  UncoveredDistances(const UncoveredDistances &) = delete;
+  UncoveredDistances &operator=(const UncoveredDistances &) = delete;
+
+  /// Record that an instruction has been covered.
+  void cover(unsigned id) { pending.push_back(id); }
+
+  /// Hand the instructions covered since the last call to the worker, and
+  /// move the distance changes computed so far into `out`. If `wait` is
+  /// set, block until all updates are done.
+  void collect(std::vector<Change> &out, bool wait);
+};
+
+} // namespace klee
+
+#endif /* KLEE_UNCOVEREDDISTANCES_H */
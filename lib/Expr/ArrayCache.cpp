@@ -2,6 +2,27 @@
 
 namespace klee {
 
+unsigned ConstantArrayHashFn::operator()(const Array *array) const {
+  unsigned res = array->size;
+  res = (res * Expr::MAGIC_HASH_CONSTANT) + array->getDomain();
+  res = (res * Expr::MAGIC_HASH_CONSTANT) + array->getRange();
+  for (const ref<ConstantExpr> &value : array->constantValues)
+    res = (res * Expr::MAGIC_HASH_CONSTANT) + value->hash();
+  return res;
+}
+
+bool ConstantArrayCmpFn::operator()(const Array *array1,
+                                    const Array *array2) const {
+  if (array1->size != array2->size ||
+      array1->getDomain() != array2->getDomain() ||
+      array1->getRange() != array2->getRange())
+    return false;
+  for (unsigned i = 0, e = array1->constantValues.size(); i != e; ++i)
+    if (array1->constantValues[i] != array2->constantValues[i])
+      return false;
+  return true;
+}
+
 ArrayCache::~ArrayCache() {
   // Free Allocated Array objects
   for (ArrayHashMap::iterator ai = cachedSymbolicArrays.begin(),
@@ -9,8 +30,8 @@ ArrayCache::~ArrayCache() {
        ai != e; ++ai) {
     delete *ai;
   }
-  for (ArrayPtrVec::iterator ai = concreteArrays.begin(),
-                             e = concreteArrays.end();
+  for (ConstantArrayHashMap::iterator ai = cachedConstantArrays.begin(),
+                                      e = cachedConstantArrays.end();
        ai != e; ++ai) {
     delete *ai;
   }
@@ -38,10 +59,16 @@ ArrayCache::CreateArray(const std::string &_name, uint64_t _size,
            "Cached symbolic array is no longer symbolic");
     return array;
   } else {
-    // Treat every constant array as distinct so we never cache them
     assert(array->isConstantArray());
-    concreteArrays.push_back(array); // For deletion later
-    return array;
+    std::pair<ConstantArrayHashMap::const_iterator, bool> success =
+        cachedConstantArrays.insert(array);
+    if (success.second) {
+      // Cache miss
+      return array;
+    }
+    // Cache hit: an array with the same contents exists already
+    delete array;
+    return *(success.first);
   }
 }
 }
@@ -0,0 +1,442 @@
+//===-- CompiledExpr.cpp --------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Expr/CompiledExpr.h"
+
+#include "klee/Expr/Assignment.h"
+#include "klee/Expr/ExprHashMap.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+using namespace klee;
+
+namespace {
+const std::uint32_t NoRegister = ~std::uint32_t(0);
+
+inline std::uint64_t maskOf(Expr::Width w) {
+  return w == 64 ? ~std::uint64_t(0) : (std::uint64_t(1) << w) - 1;
+}
+
+/// Sign extend the low `w` bits of `v`.
+inline std::int64_t sext(std::uint64_t v, Expr::Width w) {
+  return std::int64_t(v << (64 - w)) >> (64 - w);
+}
+
+bool evaluateRoots(const Assignment &a, const std::vector<ref<Expr>> &roots) {
+  AssignmentEvaluator v(a);
+  for (const ref<Expr> &e : roots)
+    if (!v.visit(e)->isTrue())
+      return false;
+  return true;
+}
+} // namespace
+
+class CompiledExpr::Compiler {
+  CompiledExpr &ce;
+  ExprHashMap<std::uint32_t> compiled;
+  std::unordered_map<const Array *, std::uint32_t> slotOf;
+
+  std::uint32_t emit(Expr::Kind kind, Expr::Width width,
+                     Expr::Width operandWidth, std::uint32_t a = NoRegister,
+                     std::uint32_t b = NoRegister, std::uint32_t c = NoRegister,
+                     std::uint64_t value = 0) {
+    ce.program.push_back({kind, width, operandWidth, a, b, c, value});
+    return ce.program.size() - 1;
+  }
+
+  std::uint32_t getSlot(const Array *array) {
+    auto it = slotOf.find(array);
+    if (it != slotOf.end())
+      return it->second;
+    Slot slot{array, {}};
+    for (const ref<ConstantExpr> &value : array->constantValues)
+      slot.constantValues.push_back(value->getZExtValue(8));
+    ce.slots.push_back(std::move(slot));
+    return slotOf[array] = ce.slots.size() - 1;
+  }
+
+  /// Compile a read as a read of the array behind a chain of selects, one
+  /// for every update that may write the read index. Updates at constant
+  /// indices are resolved here when the read index is constant too.
+  std::uint32_t compileRead(const ReadExpr &re) {
+    const Array *array = re.updates.root;
+    if (array->getRange() != Expr::Int8 || array->getDomain() > 64) {
+      failed = true;
+      return NoRegister;
+    }
+
+    const ConstantExpr *ci = dyn_cast<ConstantExpr>(re.index);
+    std::uint64_t constantIndex = ci ? ci->getZExtValue() : 0;
+    std::uint32_t index = ci ? NoRegister : compile(re.index);
+
+    std::vector<const UpdateNode *> pending;
+    std::uint32_t result = NoRegister;
+    for (const UpdateNode *un = re.updates.head.get(); un; un = un->next.get()) {
+      if (ci) {
+        if (const ConstantExpr *ui = dyn_cast<ConstantExpr>(un->index)) {
+          if (ui->getZExtValue() == constantIndex) {
+            result = compile(un->value);
+            break;
+          }
+          continue;
+        }
+      }
+      pending.push_back(un);
+    }
+
+    if (result == NoRegister) {
+      if (ci && constantIndex < array->constantValues.size())
+        result = compile(array->constantValues[constantIndex]);
+      else
+        result = emit(Expr::Read, Expr::Int8, array->getDomain(),
+                      getSlot(array), index, NoRegister, constantIndex);
+    }
+    if (!pending.empty() && ci)
+      index = compile(re.index);
+
+    // The newest update that matches wins, so select from the oldest up.
+    for (auto it = pending.rbegin(), ie = pending.rend(); it != ie; ++it) {
+      std::uint32_t matches = emit(Expr::Eq, Expr::Bool, array->getDomain(),
+                                   compile((*it)->index), index);
+      result = emit(Expr::Select, Expr::Int8, Expr::Bool, matches,
+                    compile((*it)->value), result);
+    }
+    return result;
+  }
+
+public:
+  bool failed = false;
+
+  explicit Compiler(CompiledExpr &ce) : ce(ce) {}
+
+  std::uint32_t compile(const ref<Expr> &e) {
+    if (failed)
+      return NoRegister;
+    auto it = compiled.find(e);
+    if (it != compiled.end())
+      return it->second;
+    if (e->getWidth() > 64) {
+      failed = true;
+      return NoRegister;
+    }
+
+    std::uint32_t r;
+    switch (e->getKind()) {
+    case Expr::Constant:
+      r = emit(Expr::Constant, e->getWidth(), 0, NoRegister, NoRegister,
+               NoRegister, cast<ConstantExpr>(e)->getZExtValue());
+      break;
+    case Expr::NotOptimized:
+      r = compile(e->getKid(0));
+      break;
+    case Expr::Read:
+      r = compileRead(cast<ReadExpr>(*e));
+      break;
+    case Expr::Extract: {
+      const ExtractExpr &ee = cast<ExtractExpr>(*e);
+      r = emit(Expr::Extract, ee.width, ee.expr->getWidth(), compile(ee.expr),
+               NoRegister, NoRegister, ee.offset);
+      break;
+    }
+    case Expr::Concat:
+      r = emit(Expr::Concat, e->getWidth(), e->getKid(1)->getWidth(),
+               compile(e->getKid(0)), compile(e->getKid(1)));
+      break;
+    default: {
+      std::uint32_t kids[3] = {NoRegister, NoRegister, NoRegister};
+      for (unsigned i = 0, n = e->getNumKids(); i != n; ++i)
+        kids[i] = compile(e->getKid(i));
+      r = emit(e->getKind(), e->getWidth(), e->getKid(0)->getWidth(), kids[0],
+               kids[1], kids[2]);
+      break;
+    }
+    }
+    if (failed)
+      return NoRegister;
+    compiled.emplace(e, r);
+    return r;
+  }
+};
+
+CompiledExpr::~CompiledExpr() = default;
+
+void CompiledExpr::compile() {
+  Compiler compiler(*this);
+  for (const ref<Expr> &e : roots) {
+    if (e->getWidth() != Expr::Bool)
+      compiler.failed = true;
+    results.push_back(compiler.compile(e));
+  }
+  valid = !compiler.failed;
+  if (!valid) {
+    program.clear();
+    slots.clear();
+    results.clear();
+    return;
+  }
+  registers.resize(program.size() * Lanes);
+  poisons.resize(program.size());
+  bound.resize(slots.size() * Lanes);
+  isRoot.resize(program.size());
+  for (std::uint32_t result : results)
+    isRoot[result] = true;
+}
+
+void CompiledExpr::evaluate(const Assignment *const *assignments,
+                            unsigned count, bool *satisfied) {
+  assert(count <= Lanes);
+  if (!valid) {
+    for (unsigned l = 0; l < count; ++l)
+      satisfied[l] = evaluateRoots(*assignments[l], roots);
+    return;
+  }
+
+  for (std::size_t s = 0; s < slots.size(); ++s) {
+    for (unsigned l = 0; l < Lanes; ++l) {
+      const std::vector<unsigned char> *values = nullptr;
+      if (l < count) {
+        auto it = assignments[l]->bindings.find(slots[s].array);
+        if (it != assignments[l]->bindings.end())
+          values = &it->second;
+      }
+      bound[s * Lanes + l] = values;
+    }
+  }
+
+  // Lanes with free values are left to the evaluator.
+  const std::uint8_t lanes = std::uint8_t((1u << count) - 1);
+  std::uint8_t free = 0;
+  for (unsigned l = 0; l < count; ++l)
+    if (assignments[l]->allowFreeValues)
+      free |= 1u << l;
+  // Lanes that are not known to falsify a root yet
+  std::uint8_t live = lanes & ~free;
+
+  std::uint64_t *regs = registers.data();
+  std::uint8_t *poison = poisons.data();
+  auto operand = [regs](std::uint32_t r) -> const std::uint64_t * {
+    return r == NoRegister ? nullptr : regs + std::size_t(r) * Lanes;
+  };
+  for (std::size_t i = 0, e = program.size(); i != e && live; ++i) {
+    const Instruction &ins = program[i];
+    std::uint64_t *r = regs + i * Lanes;
+    const std::uint64_t *x = operand(ins.a);
+    const std::uint64_t *y = operand(ins.b);
+    const std::uint64_t *z = operand(ins.c);
+    const std::uint64_t mask = maskOf(ins.width);
+    const Expr::Width w = ins.operandWidth;
+    std::uint8_t p = 0;
+    if (x && ins.kind != Expr::Read)
+      p |= poison[ins.a];
+    if (y)
+      p |= poison[ins.b];
+    if (z)
+      p |= poison[ins.c];
+
+    switch (ins.kind) {
+    case Expr::Constant:
+      for (unsigned l = 0; l < Lanes; ++l)
+        r[l] = ins.value;
+      break;
+    case Expr::Read: {
+      const Slot &slot = slots[ins.a];
+      const std::vector<unsigned char> *const *values = &bound[ins.a * Lanes];
+      for (unsigned l = 0; l < Lanes; ++l) {
+        std::uint64_t index = ins.b == NoRegister ? ins.value : y[l];
+        if (index < slot.constantValues.size())
+          r[l] = slot.constantValues[index];
+        else if (values[l] && index < values[l]->size())
+          r[l] = (*values[l])[index];
+        else
+          r[l] = 0;
+      }
+      break;
+    }
+    case Expr::Select:
+      // Only the selected value matters, as in SelectExpr::create.
+      p = poison[ins.a];
+      for (unsigned l = 0; l < Lanes; ++l) {
+        r[l] = x[l] ? y[l] : z[l];
+        p |= (x[l] ? poison[ins.b] : poison[ins.c]) & (1u << l);
+      }
+      break;
+    case Expr::Concat:
+      for (unsigned l = 0; l < Lanes; ++l)
+        r[l] = (x[l] << w) | y[l];
+      break;
+    case Expr::Extract:
+      for (unsigned l = 0; l < Lanes; ++l)
+        r[l] = (x[l] >> ins.value) & mask;
+      break;
+    case Expr::ZExt:
+      for (unsigned l = 0; l < Lanes; ++l)
+        r[l] = x[l] & mask;
+      break;
+    case Expr::SExt:
+      for (unsigned l = 0; l < Lanes; ++l)
+        r[l] = std::uint64_t(sext(x[l], w)) & mask;
+      break;
+    case Expr::Not:
+      for (unsigned l = 0; l < Lanes; ++l)
+        r[l] = ~x[l] & mask;
+      break;
+    case Expr::Add:
+      for (unsigned l = 0; l < Lanes; ++l)
+        r[l] = (x[l] + y[l]) & mask;
+      break;
+    case Expr::Sub:
+      for (unsigned l = 0; l < Lanes; ++l)
+        r[l] = (x[l] - y[l]) & mask;
+      break;
+    case Expr::Mul:
+      for (unsigned l = 0; l < Lanes; ++l)
+        r[l] = (x[l] * y[l]) & mask;
+      break;
+    case Expr::UDiv:
+    case Expr::URem:
+      for (unsigned l = 0; l < Lanes; ++l) {
+        if (!y[l]) {
+          p |= 1u << l;
+          r[l] = 0;
+        } else {
+          r[l] = ins.kind == Expr::UDiv ? x[l] / y[l] : x[l] % y[l];
+        }
+      }
+      break;
+    case Expr::SDiv:
+    case Expr::SRem:
+      for (unsigned l = 0; l < Lanes; ++l) {
+        std::int64_t sx = sext(x[l], w), sy = sext(y[l], w);
+        if (!sy) {
+          p |= 1u << l;
+          r[l] = 0;
+        } else if (sy == -1) {
+          // Avoid overflowing on the minimum; the quotient wraps like APInt.
+          r[l] = ins.kind == Expr::SDiv ? (0 - x[l]) & mask : 0;
+        } else {
+          r[l] = std::uint64_t(ins.kind == Expr::SDiv ? sx / sy : sx % sy) &
+                 mask;
+        }
+      }
+      break;
+    case Expr::And:
+      for (unsigned l = 0; l < Lanes; ++l)
+        r[l] = x[l] & y[l];
+      break;
+    case Expr::Or:
+      for (unsigned l = 0; l < Lanes; ++l)
+        r[l] = x[l] | y[l];
+      break;
+    case Expr::Xor:
+      for (unsigned l = 0; l < Lanes; ++l)
+        r[l] = x[l] ^ y[l];
+      break;
+    case Expr::Shl:
+      for (unsigned l = 0; l < Lanes; ++l)
+        r[l] = y[l] >= w ? 0 : (x[l] << y[l]) & mask;
+      break;
+    case Expr::LShr:
+      for (unsigned l = 0; l < Lanes; ++l)
+        r[l] = y[l] >= w ? 0 : x[l] >> y[l];
+      break;
+    case Expr::AShr:
+      for (unsigned l = 0; l < Lanes; ++l)
+        r[l] = std::uint64_t(sext(x[l], w) >>
+                             std::min<std::uint64_t>(y[l], w - 1)) &
+               mask;
+      break;
+    case Expr::Eq:
+      for (unsigned l = 0; l < Lanes; ++l)
+        r[l] = x[l] == y[l];
+      break;
+    case Expr::Ne:
+      for (unsigned l = 0; l < Lanes; ++l)
+        r[l] = x[l] != y[l];
+      break;
+    case Expr::Ult:
+      for (unsigned l = 0; l < Lanes; ++l)
+        r[l] = x[l] < y[l];
+      break;
+    case Expr::Ule:
+      for (unsigned l = 0; l < Lanes; ++l)
+        r[l] = x[l] <= y[l];
+      break;
+    case Expr::Ugt:
+      for (unsigned l = 0; l < Lanes; ++l)
+        r[l] = x[l] > y[l];
+      break;
+    case Expr::Uge:
+      for (unsigned l = 0; l < Lanes; ++l)
+        r[l] = x[l] >= y[l];
+      break;
+    case Expr::Slt:
+      for (unsigned l = 0; l < Lanes; ++l)
+        r[l] = sext(x[l], w) < sext(y[l], w);
+      break;
+    case Expr::Sle:
+      for (unsigned l = 0; l < Lanes; ++l)
+        r[l] = sext(x[l], w) <= sext(y[l], w);
+      break;
+    case Expr::Sgt:
+      for (unsigned l = 0; l < Lanes; ++l)
+        r[l] = sext(x[l], w) > sext(y[l], w);
+      break;
+    case Expr::Sge:
+      for (unsigned l = 0; l < Lanes; ++l)
+        r[l] = sext(x[l], w) >= sext(y[l], w);
+      break;
+    default:
+      assert(0 && "unhandled Expr type");
+    }
+    poison[i] = p;
+
+    if (isRoot[i]) {
+      for (unsigned l = 0; l < Lanes; ++l)
+        if (!(p & (1u << l)) && r[l] != 1)
+          live &= ~(1u << l);
+    }
+  }
+
+  for (unsigned l = 0; l < count; ++l) {
+    std::uint8_t lane = 1u << l;
+    if (free & lane) {
+      satisfied[l] = evaluateRoots(*assignments[l], roots);
+    } else if (!(live & lane)) {
+      satisfied[l] = false;
+    } else {
+      // Every root is true or divided by zero. The evaluator keeps divisions
+      // by zero unevaluated, so leave those roots to it.
+      bool poisoned = false;
+      for (std::uint32_t result : results)
+        poisoned |= poison[result] & lane;
+      satisfied[l] = !poisoned || evaluateRoots(*assignments[l], roots);
+    }
+  }
+}
+
+bool CompiledExpr::satisfies(const Assignment &a) {
+  const Assignment *assignments[1] = {&a};
+  bool satisfied;
+  evaluate(assignments, 1, &satisfied);
+  return satisfied;
+}
+
+std::size_t CompiledExpr::findSatisfying(
+    const std::vector<const Assignment *> &assignments) {
+  bool satisfied[Lanes];
+  for (std::size_t i = 0, e = assignments.size(); i < e; i += Lanes) {
+    unsigned count = std::min<std::size_t>(Lanes, e - i);
+    evaluate(&assignments[i], count, satisfied);
+    for (unsigned l = 0; l < count; ++l)
+      if (satisfied[l])
+        return i + l;
+  }
+  return assignments.size();
+}
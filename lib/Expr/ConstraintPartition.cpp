@@ -0,0 +1,247 @@
+//===-- ConstraintPartition.cpp -------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Expr/ConstraintPartition.h"
+
+#include "klee/Expr/ExprUtil.h"
+
+#include <algorithm>
+#include <map>
+
+using namespace klee;
+
+ConstraintPartition::ConstraintList::~ConstraintList() {
+  // Release uniquely owned sublists iteratively, the lists of long paths
+  // would otherwise exhaust the stack.
+  std::vector<ref<ConstraintList>> pending;
+  pending.push_back(std::move(left));
+  pending.push_back(std::move(right));
+  while (!pending.empty()) {
+    ref<ConstraintList> list = std::move(pending.back());
+    pending.pop_back();
+    if (list && list->_refCount.getCount() == 1) {
+      pending.push_back(std::move(list->left));
+      pending.push_back(std::move(list->right));
+    }
+  }
+}
+
+void ConstraintPartition::ConstraintList::collect(
+    const ConstraintList *list,
+    std::vector<std::pair<unsigned, ref<Expr>>> &result) {
+  std::vector<const ConstraintList *> stack;
+  if (list)
+    stack.push_back(list);
+  while (!stack.empty()) {
+    const ConstraintList *l = stack.back();
+    stack.pop_back();
+    if (!l->constraint.isNull())
+      result.emplace_back(l->position, l->constraint);
+    if (l->left)
+      stack.push_back(l->left.get());
+    if (l->right)
+      stack.push_back(l->right.get());
+  }
+}
+
+static void sortByPosition(std::vector<std::pair<unsigned, ref<Expr>>> &items,
+                           std::vector<ref<Expr>> &result) {
+  std::sort(items.begin(), items.end(),
+            [](const std::pair<unsigned, ref<Expr>> &a,
+               const std::pair<unsigned, ref<Expr>> &b) {
+              return a.first < b.first;
+            });
+  result.reserve(result.size() + items.size());
+  for (auto &item : items)
+    result.push_back(std::move(item.second));
+}
+
+void ConstraintPartition::getElements(const ref<Expr> &e,
+                                      std::vector<Element> &elements) {
+  std::vector<ref<ReadExpr>> reads;
+  findReads(e, /* visitUpdates= */ true, reads);
+
+  std::map<const Array *, std::vector<unsigned>> bytes;
+  for (const auto &re : reads) {
+    const Array *array = re->updates.root;
+
+    // Reads of a constant array don't alias.
+    if (array->isConstantArray() && !re->updates.head)
+      continue;
+
+    auto &indices = bytes[array];
+    if (!indices.empty() && indices.front() == WholeArray)
+      continue;
+    if (const ConstantExpr *CE = dyn_cast<ConstantExpr>(re->index)) {
+      indices.push_back((unsigned)CE->getZExtValue(32));
+    } else {
+      indices.assign(1, WholeArray);
+    }
+  }
+
+  for (auto &entry : bytes) {
+    std::vector<unsigned> &indices = entry.second;
+    std::sort(indices.begin(), indices.end());
+    indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+    for (unsigned index : indices)
+      elements.emplace_back(entry.first, index);
+  }
+}
+
+ConstraintPartition::Element ConstraintPartition::find(Element e) const {
+  // No path compression: the map is persistent, and union by size keeps
+  // the paths logarithmic.
+  for (;;) {
+    const auto *node = nodes.lookup(e);
+    assert(node && "element not in partition");
+    if (node->second.parent == e)
+      return e;
+    e = node->second.parent;
+  }
+}
+
+ConstraintPartition::Element
+ConstraintPartition::insert(const Element &e) {
+  Element whole(e.first, WholeArray);
+  if (nodes.lookup(whole))
+    return find(whole);
+  if (nodes.lookup(e))
+    return find(e);
+
+  Node node;
+  node.parent = e;
+  node.size = 1;
+  nodes = nodes.insert(std::make_pair(e, node));
+  if (e.second != WholeArray)
+    return e;
+
+  // A symbolic read depends on all bytes of the array read so far.
+  std::vector<Element> bytes;
+  for (auto it = nodes.lower_bound(Element(e.first, 0)), ie = nodes.end();
+       it != ie && it->first.first == e.first && it->first.second != WholeArray;
+       ++it)
+    bytes.push_back(it->first);
+
+  Element root = e;
+  for (const auto &byte : bytes)
+    root = unite(root, find(byte));
+  return root;
+}
+
+ConstraintPartition::Element
+ConstraintPartition::unite(const Element &a, const Element &b) {
+  if (a == b)
+    return a;
+
+  Node rootA = nodes.lookup(a)->second;
+  Node rootB = nodes.lookup(b)->second;
+  if (rootA.size < rootB.size)
+    return unite(b, a);
+
+  Node child = rootB;
+  child.parent = a;
+  child.size = 0;
+  child.constraints = ref<ConstraintList>();
+  nodes = nodes.replace(std::make_pair(b, child));
+
+  rootA.size += rootB.size;
+  if (!rootB.constraints.isNull()) {
+    rootA.constraints = rootA.constraints.isNull()
+                            ? rootB.constraints
+                            : new ConstraintList(rootA.constraints,
+                                                 rootB.constraints);
+  }
+  nodes = nodes.replace(std::make_pair(a, rootA));
+  return a;
+}
+
+void ConstraintPartition::add(const ref<Expr> &constraint,
+                              unsigned position) {
+  std::vector<Element> elements;
+  getElements(constraint, elements);
+  // Constraints without symbolic reads are independent of any query.
+  if (elements.empty())
+    return;
+
+  Element root = insert(elements.front());
+  for (auto it = elements.begin() + 1, ie = elements.end(); it != ie; ++it)
+    root = unite(root, insert(*it));
+
+  Node node = nodes.lookup(root)->second;
+  node.constraints = new ConstraintList(constraint, position, node.constraints);
+  nodes = nodes.replace(std::make_pair(root, node));
+}
+
+void ConstraintPartition::getRoots(const Element &e,
+                                   std::vector<Element> &roots) const {
+  Element whole(e.first, WholeArray);
+  if (nodes.lookup(whole)) {
+    roots.push_back(find(whole));
+  } else if (e.second != WholeArray) {
+    if (nodes.lookup(e))
+      roots.push_back(find(e));
+  } else {
+    for (auto it = nodes.lower_bound(Element(e.first, 0)), ie = nodes.end();
+         it != ie && it->first.first == e.first; ++it)
+      roots.push_back(find(it->first));
+  }
+}
+
+void ConstraintPartition::getDependentConstraints(
+    const ref<Expr> &e, std::vector<ref<Expr>> &result) const {
+  std::vector<Element> elements;
+  getElements(e, elements);
+
+  std::vector<Element> roots;
+  for (const auto &element : elements)
+    getRoots(element, roots);
+  std::sort(roots.begin(), roots.end());
+  roots.erase(std::unique(roots.begin(), roots.end()), roots.end());
+
+  std::vector<std::pair<unsigned, ref<Expr>>> constraints;
+  for (const auto &root : roots)
+    ConstraintList::collect(nodes.lookup(root)->second.constraints.get(),
+                            constraints);
+  sortByPosition(constraints, result);
+}
+
+void ConstraintPartition::getFactors(std::vector<Factor> &factors) const {
+  factors.clear();
+  std::map<Element, std::size_t> factorOfRoot;
+  std::vector<unsigned> firstPosition;
+  for (const auto &entry : nodes) {
+    Element root = find(entry.first);
+    auto it = factorOfRoot.find(root);
+    if (it == factorOfRoot.end()) {
+      it = factorOfRoot.emplace(root, factors.size()).first;
+      factors.emplace_back();
+
+      std::vector<std::pair<unsigned, ref<Expr>>> constraints;
+      ConstraintList::collect(nodes.lookup(root)->second.constraints.get(),
+                              constraints);
+      assert(!constraints.empty() && "factor without constraints");
+      firstPosition.push_back(
+          std::min_element(constraints.begin(), constraints.end())->first);
+      sortByPosition(constraints, factors.back().constraints);
+    }
+    factors[it->second].elements.push_back(entry.first);
+  }
+
+  std::vector<std::size_t> order(factors.size());
+  for (std::size_t i = 0; i < order.size(); ++i)
+    order[i] = i;
+  std::sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+    return firstPosition[a] < firstPosition[b];
+  });
+  std::vector<Factor> sorted;
+  sorted.reserve(factors.size());
+  for (std::size_t i : order)
+    sorted.push_back(std::move(factors[i]));
+  factors.swap(sorted);
+}
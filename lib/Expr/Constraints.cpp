@@ -16,7 +16,7 @@
 #include "llvm/IR/Function.h"
 #include "llvm/Support/CommandLine.h"
 
-#include <map>
+#include <algorithm>
 
 using namespace klee;
 
@@ -54,64 +54,86 @@ public:
 
 class ExprReplaceVisitor2 : public ExprVisitor {
 private:
-  const std::map< ref<Expr>, ref<Expr> > &replacements;
+  ConstraintSet::equalities_ty replacements;
 
 public:
   explicit ExprReplaceVisitor2(
-      const std::map<ref<Expr>, ref<Expr>> &_replacements)
+      const ConstraintSet::equalities_ty &_replacements)
       : ExprVisitor(true), replacements(_replacements) {}
 
   Action visitExprPost(const Expr &e) override {
-    auto it = replacements.find(ref<Expr>(const_cast<Expr *>(&e)));
-    if (it!=replacements.end()) {
+    if (auto it = replacements.lookup(ref<Expr>(const_cast<Expr *>(&e)))) {
       return Action::changeTo(it->second);
     }
     return Action::doChildren();
   }
 };
 
+// The visitor cache holds the simplified subexpressions.
+class ConstraintSet::Simplifier : public ExprReplaceVisitor2 {
+public:
+  using ExprReplaceVisitor2::ExprReplaceVisitor2;
+};
+
+/// Add the substitution implied by a constraint; earlier ones take
+/// precedence.
+static ConstraintSet::equalities_ty
+addEquality(const ConstraintSet::equalities_ty &equalities,
+            const ref<Expr> &constraint) {
+  if (const EqExpr *ee = dyn_cast<EqExpr>(constraint)) {
+    if (isa<ConstantExpr>(ee->left))
+      return equalities.insert(std::make_pair(ee->right, ee->left));
+  }
+  return equalities.insert(
+      std::make_pair(constraint, ConstantExpr::alloc(1, Expr::Bool)));
+}
+
 bool ConstraintManager::rewriteConstraints(ExprVisitor &visitor) {
-  ConstraintSet old;
+  std::vector<ref<Expr>> rewritten;
   bool changed = false;
 
-  std::swap(constraints, old);
-  for (auto &ce : old) {
-    ref<Expr> e = visitor.visit(ce);
+  rewritten.reserve(constraints.size());
+  for (const auto &ce : constraints) {
+    rewritten.push_back(visitor.visit(ce));
+    if (rewritten.back() != ce)
+      changed = true;
+  }
+  // keep the (shared) storage and the factors of unchanged sets
+  if (!changed)
+    return false;
 
-    if (e!=ce) {
+  ConstraintSet old;
+  std::swap(constraints, old);
+  auto it = rewritten.begin();
+  for (const auto &ce : old) {
+    const ref<Expr> &e = *it++;
+    if (e != ce) {
       addConstraintInternal(e); // enable further reductions
-      changed = true;
     } else {
-      constraints.push_back(ce);
+      pushConstraint(ce);
     }
   }
 
-  return changed;
+  return true;
 }
 
 ref<Expr> ConstraintManager::simplifyExpr(const ConstraintSet &constraints,
                                           const ref<Expr> &e) {
 
-  if (isa<ConstantExpr>(e))
+  if (isa<ConstantExpr>(e) || constraints.empty())
     return e;
 
-  std::map< ref<Expr>, ref<Expr> > equalities;
-
-  for (auto &constraint : constraints) {
-    if (const EqExpr *ee = dyn_cast<EqExpr>(constraint)) {
-      if (isa<ConstantExpr>(ee->left)) {
-        equalities.insert(std::make_pair(ee->right,
-                                         ee->left));
-      } else {
-        equalities.insert(
-            std::make_pair(constraint, ConstantExpr::alloc(1, Expr::Bool)));
-      }
-    } else {
-      equalities.insert(
-          std::make_pair(constraint, ConstantExpr::alloc(1, Expr::Bool)));
-    }
+  if (constraints.indexed) {
+    if (!constraints.simplifier)
+      constraints.simplifier =
+          std::make_shared<ConstraintSet::Simplifier>(constraints.equalities);
+    return constraints.simplifier->visit(e);
   }
 
+  ConstraintSet::equalities_ty equalities;
+  for (auto &constraint : constraints)
+    equalities = addEquality(equalities, constraint);
+
   return ExprReplaceVisitor2(equalities).visit(e);
 }
 
@@ -145,12 +167,12 @@ void ConstraintManager::addConstraintInternal(const ref<Expr> &e) {
 	rewriteConstraints(visitor);
       }
     }
-    constraints.push_back(e);
+    pushConstraint(e);
     break;
   }
 
   default:
-    constraints.push_back(e);
+    pushConstraint(e);
     break;
   }
 }
@@ -160,19 +182,108 @@ void ConstraintManager::addConstraint(const ref<Expr> &e) {
   addConstraintInternal(simplified);
 }
 
+void ConstraintManager::pushConstraint(const ref<Expr> &e) {
+  if (constraints.indexed) {
+    constraints.partition.add(e, constraints.size());
+    constraints.equalities = addEquality(constraints.equalities, e);
+    constraints.simplifier.reset();
+  }
+  constraints.append(e);
+}
+
 ConstraintManager::ConstraintManager(ConstraintSet &_constraints)
     : constraints(_constraints) {}
 
-bool ConstraintSet::empty() const { return constraints.empty(); }
+ConstraintChunk::ConstraintChunk(ref<ConstraintChunk> _prev,
+                                 unsigned _capacity)
+    : prev(std::move(_prev)), index(prev ? prev->index + 1 : 0),
+      start(prev ? prev->start + prev->capacity : 0), capacity(_capacity) {
+  items.reserve(capacity);
+}
+
+ConstraintSet::ConstraintSet(const constraints_ty &cs) {
+  for (const auto &e : cs)
+    push_back(e);
+}
+
+bool ConstraintSet::empty() const { return count == 0; }
+
+void ConstraintSet::buildSpine() const {
+  if (spine.size() == (tail ? tail->index + 1 : 0))
+    return;
+  spine.assign(tail->index + 1, nullptr);
+  for (const ConstraintChunk *c = tail.get(); c; c = c->prev.get())
+    spine[c->index] = c;
+}
 
 klee::ConstraintSet::constraint_iterator ConstraintSet::begin() const {
-  return constraints.begin();
+  if (!count)
+    return end();
+  buildSpine();
+  return const_iterator(spine.data(), 0, 0);
 }
 
 klee::ConstraintSet::constraint_iterator ConstraintSet::end() const {
-  return constraints.end();
+  if (!count)
+    return const_iterator();
+  buildSpine();
+  unsigned inTail = tailSize();
+  if (inTail == tail->capacity)
+    return const_iterator(spine.data(), tail->index + 1, 0);
+  return const_iterator(spine.data(), tail->index, inTail);
 }
 
-size_t ConstraintSet::size() const noexcept { return constraints.size(); }
+size_t ConstraintSet::size() const noexcept { return count; }
 
-void ConstraintSet::push_back(const ref<Expr> &e) { constraints.push_back(e); }
+void ConstraintSet::push_back(const ref<Expr> &e) {
+  if (indexed) {
+    indexed = false;
+    partition = ConstraintPartition();
+    equalities = equalities_ty();
+    simplifier.reset();
+  }
+  append(e);
+}
+
+void ConstraintSet::clear() {
+  tail = ref<ConstraintChunk>();
+  count = 0;
+  spine.clear();
+  partition = ConstraintPartition();
+  equalities = equalities_ty();
+  simplifier.reset();
+  indexed = true;
+}
+
+void ConstraintSet::append(const ref<Expr> &e) {
+  // Chunks grow geometrically, so that small sets stay small while long
+  // paths need few chunks.
+  const unsigned minCapacity = 4, maxCapacity = 256;
+
+  unsigned inTail = tail ? tailSize() : 0;
+  if (!tail || inTail == tail->capacity) {
+    unsigned capacity =
+        tail ? std::min(tail->capacity * 2, maxCapacity) : minCapacity;
+    tail = new ConstraintChunk(tail, capacity);
+    if (!spine.empty())
+      spine.push_back(tail.get());
+  } else if (tail->items.size() != inTail) {
+    // another set sharing the tail has extended it already, diverge from it
+    ref<ConstraintChunk> copy = new ConstraintChunk(tail->prev, tail->capacity);
+    copy->items.assign(tail->items.begin(), tail->items.begin() + inTail);
+    tail = copy;
+    if (!spine.empty())
+      spine.back() = tail.get();
+  }
+  tail->items.push_back(e);
+  ++count;
+}
+
+bool ConstraintSet::operator==(const ConstraintSet &b) const {
+  if (count != b.count)
+    return false;
+  // sets of equal size ending in the same chunk share all constraints
+  if (tail.get() == b.tail.get())
+    return true;
+  return std::equal(begin(), end(), b.begin());
+}
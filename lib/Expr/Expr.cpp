@@ -23,6 +23,7 @@
 
 #include <cstring>
 #include <sstream>
+#include <unordered_map>
 
 using namespace klee;
 using namespace llvm;
@@ -33,6 +34,14 @@ llvm::cl::OptionCategory
             "These options impact the way expressions are build and printed.");
 }
 
+namespace klee {
+cl::opt<bool> UseExprHashConsing(
+    "use-expr-hash-consing", cl::init(false),
+    cl::desc("Share a single node between structurally identical expressions "
+             "(default=false)"),
+    cl::cat(klee::ExprCat));
+}
+
 namespace {
 cl::opt<bool> ConstArrayOpt(
     "const-array-opt", cl::init(false),
@@ -43,7 +52,63 @@ cl::opt<bool> ConstArrayOpt(
 
 /***/
 
-unsigned Expr::count = 0;
+Expr::CountType Expr::count{0};
+
+namespace {
+/// Unique table of hash-consed expressions, bucketed by hash value. The table
+/// is weak: it holds plain pointers, and expressions unregister themselves
+/// when their last reference goes away. It is never destroyed, as expressions
+/// with static storage duration may outlive it otherwise.
+typedef std::unordered_multimap<unsigned, Expr *> ExprHashConsTable;
+
+ExprHashConsTable &getHashConsTable() {
+  static ExprHashConsTable *table = new ExprHashConsTable();
+  return *table;
+}
+} // namespace
+
+Expr::~Expr() {
+  Expr::count--;
+  if (!isCached)
+    return;
+  // Only the (base) hash value may be used here, the derived parts of this
+  // expression have already been destroyed.
+  auto range = getHashConsTable().equal_range(hashValue);
+  for (auto it = range.first; it != range.second; ++it) {
+    if (it->second == this) {
+      getHashConsTable().erase(it);
+      return;
+    }
+  }
+  assert(0 && "hash-consed expression missing from table");
+}
+
+ref<Expr> Expr::createCachedExpr(ref<Expr> e) {
+  e->computeHash();
+  if (!UseExprHashConsing)
+    return e;
+
+  // Kids are hash-consed already, hence comparing them by address is enough
+  // to establish structural identity.
+  ExprHashConsTable &table = getHashConsTable();
+  auto range = table.equal_range(e->hashValue);
+  for (auto it = range.first; it != range.second; ++it) {
+    Expr *candidate = it->second;
+    if (candidate->getKind() != e->getKind() ||
+        candidate->compareContents(*e) != 0)
+      continue;
+    unsigned i = 0, n = e->getNumKids();
+    for (; i != n; ++i)
+      if (candidate->getKid(i).get() != e->getKid(i).get())
+        break;
+    if (i == n)
+      return candidate;
+  }
+
+  e->isCached = true;
+  table.emplace(e->hashValue, e.get());
+  return e;
+}
 
 ref<Expr> Expr::createTempRead(const Array *array, Expr::Width w) {
   UpdateList ul(array, 0);
@@ -92,7 +157,7 @@ ref<Expr> Expr::createTempRead(const Array *array, Expr::Width w) {
 }
 
 int Expr::compare(const Expr &b) const {
-  static ExprEquivSet equivs;
+  static thread_local ExprEquivSet equivs;
   int r = compare(b, equivs);
   equivs.clear();
   return r;
@@ -109,7 +174,12 @@ int Expr::compare(const Expr &b, ExprEquivSet &equivs) const {
     ap = &b; bp = this;
   }
 
-  if (equivs.count(std::make_pair(ap, bp)))
+  // Structurally identical hash-consed expressions are pointer-identical, so
+  // two distinct ones always differ and there are no equivalences to memoize
+  // between them. They are still ordered by structure, not by address, to
+  // keep the order of expression sets and maps the same from run to run.
+  const bool bothHashConsed = isHashConsed() && b.isHashConsed();
+  if (!bothHashConsed && equivs.count(std::make_pair(ap, bp)))
     return 0;
 
   Kind ak = getKind(), bk = b.getKind();
@@ -127,6 +197,7 @@ int Expr::compare(const Expr &b, ExprEquivSet &equivs) const {
     if (int res = getKid(i)->compare(*b.getKid(i), equivs))
       return res;
 
+  assert(!bothHashConsed && "distinct hash-consed expressions compare equal");
   equivs.insert(std::make_pair(ap, bp));
   return 0;
 }
@@ -336,6 +407,63 @@ void Expr::dump() const {
 
 /***/
 
+namespace {
+const unsigned NumSmallConstants = 256;
+
+/// Index of a width in the small constant table, or -1
+int getSmallConstantWidthIndex(Expr::Width w) {
+  switch (w) {
+  case Expr::Bool: return 0;
+  case Expr::Int8: return 1;
+  case Expr::Int16: return 2;
+  case Expr::Int32: return 3;
+  case Expr::Int64: return 4;
+  default: return -1;
+  }
+}
+} // namespace
+
+ConstantExpr *ConstantExpr::lookupSmall(uint64_t v, Width w) {
+  int index = getSmallConstantWidthIndex(w);
+  if (index < 0)
+    return nullptr;
+  uint64_t allOnes = bits64::maxValueOfNBits(w);
+  unsigned slot;
+  if (v < NumSmallConstants && v <= allOnes)
+    slot = v;
+  else if (v == allOnes)
+    slot = NumSmallConstants;
+  else
+    return nullptr;
+
+  // One row per width: the values below NumSmallConstants, then all ones.
+  // The table holds a reference to every expression and is never destroyed.
+  // The expressions are not counted as live, and they bypass the hash-consing
+  // table, but are unique as no other node is created for their values.
+  static const ref<ConstantExpr> *table = [] {
+    const Width widths[] = {Bool, Int8, Int16, Int32, Int64};
+    auto *table = new ref<ConstantExpr>[5 * (NumSmallConstants + 1)];
+    auto add = [](ref<ConstantExpr> &entry, Width width, uint64_t value) {
+      entry = new ConstantExpr(APInt(width, value));
+      entry->computeHash();
+      entry->isShared = true;
+      --Expr::count;
+    };
+    for (Width width : widths) {
+      ref<ConstantExpr> *row =
+          table + getSmallConstantWidthIndex(width) * (NumSmallConstants + 1);
+      uint64_t max = bits64::maxValueOfNBits(width);
+      for (uint64_t value = 0; value < NumSmallConstants && value <= max;
+           ++value)
+        add(row[value], width, value);
+      if (max >= NumSmallConstants)
+        add(row[NumSmallConstants], width, max);
+    }
+    return table;
+  }();
+  return table[index * (NumSmallConstants + 1) + slot].get();
+}
+
 ref<Expr> ConstantExpr::fromMemory(void *address, Width width) {
   switch (width) {
   default: assert(0 && "invalid width");
@@ -8,6 +8,8 @@
 //===----------------------------------------------------------------------===//
 
 #include "klee/Module/KInstruction.h"
+
+#include <algorithm>
 #include <string>
 
 using namespace llvm;
@@ -25,3 +27,12 @@ std::string KInstruction::getSourceLocation() const {
            std::to_string(info->column);
   else return "[no debug info]";
 }
+
+unsigned KSwitchInstruction::getSuccessorIndex(uint64_t value) const {
+  auto it = std::lower_bound(
+      cases.begin(), cases.end(), value,
+      [](const std::pair<uint64_t, unsigned> &c, uint64_t v) {
+        return c.first < v;
+      });
+  return it != cases.end() && it->first == value ? it->second : 0;
+}
@@ -11,7 +11,9 @@
 
 #include "Passes.h"
 
+#include "klee/Config/CompileTimeInfo.h"
 #include "klee/Config/Version.h"
+#include "klee/Config/config.h"
 #include "klee/Core/Interpreter.h"
 #include "klee/Support/OptionCategories.h"
 #include "klee/Module/Cell.h"
@@ -45,6 +47,7 @@ DISABLE_WARNING_DEPRECATED_DECLARATIONS
 #include "llvm/Transforms/Utils.h"
 DISABLE_WARNING_POP
 
+#include <algorithm>
 #include <sstream>
 
 using namespace llvm;
@@ -102,6 +105,12 @@ namespace {
                              cl::desc("Allow optimization of functions that "
                                       "contain KLEE calls (default=true)"),
                              cl::init(true), cl::cat(ModuleCat));
+
+  /// Named metadata marking modules written by --output-module
+  const char *const PreparedMetadata = "klee.prepared";
+
+  /// The build of KLEE, whose runtime libraries a prepared module contains
+  const char *const PreparedBy = PACKAGE_STRING " " KLEE_BUILD_REVISION;
 }
 
 /***/
@@ -240,6 +249,36 @@ void KModule::instrument(const Interpreter::ModuleOptions &opts) {
   pm.run(*module);
 }
 
+void KModule::usePrepared(std::unique_ptr<llvm::Module> prepared,
+                          const Interpreter::ModuleOptions &opts) {
+  NamedMDNode *md = prepared->getNamedMetadata(PreparedMetadata);
+  if (!md || md->getNumOperands() != 1 ||
+      md->getOperand(0)->getNumOperands() != 3)
+    klee_error("The module was not written with --output-module");
+  auto getString = [md](unsigned i) {
+    auto *s = dyn_cast<MDString>(md->getOperand(0)->getOperand(i));
+    return s ? s->getString() : StringRef();
+  };
+  if (getString(1) != PreparedBy)
+    klee_error("The module was prepared by %s, not by this %s",
+               getString(1).str().c_str(), PreparedBy);
+  if (getString(2) != opts.OptSuffix)
+    klee_error("The module contains the %s runtime, not the %s runtime",
+               getString(2).str().c_str(), opts.OptSuffix.c_str());
+  if (getString(0) != opts.EntryPoint)
+    klee_error("The module was prepared for a different entry point");
+  prepared->eraseNamedMetadata(md);
+
+  module = std::move(prepared);
+  entryPoint = opts.EntryPoint;
+  runtimeSuffix = opts.OptSuffix;
+  targetData = std::unique_ptr<llvm::DataLayout>(new DataLayout(module.get()));
+
+  // The checks are only linked in if they were injected.
+  addInternalFunction("klee_div_zero_check");
+  addInternalFunction("klee_overshift_check");
+}
+
 void KModule::optimiseAndPrepare(
     const Interpreter::ModuleOptions &opts,
     llvm::ArrayRef<const char *> preservedFunctions) {
@@ -264,6 +303,8 @@ void KModule::optimiseAndPrepare(
   // Needs to happen after linking (since ctors/dtors can be modified)
   // and optimization (since global optimization can rewrite lists).
   injectStaticConstructorsAndDestructors(module.get(), opts.EntryPoint);
+  entryPoint = opts.EntryPoint;
+  runtimeSuffix = opts.OptSuffix;
 
   // Finally, run the passes that maintain invariants we expect during
   // interpretation. We run the intrinsic cleaner just in case we
@@ -293,8 +334,16 @@ void KModule::manifest(InterpreterHandler *ih, bool forceSourceOutput) {
   }
 
   if (OutputModule) {
+    // Record the entry point, KLEE build and runtime libraries the module
+    // was prepared for, which makes it usable with --prepared-module.
+    LLVMContext &ctx = module->getContext();
+    NamedMDNode *prepared = module->getOrInsertNamedMetadata(PreparedMetadata);
+    prepared->addOperand(MDNode::get(
+        ctx, {MDString::get(ctx, entryPoint), MDString::get(ctx, PreparedBy),
+              MDString::get(ctx, runtimeSuffix)}));
     std::unique_ptr<llvm::raw_fd_ostream> f(ih->openOutputFile("final.bc"));
     WriteBitcodeToFile(*module, *f);
+    module->eraseNamedMetadata(prepared);
   }
 
   /* Build shadow structures */
@@ -440,12 +489,25 @@ KFunction::KFunction(llvm::Function *_function,
     for (llvm::BasicBlock::iterator it = bbit->begin(), ie = bbit->end();
          it != ie; ++it) {
       KInstruction *ki;
+      KTerminatorInstruction *kt = nullptr;
+      KSwitchInstruction *ks = nullptr;
 
       switch(it->getOpcode()) {
       case Instruction::GetElementPtr:
       case Instruction::InsertValue:
       case Instruction::ExtractValue:
         ki = new KGEPInstruction(); break;
+      case Instruction::Switch:
+        if (cast<SwitchInst>(it)->getCondition()->getType()
+                ->getIntegerBitWidth() <= 64)
+          ki = kt = ks = new KSwitchInstruction();
+        else
+          ki = kt = new KTerminatorInstruction();
+        break;
+      case Instruction::Br:
+      case Instruction::IndirectBr:
+      case Instruction::Invoke:
+        ki = kt = new KTerminatorInstruction(); break;
       default:
         ki = new KInstruction(); break;
       }
@@ -453,6 +515,27 @@ KFunction::KFunction(llvm::Function *_function,
       Instruction *inst = &*it;
       ki->inst = inst;
       ki->dest = registerMap[inst];
+      ki->opcode = inst->getOpcode();
+      if (CmpInst *ci = dyn_cast<CmpInst>(inst))
+        ki->predicate = ci->getPredicate();
+      else
+        ki->predicate = 0;
+
+      if (kt) {
+        for (unsigned j = 0, e = inst->getNumSuccessors(); j != e; ++j) {
+          BasicBlock *dst = inst->getSuccessor(j);
+          int incomingBBIndex = -1;
+          if (PHINode *first = dyn_cast<PHINode>(&dst->front()))
+            incomingBBIndex = first->getBasicBlockIndex(&*bbit);
+          kt->successors.push_back({basicBlockEntry[dst], incomingBBIndex});
+        }
+      }
+      if (ks) {
+        for (auto c : cast<SwitchInst>(inst)->cases())
+          ks->cases.emplace_back(c.getCaseValue()->getZExtValue(),
+                                 c.getSuccessorIndex());
+        std::sort(ks->cases.begin(), ks->cases.end());
+      }
 
       if (isa<CallInst>(it) || isa<InvokeInst>(it)) {
         const CallBase &cb = cast<CallBase>(*inst);
@@ -9,10 +9,12 @@
 
 #include "klee/Solver/Solver.h"
 
-#include "klee/ADT/MapOfSets.h"
+#include "klee/ADT/SetTrie.h"
 #include "klee/Expr/Assignment.h"
+#include "klee/Expr/CompiledExpr.h"
 #include "klee/Expr/Constraints.h"
 #include "klee/Expr/Expr.h"
+#include "klee/Expr/ExprHashMap.h"
 #include "klee/Expr/ExprUtil.h"
 #include "klee/Expr/ExprVisitor.h"
 #include "klee/Support/OptionCategories.h"
@@ -23,6 +25,7 @@
 
 #include "llvm/Support/CommandLine.h"
 
+#include <map>
 #include <memory>
 #include <utility>
 
@@ -48,6 +51,13 @@ cl::opt<bool>
                               "before asking the SMT solver (default=false)"),
                      cl::cat(SolvingCat));
 
+cl::opt<unsigned> CexCacheMemoryLimit(
+    "cex-cache-memory-limit", cl::init(0),
+    cl::desc("Approximate memory limit in MB for the counterexample cache. "
+             "The least recently used entries are evicted beyond it, 0 for "
+             "no limit (default=0)"),
+    cl::cat(SolvingCat));
+
 } // namespace
 
 ///
@@ -62,14 +72,22 @@ struct AssignmentLessThan {
 
 
 class CexCachingSolver : public SolverImpl {
-  typedef std::set<Assignment*, AssignmentLessThan> assignmentsTable_ty;
+  /// Assignments with the number of cache entries referring to them
+  typedef std::map<Assignment*, unsigned, AssignmentLessThan>
+      assignmentsTable_ty;
 
   std::unique_ptr<Solver> solver;
   
-  MapOfSets<ref<Expr>, Assignment*> cache;
+  SetTrie<ref<Expr>, Assignment *, util::ExprHash, util::ExprCmp> cache;
   // memo table
   assignmentsTable_ty assignmentsTable;
 
+  /// Drop a cache entry's reference to an assignment.
+  void releaseAssignment(Assignment *a);
+
+  /// Estimated memory of a memoized assignment
+  static std::size_t assignmentBytes(const Assignment &a);
+
   bool searchForAssignment(KeyType &key, 
                            Assignment *&result);
   
@@ -84,7 +102,10 @@ class CexCachingSolver : public SolverImpl {
   
 public:
   CexCachingSolver(std::unique_ptr<Solver> solver)
-      : solver(std::move(solver)) {}
+      : solver(std::move(solver)) {
+    cache.setMemoryLimit(std::size_t(CexCacheMemoryLimit) << 20);
+    cache.setEvictionCallback([this](Assignment *&a) { releaseAssignment(a); });
+  }
   ~CexCachingSolver();
   
   bool computeTruth(const Query&, bool &isValid);
@@ -111,11 +132,23 @@ struct NonNullAssignment {
 
 struct NullOrSatisfyingAssignment {
   KeyType &key;
-  
-  NullOrSatisfyingAssignment(KeyType &_key) : key(_key) {}
+  /// The key compiled once a second assignment is checked against it
+  std::unique_ptr<CompiledExpr> &compiled;
+  unsigned &checked;
+
+  NullOrSatisfyingAssignment(KeyType &_key,
+                             std::unique_ptr<CompiledExpr> &_compiled,
+                             unsigned &_checked)
+      : key(_key), compiled(_compiled), checked(_checked) {}
 
   bool operator()(Assignment *a) const { 
-    return !a || a->satisfies(key.begin(), key.end()); 
+    if (!a)
+      return true;
+    if (++checked == 1)
+      return a->satisfies(key.begin(), key.end());
+    if (!compiled)
+      compiled = std::make_unique<CompiledExpr>(key.begin(), key.end());
+    return compiled->satisfies(*a);
   }
 };
 
@@ -151,14 +184,17 @@ bool CexCachingSolver::searchForAssignment(KeyType &key, Assignment *&result) {
     }
 
     // Otherwise, iterate through the set of current assignments to see if one
-    // of them satisfies the query.
-    for (assignmentsTable_ty::iterator it = assignmentsTable.begin(), 
-           ie = assignmentsTable.end(); it != ie; ++it) {
-      Assignment *a = *it;
-      if (a->satisfies(key.begin(), key.end())) {
-        result = a;
-        return true;
-      }
+    // of them satisfies the query, evaluating the compiled query on several
+    // assignments at once.
+    std::vector<const Assignment *> assignments;
+    assignments.reserve(assignmentsTable.size());
+    for (const auto &entry : assignmentsTable)
+      assignments.push_back(entry.first);
+    CompiledExpr compiled(key.begin(), key.end());
+    std::size_t i = compiled.findSatisfying(assignments);
+    if (i != assignments.size()) {
+      result = const_cast<Assignment *>(assignments[i]);
+      return true;
     }
   } else {
     // FIXME: Which order? one is sure to be better.
@@ -174,8 +210,12 @@ bool CexCachingSolver::searchForAssignment(KeyType &key, Assignment *&result) {
     // assignment. While searching subsets, we also explicitly the solutions for
     // satisfiable subsets to see if they solve the current query and return
     // them if so. This is cheap and frequently succeeds.
-    if (!lookup) 
-      lookup = cache.findSubset(key, NullOrSatisfyingAssignment(key));
+    if (!lookup) {
+      std::unique_ptr<CompiledExpr> compiled;
+      unsigned checked = 0;
+      lookup = cache.findSubset(
+          key, NullOrSatisfyingAssignment(key, compiled, checked));
+    }
 
     // If either lookup succeeded, then we have a cached solution.
     if (lookup) {
@@ -238,11 +278,15 @@ bool CexCachingSolver::getAssignment(const Query& query, Assignment *&result) {
 
     // Memoize the result.
     std::pair<assignmentsTable_ty::iterator, bool>
-      res = assignmentsTable.insert(binding);
+      res = assignmentsTable.insert(std::make_pair(binding, 0u));
     if (!res.second) {
       delete binding;
-      binding = *res.first;
+      binding = res.first->first;
+    } else {
+      // Charged once while any entry refers to it, see releaseAssignment.
+      cache.chargeSharedMemory(assignmentBytes(*binding));
     }
+    ++res.first->second;
     
     if (DebugCexCacheCheckBinding)
       if (!binding->satisfies(key.begin(), key.end())) {
@@ -266,7 +310,27 @@ CexCachingSolver::~CexCachingSolver() {
   cache.clear();
   for (assignmentsTable_ty::iterator it = assignmentsTable.begin(), 
          ie = assignmentsTable.end(); it != ie; ++it)
-    delete *it;
+    delete it->first;
+}
+
+std::size_t CexCachingSolver::assignmentBytes(const Assignment &a) {
+  std::size_t bytes = sizeof(Assignment);
+  for (const auto &b : a.bindings)
+    bytes += 4 * sizeof(void *) + sizeof(b) + b.second.size();
+  return bytes;
+}
+
+void CexCachingSolver::releaseAssignment(Assignment *a) {
+  if (!a)
+    return;
+  auto it = assignmentsTable.find(a);
+  assert(it != assignmentsTable.end() && it->first == a &&
+         "assignment not memoized");
+  if (--it->second == 0) {
+    assignmentsTable.erase(it);
+    cache.dischargeSharedMemory(assignmentBytes(*a));
+    delete a;
+  }
 }
 
 bool CexCachingSolver::computeValidity(const Query& query,
@@ -46,6 +46,13 @@ std::unique_ptr<Solver> constructSolverChain(
                  baseSolverQuerySMT2LogPath.c_str());
   }
 
+  if (!PersistentCachePath.empty()) {
+    solver = createPersistentCachingSolver(std::move(solver),
+                                           PersistentCachePath);
+    klee_message("Using persistent query cache %s",
+                 PersistentCachePath.c_str());
+  }
+
   if (UseAssignmentValidatingSolver)
     solver = createAssignmentValidatingSolver(std::move(solver));
 
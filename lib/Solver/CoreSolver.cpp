@@ -51,6 +51,23 @@ std::unique_ptr<Solver> createCoreSolver(CoreSolverType cst) {
     klee_message("Not compiled with Z3 support");
     return NULL;
 #endif
+  case PORTFOLIO_SOLVER: {
+    std::vector<CoreSolverType> backends(PortfolioSolvers.begin(),
+                                         PortfolioSolvers.end());
+    if (backends.empty()) {
+#ifdef ENABLE_STP
+      backends.push_back(STP_SOLVER);
+#endif
+#ifdef ENABLE_Z3
+      backends.push_back(Z3_SOLVER);
+#endif
+#ifdef ENABLE_METASMT
+      backends.push_back(METASMT_SOLVER);
+#endif
+    }
+    klee_message("Using portfolio solver backend");
+    return createPortfolioSolver(backends);
+  }
   case NO_SOLVER:
     klee_message("Invalid solver");
     return NULL;
@@ -11,6 +11,7 @@
 #include "klee/Solver/Solver.h"
 
 #include "klee/Expr/Assignment.h"
+#include "klee/Expr/ConstraintPartition.h"
 #include "klee/Expr/Constraints.h"
 #include "klee/Expr/Expr.h"
 #include "klee/Expr/ExprUtil.h"
@@ -140,6 +141,16 @@ public:
       }
     }
   }
+  // Build the set of a factor tracked along with the constraints.
+  explicit IndependentElementSet(const ConstraintPartition::Factor &factor)
+      : exprs(factor.constraints) {
+    for (const auto &element : factor.elements) {
+      if (element.second == ConstraintPartition::WholeArray)
+        wholeObjects.insert(element.first);
+      else
+        elements[element.first].add(element.second);
+    }
+  }
   IndependentElementSet(const IndependentElementSet &ies) : 
     elements(ies.elements),
     wholeObjects(ies.wholeObjects),
@@ -264,6 +275,35 @@ inline llvm::raw_ostream &operator<<(llvm::raw_ostream &os,
 static std::list<IndependentElementSet>*
 getAllIndependentConstraintsSets(const Query &query) {
   std::list<IndependentElementSet> *factors = new std::list<IndependentElementSet>();
+
+  // The factors of the constraints are tracked with the constraints, only
+  // the query expression has to be merged into them.
+  if (const ConstraintPartition *partition =
+          query.constraints.getPartition()) {
+    std::vector<ConstraintPartition::Factor> tracked;
+    partition->getFactors(tracked);
+    if (isa<ConstantExpr>(query.expr)) {
+      assert(cast<ConstantExpr>(query.expr)->isFalse() &&
+             "the expr should always be false and "
+             "therefore not included in factors");
+      for (const auto &factor : tracked)
+        factors->push_back(IndependentElementSet(factor));
+      return factors;
+    }
+    // Tracked factors are independent of each other, so a single pass
+    // finds all factors the query depends on.
+    IndependentElementSet current(Expr::createIsZero(query.expr));
+    for (const auto &factor : tracked) {
+      IndependentElementSet ies(factor);
+      if (current.intersects(ies))
+        current.add(ies);
+      else
+        factors->push_back(ies);
+    }
+    factors->push_front(current);
+    return factors;
+  }
+
   ConstantExpr *CE = dyn_cast<ConstantExpr>(query.expr);
   if (CE) {
     assert(CE && CE->isFalse() && "the expr should always be false and "
@@ -368,6 +408,18 @@ IndependentElementSet getIndependentConstraints(const Query& query,
 }
 
 
+// Collects the constraints the query expression depends on, from the
+// factors tracked along with the constraints if available.
+static void getRequiredConstraints(const Query &query,
+                                   std::vector<ref<Expr>> &required) {
+  if (const ConstraintPartition *partition =
+          query.constraints.getPartition()) {
+    partition->getDependentConstraints(query.expr, required);
+    return;
+  }
+  getIndependentConstraints(query, required);
+}
+
 // Extracts which arrays are referenced from a particular independent set.  Examines both
 // the actual known array accesses arr[1] plus the undetermined accesses arr[x].
 static
@@ -411,8 +463,7 @@ public:
 bool IndependentSolver::computeValidity(const Query& query,
                                         Solver::Validity &result) {
   std::vector< ref<Expr> > required;
-  IndependentElementSet eltsClosure =
-    getIndependentConstraints(query, required);
+  getRequiredConstraints(query, required);
   ConstraintSet tmp(required);
   return solver->impl->computeValidity(Query(tmp, query.expr), 
                                        result);
@@ -420,8 +471,7 @@ bool IndependentSolver::computeValidity(const Query& query,
 
 bool IndependentSolver::computeTruth(const Query& query, bool &isValid) {
   std::vector< ref<Expr> > required;
-  IndependentElementSet eltsClosure = 
-    getIndependentConstraints(query, required);
+  getRequiredConstraints(query, required);
   ConstraintSet tmp(required);
   return solver->impl->computeTruth(Query(tmp, query.expr), 
                                     isValid);
@@ -429,8 +479,7 @@ bool IndependentSolver::computeTruth(const Query& query, bool &isValid) {
 
 bool IndependentSolver::computeValue(const Query& query, ref<Expr> &result) {
   std::vector< ref<Expr> > required;
-  IndependentElementSet eltsClosure = 
-    getIndependentConstraints(query, required);
+  getRequiredConstraints(query, required);
   ConstraintSet tmp(required);
   return solver->impl->computeValue(Query(tmp, query.expr), result);
 }
@@ -0,0 +1,423 @@
+//===-- PersistentCachingSolver.cpp -----------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Solver/Solver.h"
+
+#include "klee/Expr/Constraints.h"
+#include "klee/Expr/Expr.h"
+#include "klee/Expr/ExprHashMap.h"
+#include "klee/Solver/SolverImpl.h"
+#include "klee/Solver/SolverStats.h"
+#include "klee/Support/ErrorHandling.h"
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/SHA1.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <sqlite3.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+
+using namespace klee;
+
+namespace {
+
+/// Serializes queries into a canonical text form. Arrays are numbered in
+/// order of first appearance instead of being referred to by name, so the
+/// same query built by different runs (or by different states of one run)
+/// serializes identically. Shared subexpressions and update list suffixes
+/// are emitted once and then referred to by number.
+class QueryCanonicalizer {
+  std::string buffer;
+  llvm::raw_string_ostream os;
+  ExprHashMap<unsigned> exprIds;
+  std::map<const Array *, unsigned> arrayIds;
+  std::unordered_map<const UpdateNode *, unsigned> updateIds;
+
+  void writeArray(const Array *array);
+  void writeUpdates(const UpdateList &updates);
+
+public:
+  QueryCanonicalizer() : os(buffer) {}
+
+  void write(const ref<Expr> &e);
+  void write(const Query &query);
+  void writeObjects(const std::vector<const Array *> &objects);
+
+  /// Returns a digest of everything written so far.
+  std::string getKey();
+};
+
+void QueryCanonicalizer::writeArray(const Array *array) {
+  auto it = arrayIds.find(array);
+  if (it != arrayIds.end()) {
+    os << 'A' << it->second;
+    return;
+  }
+  unsigned id = arrayIds.size();
+  arrayIds.emplace(array, id);
+  os << 'A' << id << '[' << array->size << ' ' << array->domain << ' '
+     << array->range;
+  for (const auto &value : array->constantValues) {
+    std::string str;
+    value->toString(str, 16);
+    os << ' ' << str;
+  }
+  os << ']';
+}
+
+void QueryCanonicalizer::writeUpdates(const UpdateList &updates) {
+  os << '{';
+  std::vector<const UpdateNode *> emitted;
+  for (const UpdateNode *un = updates.head.get(); un; un = un->next.get()) {
+    auto it = updateIds.find(un);
+    if (it != updateIds.end()) {
+      os << 'U' << it->second;
+      break;
+    }
+    os << '(';
+    write(un->index);
+    os << ' ';
+    write(un->value);
+    os << ')';
+    emitted.push_back(un);
+  }
+  os << '}';
+  for (const UpdateNode *un : emitted)
+    updateIds.emplace(un, updateIds.size());
+}
+
+void QueryCanonicalizer::write(const ref<Expr> &e) {
+  auto it = exprIds.find(e);
+  if (it != exprIds.end()) {
+    os << '#' << it->second;
+    return;
+  }
+
+  os << '(' << static_cast<int>(e->getKind()) << ':' << e->getWidth();
+  if (const ConstantExpr *ce = dyn_cast<ConstantExpr>(e)) {
+    std::string value;
+    ce->toString(value, 16);
+    os << ' ' << value;
+  } else if (const ExtractExpr *ee = dyn_cast<ExtractExpr>(e)) {
+    os << ' ' << ee->offset;
+  } else if (const ReadExpr *re = dyn_cast<ReadExpr>(e)) {
+    os << ' ';
+    writeArray(re->updates.root);
+    writeUpdates(re->updates);
+  }
+  for (unsigned i = 0, n = e->getNumKids(); i != n; ++i) {
+    os << ' ';
+    write(e->getKid(i));
+  }
+  os << ')';
+
+  exprIds.emplace(e, exprIds.size());
+}
+
+void QueryCanonicalizer::write(const Query &query) {
+  for (const auto &constraint : query.constraints) {
+    write(constraint);
+    os << ';';
+  }
+  os << "=>";
+  write(query.expr);
+}
+
+void QueryCanonicalizer::writeObjects(
+    const std::vector<const Array *> &objects) {
+  os << "|";
+  for (const Array *object : objects)
+    writeArray(object);
+}
+
+std::string QueryCanonicalizer::getKey() {
+  os.flush();
+  auto digest = llvm::SHA1::hash(llvm::arrayRefFromStringRef(buffer));
+  return llvm::toHex(digest);
+}
+
+class PersistentCachingSolver : public SolverImpl {
+private:
+  /// The kind of request a cache entry answers.
+  enum EntryKind { Truth = 0, Value = 1, InitialValues = 2 };
+
+  /// Version of the database layout and of the query serialization, kept in
+  /// the database as its user_version. Increase it whenever either changes.
+  /// The number of expression kinds is folded in, as the serialization
+  /// refers to kinds by number.
+  static constexpr int FormatVersion = (1 << 8) | Expr::LastKind;
+
+  std::unique_ptr<Solver> solver;
+  sqlite3 *db = nullptr;
+  sqlite3_stmt *lookupStmt = nullptr;
+  sqlite3_stmt *insertStmt = nullptr;
+
+  void prepare(const char *query, sqlite3_stmt **stmt);
+  void exec(const char *query);
+  int queryInt(const char *query);
+  void checkFormat(const std::string &path);
+  bool lookup(const std::string &key, EntryKind kind, std::string &result);
+  void insert(const std::string &key, EntryKind kind,
+              const std::string &result);
+
+public:
+  PersistentCachingSolver(std::unique_ptr<Solver> solver,
+                          const std::string &path);
+  ~PersistentCachingSolver() override;
+
+  bool computeTruth(const Query &, bool &isValid) override;
+  bool computeValue(const Query &, ref<Expr> &result) override;
+  bool computeInitialValues(const Query &,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char>> &values,
+                            bool &hasSolution) override;
+  SolverRunStatus getOperationStatusCode() override;
+  char *getConstraintLog(const Query &) override;
+  void setCoreSolverTimeout(time::Span timeout) override;
+};
+
+PersistentCachingSolver::PersistentCachingSolver(
+    std::unique_ptr<Solver> solver, const std::string &path)
+    : solver(std::move(solver)) {
+  if (sqlite3_open(path.c_str(), &db) != SQLITE_OK)
+    klee_error("Cannot open persistent query cache %s: %s", path.c_str(),
+               sqlite3_errmsg(db));
+
+  // Several KLEE processes may use the same cache: let writers wait for each
+  // other instead of failing, and let readers proceed while one writes.
+  sqlite3_busy_timeout(db, 10000);
+  char *errMsg = nullptr;
+  if (sqlite3_exec(db, "PRAGMA journal_mode = WAL;", nullptr, nullptr,
+                   &errMsg) != SQLITE_OK) {
+    klee_warning("Persistent query cache: cannot set option: %s", errMsg);
+    sqlite3_free(errMsg);
+  }
+  if (sqlite3_exec(db, "PRAGMA synchronous = NORMAL;", nullptr, nullptr,
+                   &errMsg) != SQLITE_OK) {
+    klee_warning("Persistent query cache: cannot set option: %s", errMsg);
+    sqlite3_free(errMsg);
+  }
+  checkFormat(path);
+
+  prepare("SELECT result FROM queries WHERE key = ? AND kind = ?;",
+          &lookupStmt);
+  prepare("INSERT OR IGNORE INTO queries VALUES (?, ?, ?);", &insertStmt);
+}
+
+PersistentCachingSolver::~PersistentCachingSolver() {
+  sqlite3_finalize(lookupStmt);
+  sqlite3_finalize(insertStmt);
+  if (sqlite3_close(db) != SQLITE_OK)
+    klee_warning("Persistent query cache: cannot close database: %s",
+                 sqlite3_errmsg(db));
+}
+
+void PersistentCachingSolver::prepare(const char *query, sqlite3_stmt **stmt) {
+  if (sqlite3_prepare_v2(db, query, -1, stmt, nullptr) != SQLITE_OK)
+    klee_error("Persistent query cache: cannot prepare query: %s [%s]",
+               sqlite3_errmsg(db), query);
+}
+
+void PersistentCachingSolver::exec(const char *query) {
+  char *errMsg = nullptr;
+  if (sqlite3_exec(db, query, nullptr, nullptr, &errMsg) != SQLITE_OK) {
+    std::string error(errMsg);
+    sqlite3_free(errMsg);
+    klee_error("Persistent query cache: initialisation error: %s [%s]",
+               error.c_str(), query);
+  }
+}
+
+int PersistentCachingSolver::queryInt(const char *query) {
+  sqlite3_stmt *stmt = nullptr;
+  prepare(query, &stmt);
+  if (sqlite3_step(stmt) != SQLITE_ROW)
+    klee_error("Persistent query cache: initialisation error: %s [%s]",
+               sqlite3_errmsg(db), query);
+  int result = sqlite3_column_int(stmt, 0);
+  sqlite3_finalize(stmt);
+  return result;
+}
+
+/// Creates the table in a new database and refuses a database written in
+/// another format, whose keys may denote different queries than ours.
+void PersistentCachingSolver::checkFormat(const std::string &path) {
+  // Keep other processes from creating the same database concurrently.
+  exec("BEGIN IMMEDIATE;");
+  int version = queryInt("PRAGMA user_version;");
+  if (version == 0 &&
+      queryInt("SELECT count(*) FROM sqlite_master WHERE name = 'queries';") ==
+          0) {
+    exec("CREATE TABLE queries ("
+         "key TEXT NOT NULL, kind INTEGER NOT NULL, result BLOB, "
+         "PRIMARY KEY (key, kind));");
+    std::string setVersion =
+        "PRAGMA user_version = " + std::to_string(FormatVersion) + ";";
+    exec(setVersion.c_str());
+    version = FormatVersion;
+  }
+  exec("COMMIT;");
+  if (version != FormatVersion)
+    klee_error("Persistent query cache %s has format %d, but this version of "
+               "KLEE uses format %d. Remove it or use another path.",
+               path.c_str(), version, FormatVersion);
+}
+
+bool PersistentCachingSolver::lookup(const std::string &key, EntryKind kind,
+                                     std::string &result) {
+  sqlite3_bind_text(lookupStmt, 1, key.c_str(), key.size(), SQLITE_STATIC);
+  sqlite3_bind_int(lookupStmt, 2, kind);
+  bool found = false;
+  int rc = sqlite3_step(lookupStmt);
+  if (rc == SQLITE_ROW) {
+    const void *blob = sqlite3_column_blob(lookupStmt, 0);
+    int size = sqlite3_column_bytes(lookupStmt, 0);
+    result.assign(static_cast<const char *>(blob), size);
+    found = true;
+  } else if (rc != SQLITE_DONE) {
+    klee_warning_once(0, "Persistent query cache: lookup failed: %s",
+                      sqlite3_errmsg(db));
+  }
+  sqlite3_reset(lookupStmt);
+  sqlite3_clear_bindings(lookupStmt);
+
+  if (found)
+    ++stats::queryPersistentCacheHits;
+  else
+    ++stats::queryPersistentCacheMisses;
+  return found;
+}
+
+void PersistentCachingSolver::insert(const std::string &key, EntryKind kind,
+                                     const std::string &result) {
+  sqlite3_bind_text(insertStmt, 1, key.c_str(), key.size(), SQLITE_STATIC);
+  sqlite3_bind_int(insertStmt, 2, kind);
+  sqlite3_bind_blob(insertStmt, 3, result.data(), result.size(),
+                    SQLITE_STATIC);
+  if (sqlite3_step(insertStmt) != SQLITE_DONE)
+    klee_warning_once(0, "Persistent query cache: insertion failed: %s",
+                      sqlite3_errmsg(db));
+  sqlite3_reset(insertStmt);
+  sqlite3_clear_bindings(insertStmt);
+}
+
+bool PersistentCachingSolver::computeTruth(const Query &query,
+                                           bool &isValid) {
+  QueryCanonicalizer canonicalizer;
+  canonicalizer.write(query);
+  std::string key = canonicalizer.getKey();
+
+  std::string cached;
+  if (lookup(key, Truth, cached) && cached.size() == 1) {
+    isValid = cached[0] != 0;
+    return true;
+  }
+
+  if (!solver->impl->computeTruth(query, isValid))
+    return false;
+  insert(key, Truth, std::string(1, isValid ? 1 : 0));
+  return true;
+}
+
+bool PersistentCachingSolver::computeValue(const Query &query,
+                                           ref<Expr> &result) {
+  QueryCanonicalizer canonicalizer;
+  canonicalizer.write(query);
+  std::string key = canonicalizer.getKey();
+
+  // Values are stored as "<width>:<hex digits>".
+  std::string cached;
+  if (lookup(key, Value, cached)) {
+    llvm::StringRef widthStr, valueStr;
+    std::tie(widthStr, valueStr) = llvm::StringRef(cached).split(':');
+    unsigned width;
+    if (!widthStr.getAsInteger(10, width) && width && !valueStr.empty()) {
+      result = ConstantExpr::alloc(llvm::APInt(width, valueStr, 16));
+      return true;
+    }
+  }
+
+  if (!solver->impl->computeValue(query, result))
+    return false;
+  if (const ConstantExpr *ce = dyn_cast<ConstantExpr>(result)) {
+    std::string value;
+    ce->toString(value, 16);
+    insert(key, Value, llvm::utostr(ce->getWidth()) + ":" + value);
+  }
+  return true;
+}
+
+bool PersistentCachingSolver::computeInitialValues(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char>> &values, bool &hasSolution) {
+  QueryCanonicalizer canonicalizer;
+  canonicalizer.write(query);
+  canonicalizer.writeObjects(objects);
+  std::string key = canonicalizer.getKey();
+
+  // Entries are a solvability byte, followed by the concatenated values.
+  std::size_t expectedSize = 1;
+  for (const Array *object : objects)
+    expectedSize += object->size;
+
+  std::string cached;
+  if (lookup(key, InitialValues, cached) && !cached.empty()) {
+    hasSolution = cached[0] != 0;
+    if (!hasSolution)
+      return true;
+    if (cached.size() == expectedSize) {
+      std::size_t pos = 1;
+      values.reserve(objects.size());
+      for (const Array *object : objects) {
+        values.emplace_back(cached.begin() + pos,
+                            cached.begin() + pos + object->size);
+        pos += object->size;
+      }
+      return true;
+    }
+  }
+
+  if (!solver->impl->computeInitialValues(query, objects, values, hasSolution))
+    return false;
+
+  std::string result(1, hasSolution ? 1 : 0);
+  if (hasSolution) {
+    result.reserve(expectedSize);
+    for (const auto &value : values)
+      result.append(value.begin(), value.end());
+  }
+  insert(key, InitialValues, result);
+  return true;
+}
+
+SolverImpl::SolverRunStatus PersistentCachingSolver::getOperationStatusCode() {
+  return solver->impl->getOperationStatusCode();
+}
+
+char *PersistentCachingSolver::getConstraintLog(const Query &query) {
+  return solver->impl->getConstraintLog(query);
+}
+
+void PersistentCachingSolver::setCoreSolverTimeout(time::Span timeout) {
+  solver->impl->setCoreSolverTimeout(timeout);
+}
+
+} // namespace
+
+std::unique_ptr<Solver>
+klee::createPersistentCachingSolver(std::unique_ptr<Solver> solver,
+                                    const std::string &path) {
+  return std::make_unique<Solver>(
+      std::make_unique<PersistentCachingSolver>(std::move(solver), path));
+}
@@ -0,0 +1,320 @@
+//===-- PortfolioSolver.cpp -------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "STPSolver.h"
+
+#include "klee/Expr/Assignment.h"
+#include "klee/Expr/Constraints.h"
+#include "klee/Expr/ExprUtil.h"
+#include "klee/Solver/Solver.h"
+#include "klee/Solver/SolverCmdLine.h"
+#include "klee/Solver/SolverImpl.h"
+#include "klee/Solver/SolverStats.h"
+#include "klee/Statistics/TimerStatIncrementer.h"
+#include "klee/Support/ErrorHandling.h"
+
+#include "llvm/Support/Errno.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace klee;
+
+namespace {
+
+/// Per-backend slot in the memory shared with the forked solvers. It is
+/// followed by the bytes of the computed assignment, if any.
+struct PortfolioResult {
+  bool success;
+  bool hasSolution;
+};
+
+class PortfolioSolverImpl : public SolverImpl {
+private:
+  struct Backend {
+    CoreSolverType type;
+    std::unique_ptr<Solver> solver;
+  };
+
+  std::vector<Backend> backends;
+  time::Span timeout;
+  SolverRunStatus runStatusCode;
+
+  static Statistic &getWinStatistic(CoreSolverType type);
+  void runBackend(Backend &backend, const Query &query,
+                  const std::vector<const Array *> &objects,
+                  unsigned char *slot);
+
+public:
+  explicit PortfolioSolverImpl(const std::vector<CoreSolverType> &types);
+
+  bool computeTruth(const Query &, bool &isValid) override;
+  bool computeValue(const Query &, ref<Expr> &result) override;
+  bool computeInitialValues(const Query &,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char>> &values,
+                            bool &hasSolution) override;
+  SolverRunStatus getOperationStatusCode() override;
+  char *getConstraintLog(const Query &) override;
+  void setCoreSolverTimeout(time::Span timeout) override;
+};
+
+PortfolioSolverImpl::PortfolioSolverImpl(
+    const std::vector<CoreSolverType> &types)
+    : runStatusCode(SOLVER_RUN_STATUS_FAILURE) {
+  for (CoreSolverType type : types) {
+    if (type == PORTFOLIO_SOLVER || type == DUMMY_SOLVER || type == NO_SOLVER)
+      klee_error("Invalid solver in portfolio");
+    std::unique_ptr<Solver> solver;
+#ifdef ENABLE_STP
+    // Every backend already runs in a process of its own, and the timeout is
+    // enforced here, so STP need not fork once more.
+    if (type == STP_SOLVER)
+      solver = std::make_unique<STPSolver>(false, CoreSolverOptimizeDivides);
+    else
+#endif
+      solver = createCoreSolver(type);
+    if (!solver)
+      klee_error("Failed to create core solver for portfolio");
+    backends.push_back({type, std::move(solver)});
+  }
+  if (backends.empty())
+    klee_error("Portfolio solver needs at least one core solver");
+}
+
+Statistic &PortfolioSolverImpl::getWinStatistic(CoreSolverType type) {
+  switch (type) {
+  case STP_SOLVER:
+    return stats::portfolioWinsSTP;
+  case METASMT_SOLVER:
+    return stats::portfolioWinsMetaSMT;
+  default:
+    assert(type == Z3_SOLVER && "unexpected solver in portfolio");
+    return stats::portfolioWinsZ3;
+  }
+}
+
+void PortfolioSolverImpl::runBackend(Backend &backend, const Query &query,
+                                     const std::vector<const Array *> &objects,
+                                     unsigned char *slot) {
+  std::vector<std::vector<unsigned char>> values;
+  bool hasSolution = false;
+  bool success = backend.solver->impl->computeInitialValues(query, objects,
+                                                            values, hasSolution);
+
+  PortfolioResult *result = reinterpret_cast<PortfolioResult *>(slot);
+  result->success = success;
+  result->hasSolution = hasSolution;
+  if (success && hasSolution) {
+    unsigned char *pos = slot + sizeof(PortfolioResult);
+    for (const auto &value : values) {
+      std::memcpy(pos, value.data(), value.size());
+      pos += value.size();
+    }
+  }
+}
+
+bool PortfolioSolverImpl::computeInitialValues(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char>> &values, bool &hasSolution) {
+  TimerStatIncrementer t(stats::queryTime);
+  runStatusCode = SOLVER_RUN_STATUS_FAILURE;
+  ++stats::solverQueries;
+  if (!objects.empty())
+    ++stats::queryCounterexamples;
+
+  std::size_t slotSize = sizeof(PortfolioResult);
+  for (const auto object : objects)
+    slotSize += object->size;
+  std::size_t sharedSize = slotSize * backends.size();
+  void *shared = mmap(nullptr, sharedSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (shared == MAP_FAILED) {
+    klee_warning("mmap failed (for portfolio solver) - %s",
+                 llvm::sys::StrError(errno).c_str());
+    return false;
+  }
+  unsigned char *slots = static_cast<unsigned char *>(shared);
+
+  // Every solver reports its index through the pipe when it is done, so the
+  // first answer can be taken without polling.
+  int finished[2];
+  if (pipe(finished) == -1) {
+    klee_warning("pipe failed (for portfolio solver) - %s",
+                 llvm::sys::StrError(errno).c_str());
+    munmap(shared, sharedSize);
+    return false;
+  }
+
+  fflush(stdout);
+  fflush(stderr);
+
+  std::vector<pid_t> pids(backends.size(), -1);
+  unsigned running = 0;
+  for (unsigned i = 0; i < backends.size(); ++i) {
+    pid_t pid = fork();
+    if (pid == -1) {
+      klee_warning("fork failed (for portfolio solver) - %s",
+                   llvm::sys::StrError(errno).c_str());
+      continue;
+    }
+    if (pid == 0) {
+      close(finished[0]);
+      runBackend(backends[i], query, objects, slots + i * slotSize);
+      ssize_t written;
+      do {
+        written = write(finished[1], &i, sizeof(i));
+      } while (written < 0 && errno == EINTR);
+      _exit(0);
+    }
+    pids[i] = pid;
+    ++running;
+  }
+  close(finished[1]);
+
+  if (!running) {
+    close(finished[0]);
+    munmap(shared, sharedSize);
+    runStatusCode = SOLVER_RUN_STATUS_FORK_FAILED;
+    return false;
+  }
+
+  // Take the first successful answer. Solvers that fail (e.g. time out) are
+  // skipped; if all of them fail, the pipe reaches end-of-file.
+  int winner = -1;
+  bool timedOut = false;
+  const time::Point deadline = time::getWallTime() + timeout;
+  for (unsigned remaining = running; remaining && winner == -1;) {
+    if (timeout) {
+      const time::Point now = time::getWallTime();
+      pollfd fd = {finished[0], POLLIN, 0};
+      int ready =
+          now < deadline
+              ? poll(&fd, 1, (deadline - now).toMicroseconds() / 1000 + 1)
+              : 0;
+      if (ready < 0 && errno == EINTR)
+        continue;
+      if (ready == 0) {
+        timedOut = true;
+        break;
+      }
+    }
+    unsigned index;
+    ssize_t got = read(finished[0], &index, sizeof(index));
+    if (got < 0 && errno == EINTR)
+      continue;
+    if (got != sizeof(index))
+      break;
+    --remaining;
+    const PortfolioResult *result =
+        reinterpret_cast<const PortfolioResult *>(slots + index * slotSize);
+    if (result->success)
+      winner = index;
+  }
+  close(finished[0]);
+
+  for (pid_t pid : pids) {
+    if (pid == -1)
+      continue;
+    kill(pid, SIGKILL);
+    pid_t res;
+    do {
+      res = waitpid(pid, nullptr, 0);
+    } while (res < 0 && errno == EINTR);
+  }
+
+  if (winner == -1) {
+    munmap(shared, sharedSize);
+    runStatusCode =
+        timedOut ? SOLVER_RUN_STATUS_TIMEOUT : SOLVER_RUN_STATUS_FAILURE;
+    return false;
+  }
+
+  ++getWinStatistic(backends[winner].type);
+  const unsigned char *slot = slots + winner * slotSize;
+  hasSolution = reinterpret_cast<const PortfolioResult *>(slot)->hasSolution;
+  if (hasSolution) {
+    const unsigned char *pos = slot + sizeof(PortfolioResult);
+    values.reserve(objects.size());
+    for (const auto object : objects) {
+      values.emplace_back(pos, pos + object->size);
+      pos += object->size;
+    }
+    ++stats::queriesInvalid;
+    runStatusCode = SOLVER_RUN_STATUS_SUCCESS_SOLVABLE;
+  } else {
+    ++stats::queriesValid;
+    runStatusCode = SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE;
+  }
+  munmap(shared, sharedSize);
+  return true;
+}
+
+bool PortfolioSolverImpl::computeTruth(const Query &query, bool &isValid) {
+  std::vector<const Array *> objects;
+  std::vector<std::vector<unsigned char>> values;
+  bool hasSolution;
+
+  if (!computeInitialValues(query, objects, values, hasSolution))
+    return false;
+
+  isValid = !hasSolution;
+  return true;
+}
+
+bool PortfolioSolverImpl::computeValue(const Query &query, ref<Expr> &result) {
+  std::vector<const Array *> objects;
+  std::vector<std::vector<unsigned char>> values;
+  bool hasSolution;
+
+  // Find the object used in the expression, and compute an assignment
+  // for them.
+  findSymbolicObjects(query.expr, objects);
+  if (!computeInitialValues(query.withFalse(), objects, values, hasSolution))
+    return false;
+  assert(hasSolution && "state has invalid constraint set");
+
+  // Evaluate the expression with the computed assignment.
+  Assignment a(objects, values);
+  result = a.evaluate(query.expr);
+
+  return true;
+}
+
+SolverImpl::SolverRunStatus PortfolioSolverImpl::getOperationStatusCode() {
+  return runStatusCode;
+}
+
+char *PortfolioSolverImpl::getConstraintLog(const Query &query) {
+  return backends.front().solver->getConstraintLog(query);
+}
+
+void PortfolioSolverImpl::setCoreSolverTimeout(time::Span timeout) {
+  this->timeout = timeout;
+  for (auto &backend : backends)
+    backend.solver->setCoreSolverTimeout(timeout);
+}
+
+} // namespace
+
+namespace klee {
+std::unique_ptr<Solver>
+createPortfolioSolver(const std::vector<CoreSolverType> &backends) {
+  return std::make_unique<Solver>(
+      std::make_unique<PortfolioSolverImpl>(backends));
+}
+} // namespace klee
@@ -56,6 +56,13 @@ cl::opt<bool>
                          cl::desc("Use constraint independence (default=true)"),
                          cl::cat(SolvingCat));
 
+cl::opt<std::string> PersistentCachePath(
+    "persistent-query-cache",
+    cl::desc("Path of an SQLite database caching the results of core solver "
+             "queries across runs. It can be shared by concurrent processes "
+             "(default=off)"),
+    cl::cat(SolvingCat));
+
 cl::opt<bool> DebugValidateSolver(
     "debug-validate-solver", cl::init(false),
     cl::desc("Crosscheck the results of the solver chain above the core solver "
@@ -196,9 +203,20 @@ cl::opt<CoreSolverType> CoreSolverToUse(
                clEnumValN(METASMT_SOLVER, "metasmt",
                           "metaSMT" METASMT_IS_DEFAULT_STR),
                clEnumValN(DUMMY_SOLVER, "dummy", "Dummy solver"),
-               clEnumValN(Z3_SOLVER, "z3", "Z3" Z3_IS_DEFAULT_STR)),
+               clEnumValN(Z3_SOLVER, "z3", "Z3" Z3_IS_DEFAULT_STR),
+               clEnumValN(PORTFOLIO_SOLVER, "portfolio",
+                          "Race the solvers given by -portfolio-solvers")),
     cl::init(DEFAULT_CORE_SOLVER), cl::cat(SolvingCat));
 
+cl::list<CoreSolverType> PortfolioSolvers(
+    "portfolio-solvers",
+    cl::desc("Comma-separated list of core solvers raced against each other "
+             "by -solver-backend=portfolio (default=all available)"),
+    cl::values(clEnumValN(STP_SOLVER, "stp", "STP"),
+               clEnumValN(METASMT_SOLVER, "metasmt", "metaSMT"),
+               clEnumValN(Z3_SOLVER, "z3", "Z3")),
+    cl::CommaSeparated, cl::cat(SolvingCat));
+
 cl::opt<CoreSolverType> DebugCrossCheckCoreSolverWith(
     "debug-crosscheck-core-solver",
     cl::desc(
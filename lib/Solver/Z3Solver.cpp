@@ -27,6 +27,9 @@
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
 #include <memory>
 
 namespace {
@@ -51,14 +54,35 @@ llvm::cl::opt<unsigned>
     Z3VerbosityLevel("debug-z3-verbosity", llvm::cl::init(0),
                      llvm::cl::desc("Z3 verbosity level (default=0)"),
                      llvm::cl::cat(klee::SolvingCat));
+
+llvm::cl::opt<unsigned> Z3IncrementalPoolSize(
+    "z3-incremental-pool-size", llvm::cl::init(4),
+    llvm::cl::desc("Number of live Z3 solvers kept by -z3-incremental "
+                   "(default=4)"),
+    llvm::cl::cat(klee::SolvingCat));
 }
 
 #include "llvm/Support/ErrorHandling.h"
 
 namespace klee {
+llvm::cl::opt<bool> Z3Incremental(
+    "z3-incremental", llvm::cl::init(false),
+    llvm::cl::desc("Keep Z3 solvers alive across queries and only push/pop "
+                   "the constraints that differ from the ones already "
+                   "asserted (default=false)"),
+    llvm::cl::cat(klee::SolvingCat));
 
 class Z3SolverImpl : public SolverImpl {
 private:
+  /// A Z3 solver kept alive across queries (see -z3-incremental). Each entry
+  /// of `assertedConstraints` has been asserted in its own backtracking
+  /// scope, in order, so that any suffix can be popped again.
+  struct IncrementalSolver {
+    ::Z3_solver solver;
+    std::vector<ref<Expr>> assertedConstraints;
+    std::uint64_t lastUse;
+  };
+
   std::unique_ptr<Z3Builder> builder;
   time::Span timeout;
   SolverRunStatus runStatusCode;
@@ -66,6 +90,12 @@ private:
   ::Z3_params solverParameters;
   // Parameter symbols
   ::Z3_symbol timeoutParamStrSymbol;
+  std::vector<IncrementalSolver> incrementalSolvers;
+  std::uint64_t incrementalUseCounter = 0;
+
+  ::Z3_solver getIncrementalSolver(const ConstraintSet &constraints);
+  void assertConstantArrays(::Z3_solver theSolver,
+                            const ConstantArrayFinder &finder);
 
   bool internalRunSolver(const Query &,
                          const std::vector<const Array *> *objects,
@@ -136,6 +166,8 @@ Z3SolverImpl::Z3SolverImpl()
 }
 
 Z3SolverImpl::~Z3SolverImpl() {
+  for (auto &incremental : incrementalSolvers)
+    Z3_solver_dec_ref(builder->ctx, incremental.solver);
   Z3_params_dec_ref(builder->ctx, solverParameters);
 }
 
@@ -253,22 +285,28 @@ bool Z3SolverImpl::internalRunSolver(
 
   TimerStatIncrementer t(stats::queryTime);
   // NOTE: Z3 will switch to using a slower solver internally if push/pop are
-  // used so for now it is likely that creating a new solver each time is the
-  // right way to go until Z3 changes its behaviour.
+  // used so by default we create a new solver each time. With
+  // -z3-incremental the constraint prefix shared with an earlier query is
+  // kept asserted instead, which pays off for long, shared path conditions.
   //
   // TODO: Investigate using a custom tactic as described in
   // https://github.com/klee/klee/issues/653
-  Z3_solver theSolver = Z3_mk_solver(builder->ctx);
-  Z3_solver_inc_ref(builder->ctx, theSolver);
-  Z3_solver_set_params(builder->ctx, theSolver, solverParameters);
+  Z3_solver theSolver;
+  ConstantArrayFinder constant_arrays_in_query;
+  if (Z3Incremental) {
+    theSolver = getIncrementalSolver(query.constraints);
+  } else {
+    theSolver = Z3_mk_solver(builder->ctx);
+    Z3_solver_inc_ref(builder->ctx, theSolver);
+    Z3_solver_set_params(builder->ctx, theSolver, solverParameters);
+    for (auto const &constraint : query.constraints) {
+      Z3_solver_assert(builder->ctx, theSolver, builder->construct(constraint));
+      constant_arrays_in_query.visit(constraint);
+    }
+  }
 
   runStatusCode = SOLVER_RUN_STATUS_FAILURE;
 
-  ConstantArrayFinder constant_arrays_in_query;
-  for (auto const &constraint : query.constraints) {
-    Z3_solver_assert(builder->ctx, theSolver, builder->construct(constraint));
-    constant_arrays_in_query.visit(constraint);
-  }
   ++stats::solverQueries;
   if (objects)
     ++stats::queryCounterexamples;
@@ -276,15 +314,7 @@ bool Z3SolverImpl::internalRunSolver(
   Z3ASTHandle z3QueryExpr =
       Z3ASTHandle(builder->construct(query.expr), builder->ctx);
   constant_arrays_in_query.visit(query.expr);
-
-  for (auto const &constant_array : constant_arrays_in_query.results) {
-    assert(builder->constant_array_assertions.count(constant_array) == 1 &&
-           "Constant array found in query, but not handled by Z3Builder");
-    for (auto const &arrayIndexValueExpr :
-         builder->constant_array_assertions[constant_array]) {
-      Z3_solver_assert(builder->ctx, theSolver, arrayIndexValueExpr);
-    }
-  }
+  assertConstantArrays(theSolver, constant_arrays_in_query);
 
   // KLEE Queries are validity queries i.e.
   // ∀ X Constraints(X) → query(X)
@@ -308,7 +338,12 @@ bool Z3SolverImpl::internalRunSolver(
   runStatusCode = handleSolverResponse(theSolver, satisfiable, objects, values,
                                        hasSolution);
 
-  Z3_solver_dec_ref(builder->ctx, theSolver);
+  if (Z3Incremental) {
+    // Drop the query scope, but keep the constraints for the next query.
+    Z3_solver_pop(builder->ctx, theSolver, 1);
+  } else {
+    Z3_solver_dec_ref(builder->ctx, theSolver);
+  }
   // Clear the builder's cache to prevent memory usage exploding.
   // By using ``autoClearConstructCache=false`` and clearning now
   // we allow Z3_ast expressions to be shared from an entire
@@ -331,6 +366,76 @@ bool Z3SolverImpl::internalRunSolver(
   return false; // failed
 }
 
+void Z3SolverImpl::assertConstantArrays(::Z3_solver theSolver,
+                                        const ConstantArrayFinder &finder) {
+  for (auto const &constant_array : finder.results) {
+    assert(builder->constant_array_assertions.count(constant_array) == 1 &&
+           "Constant array found in query, but not handled by Z3Builder");
+    for (auto const &arrayIndexValueExpr :
+         builder->constant_array_assertions[constant_array]) {
+      Z3_solver_assert(builder->ctx, theSolver, arrayIndexValueExpr);
+    }
+  }
+}
+
+::Z3_solver
+Z3SolverImpl::getIncrementalSolver(const ConstraintSet &constraints) {
+  // Pick the live solver that shares the longest constraint prefix with this
+  // query. If none shares anything, start a new one or recycle the least
+  // recently used one.
+  IncrementalSolver *best = nullptr;
+  std::size_t bestPrefix = 0;
+  for (auto &incremental : incrementalSolvers) {
+    const auto &asserted = incremental.assertedConstraints;
+    std::size_t prefix = 0;
+    for (auto it = constraints.begin(), ie = constraints.end();
+         it != ie && prefix < asserted.size() && *it == asserted[prefix]; ++it)
+      ++prefix;
+    if (!best || prefix > bestPrefix ||
+        (prefix == bestPrefix && incremental.lastUse < best->lastUse)) {
+      best = &incremental;
+      bestPrefix = prefix;
+    }
+  }
+
+  if (bestPrefix == 0 && incrementalSolvers.size() <
+                             std::max(1u, Z3IncrementalPoolSize.getValue())) {
+    ::Z3_solver theSolver = Z3_mk_solver(builder->ctx);
+    Z3_solver_inc_ref(builder->ctx, theSolver);
+    incrementalSolvers.push_back({theSolver, {}, 0});
+    best = &incrementalSolvers.back();
+  }
+
+  IncrementalSolver &incremental = *best;
+  incremental.lastUse = ++incrementalUseCounter;
+  // The timeout might have changed since the solver was created.
+  Z3_solver_set_params(builder->ctx, incremental.solver, solverParameters);
+
+  auto &asserted = incremental.assertedConstraints;
+  if (asserted.size() > bestPrefix) {
+    Z3_solver_pop(builder->ctx, incremental.solver,
+                  asserted.size() - bestPrefix);
+    asserted.resize(bestPrefix);
+  }
+
+  auto it = constraints.begin();
+  std::advance(it, bestPrefix);
+  for (auto ie = constraints.end(); it != ie; ++it) {
+    Z3_solver_push(builder->ctx, incremental.solver);
+    Z3_solver_assert(builder->ctx, incremental.solver, builder->construct(*it));
+    // Axiomatise the constant arrays in the scope of each constraint that
+    // uses them, so that the axioms are popped together with it.
+    ConstantArrayFinder constant_arrays_in_constraint;
+    constant_arrays_in_constraint.visit(*it);
+    assertConstantArrays(incremental.solver, constant_arrays_in_constraint);
+    asserted.push_back(*it);
+  }
+
+  // Scope for the query expression itself, popped after solving.
+  Z3_solver_push(builder->ctx, incremental.solver);
+  return incremental.solver;
+}
+
 SolverImpl::SolverRunStatus Z3SolverImpl::handleSolverResponse(
     ::Z3_solver theSolver, ::Z3_lbool satisfiable,
     const std::vector<const Array *> *objects,
@@ -0,0 +1,66 @@
+; REQUIRES: atomic-refcount
+; REQUIRES: z3
+; RUN: %llvmas %s -f -o %t1.bc
+; RUN: rm -rf %t.klee-out
+; RUN: %klee --output-dir=%t.klee-out --solver-backend=z3 --async-solver-threads=2 %t1.bc 2>&1 | FileCheck %s
+; RUN: rm -rf %t.klee-out
+; RUN: %klee --output-dir=%t.klee-out --solver-backend=z3 --async-solver-threads=2 --search=bfs %t1.bc 2>&1 | FileCheck %s
+
+; Branches on worker threads: feasible both ways, and only one way, where the
+; other side must not be explored.
+
+; CHECK-NOT: abort failure
+; CHECK: KLEE: done: completed paths = 4
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+@name = private constant [2 x i8] c"x\00"
+@visits = global i32 0
+
+declare void @klee_make_symbolic(i8*, i64, i8*)
+declare void @abort() noreturn
+
+define void @visit() {
+entry:
+  %0 = load i32, i32* @visits
+  %1 = add i32 %0, 1
+  store i32 %1, i32* @visits
+  ret void
+}
+
+define i32 @main() {
+entry:
+  %x.addr = alloca i32
+  %0 = bitcast i32* %x.addr to i8*
+  call void @klee_make_symbolic(i8* %0, i64 4, i8* getelementptr ([2 x i8], [2 x i8]* @name, i64 0, i64 0))
+  %x = load i32, i32* %x.addr
+  %small = icmp ult i32 %x, 100
+  br i1 %small, label %below, label %above
+
+below:
+  call void @visit()
+  %huge = icmp ugt i32 %x, 200
+  br i1 %huge, label %fail, label %parity
+
+above:
+  call void @visit()
+  %large = icmp ugt i32 %x, 50
+  br i1 %large, label %parity, label %fail
+
+parity:
+  %bit = and i32 %x, 1
+  %odd = icmp ne i32 %bit, 0
+  br i1 %odd, label %odd.bb, label %even.bb
+
+odd.bb:
+  call void @visit()
+  ret i32 1
+
+even.bb:
+  ret i32 0
+
+fail:
+  call void @abort()
+  unreachable
+}
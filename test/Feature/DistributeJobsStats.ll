@@ -0,0 +1,59 @@
+; RUN: %llvmas %s -f -o %t1.bc
+; RUN: rm -rf %t.klee-out %t.klee-out-distributed
+; RUN: %klee --output-dir=%t.klee-out --search=dfs %t1.bc 2>&1 | FileCheck %s
+; RUN: %klee --output-dir=%t.klee-out-distributed --distribute-jobs=4 --distribute-steal-interval=0s %t1.bc 2>&1 | FileCheck --check-prefix=CHECK-DISTRIBUTED %s
+; RUN: %sqlite3 %t.klee-out/run.stats "SELECT CoveredInstructions, UncoveredInstructions FROM stats ORDER BY rowid DESC LIMIT 1" > %t.single
+; RUN: %sqlite3 %t.klee-out-distributed/run.stats "SELECT CoveredInstructions, UncoveredInstructions FROM stats" > %t.distributed
+; RUN: diff %t.single %t.distributed
+; RUN: test -f %t.klee-out-distributed/run.istats
+; RUN: test -f %t.klee-out-distributed/assembly.ll
+
+; The statistics of all jobs end up in one line of the top-level run.stats,
+; with the same coverage as a single process.
+
+; CHECK: KLEE: done: completed paths = 256
+; CHECK-DISTRIBUTED: KLEE: done: generated tests = 256
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+@name = private constant [2 x i8] c"x\00"
+@big = global i32 0
+
+declare void @klee_make_symbolic(i8*, i64, i8*)
+
+define void @visit(i32 %count) noinline {
+entry:
+  store volatile i32 %count, i32* @big
+  ret void
+}
+
+define i32 @main() {
+entry:
+  %x = alloca [8 x i8]
+  %0 = bitcast [8 x i8]* %x to i8*
+  call void @klee_make_symbolic(i8* %0, i64 8, i8* getelementptr ([2 x i8], [2 x i8]* @name, i64 0, i64 0))
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %latch ]
+  %count = phi i32 [ 0, %entry ], [ %count.next, %latch ]
+  %p = getelementptr [8 x i8], [8 x i8]* %x, i64 0, i64 %i
+  %c = load i8, i8* %p
+  %big = icmp ugt i8 %c, 64
+  br i1 %big, label %inc, label %latch
+
+inc:
+  %count.inc = add i32 %count, 1
+  call void @visit(i32 %count.inc)
+  br label %latch
+
+latch:
+  %count.next = phi i32 [ %count, %loop ], [ %count.inc, %inc ]
+  %i.next = add i64 %i, 1
+  %done = icmp eq i64 %i.next, 8
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ret i32 %count.next
+}
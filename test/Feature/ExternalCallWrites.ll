@@ -0,0 +1,75 @@
+; RUN: %llvmas %s -f -o %t1.bc
+; RUN: rm -rf %t.klee-out
+; RUN: %klee --output-dir=%t.klee-out %t1.bc 2>&1 | FileCheck %s
+; RUN: rm -rf %t.klee-out
+; RUN: %klee --output-dir=%t.klee-out --kdalloc-track-writes=false %t1.bc 2>&1 | FileCheck %s
+
+; External calls write to a global and, through the kernel, to a heap object.
+; Only the written memory is compared after the calls, and only the modified
+; pages are copied out before the next one.
+
+; CHECK-NOT: abort failure
+; CHECK: KLEE: done: completed paths = 1
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+@hello = private constant [6 x i8] c"hello\00"
+@copy = global [6 x i8] zeroinitializer
+
+declare i8* @malloc(i64)
+declare i8* @strcpy(i8*, i8*)
+declare i32 @pipe(i32*)
+declare i64 @write(i32, i8*, i64)
+declare i64 @read(i32, i8*, i64)
+declare void @abort()
+
+define i32 @main() {
+entry:
+  %fds = alloca [2 x i32]
+  %fd0p = getelementptr [2 x i32], [2 x i32]* %fds, i64 0, i64 0
+  %fd1p = getelementptr [2 x i32], [2 x i32]* %fds, i64 0, i64 1
+  %buf = call i8* @malloc(i64 65536)
+  %hello = getelementptr [6 x i8], [6 x i8]* @hello, i64 0, i64 0
+  %copy = getelementptr [6 x i8], [6 x i8]* @copy, i64 0, i64 0
+  %p = call i32 @pipe(i32* %fd0p)
+  %fd0 = load i32, i32* %fd0p
+  %fd1 = load i32, i32* %fd1p
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %next, %ok ]
+  %offset = mul i64 %i, 4099
+  %dst = getelementptr i8, i8* %buf, i64 %offset
+  %t = trunc i64 %i to i8
+  %marker = getelementptr i8, i8* %dst, i64 8
+  store i8 %t, i8* %marker
+  store i8 0, i8* %copy
+  call i8* @strcpy(i8* %copy, i8* %hello)
+  %w = call i64 @write(i32 %fd1, i8* %copy, i64 5)
+  %r = call i64 @read(i32 %fd0, i8* %dst, i64 5)
+  %e = getelementptr i8, i8* %dst, i64 1
+  %c = load i8, i8* %e
+  %h = load i8, i8* %copy
+  %m = load i8, i8* %marker
+  %okr = icmp eq i64 %r, 5
+  %okc = icmp eq i8 %c, 101
+  %okh = icmp eq i8 %h, 104
+  %okm = icmp eq i8 %m, %t
+  %ok1 = and i1 %okr, %okc
+  %ok2 = and i1 %okh, %okm
+  %ok3 = and i1 %ok1, %ok2
+  br i1 %ok3, label %ok, label %bad
+
+bad:
+  call void @abort()
+  unreachable
+
+ok:
+  %next = add i64 %i, 1
+  %done = icmp eq i64 %next, 10
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ret i32 0
+}
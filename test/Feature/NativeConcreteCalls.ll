@@ -0,0 +1,113 @@
+; RUN: %llvmas %s -f -o %t1.bc
+; RUN: rm -rf %t.klee-out-native %t.klee-out-interpreted
+; RUN: %klee --output-dir=%t.klee-out-native --native-concrete-calls %t1.bc 2>&1 | FileCheck %s
+; RUN: %klee --output-dir=%t.klee-out-interpreted %t1.bc 2>&1 | FileCheck %s
+; RUN: %sqlite3 %t.klee-out-native/run.stats "SELECT NativeCalls FROM stats ORDER BY rowid DESC LIMIT 1" | FileCheck -check-prefix=CHECK-NATIVE %s
+; RUN: %sqlite3 %t.klee-out-interpreted/run.stats "SELECT NativeCalls FROM stats ORDER BY rowid DESC LIMIT 1" | FileCheck -check-prefix=CHECK-INTERPRETED %s
+; RUN: %sqlite3 %t.klee-out-native/run.stats "ATTACH '%t.klee-out-interpreted/run.stats' AS interpreted; SELECT (SELECT Instructions FROM stats ORDER BY rowid DESC LIMIT 1) < (SELECT Instructions FROM interpreted.stats ORDER BY rowid DESC LIMIT 1)" | FileCheck -check-prefix=CHECK-FEWER %s
+
+; init, sum and the first call to check run natively, and the function
+; pointer stored by init is the one the interpreter knows. The second call to
+; check leaves native code at the call to abort and is interpreted, as are
+; the call to sum once memory is symbolic and the faulting call to deref.
+; The four calls started natively are counted, and save instructions.
+
+; CHECK-NOT: abort failure
+; CHECK: memory error: null page access
+; CHECK-NATIVE: {{^}}4{{$}}
+; CHECK-INTERPRETED: {{^}}0{{$}}
+; CHECK-FEWER: {{^}}1{{$}}
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+@table = global [256 x i32] zeroinitializer
+@fp = global i32 (i32)* null
+
+declare void @abort()
+declare void @klee_make_symbolic(i8*, i64, i8*)
+@name = private constant [2 x i8] c"x\00"
+
+define i32 @sq(i32 %x) {
+  %m = mul i32 %x, %x
+  ret i32 %m
+}
+
+define void @init() {
+entry:
+  store i32 (i32)* @sq, i32 (i32)** @fp
+  br label %loop
+loop:
+  %i = phi i32 [ 0, %entry ], [ %inc, %loop ]
+  %s = call i32 @sq(i32 %i)
+  %v = xor i32 %s, 90
+  %idx = zext i32 %i to i64
+  %p = getelementptr [256 x i32], [256 x i32]* @table, i64 0, i64 %idx
+  store i32 %v, i32* %p
+  %inc = add i32 %i, 1
+  %c = icmp ult i32 %inc, 256
+  br i1 %c, label %loop, label %done
+done:
+  ret void
+}
+
+define i32 @sum(i32* %p, i32 %n) {
+entry:
+  br label %loop
+loop:
+  %i = phi i32 [ 0, %entry ], [ %inc, %loop ]
+  %acc = phi i32 [ 0, %entry ], [ %acc2, %loop ]
+  %idx = zext i32 %i to i64
+  %q = getelementptr i32, i32* %p, i64 %idx
+  %v = load i32, i32* %q
+  %acc2 = add i32 %acc, %v
+  %inc = add i32 %i, 1
+  %c = icmp ult i32 %inc, %n
+  br i1 %c, label %loop, label %done
+done:
+  ret i32 %acc2
+}
+
+define i32 @check(i32 %x) {
+  %bad = icmp eq i32 %x, 999
+  br i1 %bad, label %fail, label %ok
+fail:
+  call void @abort()
+  unreachable
+ok:
+  ret i32 %x
+}
+
+define i32 @deref(i32* %p) {
+  %v = load i32, i32* %p
+  ret i32 %v
+}
+
+define i32 @main() {
+entry:
+  %x = alloca i32
+  store i32 0, i32* %x
+  call void @init()
+  %t = getelementptr [256 x i32], [256 x i32]* @table, i64 0, i64 0
+  %s = call i32 @sum(i32* %t, i32 256)
+  %f = load i32 (i32)*, i32 (i32)** @fp
+  %s2 = call i32 %f(i32 3)
+  %ok1 = icmp eq i32 %s2, 9
+  %good = icmp eq i32 %s, 5564288
+  %both = and i1 %good, %ok1
+  br i1 %both, label %next, label %fail
+next:
+  %c1 = call i32 @check(i32 5)
+  %xp = bitcast i32* %x to i8*
+  %nm = getelementptr [2 x i8], [2 x i8]* @name, i64 0, i64 0
+  call void @klee_make_symbolic(i8* %xp, i64 4, i8* %nm)
+  %s3 = call i32 @sum(i32* %t, i32 256)
+  %good3 = icmp eq i32 %s3, 5564288
+  br i1 %good3, label %last, label %fail
+last:
+  %d = call i32 @deref(i32* null)
+  ret i32 %d
+fail:
+  call void @abort()
+  unreachable
+}
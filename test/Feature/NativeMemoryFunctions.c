@@ -0,0 +1,43 @@
+// RUN: %clang %s -emit-llvm -g -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --exit-on-error %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --libc=klee --exit-on-error %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --libc=klee --native-memory-functions=false --exit-on-error %t1.bc
+
+#include "klee/klee.h"
+
+#include <assert.h>
+#include <string.h>
+
+int main() {
+  char src[64], dst[64];
+  for (int i = 0; i < 64; ++i)
+    src[i] = i;
+
+  memcpy(dst, src, sizeof dst);
+  for (int i = 0; i < 64; ++i)
+    assert(dst[i] == i);
+
+  // symbolic bytes are copied as well
+  char sym;
+  klee_make_symbolic(&sym, sizeof sym, "sym");
+  src[10] = sym;
+  memcpy(dst, src, 16);
+  assert(dst[10] == sym);
+  assert(dst[11] == 11);
+
+  // overlapping ranges
+  memmove(src + 1, src, 20);
+  assert(src[11] == sym);
+  assert(src[1] == 0);
+
+  // symbolic fill value
+  memset(dst + 4, sym, 8);
+  assert(dst[3] == 3);
+  assert(dst[11] == sym);
+  assert(dst[12] == 12);
+
+  return 0;
+}
@@ -0,0 +1,28 @@
+// RUN: %clang %s -emit-llvm -g -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --exit-on-error %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --libc=klee --exit-on-error %t1.bc
+
+// A memset defined by the program is interpreted, not executed natively.
+
+#include <assert.h>
+#include <stddef.h>
+
+static unsigned calls;
+
+void *memset(void *s, int c, size_t n) {
+  unsigned char *p = s;
+  ++calls;
+  for (size_t i = 0; i < n; ++i)
+    p[i] = (unsigned char)c;
+  return s;
+}
+
+int main() {
+  char buf[16];
+  memset(buf, 'x', sizeof buf);
+  assert(calls == 1);
+  assert(buf[15] == 'x');
+  return 0;
+}
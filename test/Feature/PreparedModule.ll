@@ -0,0 +1,66 @@
+; RUN: %llvmas %s -f -o %t1.bc
+; RUN: rm -rf %t.klee-out %t.klee-out-prepared
+; RUN: %klee --output-dir=%t.klee-out --output-module %t1.bc 2>&1 | FileCheck %s
+; RUN: %klee --output-dir=%t.klee-out-prepared --prepared-module %t.klee-out/final.bc 2>&1 | FileCheck %s
+; RUN: rm -rf %t.klee-out-unprepared
+; RUN: not %klee --output-dir=%t.klee-out-unprepared --prepared-module %t1.bc 2>&1 | FileCheck --check-prefix=CHECK-UNPREPARED %s
+; RUN: rm -rf %t.klee-out-entry
+; RUN: not %klee --output-dir=%t.klee-out-entry --prepared-module --entry-point=init %t.klee-out/final.bc 2>&1 | FileCheck --check-prefix=CHECK-ENTRY %s
+; RUN: rm -rf %t.klee-out-posix
+; RUN: not %klee --output-dir=%t.klee-out-posix --prepared-module --posix-runtime %t.klee-out/final.bc 2>&1 | FileCheck --check-prefix=CHECK-POSIX %s
+; RUN: rm -rf %t.klee-out-runtime
+; RUN: not %klee --output-dir=%t.klee-out-runtime --prepared-module --runtime-build=Other %t.klee-out/final.bc 2>&1 | FileCheck --check-prefix=CHECK-RUNTIME %s
+
+; A module written by --output-module runs as it is, with its constructor
+; called once, and keeps the --libc and --posix-runtime it was linked with.
+
+; CHECK-NOT: abort failure
+; CHECK: KLEE: done: completed paths = 2
+; CHECK-UNPREPARED: The module was not written with --output-module
+; CHECK-ENTRY: The module was prepared for a different entry point
+; CHECK-POSIX: The module was linked with --posix-runtime=false
+; CHECK-RUNTIME: The module contains the {{.*}} runtime, not the {{.*}}_Other runtime
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+@initialized = global i32 0
+@name = private constant [2 x i8] c"x\00"
+@llvm.global_ctors = appending global [1 x { i32, void ()*, i8* }] [{ i32, void ()*, i8* } { i32 65535, void ()* @init, i8* null }]
+
+declare void @klee_make_symbolic(i8*, i64, i8*)
+declare void @abort() noreturn
+
+define void @init() {
+entry:
+  %0 = load i32, i32* @initialized
+  %1 = add i32 %0, 1
+  store i32 %1, i32* @initialized
+  ret void
+}
+
+define i32 @main() {
+entry:
+  %x = alloca i32
+  %0 = bitcast i32* %x to i8*
+  call void @klee_make_symbolic(i8* %0, i64 4, i8* getelementptr ([2 x i8], [2 x i8]* @name, i64 0, i64 0))
+  %1 = load i32, i32* @initialized
+  %2 = icmp eq i32 %1, 1
+  br i1 %2, label %check, label %fail
+
+check:
+  %3 = load i32, i32* %x
+  %4 = icmp sgt i32 %3, 0
+  br i1 %4, label %positive, label %other
+
+positive:
+  call void @init()
+  ret i32 1
+
+other:
+  ret i32 0
+
+fail:
+  call void @abort()
+  unreachable
+}
@@ -0,0 +1,23 @@
+; RUN: %llvmas %s -f -o %t1.bc
+; RUN: rm -rf %t.klee-out
+; RUN: not %klee --output-dir=%t.klee-out --prepared-module %t1.bc 2>&1 | FileCheck %s
+
+; A module prepared by another build of KLEE may contain other runtime
+; libraries and is refused.
+
+; CHECK: The module was prepared by KLEE 0.0 unknown, not by this KLEE
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+define i32 @main() {
+entry:
+  ret i32 0
+}
+
+!klee.link-settings = !{!0, !1}
+!klee.prepared = !{!2}
+
+!0 = !{!"libc", !"none"}
+!1 = !{!"posix-runtime", !"false"}
+!2 = !{!"main", !"KLEE 0.0 unknown", !"64_Debug+Asserts"}
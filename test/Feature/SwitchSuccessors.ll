@@ -0,0 +1,148 @@
+; RUN: %llvmas %s -f -o %t1.bc
+; RUN: rm -rf %t.klee-out
+; RUN: %klee --output-dir=%t.klee-out --switch-type=internal %t1.bc 2>&1 | FileCheck %s
+
+; Switches take the successor of the matching case, or the default, for
+; conditions of up to 64 bits and wider ones, and phi nodes reached from a
+; switch through several cases pick the value of the switch's block.
+
+; CHECK-NOT: abort failure
+; CHECK: KLEE: done: completed paths = 4
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+@name = private constant [2 x i8] c"x\00"
+
+declare void @klee_make_symbolic(i8*, i64, i8*)
+declare void @abort() noreturn
+
+; Cases 5 and 7 share the phi's block, which has the switch's block as
+; incoming block twice and not first.
+define i64 @wide(i64 %x) {
+entry:
+  switch i64 %x, label %default [
+    i64 -1, label %big
+    i64 0, label %zero
+    i64 4294967296, label %big
+    i64 5, label %join
+    i64 7, label %join
+  ]
+
+zero:
+  br label %join
+
+big:
+  br label %join
+
+default:
+  br label %join
+
+join:
+  %r = phi i64 [ 1, %zero ], [ 2, %big ], [ 57, %entry ], [ 57, %entry ], [ 3, %default ]
+  ret i64 %r
+}
+
+define i64 @wider(i128 %x) {
+entry:
+  switch i128 %x, label %default [
+    i128 18446744073709551616, label %big
+    i128 0, label %zero
+  ]
+
+zero:
+  br label %join
+
+big:
+  br label %join
+
+default:
+  br label %join
+
+join:
+  %r = phi i64 [ 1, %zero ], [ 2, %big ], [ 3, %default ]
+  ret i64 %r
+}
+
+define i64 @narrow(i8 %x) {
+entry:
+  switch i8 %x, label %default [
+    i8 -128, label %join
+    i8 127, label %join
+  ]
+
+default:
+  br label %join
+
+join:
+  %r = phi i64 [ 3, %default ], [ 57, %entry ], [ 57, %entry ]
+  ret i64 %r
+}
+
+define void @check(i64 %actual, i64 %expected) {
+entry:
+  %ok = icmp eq i64 %actual, %expected
+  br i1 %ok, label %done, label %fail
+
+done:
+  ret void
+
+fail:
+  call void @abort()
+  unreachable
+}
+
+define i32 @main() {
+entry:
+  %r0 = call i64 @wide(i64 0)
+  call void @check(i64 %r0, i64 1)
+  %r1 = call i64 @wide(i64 -1)
+  call void @check(i64 %r1, i64 2)
+  %r2 = call i64 @wide(i64 4294967296)
+  call void @check(i64 %r2, i64 2)
+  %r3 = call i64 @wide(i64 5)
+  call void @check(i64 %r3, i64 57)
+  %r4 = call i64 @wide(i64 7)
+  call void @check(i64 %r4, i64 57)
+  %r5 = call i64 @wide(i64 6)
+  call void @check(i64 %r5, i64 3)
+  %r6 = call i64 @wide(i64 4294967301)
+  call void @check(i64 %r6, i64 3)
+  %r7 = call i64 @wide(i64 9223372036854775807)
+  call void @check(i64 %r7, i64 3)
+
+  %w0 = call i64 @wider(i128 0)
+  call void @check(i64 %w0, i64 1)
+  %w1 = call i64 @wider(i128 18446744073709551616)
+  call void @check(i64 %w1, i64 2)
+  %w2 = call i64 @wider(i128 1)
+  call void @check(i64 %w2, i64 3)
+  %w3 = call i64 @wider(i128 36893488147419103232)
+  call void @check(i64 %w3, i64 3)
+
+  %n0 = call i64 @narrow(i8 -128)
+  call void @check(i64 %n0, i64 57)
+  %n1 = call i64 @narrow(i8 127)
+  call void @check(i64 %n1, i64 57)
+  %n2 = call i64 @narrow(i8 0)
+  call void @check(i64 %n2, i64 3)
+
+  ; A symbolic condition forks once per distinct successor.
+  %x = alloca i64
+  %p = bitcast i64* %x to i8*
+  call void @klee_make_symbolic(i8* %p, i64 8, i8* getelementptr ([2 x i8], [2 x i8]* @name, i64 0, i64 0))
+  %v = load i64, i64* %x
+  %s = call i64 @wide(i64 %v)
+  %is0 = icmp eq i64 %v, 0
+  %ism1 = icmp eq i64 %v, -1
+  %is32 = icmp eq i64 %v, 4294967296
+  %isbig = or i1 %ism1, %is32
+  %is5 = icmp eq i64 %v, 5
+  %is7 = icmp eq i64 %v, 7
+  %isjoin = or i1 %is5, %is7
+  %e0 = select i1 %isjoin, i64 57, i64 3
+  %e1 = select i1 %isbig, i64 2, i64 %e0
+  %e2 = select i1 %is0, i64 1, i64 %e1
+  call void @check(i64 %s, i64 %e2)
+  ret i32 0
+}
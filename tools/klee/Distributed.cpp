@@ -0,0 +1,530 @@
+//===-- Distributed.cpp ---------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Distributed.h"
+
+#include "klee/Core/Interpreter.h"
+#include "klee/Support/ErrorHandling.h"
+#include "klee/Support/FileHandling.h"
+
+#include "klee/Support/CompilerWarning.h"
+DISABLE_WARNING_PUSH
+DISABLE_WARNING_DEPRECATED_DECLARATIONS
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/raw_ostream.h"
+DISABLE_WARNING_POP
+
+#include <poll.h>
+#include <signal.h>
+#include <sqlite3.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <new>
+#include <sstream>
+
+using namespace llvm;
+using namespace klee;
+
+static bool interrupted = false;
+
+static void interrupt_handle_coordinator() {
+  // the jobs receive the same interrupt and halt on their own
+  interrupted = true;
+}
+
+/// Read exactly \p size bytes, returns false on end-of-file.
+static bool readAll(int fd, void *buffer, std::size_t size) {
+  auto *pos = static_cast<unsigned char *>(buffer);
+  while (size) {
+    ssize_t res = read(fd, pos, size);
+    if (res < 0 && errno == EINTR)
+      continue;
+    if (res <= 0)
+      return false;
+    pos += res;
+    size -= res;
+  }
+  return true;
+}
+
+namespace {
+/// Reads the run.istats of one job line by line, with one line of lookahead.
+class IStatsReader {
+  std::ifstream in;
+  std::string pending;
+  bool hasPending = false;
+
+public:
+  explicit IStatsReader(const std::string &path) : in(path) {}
+
+  bool next(std::string &line) {
+    if (hasPending) {
+      line = std::move(pending);
+      hasPending = false;
+      return true;
+    }
+    return static_cast<bool>(std::getline(in, line));
+  }
+  void putBack(std::string line) {
+    pending = std::move(line);
+    hasPending = true;
+  }
+};
+
+enum class EventMerge { Sum, Max, Min };
+
+/// Merged instruction coverage of all jobs
+struct MergedCoverage {
+  std::uint64_t covered = 0;
+  std::uint64_t uncovered = 0;
+};
+} // namespace
+
+static bool startsWith(const std::string &line, const char *prefix) {
+  return line.compare(0, std::strlen(prefix), prefix) == 0;
+}
+
+static bool parseIStatsValues(const std::string &line,
+                              std::vector<std::uint64_t> &values) {
+  std::istringstream in(line);
+  values.clear();
+  std::uint64_t value;
+  while (in >> value)
+    values.push_back(value);
+  return in.eof();
+}
+
+/// Merge the events of \p from into \p into, both starting with the
+/// instruction and line.
+static void mergeIStatsValues(const std::vector<EventMerge> &merges,
+                              std::vector<std::uint64_t> &into,
+                              const std::vector<std::uint64_t> &from) {
+  for (std::size_t i = 0; i < merges.size(); ++i) {
+    std::uint64_t &a = into[i + 2];
+    std::uint64_t b = from[i + 2];
+    switch (merges[i]) {
+    case EventMerge::Sum:
+      a += b;
+      break;
+    case EventMerge::Max:
+      a = std::max(a, b);
+      break;
+    case EventMerge::Min:
+      a = std::min(a, b);
+      break;
+    }
+  }
+}
+
+static void writeIStatsValues(llvm::raw_ostream &os,
+                              const std::vector<std::uint64_t> &values) {
+  for (auto value : values)
+    os << value << ' ';
+  os << '\n';
+}
+
+/// Merge the run.istats of the jobs in \p jobDirs into \p path. Events are
+/// added up, except that an instruction is covered if any job covered it.
+/// Returns false if the files do not describe the same module.
+static bool mergeJobIStats(const std::vector<std::string> &jobDirs,
+                           const std::string &path,
+                           MergedCoverage &coverage) {
+  std::vector<std::unique_ptr<IStatsReader>> readers;
+  for (const auto &dir : jobDirs) {
+    SmallString<128> file(dir);
+    sys::path::append(file, "run.istats");
+    readers.push_back(std::make_unique<IStatsReader>(file.c_str()));
+  }
+
+  std::string error;
+  auto out = klee_open_output_file(path, error);
+  if (!out)
+    return false;
+
+  // read the next line of every job, all jobs have to end together
+  std::vector<std::string> lines(readers.size());
+  bool consistent = true;
+  auto nextLines = [&]() {
+    std::size_t read = 0;
+    for (std::size_t i = 0; i < readers.size(); ++i)
+      read += readers[i]->next(lines[i]);
+    consistent &= read == 0 || read == readers.size();
+    return read == readers.size();
+  };
+
+  // the header ends with the object file and is the same for all jobs,
+  // except for the pid
+  std::vector<EventMerge> merges;
+  std::size_t covered = 0, uncovered = 0;
+  do {
+    if (!nextLines())
+      return false;
+    if (startsWith(lines[0], "events: ")) {
+      std::istringstream events(lines[0].substr(8));
+      std::string event;
+      while (events >> event) {
+        if (event == "Icov") {
+          covered = merges.size() + 2;
+          merges.push_back(EventMerge::Max);
+        } else if (event == "Iuncov") {
+          uncovered = merges.size() + 2;
+          merges.push_back(EventMerge::Min);
+        } else if (event == "UCdist") {
+          merges.push_back(EventMerge::Min);
+        } else {
+          merges.push_back(EventMerge::Sum);
+        }
+      }
+    }
+    *out << lines[0] << '\n';
+  } while (!startsWith(lines[0], "ob="));
+
+  std::vector<std::uint64_t> merged, values;
+  while (nextLines()) {
+    if (startsWith(lines[0], "fl=") || startsWith(lines[0], "fn=")) {
+      if (std::count(lines.begin(), lines.end(), lines[0]) !=
+          static_cast<std::ptrdiff_t>(lines.size()))
+        return false;
+      *out << lines[0] << '\n';
+      continue;
+    }
+
+    // an instruction
+    if (!parseIStatsValues(lines[0], merged) ||
+        merged.size() != merges.size() + 2)
+      return false;
+    for (std::size_t i = 1; i < lines.size(); ++i) {
+      if (!parseIStatsValues(lines[i], values) ||
+          values.size() != merged.size() ||
+          !std::equal(values.begin(), values.begin() + 2, merged.begin()))
+        return false;
+      mergeIStatsValues(merges, merged, values);
+    }
+    writeIStatsValues(*out, merged);
+    if (covered)
+      coverage.covered += merged[covered];
+    if (uncovered)
+      coverage.uncovered += merged[uncovered];
+
+    // the calls from the instruction, which differ between jobs
+    struct Call {
+      std::string callee;
+      std::string target;
+      std::uint64_t count;
+      std::vector<std::uint64_t> values;
+    };
+    std::vector<Call> calls;
+    std::map<std::string, std::size_t> callIndex;
+    for (auto &reader : readers) {
+      std::string line;
+      while (reader->next(line)) {
+        if (!startsWith(line, "cfl=") && !startsWith(line, "cfn=")) {
+          reader->putBack(std::move(line));
+          break;
+        }
+        // [cfl=<file>] cfn=<function> calls=<count> <instruction> <line>
+        Call call;
+        if (startsWith(line, "cfl=")) {
+          call.callee = line + '\n';
+          if (!reader->next(line))
+            return false;
+        }
+        if (!startsWith(line, "cfn="))
+          return false;
+        call.callee += line + '\n';
+        if (!reader->next(line) || !startsWith(line, "calls="))
+          return false;
+        std::istringstream in(line.substr(6));
+        if (!(in >> call.count) || !std::getline(in, call.target))
+          return false;
+        if (!reader->next(line) || !parseIStatsValues(line, call.values) ||
+            call.values.size() != merged.size())
+          return false;
+
+        auto it = callIndex.emplace(call.callee + call.target, calls.size());
+        if (it.second) {
+          calls.push_back(std::move(call));
+        } else {
+          Call &existing = calls[it.first->second];
+          existing.count += call.count;
+          mergeIStatsValues(merges, existing.values, call.values);
+        }
+      }
+    }
+    for (const auto &call : calls) {
+      *out << call.callee << "calls=" << call.count << call.target << '\n';
+      writeIStatsValues(*out, call.values);
+    }
+  }
+  return consistent;
+}
+
+/// Merge the last line of the run.stats of the jobs in \p jobDirs into a
+/// single line in \p path. Counters are added up, while the wall time is
+/// that of the whole exploration and \p coverage, if given, replaces the
+/// instruction coverage of the individual jobs.
+static void mergeJobStats(const std::vector<std::string> &jobDirs,
+                          const std::string &path, time::Span wallTime,
+                          const MergedCoverage *coverage) {
+  std::string schema;
+  std::vector<std::string> columns;
+  std::vector<std::int64_t> merged;
+
+  for (const auto &dir : jobDirs) {
+    SmallString<128> file(dir);
+    sys::path::append(file, "run.stats");
+    sqlite3 *db = nullptr;
+    if (sqlite3_open_v2(file.c_str(), &db, SQLITE_OPEN_READWRITE, nullptr) !=
+        SQLITE_OK) {
+      klee_warning("cannot open \"%s\": %s", file.c_str(), sqlite3_errmsg(db));
+      sqlite3_close(db);
+      continue;
+    }
+
+    sqlite3_stmt *stmt = nullptr;
+    if (schema.empty() &&
+        sqlite3_prepare_v2(db,
+                           "SELECT sql FROM sqlite_master WHERE type = "
+                           "'table' AND name = 'stats'",
+                           -1, &stmt, nullptr) == SQLITE_OK &&
+        sqlite3_step(stmt) == SQLITE_ROW)
+      schema = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0));
+    sqlite3_finalize(stmt);
+
+    stmt = nullptr;
+    if (sqlite3_prepare_v2(db,
+                           "SELECT * FROM stats ORDER BY rowid DESC LIMIT 1",
+                           -1, &stmt, nullptr) == SQLITE_OK &&
+        sqlite3_step(stmt) == SQLITE_ROW) {
+      const int numColumns = sqlite3_column_count(stmt);
+      const bool first = columns.empty();
+      for (int i = 0; i < numColumns; ++i) {
+        std::int64_t value = sqlite3_column_int64(stmt, i);
+        if (first) {
+          columns.emplace_back(sqlite3_column_name(stmt, i));
+          merged.push_back(value);
+          continue;
+        }
+        if (columns.size() != static_cast<std::size_t>(numColumns))
+          break;
+        const std::string &column = columns[i];
+        if (column == "MallocUsage" || column == "NumBranches" ||
+            column == "FullBranches" || column == "PartialBranches" ||
+            column == "CoveredInstructions")
+          merged[i] = std::max(merged[i], value);
+        else if (column == "UncoveredInstructions")
+          merged[i] = std::min(merged[i], value);
+        else
+          merged[i] += value;
+      }
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+  }
+
+  if (schema.empty() || columns.empty())
+    return;
+
+  for (std::size_t i = 0; i < columns.size(); ++i) {
+    if (columns[i] == "WallTime")
+      merged[i] = wallTime.toMicroseconds();
+    else if (coverage && columns[i] == "CoveredInstructions")
+      merged[i] = coverage->covered;
+    else if (coverage && columns[i] == "UncoveredInstructions")
+      merged[i] = coverage->uncovered;
+  }
+
+  sqlite3 *db = nullptr;
+  if (sqlite3_open(path.c_str(), &db) != SQLITE_OK) {
+    klee_warning("cannot open \"%s\": %s", path.c_str(), sqlite3_errmsg(db));
+    sqlite3_close(db);
+    return;
+  }
+  std::string insert = "INSERT INTO stats VALUES (?";
+  for (std::size_t i = 1; i < columns.size(); ++i)
+    insert += ",?";
+  insert += ')';
+  sqlite3_stmt *stmt = nullptr;
+  if (sqlite3_exec(db, schema.c_str(), nullptr, nullptr, nullptr) !=
+          SQLITE_OK ||
+      sqlite3_prepare_v2(db, insert.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+    klee_warning("cannot write \"%s\": %s", path.c_str(), sqlite3_errmsg(db));
+  } else {
+    for (std::size_t i = 0; i < merged.size(); ++i)
+      sqlite3_bind_int64(stmt, i + 1, merged[i]);
+    if (sqlite3_step(stmt) != SQLITE_DONE)
+      klee_warning("cannot write \"%s\": %s", path.c_str(), sqlite3_errmsg(db));
+  }
+  sqlite3_finalize(stmt);
+  sqlite3_close(db);
+}
+
+/// Merge the statistics of all jobs into the output directory, as if the
+/// exploration had run in a single process.
+static void mergeJobStatistics(InterpreterHandler &handler, unsigned numJobs,
+                               time::Span wallTime) {
+  std::vector<std::string> statsDirs, istatsDirs;
+  for (unsigned id = 0; id < numJobs; ++id) {
+    std::string dir = handler.getOutputFilename("job-" + llvm::utostr(id));
+    if (sys::fs::exists(dir + "/run.stats"))
+      statsDirs.push_back(dir);
+    if (sys::fs::exists(dir + "/run.istats"))
+      istatsDirs.push_back(dir);
+  }
+
+  MergedCoverage coverage;
+  bool mergedIStats = false;
+  if (!istatsDirs.empty()) {
+    std::string istats = handler.getOutputFilename("run.istats");
+    mergedIStats = mergeJobIStats(istatsDirs, istats, coverage);
+    if (mergedIStats) {
+      // the merged istats refer to the assembly of the jobs
+      sys::fs::copy_file(istatsDirs.front() + "/assembly.ll",
+                         handler.getOutputFilename("assembly.ll"));
+    } else {
+      klee_warning("cannot merge the run.istats of the jobs");
+      sys::fs::remove(istats);
+    }
+  }
+
+  if (!statsDirs.empty())
+    mergeJobStats(statsDirs, handler.getOutputFilename("run.stats"), wallTime,
+                  mergedIStats ? &coverage : nullptr);
+}
+
+bool klee::runDistributed(InterpreterHandler &handler,
+                          const DistributedOptions &opts,
+                          const StartJobFn &startJob,
+                          std::vector<unsigned char> &jobBranches) {
+  struct Job {
+    pid_t pid;
+    int fd;
+  };
+
+  void *shared = mmap(nullptr, sizeof(std::atomic<unsigned>),
+                      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (shared == MAP_FAILED)
+    klee_error("unable to map shared test counter: %s", strerror(errno));
+  auto *testCounter = new (shared) std::atomic<unsigned>(0);
+
+  sys::SetInterruptFunction(interrupt_handle_coordinator);
+
+  const auto startTime = time::getWallTime();
+  auto nextSteal = startTime;
+
+  std::deque<std::vector<unsigned char>> pending(1);
+  std::vector<Job> running;
+  unsigned numJobs = 0, stealTurn = 0;
+  bool stopping = false;
+
+  while (!running.empty() || (!pending.empty() && !stopping)) {
+    const auto now = time::getWallTime();
+    if (!stopping && opts.maxTime && now - startTime > opts.maxTime) {
+      for (const auto &job : running)
+        kill(job.pid, SIGINT);
+      stopping = true;
+    }
+    stopping |= interrupted;
+
+    while (!stopping && !pending.empty() && running.size() < opts.jobs) {
+      int fds[2];
+      if (pipe(fds) == -1)
+        klee_error("unable to create pipe for job: %s", strerror(errno));
+
+      handler.getInfoStream().flush();
+      fflush(nullptr);
+      unsigned id = numJobs++;
+      pid_t pid = fork();
+      if (pid == -1)
+        klee_error("unable to fork job: %s", strerror(errno));
+
+      if (pid == 0) {
+        close(fds[0]);
+        for (const auto &job : running)
+          close(job.fd);
+        jobBranches = std::move(pending.front());
+        startJob(id, fds[1], testCounter);
+        return true;
+      }
+
+      close(fds[1]);
+      pending.pop_front();
+      running.push_back({pid, fds[0]});
+    }
+
+    // ask busy jobs for work for every idle slot
+    if (!stopping && pending.empty() && !running.empty() &&
+        running.size() < opts.jobs && now >= nextSteal) {
+      for (auto i = running.size(); i < opts.jobs; ++i)
+        kill(running[stealTurn++ % running.size()].pid, SIGUSR1);
+      nextSteal = now + opts.stealInterval;
+    }
+
+    std::vector<struct pollfd> fds;
+    for (const auto &job : running)
+      fds.push_back({job.fd, POLLIN, 0});
+    int res = poll(fds.data(), fds.size(), 100);
+    if (res < 0) {
+      if (errno == EINTR)
+        continue;
+      klee_error("poll failed: %s", strerror(errno));
+    }
+
+    for (std::size_t i = fds.size(); i--;) {
+      if (!fds[i].revents)
+        continue;
+
+      std::uint32_t size;
+      if (readAll(running[i].fd, &size, sizeof(size))) {
+        std::vector<unsigned char> branches(size);
+        if (readAll(running[i].fd, branches.data(), size)) {
+          pending.push_back(std::move(branches));
+          continue;
+        }
+      }
+
+      // end-of-file: the job has finished
+      close(running[i].fd);
+      int status;
+      while (waitpid(running[i].pid, &status, 0) < 0 && errno == EINTR)
+        ;
+      if (!WIFEXITED(status) || WEXITSTATUS(status))
+        klee_warning("job with pid %d did not exit cleanly", running[i].pid);
+      running.erase(running.begin() + i);
+    }
+  }
+
+  if (!pending.empty())
+    klee_warning("%zu donated states were not explored", pending.size());
+
+  mergeJobStatistics(handler, numJobs, time::getWallTime() - startTime);
+
+  std::stringstream stats;
+  stats << '\n'
+        << "KLEE: done: distributed jobs = " << numJobs << '\n'
+        << "KLEE: done: generated tests = " << testCounter->load() << '\n';
+  llvm::errs() << stats.str();
+  handler.getInfoStream() << stats.str();
+
+  munmap(shared, sizeof(std::atomic<unsigned>));
+  return false;
+}
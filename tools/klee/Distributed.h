@@ -0,0 +1,50 @@
+//===-- Distributed.h -------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_DISTRIBUTED_H
+#define KLEE_DISTRIBUTED_H
+
+#include "klee/System/Time.h"
+
+#include <atomic>
+#include <functional>
+#include <vector>
+
+namespace klee {
+class InterpreterHandler;
+
+struct DistributedOptions {
+  /// Maximum number of concurrently running jobs
+  unsigned jobs;
+  /// Time after which all jobs are interrupted, or zero for no limit
+  time::Span maxTime;
+  /// Minimum time between two rounds of work requests to busy jobs
+  time::Span stealInterval;
+};
+
+/// Called in a new job process to turn it into job \p id, which donates
+/// states through \p donationFd and numbers its tests with
+/// \p sharedTestCounter.
+using StartJobFn = std::function<void(
+    unsigned id, int donationFd, std::atomic<unsigned> *sharedTestCounter)>;
+
+/// Coordinate a distributed exploration: fork up to \p opts.jobs processes,
+/// each replaying the branch trail of one subtree, and hand states donated
+/// by busy jobs to idle capacity. Jobs are asked for states with SIGUSR1,
+/// whose handler must be installed before calling this.
+///
+/// \return true in a job process (with \p jobBranches set), false in the
+/// coordinator after all jobs have finished and their statistics have been
+/// merged into the output directory of \p handler.
+bool runDistributed(InterpreterHandler &handler,
+                    const DistributedOptions &opts, const StartJobFn &startJob,
+                    std::vector<unsigned char> &jobBranches);
+} // namespace klee
+
+#endif /* KLEE_DISTRIBUTED_H */
@@ -9,6 +9,8 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "Distributed.h"
+
 #include "klee/ADT/KTest.h"
 #include "klee/ADT/TreeStream.h"
 #include "klee/Config/Version.h"
@@ -27,6 +29,7 @@
 #include "klee/Support/CompilerWarning.h"
 DISABLE_WARNING_PUSH
 DISABLE_WARNING_DEPRECATED_DECLARATIONS
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/Bitcode/BitcodeReader.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/IRBuilder.h"
@@ -34,6 +37,8 @@ DISABLE_WARNING_DEPRECATED_DECLARATIONS
 #include "llvm/IR/Instruction.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/Module.h"
 #include "llvm/IR/Type.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Errno.h"
@@ -54,7 +59,9 @@ DISABLE_WARNING_POP
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <atomic>
 #include <cerrno>
+#include <cstring>
 #include <ctime>
 #include <fstream>
 #include <iomanip>
@@ -153,6 +160,20 @@ namespace {
 		 cl::init(false),
                  cl::cat(StartCat));
 
+  cl::opt<bool>
+  PreparedModule("prepared-module",
+                 cl::desc("Execute a final.bc written by --output-module "
+                          "without linking and optimizing it again. Only "
+                          "these steps are skipped: the module is still "
+                          "loaded and its globals are initialized as usual. "
+                          "The linking options and --optimize are then "
+                          "ignored, and --libc and --posix-runtime are those "
+                          "the module was linked with. The module must have "
+                          "been written by the same build of KLEE with the "
+                          "same --runtime-build (default=false)."),
+                 cl::init(false),
+                 cl::cat(StartCat));
+
   cl::opt<bool>
   WarnAllExternals("warn-all-external-symbols",
                    cl::desc("Issue a warning on startup for all external symbols (default=false)."),
@@ -250,6 +271,28 @@ namespace {
                  cl::cat(ReplayCat));
 
 
+  /*** Distributed exploration options ***/
+
+  cl::OptionCategory DistributeCat("Distributed exploration options",
+                                   "These options split one exploration "
+                                   "across several processes.");
+
+  cl::opt<unsigned>
+  DistributeJobs("distribute-jobs",
+                 cl::desc("Split the exploration across up to this many "
+                          "concurrent processes that hand over states to each "
+                          "other as branch trails (default=0 (off))"),
+                 cl::init(0),
+                 cl::cat(DistributeCat));
+
+  cl::opt<std::string>
+  DistributeStealInterval("distribute-steal-interval",
+                          cl::desc("Minimum time between two rounds of work "
+                                   "requests to busy processes (default=1s)"),
+                          cl::init("1s"),
+                          cl::cat(DistributeCat));
+
+
 
   cl::list<std::string>
   SeedOutFile("seed-file",
@@ -298,11 +341,17 @@ class ExecutionState;
 class KleeHandler : public InterpreterHandler {
 private:
   Interpreter *m_interpreter;
-  TreeStreamWriter *m_pathWriter, *m_symPathWriter;
+  TreeStreamWriter *m_pathWriter, *m_symPathWriter, *m_branchWriter;
   std::unique_ptr<llvm::raw_ostream> m_infoFile;
 
   SmallString<128> m_outputDirectory;
 
+  // distributed exploration: per-job directory for everything but the
+  // test cases, pipe to the coordinator and test ids shared by all jobs
+  SmallString<128> m_jobDirectory;
+  int m_donationFd;
+  std::atomic<unsigned> *m_sharedTestCounter;
+
   unsigned m_numTotalTests;     // Number of tests received from the interpreter
   unsigned m_numGeneratedTests; // Number of tests successfully generated
   unsigned m_pathsCompleted; // number of completed paths
@@ -327,14 +376,23 @@ public:
 
   void setInterpreter(Interpreter *i);
 
+  /// Turn this handler into the handler of job \p id of a distributed
+  /// exploration. Must be called before setInterpreter().
+  void setJob(unsigned id, int donationFd,
+              std::atomic<unsigned> *sharedTestCounter);
+
   void processTestCase(const ExecutionState  &state,
                        const char *errorMessage,
                        const char *errorSuffix);
 
+  void processDonatedState(const std::vector<unsigned char> &branches);
+
   std::string getOutputFilename(const std::string &filename);
   std::unique_ptr<llvm::raw_fd_ostream> openOutputFile(const std::string &filename);
   std::string getTestFilename(const std::string &suffix, unsigned id);
+  std::string getTestOutputFilename(const std::string &suffix, unsigned id);
   std::unique_ptr<llvm::raw_fd_ostream> openTestFile(const std::string &suffix, unsigned id);
+  std::unique_ptr<llvm::raw_fd_ostream> openFile(const std::string &path);
 
   // load a .path file
   static void loadPathFile(std::string name,
@@ -348,7 +406,8 @@ public:
 
 KleeHandler::KleeHandler(int argc, char **argv)
     : m_interpreter(0), m_pathWriter(0), m_symPathWriter(0),
-      m_outputDirectory(), m_numTotalTests(0), m_numGeneratedTests(0),
+      m_branchWriter(0), m_outputDirectory(), m_donationFd(-1),
+      m_sharedTestCounter(0), m_numTotalTests(0), m_numGeneratedTests(0),
       m_pathsCompleted(0), m_pathsExplored(0), m_argc(argc), m_argv(argv) {
 
   // create output directory (OutputDir or "klee-out-<i>")
@@ -425,6 +484,7 @@ KleeHandler::KleeHandler(int argc, char **argv)
 KleeHandler::~KleeHandler() {
   delete m_pathWriter;
   delete m_symPathWriter;
+  delete m_branchWriter;
   fclose(klee_warning_file);
   fclose(klee_message_file);
 }
@@ -443,18 +503,44 @@ void KleeHandler::setInterpreter(Interpreter *i) {
     assert(m_symPathWriter->good());
     m_interpreter->setSymbolicPathWriter(m_symPathWriter);
   }
+
+  if (!m_jobDirectory.empty()) {
+    m_branchWriter = new TreeStreamWriter(getOutputFilename("branches.ts"));
+    assert(m_branchWriter->good());
+    m_interpreter->setBranchWriter(m_branchWriter);
+  }
+}
+
+void KleeHandler::setJob(unsigned id, int donationFd,
+                         std::atomic<unsigned> *sharedTestCounter) {
+  assert(!m_interpreter && "job set after interpreter");
+
+  SmallString<128> directory = m_outputDirectory;
+  sys::path::append(directory, "job-" + llvm::utostr(id));
+  if (mkdir(directory.c_str(), 0775) < 0)
+    klee_error("cannot create \"%s\": %s", directory.c_str(), strerror(errno));
+
+  m_jobDirectory = directory;
+  m_donationFd = donationFd;
+  m_sharedTestCounter = sharedTestCounter;
+  m_infoFile = openOutputFile("info");
 }
 
 std::string KleeHandler::getOutputFilename(const std::string &filename) {
-  SmallString<128> path = m_outputDirectory;
+  SmallString<128> path =
+      m_jobDirectory.empty() ? m_outputDirectory : m_jobDirectory;
   sys::path::append(path,filename);
   return path.c_str();
 }
 
 std::unique_ptr<llvm::raw_fd_ostream>
 KleeHandler::openOutputFile(const std::string &filename) {
+  return openFile(getOutputFilename(filename));
+}
+
+std::unique_ptr<llvm::raw_fd_ostream>
+KleeHandler::openFile(const std::string &path) {
   std::string Error;
-  std::string path = getOutputFilename(filename);
   auto f = klee_open_output_file(path, Error);
   if (!f) {
     klee_warning("error opening file \"%s\".  KLEE may have run out of file "
@@ -472,9 +558,17 @@ std::string KleeHandler::getTestFilename(const std::string &suffix, unsigned id)
   return filename.str();
 }
 
+std::string KleeHandler::getTestOutputFilename(const std::string &suffix,
+                                               unsigned id) {
+  // test cases of all jobs go into the common output directory
+  SmallString<128> path = m_outputDirectory;
+  sys::path::append(path, getTestFilename(suffix, id));
+  return path.c_str();
+}
+
 std::unique_ptr<llvm::raw_fd_ostream>
 KleeHandler::openTestFile(const std::string &suffix, unsigned id) {
-  return openOutputFile(getTestFilename(suffix, id));
+  return openFile(getTestOutputFilename(suffix, id));
 }
 
 
@@ -492,6 +586,8 @@ void KleeHandler::processTestCase(const ExecutionState &state,
     const auto start_time = time::getWallTime();
 
     unsigned id = ++m_numTotalTests;
+    if (m_sharedTestCounter)
+      id = ++*m_sharedTestCounter;
 
     if (success) {
       KTest b;
@@ -511,7 +607,7 @@ void KleeHandler::processTestCase(const ExecutionState &state,
         std::copy(out[i].second.begin(), out[i].second.end(), o->bytes);
       }
 
-      if (!kTest_toFile(&b, getOutputFilename(getTestFilename("ktest", id)).c_str())) {
+      if (!kTest_toFile(&b, getTestOutputFilename("ktest", id).c_str())) {
         klee_warning("unable to write output test case, losing it");
       } else {
         ++m_numGeneratedTests;
@@ -608,6 +704,29 @@ void KleeHandler::processTestCase(const ExecutionState &state,
   }
 }
 
+void KleeHandler::processDonatedState(
+    const std::vector<unsigned char> &branches) {
+  assert(m_donationFd != -1 && "state donated outside of a job");
+
+  // message: trail length (4 bytes), then the trail
+  std::uint32_t size = branches.size();
+  std::vector<unsigned char> message(sizeof(size) + branches.size());
+  std::memcpy(message.data(), &size, sizeof(size));
+  std::copy(branches.begin(), branches.end(), message.begin() + sizeof(size));
+
+  std::size_t written = 0;
+  while (written < message.size()) {
+    ssize_t res = write(m_donationFd, message.data() + written,
+                        message.size() - written);
+    if (res < 0) {
+      if (errno == EINTR)
+        continue;
+      klee_error("unable to donate state: %s", strerror(errno));
+    }
+    written += res;
+  }
+}
+
   // load a .path file
 void KleeHandler::loadPathFile(std::string name,
                                      std::vector<bool> &buffer) {
@@ -1005,6 +1124,11 @@ static void halt_via_gdb(int pid) {
     perror("system");
 }
 
+static void donation_handle(int) {
+  if (theInterpreter)
+    theInterpreter->requestStateDonation();
+}
+
 static void replaceOrRenameFunction(llvm::Module *module,
 		const char *old_name, const char *new_name)
 {
@@ -1116,6 +1240,156 @@ linkWithUclibc(StringRef libDir, std::string opt_suffix,
                FortifyPath.c_str(), errorMsg.c_str());
 }
 
+/// Load the runtime and the libraries selected on the command line into
+/// \p loadedModules, which starts with the program under test.
+static void
+linkLibraries(const Interpreter::ModuleOptions &Opts,
+              const std::string &opt_suffix, llvm::Module *mainModule,
+              std::vector<std::unique_ptr<llvm::Module>> &loadedModules) {
+  std::string errorMsg;
+
+  if (WithPOSIXRuntime) {
+    SmallString<128> Path(Opts.LibraryDir);
+    llvm::sys::path::append(Path, "libkleeRuntimePOSIX" + opt_suffix + ".bca");
+    klee_message("NOTE: Using POSIX model: %s", Path.c_str());
+    if (!klee::loadFile(Path.c_str(), mainModule->getContext(), loadedModules,
+                        errorMsg))
+      klee_error("error loading POSIX support '%s': %s", Path.c_str(),
+                 errorMsg.c_str());
+
+    std::string libcPrefix = (Libc == LibcType::UcLibc ? "__user_" : "");
+    if (mainFn)
+      preparePOSIX(loadedModules, libcPrefix);
+  }
+
+  if (WithUBSanRuntime) {
+    SmallString<128> Path(Opts.LibraryDir);
+    llvm::sys::path::append(Path, "libkleeUBSan" + opt_suffix + ".bca");
+    if (!klee::loadFile(Path.c_str(), mainModule->getContext(), loadedModules,
+                        errorMsg))
+      klee_error("error loading UBSan support '%s': %s", Path.c_str(),
+                 errorMsg.c_str());
+  }
+
+  if (Libcxx) {
+#ifndef SUPPORT_KLEE_LIBCXX
+    klee_error("KLEE was not compiled with libc++ support");
+#else
+    SmallString<128> LibcxxBC(Opts.LibraryDir);
+    llvm::sys::path::append(LibcxxBC, KLEE_LIBCXX_BC_NAME);
+    if (!klee::loadFile(LibcxxBC.c_str(), mainModule->getContext(), loadedModules,
+                        errorMsg))
+      klee_error("error loading libc++ '%s': %s", LibcxxBC.c_str(),
+                 errorMsg.c_str());
+    klee_message("NOTE: Using libc++ : %s", LibcxxBC.c_str());
+#ifdef SUPPORT_KLEE_EH_CXX
+    SmallString<128> EhCxxPath(Opts.LibraryDir);
+    llvm::sys::path::append(EhCxxPath, "libkleeeh-cxx" + opt_suffix + ".bca");
+    if (!klee::loadFile(EhCxxPath.c_str(), mainModule->getContext(),
+                        loadedModules, errorMsg))
+      klee_error("error loading libklee-eh-cxx '%s': %s", EhCxxPath.c_str(),
+                 errorMsg.c_str());
+    klee_message("NOTE: Enabled runtime support for C++ exceptions");
+#else
+    klee_message("NOTE: KLEE was not compiled with support for C++ exceptions");
+#endif
+#endif
+  }
+
+  switch (Libc) {
+  case LibcType::KleeLibc: {
+    // FIXME: Find a reasonable solution for this.
+    SmallString<128> Path(Opts.LibraryDir);
+    llvm::sys::path::append(Path,
+                            "libkleeRuntimeKLEELibc" + opt_suffix + ".bca");
+    if (!klee::loadFile(Path.c_str(), mainModule->getContext(), loadedModules,
+                        errorMsg))
+      klee_error("error loading klee libc '%s': %s", Path.c_str(),
+                 errorMsg.c_str());
+  }
+  /* Falls through. */
+  case LibcType::FreestandingLibc: {
+    SmallString<128> Path(Opts.LibraryDir);
+    llvm::sys::path::append(Path,
+                            "libkleeRuntimeFreestanding" + opt_suffix + ".bca");
+    if (!klee::loadFile(Path.c_str(), mainModule->getContext(), loadedModules,
+                        errorMsg))
+      klee_error("error loading freestanding support '%s': %s", Path.c_str(),
+                 errorMsg.c_str());
+    break;
+  }
+  case LibcType::UcLibc:
+    linkWithUclibc(Opts.LibraryDir, opt_suffix, loadedModules);
+    break;
+  }
+
+  for (const auto &library : LinkLibraries) {
+    if (!klee::loadFile(library, mainModule->getContext(), loadedModules,
+                        errorMsg))
+      klee_error("error loading bitcode library '%s': %s", library.c_str(),
+                 errorMsg.c_str());
+  }
+}
+
+/// Named metadata recording the --libc and --posix-runtime a module was
+/// linked with, which also hold for it when it is run with --prepared-module
+static const char *const LinkSettingsMetadata = "klee.link-settings";
+
+/// The --libc value that selects \p libc
+static const char *getLibcName(LibcType libc) {
+  switch (libc) {
+  case LibcType::FreestandingLibc:
+    return "none";
+  case LibcType::KleeLibc:
+    return "klee";
+  case LibcType::UcLibc:
+    return "uclibc";
+  }
+  llvm_unreachable("invalid libc");
+}
+
+static void recordLinkSettings(llvm::Module *module) {
+  LLVMContext &ctx = module->getContext();
+  auto setting = [&ctx](StringRef name, StringRef value) {
+    return MDNode::get(ctx, {MDString::get(ctx, name),
+                             MDString::get(ctx, value)});
+  };
+  NamedMDNode *md = module->getOrInsertNamedMetadata(LinkSettingsMetadata);
+  md->addOperand(setting("libc", getLibcName(Libc)));
+  md->addOperand(setting("posix-runtime", WithPOSIXRuntime ? "true" : "false"));
+}
+
+/// Take --libc and --posix-runtime from a prepared module, unless they are
+/// given and differ from those it was linked with.
+static void useLinkSettings(const llvm::Module *module) {
+  const NamedMDNode *md = module->getNamedMetadata(LinkSettingsMetadata);
+  if (!md)
+    klee_error("The module does not record the libraries it was linked with");
+
+  for (const MDNode *setting : md->operands()) {
+    auto *name = dyn_cast<MDString>(setting->getOperand(0));
+    auto *value = dyn_cast<MDString>(setting->getOperand(1));
+    if (!name || !value)
+      klee_error("Invalid link settings in the module");
+
+    if (name->getString() == "libc") {
+      LibcType libc;
+      if (Libc.getParser().parse(Libc, "libc", value->getString(), libc))
+        klee_error("Invalid libc in the module");
+      if (Libc.getNumOccurrences() && Libc != libc)
+        klee_error("The module was linked with --libc=%s",
+                   value->getString().str().c_str());
+      Libc = libc;
+    } else if (name->getString() == "posix-runtime") {
+      bool posix = value->getString() == "true";
+      if (WithPOSIXRuntime.getNumOccurrences() && WithPOSIXRuntime != posix)
+        klee_error("The module was linked with --posix-runtime=%s",
+                   value->getString().str().c_str());
+      WithPOSIXRuntime = posix;
+    }
+  }
+}
+
 int main(int argc, char **argv, char **envp) {
   atexit(llvm_shutdown); // Call llvm_shutdown() on exit
 
@@ -1123,7 +1397,8 @@ int main(int argc, char **argv, char **envp) {
      {&ChecksCat,      &DebugCat,    &ExtCallsCat, &ExprCat,     &LinkCat,
       &MemoryCat,      &MergeCat,    &MiscCat,     &ModuleCat,   &ReplayCat,
       &SearchCat,      &SeedingCat,  &SolvingCat,  &StartCat,    &StatsCat,
-      &TerminationCat, &TestCaseCat, &TestGenCat,  &ExecTreeCat, &ExecTreeCat});
+      &TerminationCat, &TestCaseCat, &TestGenCat,  &ExecTreeCat, &ExecTreeCat,
+      &DistributeCat});
   llvm::InitializeNativeTarget();
 
   parseArguments(argc, argv);
@@ -1244,7 +1519,8 @@ int main(int argc, char **argv, char **envp) {
   Interpreter::ModuleOptions Opts(LibraryDir.c_str(), EntryPoint, opt_suffix,
                                   /*Optimize=*/OptimizeModule,
                                   /*CheckDivZero=*/CheckDivZero,
-                                  /*CheckOvershift=*/CheckOvershift);
+                                  /*CheckOvershift=*/CheckOvershift,
+                                  /*Prepared=*/PreparedModule);
 
   // Get the main function
   for (auto &module : loadedModules) {
@@ -1267,86 +1543,12 @@ int main(int argc, char **argv, char **envp) {
     klee_error("Entry function '%s' not found in module.", EntryPoint.c_str());
 
 
-  if (WithPOSIXRuntime) {
-    SmallString<128> Path(Opts.LibraryDir);
-    llvm::sys::path::append(Path, "libkleeRuntimePOSIX" + opt_suffix + ".bca");
-    klee_message("NOTE: Using POSIX model: %s", Path.c_str());
-    if (!klee::loadFile(Path.c_str(), mainModule->getContext(), loadedModules,
-                        errorMsg))
-      klee_error("error loading POSIX support '%s': %s", Path.c_str(),
-                 errorMsg.c_str());
-
-    std::string libcPrefix = (Libc == LibcType::UcLibc ? "__user_" : "");
-    if (mainFn)
-      preparePOSIX(loadedModules, libcPrefix);
-  }
-
-  if (WithUBSanRuntime) {
-    SmallString<128> Path(Opts.LibraryDir);
-    llvm::sys::path::append(Path, "libkleeUBSan" + opt_suffix + ".bca");
-    if (!klee::loadFile(Path.c_str(), mainModule->getContext(), loadedModules,
-                        errorMsg))
-      klee_error("error loading UBSan support '%s': %s", Path.c_str(),
-                 errorMsg.c_str());
-  }
-
-  if (Libcxx) {
-#ifndef SUPPORT_KLEE_LIBCXX
-    klee_error("KLEE was not compiled with libc++ support");
-#else
-    SmallString<128> LibcxxBC(Opts.LibraryDir);
-    llvm::sys::path::append(LibcxxBC, KLEE_LIBCXX_BC_NAME);
-    if (!klee::loadFile(LibcxxBC.c_str(), mainModule->getContext(), loadedModules,
-                        errorMsg))
-      klee_error("error loading libc++ '%s': %s", LibcxxBC.c_str(),
-                 errorMsg.c_str());
-    klee_message("NOTE: Using libc++ : %s", LibcxxBC.c_str());
-#ifdef SUPPORT_KLEE_EH_CXX
-    SmallString<128> EhCxxPath(Opts.LibraryDir);
-    llvm::sys::path::append(EhCxxPath, "libkleeeh-cxx" + opt_suffix + ".bca");
-    if (!klee::loadFile(EhCxxPath.c_str(), mainModule->getContext(),
-                        loadedModules, errorMsg))
-      klee_error("error loading libklee-eh-cxx '%s': %s", EhCxxPath.c_str(),
-                 errorMsg.c_str());
-    klee_message("NOTE: Enabled runtime support for C++ exceptions");
-#else
-    klee_message("NOTE: KLEE was not compiled with support for C++ exceptions");
-#endif
-#endif
-  }
-
-  switch (Libc) {
-  case LibcType::KleeLibc: {
-    // FIXME: Find a reasonable solution for this.
-    SmallString<128> Path(Opts.LibraryDir);
-    llvm::sys::path::append(Path,
-                            "libkleeRuntimeKLEELibc" + opt_suffix + ".bca");
-    if (!klee::loadFile(Path.c_str(), mainModule->getContext(), loadedModules,
-                        errorMsg))
-      klee_error("error loading klee libc '%s': %s", Path.c_str(),
-                 errorMsg.c_str());
-  }
-  /* Falls through. */
-  case LibcType::FreestandingLibc: {
-    SmallString<128> Path(Opts.LibraryDir);
-    llvm::sys::path::append(Path,
-                            "libkleeRuntimeFreestanding" + opt_suffix + ".bca");
-    if (!klee::loadFile(Path.c_str(), mainModule->getContext(), loadedModules,
-                        errorMsg))
-      klee_error("error loading freestanding support '%s': %s", Path.c_str(),
-                 errorMsg.c_str());
-    break;
-  }
-  case LibcType::UcLibc:
-    linkWithUclibc(LibraryDir, opt_suffix, loadedModules);
-    break;
-  }
-
-  for (const auto &library : LinkLibraries) {
-    if (!klee::loadFile(library, mainModule->getContext(), loadedModules,
-                        errorMsg))
-      klee_error("error loading bitcode library '%s': %s", library.c_str(),
-                 errorMsg.c_str());
+  // A prepared module already contains the runtime and libraries.
+  if (PreparedModule) {
+    useLinkSettings(mainModule);
+  } else {
+    recordLinkSettings(mainModule);
+    linkLibraries(Opts, opt_suffix, mainModule, loadedModules);
   }
 
   // FIXME: Change me to std types.
@@ -1391,13 +1593,44 @@ int main(int argc, char **argv, char **envp) {
   Interpreter::InterpreterOptions IOpts;
   IOpts.MakeConcreteSymbolic = MakeConcreteSymbolic;
   KleeHandler *handler = new KleeHandler(pArgc, pArgv);
+
+  for (int i = 0; i < argc; i++)
+    handler->getInfoStream() << argv[i] << (i + 1 < argc ? " " : "\n");
+
+  std::vector<unsigned char> jobBranches;
+  bool isJob = false;
+  if (DistributeJobs) {
+    if (!ReplayKTestDir.empty() || !ReplayKTestFile.empty() ||
+        !ReplayPathFile.empty() || !SeedOutFile.empty() || !SeedOutDir.empty())
+      klee_error("--distribute-jobs cannot be combined with replaying or "
+                 "seeding");
+
+    // installed before the first fork so a job can never miss a request
+    signal(SIGUSR1, donation_handle);
+    DistributedOptions distributedOpts{DistributeJobs, time::Span(MaxTime),
+                                       time::Span(DistributeStealInterval)};
+    isJob = runDistributed(
+        *handler, distributedOpts,
+        [handler](unsigned id, int donationFd,
+                  std::atomic<unsigned> *sharedTestCounter) {
+          sys::SetInterruptFunction(interrupt_handle);
+          handler->setJob(id, donationFd, sharedTestCounter);
+        },
+        jobBranches);
+  }
+  if (DistributeJobs && !isJob) {
+    for (unsigned i=0; i<InputArgv.size()+1; i++)
+      delete[] pArgv[i];
+    delete[] pArgv;
+    delete handler;
+    return 0;
+  }
+
   Interpreter *interpreter =
     theInterpreter = Interpreter::create(ctx, IOpts, handler);
   assert(interpreter);
   handler->setInterpreter(interpreter);
 
-  for (int i = 0; i < argc; i++)
-    handler->getInfoStream() << argv[i] << (i + 1 < argc ? " " : "\n");
   handler->getInfoStream() << "PID: " << getpid() << "\n";
 
   // Get the desired main function.  klee_main initializes uClibc
@@ -1415,6 +1648,8 @@ int main(int argc, char **argv, char **envp) {
     KleeHandler::loadPathFile(ReplayPathFile, replayPath);
     interpreter->setReplayPath(&replayPath);
   }
+  if (DistributeJobs)
+    interpreter->setReplayBranches(&jobBranches);
 
   auto startTime = std::time(nullptr);
   { // output clock info and start time
@@ -0,0 +1,133 @@
+//===-- AsyncSolverTest.cpp -----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Core/AsyncSolver.h"
+
+#include "klee/Expr/ArrayCache.h"
+#include "klee/Expr/Constraints.h"
+#include "klee/Expr/Expr.h"
+#include "klee/Solver/Solver.h"
+#include "klee/Solver/SolverCmdLine.h"
+
+#include "gtest/gtest.h"
+
+#include <map>
+
+using namespace klee;
+
+namespace {
+
+#ifdef KLEE_ATOMIC_REFCOUNT
+
+class AsyncSolverTest : public ::testing::Test {
+protected:
+  ArrayCache ac;
+  ref<Expr> x;
+  std::unique_ptr<AsyncSolver> asyncSolver;
+
+  void SetUp() override {
+    const Array *array = ac.CreateArray("x", 1);
+    x = ReadExpr::create(UpdateList(array, 0),
+                         ConstantExpr::alloc(0, Expr::Int32));
+    std::vector<std::unique_ptr<Solver>> solvers;
+    for (unsigned i = 0; i < 2; ++i)
+      solvers.push_back(createCoreSolver(CoreSolverToUse));
+    asyncSolver = std::make_unique<AsyncSolver>(std::move(solvers));
+  }
+
+  ref<Expr> lessThan(unsigned value) {
+    return UltExpr::create(x, ConstantExpr::alloc(value, Expr::Int8));
+  }
+
+  std::map<AsyncSolver::Ticket, Solver::Validity> collectAll(unsigned n) {
+    std::map<AsyncSolver::Ticket, Solver::Validity> answers;
+    while (answers.size() < n) {
+      std::vector<AsyncSolver::Result> results;
+      asyncSolver->collect(results, true);
+      EXPECT_FALSE(results.empty());
+      if (results.empty())
+        break;
+      for (const auto &result : results) {
+        EXPECT_TRUE(result.success);
+        answers[result.ticket] = result.validity;
+      }
+    }
+    return answers;
+  }
+};
+
+TEST_F(AsyncSolverTest, Validity) {
+  ConstraintSet constraints;
+  ConstraintManager(constraints).addConstraint(lessThan(10));
+
+  AsyncSolver::Ticket valid = asyncSolver->submit(constraints, lessThan(20));
+  AsyncSolver::Ticket invalid = asyncSolver->submit(
+      constraints, Expr::createIsZero(lessThan(20)));
+  AsyncSolver::Ticket unknown = asyncSolver->submit(constraints, lessThan(5));
+
+  auto answers = collectAll(3);
+  EXPECT_EQ(Solver::True, answers[valid]);
+  EXPECT_EQ(Solver::False, answers[invalid]);
+  EXPECT_EQ(Solver::Unknown, answers[unknown]);
+}
+
+TEST_F(AsyncSolverTest, IdenticalQueriesShareAnAnswer) {
+  ConstraintSet constraints;
+  std::vector<AsyncSolver::Ticket> tickets;
+  for (unsigned i = 0; i < 8; ++i)
+    tickets.push_back(asyncSolver->submit(constraints, lessThan(100)));
+
+  auto answers = collectAll(tickets.size());
+  for (AsyncSolver::Ticket ticket : tickets)
+    EXPECT_EQ(Solver::Unknown, answers[ticket]);
+}
+
+TEST_F(AsyncSolverTest, BatchesQueriesOverDifferentConstraints) {
+  // more queries than the workers take at once, over two constraint sets
+  ConstraintSet below10, below50;
+  ConstraintManager(below10).addConstraint(lessThan(10));
+  ConstraintManager(below50).addConstraint(lessThan(50));
+  std::map<AsyncSolver::Ticket, Solver::Validity> expected;
+  for (unsigned bound = 1; bound <= 40; ++bound) {
+    const ConstraintSet &constraints = bound % 2 ? below10 : below50;
+    unsigned limit = bound % 2 ? 10 : 50;
+    expected[asyncSolver->submit(constraints, lessThan(bound))] =
+        bound >= limit ? Solver::True : Solver::Unknown;
+  }
+
+  EXPECT_EQ(expected, collectAll(expected.size()));
+}
+
+TEST_F(AsyncSolverTest, CancelWaitsForRunningQueries) {
+  ConstraintSet constraints;
+  for (unsigned bound = 1; bound <= 40; ++bound)
+    asyncSolver->submit(constraints, lessThan(bound));
+  asyncSolver->cancel();
+
+  // nothing submitted before is answered afterwards
+  std::vector<AsyncSolver::Result> results;
+  asyncSolver->collect(results, true);
+  EXPECT_TRUE(results.empty());
+}
+
+TEST_F(AsyncSolverTest, CollectWithoutQueries) {
+  std::vector<AsyncSolver::Result> results;
+  asyncSolver->collect(results, true);
+  EXPECT_TRUE(results.empty());
+}
+
+#else
+
+TEST(AsyncSolverTest, RequiresAtomicRefCounts) {
+  GTEST_SKIP() << "AsyncSolver needs -DENABLE_ATOMIC_REFCOUNT=ON";
+}
+
+#endif
+
+} // namespace
@@ -0,0 +1,157 @@
+//===-- ExecutionTreeBenchmark.cpp ------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+/* Compares the pooled execution tree with individually allocated nodes
+   linked by tagged pointers, as the tree was laid out before, in memory per
+   node and in the speed of random path selection. Built with
+   ENABLE_UNIT_BENCHMARKS; not part of the unit tests. */
+
+#define KLEE_UNITTEST
+
+#include "Core/ExecutionState.h"
+#include "Core/ExecutionTree.h"
+#include "Core/Searcher.h"
+#include "klee/ADT/RNG.h"
+
+#include "llvm/ADT/PointerIntPair.h"
+
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+struct PointerNode;
+using PointerNodePtr = llvm::PointerIntPair<PointerNode *, 3, std::uint8_t>;
+
+struct PointerNode {
+  PointerNode *parent{nullptr};
+  PointerNodePtr left;
+  PointerNodePtr right;
+  ExecutionState *state{nullptr};
+
+  virtual ~PointerNode() = default;
+};
+
+const unsigned numStates = 1u << 16;
+const unsigned selections = 1000000;
+
+/// Copy the shape of `tree` into individually allocated nodes, allocated
+/// in between other objects as happens during execution.
+PointerNode *copyTree(const InMemoryExecutionTree &tree,
+                      std::vector<std::unique_ptr<PointerNode>> &nodes,
+                      std::vector<std::unique_ptr<char[]>> &noise) {
+  std::vector<std::pair<ExecutionTreeNodeIndex, PointerNode *>> stack;
+  nodes.emplace_back(new PointerNode());
+  PointerNode *root = nodes.back().get();
+  stack.emplace_back(tree.root.getIndex(), root);
+  while (!stack.empty()) {
+    auto item = stack.back();
+    stack.pop_back();
+    const ExecutionTreeNode &node = tree.getNode(item.first);
+    PointerNode *copy = item.second;
+    copy->state = node.state;
+    for (auto child : {&node.left, &node.right}) {
+      if (!*child)
+        continue;
+      noise.emplace_back(new char[256]);
+      nodes.emplace_back(new PointerNode());
+      PointerNode *childCopy = nodes.back().get();
+      childCopy->parent = copy;
+      PointerNodePtr ptr(childCopy, 1);
+      if (child == &node.left)
+        copy->left = ptr;
+      else
+        copy->right = ptr;
+      stack.emplace_back(child->getIndex(), childCopy);
+    }
+  }
+  return root;
+}
+
+/// The random path walk as RandomPathSearcher did it on pointers.
+ExecutionState &selectState(PointerNode *n, RNG &rng) {
+  unsigned flips = 0, bits = 0;
+  while (!n->state) {
+    if (!n->left.getPointer()) {
+      n = n->right.getPointer();
+    } else if (!n->right.getPointer()) {
+      n = n->left.getPointer();
+    } else {
+      if (bits == 0) {
+        flips = rng.getInt32();
+        bits = 32;
+      }
+      --bits;
+      n = ((flips & (1U << bits)) ? n->left : n->right).getPointer();
+    }
+  }
+  return *n->state;
+}
+
+TEST(ExecutionTreeBenchmark, RandomPath) {
+  std::vector<std::unique_ptr<ExecutionState>> states;
+  states.push_back(std::make_unique<ExecutionState>());
+  InMemoryExecutionTree tree(*states.front());
+
+  // Fork random states, so that the tree is unbalanced like real ones.
+  RNG shapeRNG;
+  for (unsigned i = 1; i < numStates; ++i) {
+    states.push_back(std::make_unique<ExecutionState>());
+    ExecutionState &current = *states[shapeRNG.getInt32() % i];
+    tree.attach(current.executionTreeNode, states.back().get(), &current,
+                BranchType::NONE);
+  }
+
+  RNG rng;
+  RandomPathSearcher searcher(&tree, rng);
+  std::vector<ExecutionState *> added;
+  for (auto &state : states)
+    added.push_back(state.get());
+  searcher.update(nullptr, added, {});
+
+  std::vector<std::unique_ptr<PointerNode>> pointerNodes;
+  std::vector<std::unique_ptr<char[]>> noise;
+  PointerNode *pointerRoot = copyTree(tree, pointerNodes, noise);
+  ASSERT_EQ(tree.getNodePool().size(), pointerNodes.size());
+
+  auto start = std::chrono::steady_clock::now();
+  std::size_t checksum = 0;
+  for (unsigned i = 0; i < selections; ++i)
+    checksum += searcher.selectState().steppedInstructions + 1;
+  auto pooled = std::chrono::steady_clock::now() - start;
+  EXPECT_EQ(selections, checksum);
+
+  RNG pointerRNG;
+  start = std::chrono::steady_clock::now();
+  checksum = 0;
+  for (unsigned i = 0; i < selections; ++i)
+    checksum += selectState(pointerRoot, pointerRNG).steppedInstructions + 1;
+  auto pointers = std::chrono::steady_clock::now() - start;
+  EXPECT_EQ(selections, checksum);
+
+  const ExecutionTreeNodePool &pool = tree.getNodePool();
+  double poolBytes = double(pool.capacityInBytes()) / pool.size();
+  std::cout << "execution tree with " << pool.size() << " nodes: pooled "
+            << poolBytes << " B/node, "
+            << std::chrono::duration<double, std::nano>(pooled).count() /
+                   selections
+            << " ns/selection; pointers " << sizeof(PointerNode)
+            << " B/node plus allocator overhead, "
+            << std::chrono::duration<double, std::nano>(pointers).count() /
+                   selections
+            << " ns/selection\n";
+}
+
+} // namespace
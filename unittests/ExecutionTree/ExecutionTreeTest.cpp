@@ -0,0 +1,98 @@
+//===-- ExecutionTreeTest.cpp ---------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+#define KLEE_UNITTEST
+
+#include "gtest/gtest.h"
+
+#include "Core/ExecutionState.h"
+#include "Core/ExecutionTree.h"
+
+using namespace klee;
+
+namespace {
+
+TEST(ExecutionTreeTest, NodePtrTags) {
+  ExecutionTreeNodePtr null;
+  EXPECT_FALSE(null);
+
+  ExecutionTreeNodePtr ptr(ExecutionTreeNodePtr::MaxIndex, 0b101);
+  EXPECT_TRUE(ptr);
+  EXPECT_EQ(ExecutionTreeNodePtr::MaxIndex, ptr.getIndex());
+  EXPECT_EQ(0b101, ptr.getInt());
+
+  ptr.setInt(0b010);
+  EXPECT_EQ(ExecutionTreeNodePtr::MaxIndex, ptr.getIndex());
+  EXPECT_EQ(0b010, ptr.getInt());
+}
+
+TEST(ExecutionTreeTest, NodeSize) {
+  // A state and three indices, smaller than the vtable and four pointers of
+  // individually allocated nodes.
+  EXPECT_LE(sizeof(ExecutionTreeNode),
+            sizeof(ExecutionState *) + 4 * sizeof(ExecutionTreeNodeIndex));
+}
+
+TEST(ExecutionTreeTest, AttachAndRemove) {
+  ExecutionState root, left, right;
+  InMemoryExecutionTree tree(root);
+  const ExecutionTreeNodePool &pool = tree.getNodePool();
+  ExecutionTreeNodeIndex rootNode = root.executionTreeNode;
+  EXPECT_EQ(rootNode, tree.root.getIndex());
+  EXPECT_EQ(1u, pool.size());
+
+  tree.attach(root.executionTreeNode, &left, &root, BranchType::NONE);
+  EXPECT_EQ(3u, pool.size());
+  EXPECT_EQ(nullptr, tree.getNode(rootNode).state);
+  EXPECT_EQ(left.executionTreeNode, tree.getNode(rootNode).left.getIndex());
+  EXPECT_EQ(root.executionTreeNode, tree.getNode(rootNode).right.getIndex());
+  EXPECT_EQ(rootNode, tree.getNode(left.executionTreeNode).parent);
+  EXPECT_EQ(&left, tree.getNode(left.executionTreeNode).state);
+
+  tree.attach(left.executionTreeNode, &right, &left, BranchType::NONE);
+  EXPECT_EQ(5u, pool.size());
+  ExecutionTreeNodeIndex removed = right.executionTreeNode;
+  ExecutionTreeNodeIndex removedParent = tree.getNode(removed).parent;
+
+  // Removing the last child of a node removes the node as well, and the
+  // freed nodes are reused.
+  tree.remove(right.executionTreeNode);
+  EXPECT_EQ(4u, pool.size());
+  tree.remove(left.executionTreeNode);
+  EXPECT_EQ(2u, pool.size());
+  EXPECT_FALSE(tree.getNode(rootNode).left);
+
+  ExecutionState other;
+  tree.attach(root.executionTreeNode, &other, &root, BranchType::NONE);
+  EXPECT_EQ(4u, pool.size());
+  EXPECT_TRUE(other.executionTreeNode == removed ||
+              other.executionTreeNode == removedParent);
+}
+
+TEST(ExecutionTreeTest, ManyNodes) {
+  // Span several pool chunks.
+  const unsigned numStates = 10000;
+  std::vector<std::unique_ptr<ExecutionState>> states;
+  states.push_back(std::make_unique<ExecutionState>());
+  InMemoryExecutionTree tree(*states.front());
+  for (unsigned i = 1; i < numStates; ++i) {
+    states.push_back(std::make_unique<ExecutionState>());
+    ExecutionState &current = *states[i / 2];
+    tree.attach(current.executionTreeNode, states.back().get(), &current,
+                BranchType::NONE);
+  }
+  EXPECT_EQ(2 * numStates - 1, tree.getNodePool().size());
+  for (auto &state : states)
+    EXPECT_EQ(state.get(), tree.getNode(state->executionTreeNode).state);
+
+  for (unsigned i = 0; i < numStates; ++i)
+    tree.remove(states[i]->executionTreeNode);
+  EXPECT_EQ(0u, tree.getNodePool().size());
+}
+
+} // namespace
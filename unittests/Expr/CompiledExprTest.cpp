@@ -0,0 +1,290 @@
+//===-- CompiledExprTest.cpp ----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/Expr/ArrayCache.h"
+#include "klee/Expr/Assignment.h"
+#include "klee/Expr/CompiledExpr.h"
+#include "klee/Expr/Expr.h"
+
+#include <memory>
+#include <random>
+
+using namespace klee;
+
+namespace {
+
+const unsigned arraySize = 8;
+
+class RandomExprs {
+  std::mt19937 &rng;
+  std::vector<const Array *> arrays;
+
+  unsigned pick(unsigned n) { return rng() % n; }
+
+  Expr::Width randomWidth() {
+    static const Expr::Width widths[] = {1, 3, 8, 16, 32, 33, 64};
+    return widths[pick(sizeof(widths) / sizeof(widths[0]))];
+  }
+
+  ref<Expr> constant(Expr::Width w) {
+    std::uint64_t value = (std::uint64_t(rng()) << 32) | rng();
+    // Favour the values at the edges of the signed and unsigned ranges.
+    switch (pick(4)) {
+    case 0:
+      value = pick(3);
+      break;
+    case 1:
+      value = ~std::uint64_t(0);
+      break;
+    case 2:
+      value = std::uint64_t(1) << (w - 1);
+      break;
+    }
+    if (w < 64)
+      value &= (std::uint64_t(1) << w) - 1;
+    return ConstantExpr::create(value, w);
+  }
+
+  ref<Expr> index(unsigned depth) {
+    if (depth == 0 || pick(2))
+      return ConstantExpr::create(pick(arraySize + 2), Expr::Int32);
+    return ZExtExpr::create(ExtractExpr::create(generate(8, depth), 0, 3),
+                            Expr::Int32);
+  }
+
+  ref<Expr> read(unsigned depth) {
+    UpdateList updates(arrays[pick(arrays.size())], nullptr);
+    for (unsigned i = 0, n = depth ? pick(3) : 0; i < n; ++i)
+      updates.extend(index(depth), generate(8, depth));
+    return ReadExpr::create(updates, index(depth));
+  }
+
+public:
+  RandomExprs(std::mt19937 &rng, const std::vector<const Array *> &arrays)
+      : rng(rng), arrays(arrays) {}
+
+  ref<Expr> generate(Expr::Width w, unsigned depth) {
+    if (depth == 0 || pick(8) == 0) {
+      if (pick(3) == 0)
+        return constant(w);
+      unsigned readDepth = depth ? depth - 1 : 0;
+      ref<Expr> r = read(readDepth);
+      while (r->getWidth() < w)
+        r = ConcatExpr::create(read(readDepth), r);
+      return ExtractExpr::create(r, 0, w);
+    }
+    --depth;
+
+    switch (pick(7)) {
+    case 0: {
+      if (w == 1)
+        break;
+      Expr::Width narrow = 1 + pick(w - 1);
+      ref<Expr> e = generate(narrow, depth);
+      return pick(2) ? ZExtExpr::create(e, w) : SExtExpr::create(e, w);
+    }
+    case 1: {
+      if (w == 64)
+        break;
+      Expr::Width wide = w + 1 + pick(64 - w);
+      return ExtractExpr::create(generate(wide, depth), pick(wide - w + 1), w);
+    }
+    case 2: {
+      if (w == 1)
+        break;
+      Expr::Width left = 1 + pick(w - 1);
+      return ConcatExpr::create(generate(left, depth),
+                                generate(w - left, depth));
+    }
+    case 3:
+      return SelectExpr::create(generate(1, depth), generate(w, depth),
+                                generate(w, depth));
+    case 4:
+      if (w == 1) {
+        Expr::Width ow = randomWidth();
+        ref<Expr> l = generate(ow, depth), r = generate(ow, depth);
+        static const Expr::Kind compares[] = {
+            Expr::Eq,  Expr::Ne,  Expr::Ult, Expr::Ule, Expr::Ugt,
+            Expr::Uge, Expr::Slt, Expr::Sle, Expr::Sgt, Expr::Sge};
+        return Expr::createFromKind(compares[pick(10)], {l, r});
+      }
+      break;
+    case 5:
+      return NotExpr::create(generate(w, depth));
+    }
+
+    static const Expr::Kind binary[] = {
+        Expr::Add,  Expr::Sub, Expr::Mul, Expr::UDiv, Expr::SDiv,
+        Expr::URem, Expr::SRem, Expr::And, Expr::Or,  Expr::Xor,
+        Expr::Shl,  Expr::LShr, Expr::AShr};
+    Expr::Kind kind = binary[pick(sizeof(binary) / sizeof(binary[0]))];
+    ref<Expr> l = generate(w, depth), r = generate(w, depth);
+    if (kind >= Expr::UDiv && kind <= Expr::SRem && r->isZero())
+      kind = Expr::Add;
+    if (kind >= Expr::Shl && pick(2))
+      r = constant(w);
+    return Expr::createFromKind(kind, {l, r});
+  }
+};
+
+std::vector<std::unique_ptr<Assignment>>
+randomAssignments(std::mt19937 &rng, const std::vector<const Array *> &arrays,
+                  unsigned count) {
+  std::vector<std::unique_ptr<Assignment>> assignments;
+  for (unsigned i = 0; i < count; ++i) {
+    auto a = std::make_unique<Assignment>();
+    for (const Array *array : arrays) {
+      // Leave some arrays unbound and bind some only partially.
+      if (array->isConstantArray() || rng() % 8 == 0)
+        continue;
+      std::vector<unsigned char> values(rng() % 4 ? arraySize : 3);
+      for (unsigned char &v : values)
+        v = rng() % 4 == 0 ? 0xff : rng() % 4;
+      a->bindings[array] = values;
+    }
+    assignments.push_back(std::move(a));
+  }
+  return assignments;
+}
+
+std::vector<const Array *> makeArrays(ArrayCache &ac) {
+  std::vector<ref<ConstantExpr>> values;
+  for (unsigned i = 0; i < arraySize - 2; ++i)
+    values.push_back(ConstantExpr::create(0x80 + i, Expr::Int8));
+  return {ac.CreateArray("a", arraySize), ac.CreateArray("b", arraySize),
+          ac.CreateArray("c", values.size(), &values.front(),
+                         &values.back() + 1)};
+}
+
+TEST(CompiledExprTest, MatchesEvaluator) {
+  std::mt19937 rng(1);
+  ArrayCache ac;
+  std::vector<const Array *> arrays = makeArrays(ac);
+  RandomExprs exprs(rng, arrays);
+  auto assignments = randomAssignments(rng, arrays, 20);
+
+  unsigned compiled = 0, satisfied = 0;
+  for (unsigned i = 0; i < 300; ++i) {
+    ref<Expr> e = exprs.generate(1 + rng() % 64, 4);
+    for (auto &a : assignments) {
+      // Compare values through equalities with the evaluated value.
+      ref<Expr> value = a->evaluate(e);
+      ConstantExpr *ce = dyn_cast<ConstantExpr>(value);
+      if (!ce)
+        continue;
+      ref<Expr> other = ConstantExpr::create(ce->getZExtValue() ^ 1,
+                                             ce->getWidth());
+      for (const ref<Expr> &query :
+           {EqExpr::create(e, value), EqExpr::create(e, other)}) {
+        std::vector<ref<Expr>> roots = {query};
+        CompiledExpr program(roots);
+        compiled += program.isCompiled();
+        bool expected = a->satisfies(roots.begin(), roots.end());
+        satisfied += expected;
+        EXPECT_EQ(expected, program.satisfies(*a));
+      }
+    }
+
+    // Several roots against a batch of assignments
+    std::vector<ref<Expr>> roots;
+    for (unsigned j = 0; j < 3; ++j)
+      roots.push_back(exprs.generate(1, 3));
+    CompiledExpr program(roots);
+    std::vector<const Assignment *> batch;
+    std::size_t expected = assignments.size();
+    for (auto &a : assignments) {
+      batch.push_back(a.get());
+      if (expected == assignments.size() &&
+          a->satisfies(roots.begin(), roots.end()))
+        expected = batch.size() - 1;
+    }
+    EXPECT_EQ(expected, program.findSatisfying(batch));
+  }
+  EXPECT_GT(compiled, 0u);
+  EXPECT_GT(satisfied, 0u);
+}
+
+TEST(CompiledExprTest, Fallbacks) {
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("a", 16);
+  ref<Expr> read = Expr::createTempRead(array, 32);
+  ref<Expr> wide = ConcatExpr::create(Expr::createTempRead(array, 64),
+                                      Expr::createTempRead(array, 64));
+  ref<Expr> zero = ConstantExpr::create(0, 32);
+
+  Assignment a;
+  a.bindings[array] = std::vector<unsigned char>(16, 1);
+
+  // Too wide to compile
+  std::vector<ref<Expr>> roots = {
+      EqExpr::create(wide, ConstantExpr::create(0, 128))};
+  CompiledExpr program(roots);
+  EXPECT_FALSE(program.isCompiled());
+  EXPECT_FALSE(program.satisfies(a));
+  roots = {NotExpr::create(roots[0])};
+  CompiledExpr negated(roots);
+  EXPECT_TRUE(negated.satisfies(a));
+
+  // Dividing by zero leaves the evaluator with an expression that is not
+  // true.
+  a.bindings[array] = std::vector<unsigned char>(16, 0);
+  roots = {UltExpr::create(UDivExpr::create(ConstantExpr::create(7, 32), read),
+                           ConstantExpr::create(5, 32))};
+  CompiledExpr division(roots);
+  EXPECT_TRUE(division.isCompiled());
+  EXPECT_FALSE(division.satisfies(a));
+  ref<Expr> denominator = ExtractExpr::create(read, 0, 8);
+  roots = {EqExpr::create(
+      SelectExpr::create(EqExpr::create(denominator,
+                                        ConstantExpr::create(0, 8)),
+                         zero, URemExpr::create(read, ZExtExpr::create(
+                                                          denominator, 32))),
+      zero)};
+  CompiledExpr guarded(roots);
+  EXPECT_TRUE(guarded.satisfies(a));
+
+  // Free values are left to the evaluator.
+  Assignment free(true);
+  EXPECT_EQ(free.satisfies(roots.begin(), roots.end()), guarded.satisfies(free));
+}
+
+TEST(CompiledExprTest, ManyAssignments) {
+  std::mt19937 rng(2);
+  ArrayCache ac;
+  std::vector<const Array *> arrays = makeArrays(ac);
+  RandomExprs exprs(rng, arrays);
+  auto owned = randomAssignments(rng, arrays, 2000);
+  std::vector<const Assignment *> assignments;
+  for (auto &a : owned)
+    assignments.push_back(a.get());
+
+  // A query of many constraints none of the assignments satisfies, so that
+  // every assignment is tried
+  std::vector<ref<Expr>> roots;
+  for (unsigned i = 0; i < 30; ++i)
+    roots.push_back(exprs.generate(1, 5));
+  ref<Expr> read = Expr::createTempRead(arrays[0], 64);
+  roots.push_back(EqExpr::create(read, ConstantExpr::create(~0ull - 1, 64)));
+
+  std::size_t expected = assignments.size();
+  for (std::size_t i = 0; i < owned.size(); ++i) {
+    if (owned[i]->satisfies(roots.begin(), roots.end())) {
+      expected = i;
+      break;
+    }
+  }
+
+  CompiledExpr program(roots);
+  EXPECT_TRUE(program.isCompiled());
+  EXPECT_EQ(expected, program.findSatisfying(assignments));
+}
+
+} // namespace
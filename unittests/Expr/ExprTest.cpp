@@ -11,9 +11,15 @@
 #include "gtest/gtest.h"
 
 #include "klee/Expr/ArrayCache.h"
+#include "klee/Expr/Constraints.h"
 #include "klee/Expr/Expr.h"
 
+#include "llvm/Support/CommandLine.h"
+
 using namespace klee;
+namespace klee {
+extern llvm::cl::opt<bool> UseExprHashConsing;
+}
 
 namespace {
 
@@ -160,6 +166,36 @@ TEST(ExprTest, ReadExprFoldingIndexOutOfBound) {
   EXPECT_EQ(Expr::Read, read.get()->getKind());
 }
 
+TEST(ExprTest, ConstantArrayInterning) {
+  unsigned size = 5;
+  std::vector<ref<ConstantExpr> > Contents(size);
+  for (unsigned i = 0; i < size; ++i)
+    Contents[i] = ConstantExpr::create(i + 1, Expr::Int8);
+  ArrayCache ac;
+  const Array *array =
+      ac.CreateArray("arr", size, &Contents[0], &Contents[0] + size);
+
+  // Equal contents give the first array, whatever the name.
+  std::vector<ref<ConstantExpr> > Same(size);
+  for (unsigned i = 0; i < size; ++i)
+    Same[i] = ConstantExpr::create(i + 1, Expr::Int8);
+  const Array *same =
+      ac.CreateArray("other", size, &Same[0], &Same[0] + size);
+  EXPECT_EQ(array, same);
+  EXPECT_EQ("arr", same->name);
+
+  // Different contents, sizes or domains give different arrays.
+  Same[2] = ConstantExpr::create(0, Expr::Int8);
+  EXPECT_NE(array, ac.CreateArray("arr", size, &Same[0], &Same[0] + size));
+  EXPECT_NE(array, ac.CreateArray("arr", size - 1, &Contents[0],
+                                  &Contents[0] + size - 1));
+  EXPECT_NE(array, ac.CreateArray("arr", size, &Contents[0],
+                                  &Contents[0] + size, Expr::Int64));
+
+  // Symbolic arrays are still told apart by name.
+  EXPECT_NE(array, ac.CreateArray("arr", size));
+}
+
 TEST(ExprTest, ReadExprFoldingConstantUpdate) {
   unsigned size = 5;
 
@@ -264,4 +300,214 @@ TEST(ExprTest, ReadExprFoldingSymbolicIndexUpdate) {
     EXPECT_EQ(Expr::Read, read.get()->getKind());
   }
 }
+
+TEST(ExprTest, HashConsing) {
+  klee::UseExprHashConsing = true;
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("arr", 256);
+  unsigned baseCount = Expr::count;
+  {
+    ref<Expr> a = AddExpr::create(Expr::createTempRead(array, Expr::Int32),
+                                  getConstant(7, Expr::Int32));
+    ref<Expr> b = AddExpr::create(Expr::createTempRead(array, Expr::Int32),
+                                  getConstant(7, Expr::Int32));
+    ref<Expr> c = AddExpr::create(Expr::createTempRead(array, Expr::Int32),
+                                  getConstant(8, Expr::Int32));
+    EXPECT_TRUE(a->isHashConsed());
+    EXPECT_EQ(a.get(), b.get());
+    EXPECT_NE(a.get(), c.get());
+    EXPECT_NE(a, c);
+    // Both expressions share all kids but the constant.
+    EXPECT_EQ(a->getKid(1).get(), c->getKid(1).get());
+    // Distinct expressions are ordered by structure, as without
+    // hash-consing, shared small constants included.
+    klee::UseExprHashConsing = false;
+    ref<Expr> a2 = AddExpr::create(Expr::createTempRead(array, Expr::Int32),
+                                   getConstant(7, Expr::Int32));
+    ref<Expr> c2 = AddExpr::create(Expr::createTempRead(array, Expr::Int32),
+                                   getConstant(8, Expr::Int32));
+    ref<Expr> large2 = getConstant(1000, Expr::Int32);
+    klee::UseExprHashConsing = true;
+    EXPECT_FALSE(a2->isHashConsed());
+    EXPECT_NE(0, a->compare(*c));
+    EXPECT_EQ(a2->compare(*c2), a->compare(*c));
+    EXPECT_EQ(-a->compare(*c), c->compare(*a));
+    ref<Expr> small = getConstant(7, Expr::Int32);
+    ref<Expr> large = getConstant(1000, Expr::Int32);
+    EXPECT_TRUE(small->isHashConsed());
+    EXPECT_EQ(small->compare(*large2), small->compare(*large));
+  }
+  klee::UseExprHashConsing = false;
+  // The table must not keep expressions alive.
+  EXPECT_EQ(baseCount, static_cast<unsigned>(Expr::count));
+  ref<Expr> d = ConstantExpr::create(7, Expr::Int32);
+  EXPECT_EQ(d.get(), getConstant(7, Expr::Int32).get());
+}
+
+TEST(ExprTest, SmallConstants) {
+  // Small constants are shared and not counted, whichever way they are made.
+  ref<ConstantExpr> two = ConstantExpr::create(2, Expr::Int32);
+  unsigned baseCount = Expr::count;
+  ref<ConstantExpr> sum = two->Add(ConstantExpr::create(3, Expr::Int32));
+  EXPECT_EQ(sum.get(), ConstantExpr::alloc(llvm::APInt(32, 5)).get());
+  EXPECT_EQ(sum->hash(), ConstantExpr::alloc(5, Expr::Int32)->hash());
+  ref<ConstantExpr> minusOne = two->Sub(ConstantExpr::create(3, Expr::Int32));
+  EXPECT_TRUE(minusOne->isAllOnes());
+  EXPECT_EQ(minusOne.get(), ConstantExpr::create(0xffffffff, Expr::Int32).get());
+  EXPECT_EQ(ConstantExpr::alloc(1, Expr::Bool).get(),
+            sum->Ugt(two).get());
+  EXPECT_EQ(baseCount, static_cast<unsigned>(Expr::count));
+
+  // Equal values of different widths are distinct.
+  EXPECT_NE(ConstantExpr::create(5, Expr::Int8).get(), sum.get());
+  EXPECT_EQ(5u, ConstantExpr::create(5, Expr::Int8)->getZExtValue());
+  EXPECT_EQ(0xffu, ConstantExpr::create(0xff, Expr::Int8)->getZExtValue());
+  // Bits above the width are dropped before the lookup.
+  EXPECT_EQ(ConstantExpr::create(0, Expr::Int8).get(),
+            ConstantExpr::alloc(0x100, Expr::Int8).get());
+  EXPECT_EQ(ConstantExpr::create(0xff, Expr::Int8).get(),
+            ConstantExpr::alloc(~UINT64_C(0), Expr::Int8).get());
+
+  // Other constants are allocated as before.
+  ref<ConstantExpr> large = ConstantExpr::create(1000, Expr::Int32);
+  EXPECT_EQ(baseCount + 1, static_cast<unsigned>(Expr::count));
+  EXPECT_NE(large.get(), ConstantExpr::create(1000, Expr::Int32).get());
+  EXPECT_EQ(large, ConstantExpr::create(1000, Expr::Int32));
+  EXPECT_EQ(nullptr, ConstantExpr::lookupSmall(5, 7));
+  EXPECT_EQ(nullptr, ConstantExpr::lookupSmall(256, Expr::Int16));
+  EXPECT_EQ(nullptr, ConstantExpr::lookupSmall(2, Expr::Bool));
+}
+
+TEST(ExprTest, ConstraintSetSharing) {
+  ConstraintSet base;
+  for (int i = 0; i < 10; ++i)
+    base.push_back(getConstant(i, Expr::Int32));
+
+  // Forked sets share the prefix and diverge on their own appends.
+  ConstraintSet left(base), right(base);
+  left.push_back(getConstant(100, Expr::Int32));
+  right.push_back(getConstant(200, Expr::Int32));
+  right.push_back(getConstant(201, Expr::Int32));
+  EXPECT_EQ(10u, base.size());
+  EXPECT_EQ(11u, left.size());
+  EXPECT_EQ(12u, right.size());
+
+  std::vector<ref<Expr>> expected;
+  for (int i = 0; i < 10; ++i)
+    expected.push_back(getConstant(i, Expr::Int32));
+  EXPECT_TRUE(std::equal(base.begin(), base.end(), expected.begin()));
+  expected.push_back(getConstant(100, Expr::Int32));
+  EXPECT_TRUE(std::equal(left.begin(), left.end(), expected.begin()));
+  expected.back() = getConstant(200, Expr::Int32);
+  expected.push_back(getConstant(201, Expr::Int32));
+  EXPECT_TRUE(std::equal(right.begin(), right.end(), expected.begin()));
+  EXPECT_EQ(ConstraintSet(expected), right);
+  EXPECT_FALSE(left == right);
+
+  // Growing the base after the fork does not affect the forks.
+  base.push_back(getConstant(300, Expr::Int32));
+  EXPECT_EQ(getConstant(100, Expr::Int32), *std::next(left.begin(), 10));
+  EXPECT_EQ(getConstant(300, Expr::Int32), *std::next(base.begin(), 10));
+}
+
+TEST(ExprTest, ConstraintPartition) {
+  ArrayCache ac;
+  const Array *a = ac.CreateArray("a", 4);
+  const Array *b = ac.CreateArray("b", 4);
+  const Array *c = ac.CreateArray("c", 4);
+  auto read = [](const Array *array, ref<Expr> index) {
+    return ReadExpr::create(UpdateList(array, nullptr), index);
+  };
+  auto byte = [&](const Array *array, unsigned index) {
+    return read(array, getConstant(index, Expr::Int32));
+  };
+
+  ref<Expr> c1 = UltExpr::create(byte(a, 0), getConstant(10, Expr::Int8));
+  ref<Expr> c2 = UltExpr::create(byte(b, 1), getConstant(20, Expr::Int8));
+  // a symbolic read of a depends on all of its bytes
+  ref<Expr> c3 = UltExpr::create(
+      byte(c, 2), read(a, ZExtExpr::create(byte(c, 3), Expr::Int32)));
+  ref<Expr> c4 = UltExpr::create(byte(b, 3), getConstant(5, Expr::Int8));
+
+  ConstraintSet constraints;
+  ConstraintManager m(constraints);
+  for (const auto &constraint : {c1, c2, c3, c4})
+    m.addConstraint(constraint);
+  const ConstraintPartition *partition = constraints.getPartition();
+  ASSERT_NE(nullptr, partition);
+
+  std::vector<ref<Expr>> required;
+  partition->getDependentConstraints(
+      UltExpr::create(getConstant(3, Expr::Int8), byte(a, 2)), required);
+  EXPECT_EQ(std::vector<ref<Expr>>({c1, c3}), required);
+  required.clear();
+  partition->getDependentConstraints(
+      UltExpr::create(getConstant(3, Expr::Int8), byte(b, 1)), required);
+  EXPECT_EQ(std::vector<ref<Expr>>({c2}), required);
+  required.clear();
+  partition->getDependentConstraints(
+      UltExpr::create(getConstant(3, Expr::Int8),
+                      read(b, ZExtExpr::create(byte(c, 0), Expr::Int32))),
+      required);
+  EXPECT_EQ(std::vector<ref<Expr>>({c2, c4}), required);
+
+  std::vector<ConstraintPartition::Factor> factors;
+  partition->getFactors(factors);
+  ASSERT_EQ(3u, factors.size());
+  EXPECT_EQ(std::vector<ref<Expr>>({c1, c3}), factors[0].constraints);
+  EXPECT_EQ(std::vector<ref<Expr>>({c2}), factors[1].constraints);
+  EXPECT_EQ(std::vector<ref<Expr>>({c4}), factors[2].constraints);
+
+  // Merging factors in a copy leaves the original alone.
+  ConstraintSet copy(constraints);
+  ConstraintManager(copy).addConstraint(
+      UltExpr::create(byte(b, 1), byte(b, 3)));
+  copy.getPartition()->getFactors(factors);
+  EXPECT_EQ(2u, factors.size());
+  partition->getFactors(factors);
+  EXPECT_EQ(3u, factors.size());
+
+  // Factors are not tracked for constraints appended directly.
+  copy.push_back(c1);
+  EXPECT_EQ(nullptr, copy.getPartition());
+}
+
+TEST(ExprTest, SimplifyWithEqualities) {
+  ArrayCache ac;
+  const Array *a = ac.CreateArray("a", 4);
+  auto byte = [&](unsigned index) {
+    return ReadExpr::create(UpdateList(a, nullptr),
+                            getConstant(index, Expr::Int32));
+  };
+  ref<Expr> bound = UltExpr::create(byte(1), getConstant(3, Expr::Int8));
+  ref<Expr> sum = AddExpr::create(byte(0), getConstant(1, Expr::Int8));
+
+  ConstraintSet constraints;
+  ConstraintManager m(constraints);
+  m.addConstraint(EqExpr::create(getConstant(5, Expr::Int8), byte(0)));
+  m.addConstraint(bound);
+
+  for (int i = 0; i < 2; ++i) {
+    EXPECT_EQ(getConstant(6, Expr::Int8),
+              ConstraintManager::simplifyExpr(constraints, sum));
+    EXPECT_EQ(ref<Expr>(ConstantExpr::alloc(1, Expr::Bool)),
+              ConstraintManager::simplifyExpr(constraints, bound));
+  }
+
+  // Sets without tracked equalities give the same results.
+  ConstraintSet plain(std::vector<ref<Expr>>(constraints.begin(),
+                                             constraints.end()));
+  EXPECT_EQ(getConstant(6, Expr::Int8),
+            ConstraintManager::simplifyExpr(plain, sum));
+
+  // Copies share simplifications until a constraint is added.
+  ConstraintSet copy(constraints);
+  ConstraintManager(copy).addConstraint(
+      EqExpr::create(getConstant(7, Expr::Int8), byte(2)));
+  EXPECT_EQ(getConstant(7, Expr::Int8),
+            ConstraintManager::simplifyExpr(copy, byte(2)));
+  EXPECT_EQ(byte(2), ConstraintManager::simplifyExpr(constraints, byte(2)));
+  EXPECT_EQ(getConstant(6, Expr::Int8),
+            ConstraintManager::simplifyExpr(copy, sum));
+}
 }
@@ -0,0 +1,359 @@
+//===-- MemoryTest.cpp ----------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#define KLEE_UNITTEST
+
+#include "Core/AddressSpace.h"
+#include "Core/ExecutionState.h"
+#include "Core/Memory.h"
+#include "Core/TimingSolver.h"
+
+#include "klee/ADT/BitArray.h"
+#include "klee/Expr/ArrayCache.h"
+#include "klee/Expr/Constraints.h"
+#include "klee/Expr/Expr.h"
+#include "klee/Solver/Solver.h"
+#include "klee/Solver/SolverCmdLine.h"
+
+#include "gtest/gtest.h"
+
+using namespace klee;
+
+namespace {
+
+const unsigned objectSize = 3 * 4096 + 100;
+
+void initializeContext() {
+  static bool contextInitialized = false;
+  if (!contextInitialized) {
+    Context::initialize(true, Expr::Int64);
+    contextInitialized = true;
+  }
+}
+
+ref<ObjectState> makeConcreteObject() {
+  initializeContext();
+  MemoryObject *mo = new MemoryObject(0x10000, objectSize, 8, false, true,
+                                      false, nullptr, nullptr);
+  ref<ObjectState> os(new ObjectState(mo));
+  for (unsigned i = 0; i < objectSize; ++i)
+    os->write8(i, i & 0xFF);
+  return os;
+}
+
+uint64_t readByte(const ObjectState *os, unsigned offset) {
+  ref<ConstantExpr> ce = dyn_cast<ConstantExpr>(os->read8(offset));
+  EXPECT_TRUE(ce);
+  return ce ? ce->getZExtValue() : ~0ULL;
+}
+
+uint64_t readByte(const ref<ObjectState> &os, unsigned offset) {
+  return readByte(os.get(), offset);
+}
+
+TEST(MemoryTest, CopyOnWritePages) {
+  ref<ObjectState> os = makeConcreteObject();
+  ref<ObjectState> copy(new ObjectState(*os));
+
+  copy->write8(5000, 0xFF);
+  copy->write8(4095, 0xEE);
+  copy->write8(4096, 0xDD);
+
+  for (unsigned i = 0; i < objectSize; ++i)
+    ASSERT_EQ(i & 0xFF, readByte(os, i));
+  EXPECT_EQ(0xFFU, readByte(copy, 5000));
+  EXPECT_EQ(0xEEU, readByte(copy, 4095));
+  EXPECT_EQ(0xDDU, readByte(copy, 4096));
+  EXPECT_EQ(4999U & 0xFF, readByte(copy, 4999));
+  EXPECT_EQ(9000U & 0xFF, readByte(copy, 9000));
+}
+
+TEST(MemoryTest, SymbolicBytesAreNotShared) {
+  ref<ObjectState> os = makeConcreteObject();
+  ref<ObjectState> copy(new ObjectState(*os));
+
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("sym", 1);
+  ref<Expr> sym = ReadExpr::create(UpdateList(array, 0),
+                                   ConstantExpr::alloc(0, Expr::Int32));
+  copy->write(8200, sym);
+
+  EXPECT_EQ(8200U & 0xFF, readByte(os, 8200));
+  EXPECT_EQ(sym, copy->read8(8200));
+
+  // a write at a symbolic offset flushes the whole copy
+  ref<Expr> index = ZExtExpr::create(sym, Expr::Int32);
+  copy->write(index, ConstantExpr::alloc(0x42, Expr::Int8));
+  for (unsigned i = 0; i < objectSize; i += 97)
+    ASSERT_EQ(i & 0xFF, readByte(os, i));
+}
+
+TEST(MemoryTest, BitArrayRanges) {
+  BitArray bits(100, false);
+  bits.setRange(30, 70);
+  EXPECT_TRUE(bits.allSet(30, 70));
+  EXPECT_FALSE(bits.allSet(29, 70));
+  EXPECT_TRUE(bits.noneSet(0, 30));
+  EXPECT_TRUE(bits.noneSet(70, 100));
+  EXPECT_EQ(30U, bits.findNextSet(0, 100));
+  EXPECT_EQ(65U, bits.findNextSet(65, 100));
+  EXPECT_EQ(100U, bits.findNextSet(70, 100));
+  bits.unsetRange(33, 64);
+  EXPECT_EQ(64U, bits.findNextSet(33, 100));
+  EXPECT_EQ(40U, bits.findNextSet(33, 40));
+  EXPECT_TRUE(bits.allSet(30, 33));
+}
+
+TEST(MemoryTest, ConcreteRanges) {
+  ref<ObjectState> os = makeConcreteObject();
+  ref<ObjectState> copy(new ObjectState(*os));
+
+  // wide reads of concrete bytes across a page boundary
+  ref<ConstantExpr> value =
+      dyn_cast<ConstantExpr>(os->read(4094, Expr::Int32));
+  ASSERT_TRUE(value);
+  EXPECT_EQ(0x0100FFFEU, value->getZExtValue());
+
+  std::vector<uint8_t> bytes(5000, 0x5A);
+  copy->writeConcrete(2000, bytes.data(), bytes.size());
+  copy->write32(8190, 0xAABBCCDD);
+  std::vector<uint8_t> buffer(5000);
+  ASSERT_TRUE(copy->readConcrete(2000, buffer.data(), buffer.size()));
+  EXPECT_EQ(bytes, buffer);
+  EXPECT_EQ(0xDDU, readByte(copy, 8190));
+  EXPECT_EQ(0xAAU, readByte(copy, 8193));
+  for (unsigned i = 0; i < objectSize; i += 89)
+    ASSERT_EQ(i & 0xFF, readByte(os, i));
+
+  // ranges with symbolic bytes are not read
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("sym", 1);
+  copy->write(6000, ReadExpr::create(UpdateList(array, 0),
+                                     ConstantExpr::alloc(0, Expr::Int32)));
+  EXPECT_FALSE(copy->readConcrete(5990, buffer.data(), 20));
+  EXPECT_FALSE(isa<ConstantExpr>(copy->read(5998, Expr::Int32)));
+  copy->writeConcrete(5990, bytes.data(), 20);
+  EXPECT_TRUE(isa<ConstantExpr>(copy->read(5998, Expr::Int32)));
+}
+
+TEST(MemoryTest, CopyModifiedPages) {
+  initializeContext();
+  const std::uint64_t everything = ~0ULL;
+  std::vector<uint8_t> native(2 * objectSize);
+  auto nativeAddress = reinterpret_cast<uint64_t>(native.data());
+  const MemoryObject *mo1 = new MemoryObject(
+      nativeAddress, objectSize, 8, false, true, false, nullptr, nullptr);
+  const MemoryObject *mo2 =
+      new MemoryObject(nativeAddress + objectSize, objectSize, 8, false, true,
+                       false, nullptr, nullptr);
+  AddressSpace as;
+  as.bindObject(mo1, new ObjectState(mo1));
+  as.bindObject(mo2, new ObjectState(mo2));
+  as.getWriteable(mo1, as.findObject(mo1))->write8(10, 1);
+
+  as.copyOutConcretes();
+  EXPECT_EQ(1, native[10]);
+  ASSERT_TRUE(as.copyInConcretes({{0, everything}}));
+
+  // Only the pages written since are copied out again.
+  native[20] = 2;
+  native[5000] = 3;
+  as.getWriteable(mo1, as.findObject(mo1))->write8(5001, 4);
+  as.copyOutConcretes();
+  EXPECT_EQ(2, native[20]);
+  EXPECT_EQ(0, native[5000]);
+  EXPECT_EQ(4, native[5001]);
+
+  // Only the written ranges are compared.
+  native[objectSize + 100] = 5;
+  native[objectSize + 9000] = 6;
+  ASSERT_TRUE(as.copyInConcretes(
+      {{nativeAddress + objectSize + 50, nativeAddress + objectSize + 150}}));
+  EXPECT_EQ(5U, readByte(as.findObject(mo2), 100));
+  EXPECT_EQ(0U, readByte(as.findObject(mo2), 9000));
+
+  // A fork shares the native memory until another address space copies out.
+  AddressSpace fork(as);
+  native[20] = 0;
+  native[objectSize + 9000] = 0;
+  fork.copyOutConcretes();
+  ASSERT_TRUE(fork.copyInConcretes({{0, everything}}));
+  native[30] = 7;
+  as.copyOutConcretes();
+  EXPECT_EQ(0, native[30]);
+  ASSERT_TRUE(as.copyInConcretes({{0, everything}}));
+
+  // Copied in pages are copied out only once modified again.
+  native[objectSize + 4100] = 8;
+  as.copyOutConcretes();
+  ASSERT_TRUE(as.copyInConcretes({{0, everything}}));
+  EXPECT_EQ(8U, readByte(as.findObject(mo2), 4100));
+  native[objectSize + 4100] = 9;
+  as.copyOutConcretes();
+  EXPECT_EQ(9, native[objectSize + 4100]);
+  as.getWriteable(mo2, as.findObject(mo2))->write8(4101, 10);
+  AddressSpace::forgetNativeMemory();
+  as.copyOutConcretes();
+  EXPECT_EQ(8, native[objectSize + 4100]);
+  EXPECT_EQ(10, native[objectSize + 4101]);
+  EXPECT_EQ(0, native[30]);
+
+  // Read-only objects may not change.
+  as.getWriteable(mo1, as.findObject(mo1))->setReadOnly(true);
+  native[40] = 11;
+  EXPECT_TRUE(as.copyInConcretes({{nativeAddress + 50, everything}}));
+  EXPECT_FALSE(as.copyInConcretes({{0, everything}}));
+}
+
+class AddressSpaceTest : public ::testing::Test {
+protected:
+  static const unsigned numObjects = 64;
+  static const uint64_t firstAddress = 0x1000;
+  static const uint64_t stride = 0x200;
+
+  ArrayCache ac;
+  ExecutionState state;
+  std::unique_ptr<TimingSolver> solver;
+  ref<Expr> index;
+  std::vector<const MemoryObject *> mos;
+
+  void SetUp() override {
+    initializeContext();
+    solver = std::make_unique<TimingSolver>(createCoreSolver(CoreSolverToUse));
+    for (unsigned i = 0; i < numObjects; ++i) {
+      const MemoryObject *mo = new MemoryObject(
+          firstAddress + i * stride, 16, 8, false, true, false, nullptr,
+          nullptr);
+      state.addressSpace.bindObject(mo, new ObjectState(mo));
+      mos.push_back(mo);
+    }
+    const Array *array = ac.CreateArray("index", 1);
+    index = ZExtExpr::create(
+        ReadExpr::create(UpdateList(array, 0),
+                         ConstantExpr::alloc(0, Expr::Int32)),
+        Expr::Int64);
+  }
+
+  // firstAddress + index * 0x100 hits an object for every even index
+  ref<Expr> pointer() const {
+    return AddExpr::create(
+        ConstantExpr::alloc(firstAddress, Expr::Int64),
+        MulExpr::create(index, ConstantExpr::alloc(0x100, Expr::Int64)));
+  }
+
+  void constrain(ref<Expr> e) {
+    ConstraintManager(state.constraints).addConstraint(e);
+  }
+};
+
+TEST_F(AddressSpaceTest, ResolveAll) {
+  constrain(UltExpr::create(index, ConstantExpr::alloc(48, Expr::Int64)));
+
+  ResolutionList rl;
+  EXPECT_FALSE(state.addressSpace.resolve(state, solver.get(), pointer(), rl));
+  ASSERT_EQ(24U, rl.size());
+  for (unsigned i = 0; i < rl.size(); ++i)
+    EXPECT_EQ(mos[i], rl[i].first);
+}
+
+TEST_F(AddressSpaceTest, ResolveWindow) {
+  // A window in the middle, whose objects on both sides are ruled out
+  constrain(UleExpr::create(ConstantExpr::alloc(41, Expr::Int64), index));
+  constrain(UltExpr::create(index, ConstantExpr::alloc(59, Expr::Int64)));
+
+  ResolutionList rl;
+  EXPECT_FALSE(state.addressSpace.resolve(state, solver.get(), pointer(), rl));
+  ASSERT_EQ(9U, rl.size());
+  for (unsigned i = 0; i < rl.size(); ++i)
+    EXPECT_EQ(mos[21 + i], rl[i].first);
+}
+
+TEST_F(AddressSpaceTest, ResolveMaxResolutions) {
+  ResolutionList rl;
+  EXPECT_TRUE(
+      state.addressSpace.resolve(state, solver.get(), pointer(), rl, 5));
+  EXPECT_EQ(5U, rl.size());
+}
+
+TEST_F(AddressSpaceTest, ResolveInBounds) {
+  constrain(EqExpr::create(index, ConstantExpr::alloc(10, Expr::Int64)));
+
+  ResolutionList rl;
+  EXPECT_FALSE(state.addressSpace.resolve(state, solver.get(), pointer(), rl));
+  ASSERT_EQ(1U, rl.size());
+  EXPECT_EQ(mos[5], rl[0].first);
+}
+
+TEST_F(AddressSpaceTest, ResolveOne) {
+  // 101 falls between two objects, so only 102 resolves
+  constrain(UltExpr::create(ConstantExpr::alloc(100, Expr::Int64), index));
+  constrain(UltExpr::create(index, ConstantExpr::alloc(103, Expr::Int64)));
+
+  ObjectPair op;
+  bool success;
+  ASSERT_TRUE(state.addressSpace.resolveOne(state, solver.get(), pointer(), op,
+                                            success));
+  ASSERT_TRUE(success);
+  EXPECT_EQ(mos[51], op.first);
+}
+
+TEST_F(AddressSpaceTest, ResolveOneBetweenObjects) {
+  constrain(EqExpr::create(ExtractExpr::create(index, 0, Expr::Bool),
+                           ConstantExpr::alloc(1, Expr::Bool)));
+
+  ObjectPair op;
+  bool success;
+  ASSERT_TRUE(state.addressSpace.resolveOne(state, solver.get(), pointer(), op,
+                                            success));
+  EXPECT_FALSE(success);
+}
+
+TEST_F(AddressSpaceTest, SymbolicObjectsUntracked) {
+  AddressSpace &as = state.addressSpace;
+  EXPECT_FALSE(as.hasSymbolicObjects());
+  as.getWriteable(mos[3], as.findObject(mos[3]))->write(0, index);
+  EXPECT_TRUE(as.hasSymbolicObjects());
+}
+
+class TrackedAddressSpaceTest : public AddressSpaceTest {
+protected:
+  void SetUp() override {
+    AddressSpace::trackSymbolicObjects(true);
+    AddressSpaceTest::SetUp();
+  }
+  void TearDown() override { AddressSpace::trackSymbolicObjects(false); }
+};
+
+TEST_F(TrackedAddressSpaceTest, SymbolicObjects) {
+  AddressSpace &as = state.addressSpace;
+  EXPECT_FALSE(as.hasSymbolicObjects());
+
+  // a symbolic write is counted, a concrete one over it uncounts the object
+  ObjectState *os = as.getWriteable(mos[3], as.findObject(mos[3]));
+  os->write(0, index);
+  EXPECT_TRUE(as.hasSymbolicObjects());
+  ref<Expr> zero = ConstantExpr::alloc(0, Expr::Int64);
+  as.getWriteable(mos[3], as.findObject(mos[3]))->write(0, zero);
+  EXPECT_FALSE(as.hasSymbolicObjects());
+
+  // a copy shares the count, but not the writes after it
+  as.getWriteable(mos[5], as.findObject(mos[5]))->write(8, index);
+  AddressSpace copy(as);
+  EXPECT_TRUE(copy.hasSymbolicObjects());
+  copy.getWriteable(mos[5], copy.findObject(mos[5]))->write(8, zero);
+  copy.getWriteable(mos[7], copy.findObject(mos[7]))->write(0, index);
+  EXPECT_TRUE(copy.hasSymbolicObjects());
+  copy.unbindObject(mos[7]);
+  EXPECT_FALSE(copy.hasSymbolicObjects());
+  EXPECT_TRUE(as.hasSymbolicObjects());
+  as.unbindObject(mos[5]);
+  EXPECT_FALSE(as.hasSymbolicObjects());
+}
+
+} // namespace
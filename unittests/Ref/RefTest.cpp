@@ -14,6 +14,8 @@
 #include "klee/ADT/Ref.h"
 #include "gtest/gtest.h"
 #include <iostream>
+#include <thread>
+#include <vector>
 
 using klee::ref;
 
@@ -47,6 +49,12 @@ struct SelfRefExpr {
   ~SelfRefExpr() { finished_counter++; }
 };
 
+struct AtomicExpr {
+  /// @brief Required by klee::ref-managed objects
+  class klee::AtomicReferenceCounter _refCount;
+  ~AtomicExpr() { finished_counter++; }
+};
+
 struct ParentExpr {
   /// @brief Required by klee::ref-managed objects
   class klee::ReferenceCounter _refCount;
@@ -175,3 +183,23 @@ TEST(RefTest, SelfRef) {
   r_root = r_root->next_;
   EXPECT_EQ(2u, r_e_1->_refCount.getCount());
 }
+
+TEST(RefTest, AtomicAcrossThreads) {
+  finished_counter = 0;
+  {
+    ref<AtomicExpr> root(new AtomicExpr());
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < 4; ++i) {
+      threads.emplace_back([root] {
+        for (unsigned j = 0; j < 100000; ++j) {
+          ref<AtomicExpr> copy = root;
+          (void)copy;
+        }
+      });
+    }
+    for (auto &t : threads)
+      t.join();
+    EXPECT_EQ(1u, root->_refCount.getCount());
+  }
+  EXPECT_EQ(1, finished_counter);
+}
@@ -118,9 +118,9 @@ TEST(SearcherTest, TwoRandomPath) {
 
 TEST(SearcherTest, TwoRandomPathDot) {
   std::stringstream modelExecutionTreeDot;
-  ExecutionTreeNode *rootExecutionTreeNode, *rightLeafExecutionTreeNode,
-      *esParentExecutionTreeNode, *es1LeafExecutionTreeNode,
-      *esLeafExecutionTreeNode;
+  ExecutionTreeNodeIndex rootExecutionTreeNode, rightLeafExecutionTreeNode,
+      esParentExecutionTreeNode, es1LeafExecutionTreeNode,
+      esLeafExecutionTreeNode;
 
   // Root state
   ExecutionState root;
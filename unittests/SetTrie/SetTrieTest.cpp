@@ -0,0 +1,173 @@
+//===-- SetTrieTest.cpp ---------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/ADT/SetTrie.h"
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <random>
+
+using namespace klee;
+
+namespace {
+
+using Set = std::set<int>;
+
+bool isSubset(const Set &a, const Set &b) {
+  return std::includes(b.begin(), b.end(), a.begin(), a.end());
+}
+
+Set randomSet(std::mt19937 &rng, int universe, unsigned maxSize) {
+  Set set;
+  unsigned size = rng() % (maxSize + 1);
+  for (unsigned i = 0; i < size; ++i)
+    set.insert(rng() % universe);
+  return set;
+}
+
+TEST(SetTrieTest, Lookup) {
+  SetTrie<int, int> trie;
+  trie.insert({1, 2, 3}, 1);
+  trie.insert({}, 2);
+  trie.insert({1, 3}, 3);
+
+  EXPECT_EQ(3u, trie.size());
+  ASSERT_NE(nullptr, trie.lookup({1, 2, 3}));
+  EXPECT_EQ(1, *trie.lookup({1, 2, 3}));
+  ASSERT_NE(nullptr, trie.lookup({}));
+  EXPECT_EQ(2, *trie.lookup({}));
+  EXPECT_EQ(nullptr, trie.lookup({1, 2}));
+  EXPECT_EQ(nullptr, trie.lookup({1, 2, 3, 4}));
+
+  trie.insert({3, 1}, 4);
+  EXPECT_EQ(3u, trie.size());
+  EXPECT_EQ(4, *trie.lookup({1, 3}));
+}
+
+TEST(SetTrieTest, SubsetsAndSupersets) {
+  std::mt19937 rng(1);
+  const int universe = 100;
+  SetTrie<int, unsigned> trie;
+  std::vector<Set> sets;
+  for (unsigned i = 0; i < 2000; ++i) {
+    Set set = randomSet(rng, universe, 8);
+    if (trie.lookup(set))
+      continue;
+    trie.insert(set, sets.size());
+    sets.push_back(set);
+  }
+
+  auto any = [](unsigned) { return true; };
+  for (unsigned i = 0; i < 500; ++i) {
+    Set query = randomSet(rng, universe + 10, 30);
+    bool hasSubset = false;
+    for (const Set &set : sets)
+      hasSubset |= isSubset(set, query);
+
+    unsigned *subset = trie.findSubset(query, any);
+    EXPECT_EQ(hasSubset, subset != nullptr);
+    if (subset) {
+      EXPECT_TRUE(isSubset(sets[*subset], query));
+    }
+
+    Set small = randomSet(rng, universe, 2);
+    bool hasSmallSuperset = false;
+    for (const Set &set : sets)
+      hasSmallSuperset |= isSubset(small, set);
+    unsigned *superset = trie.findSuperset(small, any);
+    EXPECT_EQ(hasSmallSuperset, superset != nullptr);
+    if (superset) {
+      EXPECT_TRUE(isSubset(small, sets[*superset]));
+    }
+  }
+
+  // The predicate selects among the candidates.
+  Set all;
+  for (int i = 0; i < universe; ++i)
+    all.insert(i);
+  unsigned *odd =
+      trie.findSubset(all, [](unsigned value) { return value % 2 == 1; });
+  ASSERT_NE(nullptr, odd);
+  EXPECT_EQ(1u, *odd % 2);
+}
+
+TEST(SetTrieTest, Eviction) {
+  SetTrie<int, int> trie;
+  std::vector<int> evicted;
+  trie.setEvictionCallback([&](int &value) { evicted.push_back(value); });
+
+  for (int i = 0; i < 10; ++i)
+    trie.insert({i, i + 100}, i, 1000);
+  std::size_t perEntry = trie.memoryUsage() / 10;
+  EXPECT_GE(perEntry, 1000u);
+  EXPECT_TRUE(evicted.empty());
+
+  // Use the oldest entry, so that the second oldest goes first.
+  EXPECT_NE(nullptr, trie.lookup({0, 100}));
+  trie.setMemoryLimit(perEntry * 8);
+  trie.insert({50}, 50, 1000);
+  EXPECT_LE(trie.memoryUsage(), perEntry * 8);
+  ASSERT_GE(evicted.size(), 2u);
+  EXPECT_EQ(1, evicted[0]);
+  EXPECT_EQ(2, evicted[1]);
+  EXPECT_EQ(10u + 1 - evicted.size(), trie.size());
+  EXPECT_NE(nullptr, trie.lookup({0, 100}));
+  EXPECT_NE(nullptr, trie.lookup({50}));
+  EXPECT_EQ(nullptr, trie.lookup({1, 101}));
+  EXPECT_EQ(nullptr, trie.findSuperset({1}, [](int) { return true; }));
+
+  // Evicting everything but the newest entry releases all other elements.
+  trie.setMemoryLimit(1);
+  trie.insert({7, 8}, 78);
+  EXPECT_EQ(1u, trie.size());
+  trie.setMemoryLimit(0);
+  trie.clear();
+  EXPECT_EQ(0u, trie.size());
+  EXPECT_EQ(0u, trie.memoryUsage());
+}
+
+TEST(SetTrieTest, SharedMemory) {
+  // Entries share values by index, which are charged once while in use.
+  SetTrie<int, int> trie;
+  std::vector<unsigned> users(2, 0);
+  auto insert = [&](int element, int value) {
+    if (users[value]++ == 0)
+      trie.chargeSharedMemory(1000);
+    trie.insert({element}, value);
+  };
+  trie.setEvictionCallback([&](int &value) {
+    if (--users[value] == 0)
+      trie.dischargeSharedMemory(1000);
+  });
+
+  insert(0, 0);
+  insert(1, 0);
+  std::size_t perEntry = (trie.memoryUsage() - 1000) / 2;
+
+  // Evicting the entry that first used a value keeps the value charged.
+  trie.setMemoryLimit(2 * perEntry + 2000);
+  insert(2, 1);
+  EXPECT_EQ(2u, trie.size());
+  EXPECT_EQ(1u, users[0]);
+  EXPECT_EQ(2 * perEntry + 2000, trie.memoryUsage());
+
+  // Once no entry uses a value, it is no longer charged.
+  trie.setMemoryLimit(2 * perEntry + 1000);
+  insert(3, 1);
+  EXPECT_EQ(2u, trie.size());
+  EXPECT_EQ(0u, users[0]);
+  EXPECT_EQ(2 * perEntry + 1000, trie.memoryUsage());
+
+  trie.clear();
+  trie.dischargeSharedMemory(1000);
+  EXPECT_EQ(0u, trie.memoryUsage());
+}
+
+} // namespace
@@ -0,0 +1,132 @@
+//===-- PersistentCachingSolverTest.cpp -----------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/Expr/ArrayCache.h"
+#include "klee/Expr/Constraints.h"
+#include "klee/Expr/Expr.h"
+#include "klee/Solver/Solver.h"
+#include "klee/Solver/SolverCmdLine.h"
+#include "klee/Solver/SolverStats.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+
+#include <sqlite3.h>
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+ArrayCache AC;
+
+class PersistentCachingSolverTest : public ::testing::Test {
+protected:
+  llvm::SmallString<128> path;
+  std::unique_ptr<Solver> solver;
+
+  void SetUp() override {
+    ASSERT_FALSE(
+        llvm::sys::fs::createTemporaryFile("klee-query-cache", "sqlite", path));
+  }
+
+  // Runs even when an assertion ends the test early. The solver closes the
+  // database first, then the database and its WAL files are removed.
+  void TearDown() override {
+    solver.reset();
+    if (path.empty())
+      return;
+    llvm::sys::fs::remove(path);
+    llvm::sys::fs::remove(path + "-wal");
+    llvm::sys::fs::remove(path + "-shm");
+  }
+
+  void open(std::unique_ptr<Solver> s) {
+    solver.reset();
+    solver = createPersistentCachingSolver(std::move(s), path.str().str());
+  }
+
+  /// Returns an array named \p name and the query constraints 5 < x on it.
+  std::pair<const Array *, ref<Expr>> makeQuery(const char *name,
+                                                ConstraintSet &constraints) {
+    const Array *array = AC.CreateArray(name, 4);
+    ref<Expr> x = Expr::createTempRead(array, Expr::Int32);
+    constraints =
+        ConstraintSet({UltExpr::create(ConstantExpr::alloc(5, Expr::Int32), x)});
+    return std::make_pair(array, x);
+  }
+};
+
+TEST_F(PersistentCachingSolverTest, ReusesResultsAcrossSolvers) {
+  {
+    open(createCoreSolver(CoreSolverToUse));
+    ConstraintSet constraints;
+    auto q = makeQuery("cache_a", constraints);
+    bool result = false;
+    ASSERT_TRUE(solver->mustBeTrue(
+        Query(constraints,
+              UltExpr::create(ConstantExpr::alloc(4, Expr::Int32), q.second)),
+        result));
+    EXPECT_TRUE(result);
+    std::vector<const Array *> objects{q.first};
+    std::vector<std::vector<unsigned char>> values;
+    ASSERT_TRUE(solver->getInitialValues(
+        Query(constraints, ConstantExpr::alloc(0, Expr::Bool)), objects,
+        values));
+  }
+
+  // The same queries over a differently named array are answered from the
+  // database alone: the underlying solver always fails.
+  open(createDummySolver());
+  ConstraintSet constraints;
+  auto q = makeQuery("cache_b", constraints);
+  uint64_t hitsBefore = stats::queryPersistentCacheHits;
+  bool result = false;
+  ASSERT_TRUE(solver->mustBeTrue(
+      Query(constraints,
+            UltExpr::create(ConstantExpr::alloc(4, Expr::Int32), q.second)),
+      result));
+  EXPECT_TRUE(result);
+  std::vector<const Array *> objects{q.first};
+  std::vector<std::vector<unsigned char>> values;
+  ASSERT_TRUE(solver->getInitialValues(
+      Query(constraints, ConstantExpr::alloc(0, Expr::Bool)), objects, values));
+  ASSERT_EQ(1u, values.size());
+  ASSERT_EQ(4u, values[0].size());
+  uint32_t model = 0;
+  for (unsigned i = 0; i < 4; ++i)
+    model |= static_cast<uint32_t>(values[0][i]) << (8 * i);
+  EXPECT_GT(model, 5u);
+  EXPECT_EQ(hitsBefore + 2, stats::queryPersistentCacheHits);
+  // A different query misses.
+  EXPECT_FALSE(solver->mustBeTrue(
+      Query(constraints,
+            UltExpr::create(ConstantExpr::alloc(6, Expr::Int32), q.second)),
+      result));
+}
+
+TEST_F(PersistentCachingSolverTest, RejectsOtherFormats) {
+  open(createDummySolver());
+  solver.reset();
+
+  // Pretend the database was written by another version of KLEE.
+  sqlite3 *db = nullptr;
+  ASSERT_EQ(SQLITE_OK, sqlite3_open(path.c_str(), &db));
+  EXPECT_EQ(SQLITE_OK, sqlite3_exec(db, "PRAGMA user_version = 1;", nullptr,
+                                    nullptr, nullptr));
+  sqlite3_close(db);
+
+  ASSERT_DEATH(open(createDummySolver()), "has format 1");
+}
+} // namespace
@@ -0,0 +1,70 @@
+//===-- PortfolioSolverTest.cpp -------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/Config/config.h"
+#include "klee/Expr/ArrayCache.h"
+#include "klee/Expr/Constraints.h"
+#include "klee/Expr/Expr.h"
+#include "klee/Solver/Solver.h"
+#include "klee/Solver/SolverCmdLine.h"
+#include "klee/Solver/SolverStats.h"
+
+#include <memory>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+ArrayCache AC;
+
+TEST(PortfolioSolverTest, RacesDistinctBackends) {
+  std::vector<CoreSolverType> backends;
+#ifdef ENABLE_STP
+  backends.push_back(STP_SOLVER);
+#endif
+#ifdef ENABLE_Z3
+  backends.push_back(Z3_SOLVER);
+#endif
+#ifdef ENABLE_METASMT
+  backends.push_back(METASMT_SOLVER);
+#endif
+  if (backends.size() < 2)
+    GTEST_SKIP() << "Needs at least two solver backends";
+
+  std::unique_ptr<Solver> solver(createPortfolioSolver(backends));
+  solver->setCoreSolverTimeout(time::Span("10s"));
+
+  const Array *array = AC.CreateArray("portfolio_x", 4);
+  const ref<Expr> x = Expr::createTempRead(array, Expr::Int32);
+  auto c = [](uint64_t v) { return ConstantExpr::alloc(v, Expr::Int32); };
+  ConstraintSet constraints(
+      {UltExpr::create(c(5), x), UltExpr::create(x, c(7))});
+
+  auto wins = [] {
+    return stats::portfolioWinsSTP + stats::portfolioWinsZ3 +
+           stats::portfolioWinsMetaSMT;
+  };
+  uint64_t winsBefore = wins();
+  bool result = false;
+  ASSERT_TRUE(
+      solver->mustBeTrue(Query(constraints, EqExpr::create(x, c(6))), result));
+  EXPECT_TRUE(result);
+  ASSERT_TRUE(
+      solver->mustBeFalse(Query(constraints, EqExpr::create(x, c(5))), result));
+  EXPECT_TRUE(result);
+
+  ref<ConstantExpr> value;
+  ASSERT_TRUE(solver->getValue(Query(constraints, x), value));
+  EXPECT_EQ(6u, value->getZExtValue());
+  // Every query is won by exactly one backend.
+  EXPECT_EQ(winsBefore + 3, wins());
+}
+} // namespace
@@ -19,9 +19,14 @@
 #include "klee/Expr/Expr.h"
 #include "klee/Solver/Solver.h"
 
+#include "llvm/Support/CommandLine.h"
+
 #include <memory>
 
 using namespace klee;
+namespace klee {
+extern llvm::cl::opt<bool> Z3Incremental;
+}
 
 namespace {
 ArrayCache AC;
@@ -69,3 +74,48 @@ TEST_F(Z3SolverTest, GetConstraintLog) {
   ASSERT_STRNE(Occurence, nullptr);
   free(ConstraintsString);
 }
+
+class Z3SolverIncrementalTest : public ::testing::Test {
+protected:
+  void SetUp() override { Z3Incremental = true; }
+  // Restored even when an assertion ends the test early.
+  void TearDown() override { Z3Incremental = false; }
+};
+
+TEST_F(Z3SolverIncrementalTest, SharedAndDivergingPrefixes) {
+  std::unique_ptr<Solver> solver(createCoreSolver(CoreSolverType::Z3_SOLVER));
+  solver->setCoreSolverTimeout(time::Span("10s"));
+
+  const Array *array = AC.CreateArray("incremental_x", 4);
+  const ref<Expr> x = Expr::createTempRead(array, Expr::Int32);
+  auto c = [](uint64_t v) { return ConstantExpr::alloc(v, Expr::Int32); };
+
+  ConstraintSet gt5({UltExpr::create(c(5), x)});
+  ConstraintSet gt5lt10({UltExpr::create(c(5), x), UltExpr::create(x, c(10))});
+  ConstraintSet lt2({UltExpr::create(x, c(2))});
+
+  bool result = false;
+  ASSERT_TRUE(solver->mustBeTrue(Query(gt5, UltExpr::create(c(3), x)), result));
+  EXPECT_TRUE(result);
+  // Extends the previous prefix.
+  ASSERT_TRUE(solver->mustBeTrue(Query(gt5lt10, UltExpr::create(x, c(9))),
+                                 result));
+  EXPECT_FALSE(result);
+  ASSERT_TRUE(solver->mustBeTrue(Query(gt5lt10, UltExpr::create(x, c(10))),
+                                 result));
+  EXPECT_TRUE(result);
+  // Shares nothing: the old constraints must not leak into this query.
+  ASSERT_TRUE(solver->mustBeFalse(Query(lt2, EqExpr::create(x, c(1))),
+                                  result));
+  EXPECT_FALSE(result);
+  // Back to a strict prefix of an earlier query.
+  std::vector<const Array *> objects{array};
+  std::vector<std::vector<unsigned char>> values;
+  ASSERT_TRUE(solver->getInitialValues(Query(gt5, ConstantExpr::alloc(0, 1)),
+                                       objects, values));
+  ASSERT_EQ(1u, values.size());
+  uint32_t model = 0;
+  for (unsigned i = 0; i < 4; ++i)
+    model |= static_cast<uint32_t>(values[0][i]) << (8 * i);
+  EXPECT_GT(model, 5u);
+}
@@ -0,0 +1,77 @@
+//===-- StatisticsTest.cpp ------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Statistics/Statistic.h"
+#include "klee/Statistics/Statistics.h"
+
+#include "gtest/gtest.h"
+
+#include <thread>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+Statistic counter("TestCounter", "tc");
+
+TEST(StatisticsTest, MainThreadIncrement) {
+  uint64_t before = counter.getValue();
+  ++counter;
+  counter += 4;
+  EXPECT_EQ(before + 5, counter.getValue());
+}
+
+TEST(StatisticsTest, ThreadShards) {
+  const unsigned numThreads = 4;
+  const unsigned increments = 10000;
+  uint64_t before = counter.getValue();
+
+  theStatisticManager->allowThreads(true);
+  // the main thread still counts directly
+  ++counter;
+  EXPECT_EQ(++before, counter.getValue());
+
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < numThreads; ++i) {
+    threads.emplace_back([&] {
+      theStatisticManager->attachThread();
+      for (unsigned j = 0; j < increments; ++j)
+        ++counter;
+      theStatisticManager->detachThread();
+    });
+  }
+  for (auto &t : threads)
+    t.join();
+
+  // counts of other threads only show up after merging
+  EXPECT_EQ(before, counter.getValue());
+  theStatisticManager->mergeThreadStats();
+  EXPECT_EQ(before + numThreads * increments, counter.getValue());
+
+  // merged shards are not counted twice
+  theStatisticManager->mergeThreadStats();
+  EXPECT_EQ(before + numThreads * increments, counter.getValue());
+  theStatisticManager->allowThreads(false);
+  EXPECT_EQ(before + numThreads * increments, counter.getValue());
+}
+
+TEST(StatisticsTest, DisallowingThreadsMergesShards) {
+  uint64_t before = counter.getValue();
+  theStatisticManager->allowThreads(true);
+  std::thread thread([] {
+    theStatisticManager->attachThread();
+    counter += 3;
+    theStatisticManager->detachThread();
+  });
+  thread.join();
+  EXPECT_EQ(before, counter.getValue());
+  theStatisticManager->allowThreads(false);
+  EXPECT_EQ(before + 3, counter.getValue());
+}
+} // namespace
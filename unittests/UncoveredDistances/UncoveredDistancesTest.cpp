@@ -0,0 +1,136 @@
+//===-- UncoveredDistancesTest.cpp ----------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Core/UncoveredDistances.h"
+
+#include "gtest/gtest.h"
+
+#include <random>
+
+using namespace klee;
+
+namespace {
+
+/// Random functions of straight-line code with some branches and calls,
+/// including recursion and calls to declarations.
+UncoveredDistances::Graph makeGraph(std::mt19937 &rng) {
+  const unsigned numFunctions = 12;
+  const unsigned instructionsPerFunction = 10;
+  UncoveredDistances::Graph graph;
+
+  for (unsigned f = 0; f < numFunctions; ++f) {
+    if (f % 5 == 4) {
+      graph.entries.push_back(UncoveredDistances::None);
+      continue;
+    }
+    unsigned entry = graph.functionOf.size();
+    graph.entries.push_back(entry);
+    for (unsigned i = 0; i < instructionsPerFunction; ++i) {
+      unsigned id = entry + i;
+      graph.functionOf.push_back(f);
+      graph.through.push_back(1 + rng() % 3);
+      if (i + 1 < instructionsPerFunction)
+        graph.successors.emplace_back(id, id + 1);
+      if (rng() % 4 == 0)
+        graph.successors.emplace_back(id,
+                                      entry + rng() % instructionsPerFunction);
+      if (rng() % 3 == 0) {
+        graph.calls.emplace_back(id, rng() % numFunctions);
+        if (rng() % 5 == 0)
+          graph.through.back() = 0;
+      }
+    }
+  }
+  // ids without an instruction
+  graph.functionOf.push_back(UncoveredDistances::None);
+  graph.through.push_back(0);
+  return graph;
+}
+
+/// The distances as computed by a plain fixpoint over all instructions.
+std::vector<std::uint64_t> reference(const UncoveredDistances::Graph &graph,
+                                     const std::vector<bool> &uncovered) {
+  std::vector<std::uint64_t> dist(graph.functionOf.size());
+  for (unsigned id = 0; id < dist.size(); ++id)
+    dist[id] = uncovered[id];
+
+  auto improve = [&](unsigned id, std::uint64_t value) {
+    if (dist[id] == 0 || value < dist[id]) {
+      dist[id] = value;
+      return true;
+    }
+    return false;
+  };
+
+  bool changed;
+  do {
+    changed = false;
+    for (const auto &edge : graph.successors)
+      if (graph.through[edge.first] && dist[edge.second])
+        changed |= improve(edge.first,
+                           graph.through[edge.first] + dist[edge.second]);
+    for (const auto &call : graph.calls) {
+      unsigned entry = graph.entries[call.second];
+      if (entry != UncoveredDistances::None && dist[entry])
+        changed |= improve(call.first, 1 + dist[entry]);
+    }
+  } while (changed);
+  return dist;
+}
+
+void checkCoverage(bool background) {
+  std::mt19937 rng(background ? 7 : 3);
+  UncoveredDistances::Graph graph = makeGraph(rng);
+  unsigned numIds = graph.functionOf.size();
+
+  std::vector<bool> uncovered(numIds);
+  for (unsigned id = 0; id < numIds; ++id)
+    uncovered[id] = graph.functionOf[id] != UncoveredDistances::None;
+
+  UncoveredDistances distances(graph, uncovered, background);
+  std::vector<std::uint64_t> current(numIds, 0);
+  auto apply = [&](bool wait) {
+    std::vector<UncoveredDistances::Change> changes;
+    distances.collect(changes, wait);
+    for (const auto &change : changes)
+      current[change.first] = change.second;
+  };
+
+  apply(false);
+  EXPECT_EQ(reference(graph, uncovered), current);
+
+  std::vector<unsigned> order;
+  for (unsigned id = 0; id < numIds; ++id)
+    if (uncovered[id])
+      order.push_back(id);
+  std::shuffle(order.begin(), order.end(), rng);
+
+  for (std::size_t i = 0; i < order.size(); ++i) {
+    uncovered[order[i]] = false;
+    distances.cover(order[i]);
+    // covering twice has no effect
+    distances.cover(order[i]);
+    if (i % 7 == 0) {
+      apply(false);
+    } else if (i % 3 == 0) {
+      apply(true);
+      EXPECT_EQ(reference(graph, uncovered), current);
+    }
+  }
+
+  apply(true);
+  EXPECT_EQ(reference(graph, uncovered), current);
+  EXPECT_EQ(std::vector<std::uint64_t>(numIds, 0), current);
+}
+
+TEST(UncoveredDistancesTest, Incremental) { checkCoverage(false); }
+
+TEST(UncoveredDistancesTest, Background) { checkCoverage(true); }
+
+} // namespace